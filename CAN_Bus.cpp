@@ -0,0 +1,206 @@
+/*
+ One CAN controller with its own receive queue and poll schedule
+ by:
+ date:
+ license:
+ */
+
+#include "CAN_Bus.h"
+
+/*
+
+*/
+CAN_Bus::CAN_Bus()
+{
+  driver = 0;
+  number = 0;
+  bitrate = 0;
+  period = 0;
+  budget = CAN_BUS_BUDGET;
+  next_poll = 0;
+  received = 0;
+  deferred = 0;
+  refused = 0;
+  listening = false;
+}
+
+/*
+ Start the controller behind driver at bitrate. index is stamped on every
+ frame it receives. Returns false if the controller did not start.
+*/
+bool CAN_Bus::begin(CAN_Driver* driver, byte index, uint32_t bitrate)
+{
+  this->driver = driver;
+  this->bitrate = bitrate;
+  number = index;
+
+  return driver->begin(bitrate);
+}
+
+/*
+ Program the controller's filters with the diagnostic replies and the
+ IDs subscribed so far. Returns false if the controller did not take
+ them.
+*/
+bool CAN_Bus::filter()
+{
+  uint32_t mask;
+  uint32_t filter;
+
+  if (driver == 0)
+  {
+    return false;
+  }
+
+  ring.acceptance(&mask, &filter);
+
+  return driver->filter(0, CAN_RING_REPLY_MASK, CAN_RING_REPLY_FILTER) && driver->filter(1, mask, filter);
+}
+
+/*
+ Listen-only on or off, the controller is left alone if it is in that
+ mode already. Returns false if it did not change mode.
+*/
+bool CAN_Bus::listen(bool on)
+{
+  if ((driver == 0) || (on == listening))
+  {
+    return driver != 0;
+  }
+  if (driver->listen(on) == false)
+  {
+    return false;
+  }
+  listening = on;
+
+  return true;
+}
+
+/*
+ Poll every period milliseconds, 0 for every call, taking at most budget
+ frames each time.
+*/
+void CAN_Bus::schedule(uint16_t period, byte budget)
+{
+  this->period = period;
+  this->budget = (budget > 0) ? budget : 1;
+}
+
+/*
+ Move up to the budget of frames from the controller into the ring, if
+ the bus is due. Frames the ring does not accept still count against the
+ budget, reading them took the time. Returns the frames taken.
+*/
+byte CAN_Bus::poll(uint32_t now)
+{
+  OBD_Frame frame;
+  byte taken = 0;
+
+  if ((driver == 0) || ((int32_t)(now - next_poll) < 0))
+  {
+    return 0;
+  }
+
+  while (taken < budget)
+  {
+    if (driver->receive(&frame) == false)
+    {
+      break;
+    }
+
+    frame.timestamp = now;
+    frame.bus = number;
+    taken++;
+
+    if (ring.accept(frame.id))
+    {
+      ring.push(&frame);
+    }
+  }
+
+  received += taken;
+  next_poll = now + period;
+  if (taken == budget)
+  {
+    // More may be waiting, come back on the next pass
+    next_poll = now;
+    deferred++;
+  }
+
+  return taken;
+}
+
+/*
+ Returns false if the controller could not take the frame.
+*/
+bool CAN_Bus::send(const OBD_Frame* frame)
+{
+  if ((driver == 0) || (driver->send(frame) == false))
+  {
+    refused++;
+    return false;
+  }
+
+  return true;
+}
+
+/*
+
+*/
+byte CAN_Bus::index()
+{
+  return number;
+}
+
+/*
+ Bitrate the controller was started at.
+*/
+uint32_t CAN_Bus::rate()
+{
+  return bitrate;
+}
+
+/*
+
+*/
+CAN_Merge::CAN_Merge()
+{
+  begin(0, 0);
+}
+
+/*
+ Merge the rings of count buses.
+*/
+void CAN_Merge::begin(CAN_Bus* buses, byte count)
+{
+  this->buses = buses;
+  this->count = count;
+}
+
+/*
+ Pop the oldest frame waiting on any bus, the lower index first on a tie.
+ Returns false if every ring is empty.
+*/
+bool CAN_Merge::pop(OBD_Frame* frame)
+{
+  const OBD_Frame* oldest = 0;
+  byte from = 0;
+
+  for (byte i = 0; i < count; i++)
+  {
+    const OBD_Frame* head = buses[i].ring.peek();
+
+    if ((head != 0) && ((oldest == 0) || ((int32_t)(head->timestamp - oldest->timestamp) < 0)))
+    {
+      oldest = head;
+      from = i;
+    }
+  }
+
+  if (oldest == 0)
+  {
+    return false;
+  }
+
+  return buses[from].ring.pop(frame);
+}
@@ -0,0 +1,94 @@
+/*
+ One CAN controller with its own receive queue and poll schedule
+ by:
+ date:
+ license:
+
+ Each CAN_Bus moves frames from its CAN_Driver into its own CAN_Ring, at
+ its own bitrate and on its own schedule: every period milliseconds, at
+ most budget frames per poll. The budget bounds the time one poll takes,
+ so a bus flooded with traffic costs the loop the same as a busy one and
+ the other bus is still polled every pass; what it cannot take waits in
+ its own controller and ring and is lost there, never on the other bus.
+ A poll that stops at the budget polls again on the next pass whatever
+ the period, so a backlog is worked off as fast as the loop allows.
+
+ Frames are stamped with the time of the poll that took them. Each ring
+ is therefore in time order, and a frame still in a controller will be
+ stamped no earlier than any frame already taken, so CAN_Merge only has
+ to take the oldest of the ring heads to give one stream in time order.
+
+ That is the order the frames were taken in, not the order they came off
+ the wire. A frame is stamped late by as long as it waited in its
+ controller: up to one poll period plus the slowest loop pass on a bus
+ with a period, and on a flooded bus whatever its backlog takes to work
+ off at the budget per pass. Frames of two buses can therefore be merged
+ out of arrival order by that much, a flooded bus 0 by up to a poll
+ period on the SAM3X8E build, while each bus's own frames stay in order.
+ CANClass::read() hands out no receive time, so the poll is the earliest
+ the frame can be stamped there; on the MCP2515 build the interrupt
+ stamps it as it arrives.
+
+ filter() sets the controller's acceptance filters to what the ring
+ accepts, so the broadcasts nobody subscribed to never take one of its
+ buffers. The ring still checks every frame, one filter for the
+ subscriptions lets through the IDs that share their bits.
+
+ listen() puts the controller in listen-only mode and back, nothing the
+ bus does then is acknowledged or answered with an error frame.
+
+ On the MCP2515 build poll() runs as the INT pin interrupt with the loop
+ popping the ring, the lock-free split CAN_Ring is written for.
+ */
+#ifndef can_bus_h_
+#define can_bus_h_
+
+#include <Arduino.h>
+#include "OBD_Frame.h"
+#include "CAN_Driver.h"
+#include "CAN_Ring.h"
+
+#define CAN_BUS_BUDGET (CAN_RING_SIZE / 2) // frames per poll unless scheduled otherwise
+
+class CAN_Bus
+{
+  public:
+    CAN_Bus();
+    bool begin(CAN_Driver* driver, byte index, uint32_t bitrate);
+    bool filter();
+    bool listen(bool on);
+    void schedule(uint16_t period, byte budget);
+    byte poll(uint32_t now);
+    bool send(const OBD_Frame* frame);
+    byte index();
+    uint32_t rate();
+
+    CAN_Ring ring;
+
+    uint32_t received; // frames taken from the controller, accepted or not
+    uint16_t deferred; // polls that stopped at the budget
+    uint16_t refused;  // sends the controller had no room for
+
+  private:
+    CAN_Driver* driver;
+    byte number;
+    uint32_t bitrate;
+    uint16_t period;
+    byte budget;
+    uint32_t next_poll;
+    bool listening;
+};
+
+class CAN_Merge
+{
+  public:
+    CAN_Merge();
+    void begin(CAN_Bus* buses, byte count);
+    bool pop(OBD_Frame* frame);
+
+  private:
+    CAN_Bus* buses;
+    byte count;
+};
+
+#endif // _can_bus_h_
@@ -0,0 +1,272 @@
+/*
+ CAN_Driver over the MCP2515 and SAM3X8E CAN libraries
+ by:
+ date:
+ license:
+ */
+
+#include "CAN_Controller.h"
+
+#if defined(ARDUINO) && defined(ARDUINO_ARCH_AVR)
+#include <SPI.h>
+
+// Microchip MCP2515 datasheet
+// SPI instruction set
+#define MCP2515_WRITE      0x02
+#define MCP2515_READ       0x03
+#define MCP2515_BIT_MODIFY 0x05
+
+// Control, mask and filter registers
+#define MCP2515_TXB0CTRL 0x30
+#define MCP2515_TXB1CTRL 0x40
+#define MCP2515_TXB2CTRL 0x50
+#define MCP2515_TXREQ    0x08 // in TXBnCTRL, set until the buffer is sent
+#define MCP2515_CANSTAT  0x0E
+#define MCP2515_CANCTRL  0x0F
+#define MCP2515_RXM0SIDH 0x20
+#define MCP2515_RXM1SIDH 0x24
+#define MCP2515_MODE_MASK   0xE0 // REQOP in CANCTRL, OPMOD in CANSTAT
+#define MCP2515_MODE_NORMAL 0x00
+#define MCP2515_MODE_LISTEN 0x60
+#define MCP2515_MODE_CONFIG 0x80
+#define MCP2515_MODE_TRIES  100  // CANSTAT reads before giving up on a mode change
+
+#define MCP2515_SPI_CLOCK 10000000
+
+// RXF0SIDH - RXF5SIDH, the first two check for RXB0 and the others for RXB1
+static const byte mcp2515_filters[] = {0x00, 0x04, 0x08, 0x10, 0x14, 0x18};
+
+/*
+
+*/
+static byte mcp2515Read(byte select, byte address)
+{
+  byte value;
+
+  SPI.beginTransaction(SPISettings(MCP2515_SPI_CLOCK, MSBFIRST, SPI_MODE0));
+  digitalWrite(select, LOW);
+  SPI.transfer(MCP2515_READ);
+  SPI.transfer(address);
+  value = SPI.transfer(0);
+  digitalWrite(select, HIGH);
+  SPI.endTransaction();
+
+  return value;
+}
+
+/*
+ Standard ID bits of a mask or filter, EXIDE clear so filters only match
+ base frames.
+*/
+static void mcp2515WriteID(byte select, byte address, uint32_t id)
+{
+  SPI.beginTransaction(SPISettings(MCP2515_SPI_CLOCK, MSBFIRST, SPI_MODE0));
+  digitalWrite(select, LOW);
+  SPI.transfer(MCP2515_WRITE);
+  SPI.transfer(address);
+  SPI.transfer(id >> 3);          // SIDH
+  SPI.transfer((id & 0x07) << 5); // SIDL
+  SPI.transfer(0);                // EID8
+  SPI.transfer(0);                // EID0
+  digitalWrite(select, HIGH);
+  SPI.endTransaction();
+}
+
+/*
+ Request an operation mode and wait until the chip is in it.
+*/
+static bool mcp2515Mode(byte select, byte mode)
+{
+  SPI.beginTransaction(SPISettings(MCP2515_SPI_CLOCK, MSBFIRST, SPI_MODE0));
+  digitalWrite(select, LOW);
+  SPI.transfer(MCP2515_BIT_MODIFY);
+  SPI.transfer(MCP2515_CANCTRL);
+  SPI.transfer(MCP2515_MODE_MASK);
+  SPI.transfer(mode);
+  digitalWrite(select, HIGH);
+  SPI.endTransaction();
+
+  for (byte i = 0; i < MCP2515_MODE_TRIES; i++)
+  {
+    if ((mcp2515Read(select, MCP2515_CANSTAT) & MCP2515_MODE_MASK) == mode)
+    {
+      return true;
+    }
+  }
+
+  return false;
+}
+#endif
+
+/*
+
+*/
+CAN_Controller::CAN_Controller(CANClass* channel, uint8_t hardware)
+{
+  this->channel = channel;
+  this->hardware = hardware;
+}
+
+/*
+ Set the CAN mode and speed.
+*/
+bool CAN_Controller::begin(uint32_t bitrate)
+{
+  channel->begin(bitrate);
+
+  return true;
+}
+
+/*
+
+*/
+bool CAN_Controller::receive(OBD_Frame* frame)
+{
+  unsigned long id;
+
+  if (channel->available() == false)
+  {
+    return false;
+  }
+
+  channel->read(&id, &frame->length, frame->data);
+  frame->id = id;
+
+  return true;
+}
+
+/*
+ Refused while every transmit buffer still holds a frame, the libraries
+ would wait for one to go out, which on a bus nobody acknowledges is for
+ ever.
+*/
+bool CAN_Controller::send(const OBD_Frame* frame)
+{
+  if (transmitFree() == false)
+  {
+    return false;
+  }
+
+  channel->write(frame->id, CAN_BASE_FRAME, frame->length, frame->data);
+
+  return true;
+}
+
+/*
+ Program acceptance filter slot, see CAN_Controller.h for where it goes.
+*/
+bool CAN_Controller::filter(byte slot, uint32_t mask, uint32_t filter)
+{
+  if (slot >= CAN_DRIVER_FILTERS)
+  {
+    return false;
+  }
+
+#if !defined(ARDUINO)
+  return channel->filter(slot, mask, filter);
+#elif defined(ARDUINO_ARCH_AVR)
+  // Masks and filters can only be written in configuration mode, and
+  // the chip goes back to the mode the library left it in
+  byte mode = mcp2515Read(hardware, MCP2515_CANSTAT) & MCP2515_MODE_MASK;
+
+  if (mcp2515Mode(hardware, MCP2515_MODE_CONFIG) == false)
+  {
+    return false;
+  }
+
+  mcp2515WriteID(hardware, (slot == 0) ? MCP2515_RXM0SIDH : MCP2515_RXM1SIDH, mask);
+  for (byte i = (slot == 0) ? 0 : 2; i < ((slot == 0) ? 2 : sizeof(mcp2515_filters)); i++)
+  {
+    mcp2515WriteID(hardware, mcp2515_filters[i], filter);
+  }
+
+  return mcp2515Mode(hardware, mode);
+#else
+  // A mailbox is disabled while its acceptance mask and ID change, and
+  // enabled again for reception
+  Can* controller = (hardware == 0) ? CAN0 : CAN1;
+  byte receivers = 0;
+  byte set = 0;
+
+  for (byte mb = 0; mb < CANMB_NUMBER; mb++)
+  {
+    uint32_t type = controller->CAN_MB[mb].CAN_MMR & CAN_MMR_MOT_Msk;
+
+    if ((type != CAN_MMR_MOT_MB_RX) && (type != CAN_MMR_MOT_MB_RX_OVERWRITE))
+    {
+      continue;
+    }
+    if ((receivers++ % CAN_DRIVER_FILTERS) != slot)
+    {
+      continue;
+    }
+
+    controller->CAN_MB[mb].CAN_MMR &= ~CAN_MMR_MOT_Msk;
+    controller->CAN_MB[mb].CAN_MAM = CAN_MAM_MIDvA(mask);
+    controller->CAN_MB[mb].CAN_MID = CAN_MID_MIDvA(filter);
+    controller->CAN_MB[mb].CAN_MMR |= type;
+    controller->CAN_MB[mb].CAN_MCR = CAN_MCR_MTCR;
+    set++;
+  }
+
+  return (set != 0);
+#endif
+}
+
+/*
+ Listen-only on or off, see CAN_Driver.h.
+*/
+bool CAN_Controller::listen(bool on)
+{
+#if !defined(ARDUINO)
+  return channel->listen(on);
+#elif defined(ARDUINO_ARCH_AVR)
+  return mcp2515Mode(hardware, on ? MCP2515_MODE_LISTEN : MCP2515_MODE_NORMAL);
+#else
+  // ABM only changes with the controller disabled, enabling it again
+  // waits for 11 recessive bits before it takes part in the bus
+  Can* controller = (hardware == 0) ? CAN0 : CAN1;
+
+  controller->CAN_MR &= ~CAN_MR_CANEN;
+  if (on)
+  {
+    controller->CAN_MR |= CAN_MR_ABM;
+  }
+  else
+  {
+    controller->CAN_MR &= ~CAN_MR_ABM;
+  }
+  controller->CAN_MR |= CAN_MR_CANEN;
+
+  return ((controller->CAN_MR & CAN_MR_ABM) != 0) == on;
+#endif
+}
+
+/*
+ True if a transmit buffer is free: one of the MCP2515's three with TXREQ
+ clear, a SAM3X8E transmit mailbox that is ready, or a host channel that
+ is not listening.
+*/
+bool CAN_Controller::transmitFree()
+{
+#if !defined(ARDUINO)
+  return channel->listening == false;
+#elif defined(ARDUINO_ARCH_AVR)
+  return ((mcp2515Read(hardware, MCP2515_TXB0CTRL) & MCP2515_TXREQ) == 0) ||
+         ((mcp2515Read(hardware, MCP2515_TXB1CTRL) & MCP2515_TXREQ) == 0) ||
+         ((mcp2515Read(hardware, MCP2515_TXB2CTRL) & MCP2515_TXREQ) == 0);
+#else
+  Can* controller = (hardware == 0) ? CAN0 : CAN1;
+
+  for (byte mb = 0; mb < CANMB_NUMBER; mb++)
+  {
+    if (((controller->CAN_MB[mb].CAN_MMR & CAN_MMR_MOT_Msk) == CAN_MMR_MOT_MB_TX) &&
+        (controller->CAN_MB[mb].CAN_MSR & CAN_MSR_MRDY))
+    {
+      return true;
+    }
+  }
+
+  return false;
+#endif
+}
@@ -0,0 +1,52 @@
+/*
+ CAN_Driver over the MCP2515 and SAM3X8E CAN libraries
+ by:
+ date:
+ license:
+
+ Wraps a library channel, CAN_MCP2515 on the AVR or one of the two
+ CAN_SAM3X8E controllers on the Due, so a CAN_Bus can poll it. Only base
+ frames are sent, the OBD requests and replies are all 11 bit.
+
+ The library leaves the acceptance filters open, so filter() writes the
+ controller's registers itself, hardware naming which controller: the
+ MCP2515's chip select pin or the SAM3X8E's CAN0 / CAN1. On the MCP2515
+ filter 0 takes RXM0 with RXF0 - RXF1 for RXB0 and filter 1 RXM1 with
+ RXF2 - RXF5 for RXB1. On the SAM3X8E the receive mailboxes the library
+ set up take the two filters in turn. The host stand-in keeps the filters
+ in CANClass::filter().
+
+ send() reads the transmit buffers' state the same way and refuses the
+ frame when none is free, so CAN_Bus counts it instead of the library
+ waiting for a buffer.
+
+ listen() sets the MCP2515's listen-only operation mode or the SAM3X8E's
+ autobaud mode, which is its listen-only mode, with the same register
+ access.
+ */
+#ifndef can_controller_h_
+#define can_controller_h_
+
+#include <Arduino.h>
+#include <CAN.h>
+#include "OBD_Frame.h"
+#include "CAN_Driver.h"
+
+class CAN_Controller : public CAN_Driver
+{
+  public:
+    CAN_Controller(CANClass* channel, uint8_t hardware);
+    bool begin(uint32_t bitrate);
+    bool receive(OBD_Frame* frame);
+    bool send(const OBD_Frame* frame);
+    bool filter(byte slot, uint32_t mask, uint32_t filter);
+    bool listen(bool on);
+
+  private:
+    bool transmitFree();
+
+    CANClass* channel;
+    uint8_t hardware;
+};
+
+#endif // _can_controller_h_
@@ -0,0 +1,44 @@
+/*
+ CAN controller interface polled by CAN_Bus
+ by:
+ date:
+ license:
+
+ The one place a CAN_Bus touches hardware. CAN_Controller puts the
+ MCP2515 and SAM3X8E libraries behind it on the boards, the host tools
+ put SocketCAN interfaces or simulated controllers behind it, so the same
+ queueing and merging runs against either.
+
+ receive() and send() never wait: receive() returns false when the
+ controller holds nothing, send() when it has no free transmit buffer.
+
+ filter() sets one of the controller's CAN_DRIVER_FILTERS acceptance
+ filters for 11 bit IDs, a frame is kept if (id & mask) == (filter & mask)
+ for any of them. Until both are set a controller may keep every frame.
+ It returns false if the controller cannot hold the filter.
+
+ listen(true) puts the controller in its listen-only mode: it receives
+ but never transmits, not even the acknowledge bit or an error frame, so
+ nothing it does shows on the bus. listen(false) returns it to normal
+ operation. It returns false if the controller did not change mode.
+ */
+#ifndef can_driver_h_
+#define can_driver_h_
+
+#include <Arduino.h>
+#include "OBD_Frame.h"
+
+#define CAN_DRIVER_FILTERS 2 // 0 for the diagnostic replies, 1 for the broadcasts
+
+class CAN_Driver
+{
+  public:
+    virtual ~CAN_Driver() {}
+    virtual bool begin(uint32_t bitrate) = 0;
+    virtual bool receive(OBD_Frame* frame) = 0; // id, length and data of the oldest frame held
+    virtual bool send(const OBD_Frame* frame) = 0;
+    virtual bool filter(byte slot, uint32_t mask, uint32_t filter) = 0;
+    virtual bool listen(bool on) = 0;
+};
+
+#endif // _can_driver_h_
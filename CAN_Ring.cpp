@@ -0,0 +1,182 @@
+/*
+ Interrupt to loop CAN receive ring
+ by:
+ date:
+ license:
+ */
+
+#include "CAN_Ring.h"
+
+/*
+
+*/
+CAN_Ring::CAN_Ring()
+{
+  head = 0;
+  tail = 0;
+  overflows = 0;
+  high_water = 0;
+  subscriptions = 0;
+}
+
+/*
+ Producer side, called from the receive interrupt. Returns false and
+ counts an overflow if the ring is full; the newest frame is the one lost
+ so the loop never sees a reply out of order.
+*/
+bool CAN_Ring::push(const OBD_Frame* frame)
+{
+  uint8_t h = head;
+  uint8_t level = h - tail;
+
+  if (level >= CAN_RING_SIZE)
+  {
+    overflows++;
+    return false;
+  }
+
+  frames[h & CAN_RING_MASK] = *frame;
+  CAN_RING_BARRIER();
+  head = h + 1;
+
+  if (++level > high_water)
+  {
+    high_water = level;
+  }
+
+  return true;
+}
+
+/*
+ Consumer side, called from the main loop. Returns false if the ring is
+ empty.
+*/
+bool CAN_Ring::pop(OBD_Frame* frame)
+{
+  uint8_t t = tail;
+
+  if (t == head)
+  {
+    return false;
+  }
+
+  CAN_RING_BARRIER();
+  *frame = frames[t & CAN_RING_MASK];
+  CAN_RING_BARRIER();
+  tail = t + 1;
+
+  return true;
+}
+
+/*
+ Consumer side, the frame pop() would return next, or 0 if the ring is
+ empty. It stays in place until popped.
+*/
+const OBD_Frame* CAN_Ring::peek()
+{
+  uint8_t t = tail;
+
+  if (t == head)
+  {
+    return 0;
+  }
+
+  CAN_RING_BARRIER();
+  return &frames[t & CAN_RING_MASK];
+}
+
+/*
+ Frames waiting for the consumer.
+*/
+byte CAN_Ring::available()
+{
+  return (uint8_t)(head - tail);
+}
+
+/*
+ Consumer side, the overflows so far. On the AVR the count takes two
+ reads, between which the interrupt could carry into the high byte, so
+ it is read with interrupts off.
+*/
+uint16_t CAN_Ring::lost()
+{
+#if defined(ARDUINO_ARCH_AVR)
+  uint16_t count;
+
+  noInterrupts();
+  count = overflows;
+  interrupts();
+
+  return count;
+#else
+  return overflows;
+#endif
+}
+
+/*
+ Software acceptance filter for controllers whose own filters are not
+ set up, or too coarse to hold every subscribed ID.
+*/
+bool CAN_Ring::accept(uint32_t id)
+{
+  byte count = subscriptions;
+
+  if ((id & CAN_RING_REPLY_MASK) == CAN_RING_REPLY_FILTER)
+  {
+    return true;
+  }
+
+  for (byte i = 0; i < count; i++)
+  {
+    if (subscribed[i] == id)
+    {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/*
+ Also accept a broadcast ID. Safe while the interrupt is running since
+ the entry is complete before the count includes it.
+*/
+bool CAN_Ring::subscribe(uint32_t id)
+{
+  byte count = subscriptions;
+
+  if (accept(id))
+  {
+    return true;
+  }
+
+  if (count >= CAN_RING_SUBSCRIPTIONS)
+  {
+    return false;
+  }
+
+  subscribed[count] = id;
+  CAN_RING_BARRIER();
+  subscriptions = count + 1;
+
+  return true;
+}
+
+/*
+ Narrowest single mask and filter accepting every subscribed ID: the mask
+ keeps the bits all of them share. Nothing subscribed gives a mask that
+ accepts nothing but 0x000.
+*/
+void CAN_Ring::acceptance(uint32_t* mask, uint32_t* filter)
+{
+  byte count = subscriptions;
+  uint32_t differ = 0;
+
+  for (byte i = 1; i < count; i++)
+  {
+    differ |= subscribed[i] ^ subscribed[0];
+  }
+
+  *mask = ~differ & 0x7FF;
+  *filter = (count > 0) ? (subscribed[0] & *mask) : 0;
+}
@@ -0,0 +1,74 @@
+/*
+ Interrupt to loop CAN receive ring
+ by:
+ date:
+ license:
+
+ The CAN receive interrupt is the only producer and the main loop the only
+ consumer, so the ring needs no lock: each side only ever writes its own
+ index, and the indices are single bytes the processor reads and writes
+ in one instruction. Frames are timestamped by the interrupt, so a frame
+ that waits in the ring while the loop is busy with the LCD keeps the time
+ it actually arrived.
+
+ Only diagnostic replies (ID_REPLY_1 - ID_REPLY_8) and the broadcast IDs
+ passed to subscribe() are stored. acceptance() gives the mask and filter
+ pair covering the subscribed IDs for the controller's own filters, the
+ replies always fit CAN_RING_REPLY_MASK / CAN_RING_REPLY_FILTER.
+ */
+#ifndef can_ring_h_
+#define can_ring_h_
+
+#include <Arduino.h>
+#include "OBD_Frame.h"
+#include "WWH_OBD.h"
+
+// Power of two, at most 128 so the free running byte indices wrap cleanly
+#if defined(ARDUINO_ARCH_AVR)
+#define CAN_RING_SIZE 16
+#else
+#define CAN_RING_SIZE 64
+#endif
+#define CAN_RING_MASK (CAN_RING_SIZE - 1)
+
+#define CAN_RING_SUBSCRIPTIONS 8 // broadcast IDs accepted besides the replies
+
+// Controller mask and filter accepting exactly ID_REPLY_1 - ID_REPLY_8
+#define CAN_RING_REPLY_MASK   0x7F8
+#define CAN_RING_REPLY_FILTER ID_REPLY_1
+
+// Keeps the compiler from moving frame copies across an index update. One
+// core, so nothing stronger is needed on the boards.
+#if defined(ARDUINO)
+#define CAN_RING_BARRIER() __asm__ __volatile__ ("" ::: "memory")
+#else
+#define CAN_RING_BARRIER() __sync_synchronize()
+#endif
+
+class CAN_Ring
+{
+  public:
+    CAN_Ring();
+    bool push(const OBD_Frame* frame);
+    bool pop(OBD_Frame* frame);
+    const OBD_Frame* peek();
+    byte available();
+    bool accept(uint32_t id);
+    bool subscribe(uint32_t id);
+    void acceptance(uint32_t* mask, uint32_t* filter);
+    uint16_t lost();
+
+    // Written by the producer only, overflows read through lost()
+    volatile uint16_t overflows;  // frames dropped because the ring was full
+    volatile uint8_t high_water;  // most frames ever waiting
+
+  private:
+    OBD_Frame frames[CAN_RING_SIZE];
+    volatile uint8_t head; // next slot the producer fills
+    volatile uint8_t tail; // next slot the consumer empties
+
+    uint16_t subscribed[CAN_RING_SUBSCRIPTIONS];
+    volatile uint8_t subscriptions;
+};
+
+#endif // _can_ring_h_
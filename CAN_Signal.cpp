@@ -0,0 +1,207 @@
+/*
+ Broadcast CAN signal database
+ by:
+ date:
+ license:
+ */
+
+#include "CAN_Signal.h"
+
+// Broadcast signals, sorted by message identifier for lookup(). Signals of
+// the same message are kept together. Per-vehicle configuration like the
+// message IDs in CAN_Signal.h: the bit positions are placeholders to be
+// matched to a capture of the vehicle.
+//   id,                pid,           start, length, flags, unit, mul, div, offset
+static const CAN_Signal_Def signal_dictionary[] PROGMEM = {
+  {FORD_CAN_ID_BRAKE, FORD_PID_BPA,  3,  1, PID_FLAG_HEX, OBD_UNIT_NONE, 1, 1, 0},                    // switch
+  {FORD_CAN_ID_TRANS, FORD_PID_TR,   7,  4, PID_FLAG_HEX | SIGNAL_FLAG_MOTOROLA, OBD_UNIT_NONE, 1, 1, 0}, // P R N D ...
+  {FORD_CAN_ID_TRANS, FORD_PID_TRD, 11,  4, SIGNAL_FLAG_MOTOROLA, OBD_UNIT_COUNT, 1, 1, 0}             // gear
+};
+
+#define SIGNAL_DICTIONARY_SIZE (sizeof(signal_dictionary) / sizeof(CAN_Signal_Def))
+
+/*
+
+*/
+CAN_Signal::CAN_Signal()
+{
+}
+
+/*
+ Unpack every known signal of a received frame. Returns the number of
+ samples written, 0 for messages not in the database.
+*/
+byte CAN_Signal::decode(uint32_t id, const byte* data, byte length, uint32_t timestamp, OBD_Sample* samples, byte max)
+{
+  CAN_Signal_Def desc;
+  byte count = 0;
+
+  for (byte i = lookup(id); (i < SIGNAL_DICTIONARY_SIZE) && (count < max); i++)
+  {
+    memcpy_P(&desc, &signal_dictionary[i], sizeof(CAN_Signal_Def));
+
+    if (desc.id != id)
+    {
+      break;
+    }
+
+    // Skip signals reaching past a short frame. A big endian signal fills
+    // its start byte down to bit 0, then whole bytes after it.
+    if ((desc.flags & SIGNAL_FLAG_MOTOROLA) ?
+        (((desc.start >> 3) + ((desc.length + 6 - (desc.start & 0x07)) >> 3)) >= length) :
+        (((desc.start + desc.length - 1) >> 3) >= length))
+    {
+      continue;
+    }
+
+    OBD_Sample* sample = &samples[count++];
+
+    sample->timestamp = timestamp;
+    sample->pid = desc.pid;
+    sample->raw = extract(&desc, data);
+
+    if (desc.flags & PID_FLAG_HEX)
+    {
+      sample->value = sample->raw;
+      sample->unit = OBD_UNIT_BITS;
+      sample->decimals = 0;
+      sample->digits = (desc.length + 3) / 4;
+    }
+    else
+    {
+      sample->value = ((sample->raw * (int32_t)desc.mul) / (int32_t)desc.div) + desc.offset;
+      sample->unit = desc.unit;
+      sample->decimals = desc.flags & PID_FLAG_DECIMALS;
+      sample->digits = 0;
+    }
+  }
+
+  return count;
+}
+
+/*
+ Number of distinct message identifiers in the database.
+*/
+byte CAN_Signal::messages()
+{
+  byte count = 0;
+
+  for (byte i = 0; i < SIGNAL_DICTIONARY_SIZE; i++)
+  {
+    if ((i == 0) || (pgm_read_word(&signal_dictionary[i].id) != pgm_read_word(&signal_dictionary[i - 1].id)))
+    {
+      count++;
+    }
+  }
+
+  return count;
+}
+
+/*
+ Message identifier number index, in ascending order, to subscribe to.
+ Returns 0 past the last one.
+*/
+uint16_t CAN_Signal::message(byte index)
+{
+  for (byte i = 0; i < SIGNAL_DICTIONARY_SIZE; i++)
+  {
+    uint16_t id = pgm_read_word(&signal_dictionary[i].id);
+
+    if ((i == 0) || (id != pgm_read_word(&signal_dictionary[i - 1].id)))
+    {
+      if (index-- == 0)
+      {
+        return id;
+      }
+    }
+  }
+
+  return 0;
+}
+
+/*
+ Raw value of a signal, whole bytes at a time where the layout allows.
+*/
+int32_t CAN_Signal::extract(const CAN_Signal_Def* desc, const byte* data)
+{
+  uint32_t raw = 0;
+  byte position = desc->start;
+  byte got = 0;
+
+  if (desc->flags & SIGNAL_FLAG_MOTOROLA)
+  {
+    // Most significant bits first, each byte from its bit down to bit 0
+    while (got < desc->length)
+    {
+      byte bit = position & 0x07;
+      byte take = desc->length - got;
+
+      if (take > bit + 1)
+      {
+        take = bit + 1;
+      }
+
+      raw = (raw << take) | ((data[position >> 3] >> (bit + 1 - take)) & ((1 << take) - 1));
+      got += take;
+      position = ((position >> 3) + 1) * 8 + 7;
+    }
+  }
+  else
+  {
+    // Least significant bits first, each byte from its bit up to bit 7
+    while (got < desc->length)
+    {
+      byte bit = position & 0x07;
+      byte take = desc->length - got;
+
+      if (take > 8 - bit)
+      {
+        take = 8 - bit;
+      }
+
+      raw |= (uint32_t)((data[position >> 3] >> bit) & ((1 << take) - 1)) << got;
+      got += take;
+      position += take;
+    }
+  }
+
+  if ((desc->flags & PID_FLAG_SIGNED) && (desc->length < 32))
+  {
+    byte shift = 32 - desc->length;
+    return ((int32_t)(raw << shift)) >> shift;
+  }
+
+  return raw;
+}
+
+/*
+ Index of the first signal of a message, binary searching the database in
+ flash. Returns SIGNAL_DICTIONARY_SIZE if the message is unknown.
+*/
+byte CAN_Signal::lookup(uint32_t id)
+{
+  byte low = 0;
+  byte high = SIGNAL_DICTIONARY_SIZE;
+
+  // Lower bound, so the search lands on the first of several signals
+  while (low < high)
+  {
+    byte mid = (low + high) / 2;
+
+    if (pgm_read_word(&signal_dictionary[mid].id) < id)
+    {
+      low = mid + 1;
+    }
+    else
+    {
+      high = mid;
+    }
+  }
+
+  if ((low < SIGNAL_DICTIONARY_SIZE) && (pgm_read_word(&signal_dictionary[low].id) == id))
+  {
+    return low;
+  }
+
+  return SIGNAL_DICTIONARY_SIZE;
+}
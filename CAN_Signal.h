@@ -0,0 +1,70 @@
+/*
+ Broadcast CAN signal database
+ by:
+ date:
+ license:
+
+ Most of what the dashboard polls for is already broadcast by the
+ powertrain modules many times a second. Each signal is described the way
+ a DBC file does it: message identifier, start bit, length in bits, byte
+ order, scale and offset. The table lives in flash sorted by message
+ identifier, so a received frame finds its signals with a binary search
+ and is unpacked straight into OBD_Samples without a single request on
+ the bus.
+
+ Start bits follow the DBC numbering: for little endian (Intel) signals the
+ least significant bit, for big endian (Motorola) signals the most
+ significant bit, bit 0 being the least significant bit of data byte 0.
+ */
+#ifndef can_signal_h_
+#define can_signal_h_
+
+#include <Arduino.h>
+#include "OBD_Sample.h"
+#include "WWH_OBD.h"
+#include "Ford_OBD.h"
+
+// Free bit of PID_FLAG_*, byte order of a signal
+#define SIGNAL_FLAG_MOTOROLA 0x08 // big endian, start bit is the MSB
+
+// Per-vehicle configuration: change these to match your vehicle.
+//
+// Ford powertrain broadcast messages. The identifiers, and the layouts in
+// signal_dictionary in CAN_Signal.cpp, differ between platforms and model
+// years. The values here are placeholders, not taken from any one vehicle;
+// confirm them against a capture of yours before trusting what LISTEN
+// mode shows. Either edit them here or define them before this header.
+#ifndef FORD_CAN_ID_BRAKE
+#define FORD_CAN_ID_BRAKE 0x165 // placeholder, brake pedal and pressure switch
+#endif
+#ifndef FORD_CAN_ID_TRANS
+#define FORD_CAN_ID_TRANS 0x171 // placeholder, transmission range and gear
+#endif
+
+typedef struct
+{
+  uint16_t id;      // CAN identifier of the message carrying the signal
+  uint16_t pid;     // OBD_Sample::pid reported, the matching DID if there is one
+  uint8_t start;    // DBC start bit
+  uint8_t length;   // bits
+  uint8_t flags;    // PID_FLAG_DECIMALS, PID_FLAG_SIGNED, PID_FLAG_HEX, SIGNAL_FLAG_MOTOROLA
+  uint8_t unit;     // OBD_UNIT_*
+  uint16_t mul;
+  uint16_t div;
+  int16_t offset;
+} CAN_Signal_Def;
+
+class CAN_Signal
+{
+  public:
+    CAN_Signal();
+    byte decode(uint32_t id, const byte* data, byte length, uint32_t timestamp, OBD_Sample* samples, byte max);
+    byte messages();
+    uint16_t message(byte index);
+    static int32_t extract(const CAN_Signal_Def* desc, const byte* data);
+
+  private:
+    static byte lookup(uint32_t id);
+};
+
+#endif // _can_signal_h_
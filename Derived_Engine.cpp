@@ -0,0 +1,171 @@
+/*
+ Derived channels computed from decoded samples as they arrive
+ by:
+ date:
+ license:
+ */
+
+#include "Derived_Engine.h"
+
+#define DERIVED_NONE 0xFF
+
+/*
+
+*/
+Derived_Engine::Derived_Engine()
+{
+  definitions = 0;
+  channels = 0;
+  source_count = 0;
+  received = 0;
+  evaluations = 0;
+  skipped = 0;
+}
+
+/*
+ Take a PROGMEM table of count channels. Returns false if it has more
+ channels or distinct inputs than fit; the channels before that work.
+*/
+bool Derived_Engine::begin(const Derived_Def* definitions, byte count)
+{
+  Derived_Def def;
+
+  this->definitions = definitions;
+  channels = 0;
+  source_count = 0;
+  received = 0;
+  memset(dependents, 0, sizeof(dependents));
+
+  if (count > DERIVED_CHANNELS_MAX)
+  {
+    count = DERIVED_CHANNELS_MAX;
+  }
+
+  for (byte c = 0; c < count; c++)
+  {
+    memcpy_P(&def, &definitions[c], sizeof(Derived_Def));
+
+    input_count[c] = 0;
+    for (byte n = 0; (n < DERIVED_INPUTS_MAX) && (def.inputs[n] != 0); n++)
+    {
+      byte index = source(def.inputs[n]);
+
+      if (index == DERIVED_NONE)
+      {
+        if (source_count == DERIVED_SOURCES_MAX)
+        {
+          return false;
+        }
+        index = source_count++;
+        memset(&sources[index], 0, sizeof(OBD_Sample));
+        sources[index].pid = def.inputs[n];
+      }
+
+      inputs[c][n] = index;
+      input_count[c]++;
+      if (def.triggers & (1 << n))
+      {
+        dependents[index] |= 1 << c;
+      }
+    }
+
+    channels = c + 1;
+  }
+
+  return channels == count;
+}
+
+/*
+ Take a decoded sample. Writes the derived channels it caused, and the
+ ones those caused in turn, to outputs and returns their number. A
+ sample no channel reads returns 0 after one scan of the inputs.
+*/
+byte Derived_Engine::update(const OBD_Sample* sample, OBD_Sample* outputs, byte max)
+{
+  const OBD_Sample* next = sample;
+  byte count = 0;
+  byte fed = 0;
+
+  while (next != 0)
+  {
+    byte index = source(next->pid);
+
+    if (index != DERIVED_NONE)
+    {
+      uint8_t mask = dependents[index];
+
+      sources[index] = *next;
+      received |= 1 << index;
+
+      for (byte c = 0; (mask != 0) && (count < max); c++, mask >>= 1)
+      {
+        if ((mask & 1) && evaluate(c, next->timestamp, &outputs[count]))
+        {
+          count++;
+        }
+      }
+    }
+
+    // Results are inputs too
+    next = (fed < count) ? &outputs[fed++] : 0;
+  }
+
+  return count;
+}
+
+/*
+ Index of a channel in sources, or DERIVED_NONE.
+*/
+byte Derived_Engine::source(uint16_t pid)
+{
+  for (byte i = 0; i < source_count; i++)
+  {
+    if (sources[i].pid == pid)
+    {
+      return i;
+    }
+  }
+
+  return DERIVED_NONE;
+}
+
+/*
+
+*/
+bool Derived_Engine::evaluate(byte channel, uint32_t timestamp, OBD_Sample* output)
+{
+  const OBD_Sample* values[DERIVED_INPUTS_MAX];
+  Derived_Def def;
+  int32_t value;
+
+  for (byte n = 0; n < input_count[channel]; n++)
+  {
+    const OBD_Sample* input = &sources[inputs[channel][n]];
+
+    if (((received & (1 << inputs[channel][n])) == 0) ||
+        ((int32_t)(timestamp - input->timestamp) > DERIVED_MAX_AGE))
+    {
+      skipped++;
+      return false;
+    }
+    values[n] = input;
+  }
+
+  memcpy_P(&def, &definitions[channel], sizeof(Derived_Def));
+  if (def.function(values, &value) == false)
+  {
+    skipped++;
+    return false;
+  }
+
+  evaluations++;
+  output->timestamp = timestamp;
+  output->raw = value;
+  output->value = value;
+  output->pid = def.pid;
+  output->unit = def.unit;
+  output->decimals = def.decimals;
+  output->digits = 0;
+
+  return true;
+}
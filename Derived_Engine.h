@@ -0,0 +1,81 @@
+/*
+ Derived channels computed from decoded samples as they arrive
+ by:
+ date:
+ license:
+
+ A derived channel is a function of the latest values of a few input
+ channels: gear ratio from RPM and road speed, combined g from the
+ accelerometer, a smoothed response from throttle and RPM. Each one is
+ described by a Derived_Def in a PROGMEM table giving its inputs, which
+ of them trigger it and the unit of its result.
+
+ begin() turns the table into a list of distinct inputs, each with a bit
+ per channel it triggers, so update() only looks up the sample's channel
+ and runs the functions that depend on it; everything else costs one
+ scan of the inputs. The results come out as OBD_Samples with the
+ trigger's timestamp and are fed back in, so a derived channel can be
+ the input of another. A channel is skipped while one of its inputs was
+ never seen or is more than DERIVED_MAX_AGE older than the trigger.
+
+ Functions keep their filter state in Stream_Filter objects of their
+ own and must not use the heap.
+ */
+#ifndef derived_engine_h_
+#define derived_engine_h_
+
+#include <Arduino.h>
+#include "OBD_Sample.h"
+
+#define DERIVED_CHANNELS_MAX 8
+#define DERIVED_INPUTS_MAX   3
+#define DERIVED_SOURCES_MAX  12   // distinct input channels of all derived channels
+#define DERIVED_MAX_AGE      1000 // milliseconds an input may lag the trigger
+
+// Log channels, after the lap timer
+#define DERIVED_CHANNEL_GEAR     0xFF30 // engine to wheel ratio over the final drive, 2 decimals
+#define DERIVED_CHANNEL_SLIP     0xFF31 // torque converter slip, % with 1 decimal
+#define DERIVED_CHANNEL_G        0xFF32 // combined horizontal acceleration, mg
+#define DERIVED_CHANNEL_PEAK_G   0xFF33 // greatest combined g of the last seconds, mg
+#define DERIVED_CHANNEL_RPM_RATE 0xFF34 // smoothed RPM change, min-1 per second
+#define DERIVED_CHANNEL_RESPONSE 0xFF35 // RPM change per % of pedal, min-1 per second
+
+// Computes a channel from its inputs, in the order of Derived_Def::inputs.
+// Returns false if there is no value this time.
+typedef bool (*Derived_Function)(const OBD_Sample* const* inputs, int32_t* value);
+
+typedef struct
+{
+  uint16_t pid;                        // OBD_Sample::pid of the result
+  uint16_t inputs[DERIVED_INPUTS_MAX]; // channels read, 0 past the last
+  uint8_t triggers;                    // bit n set: an update of inputs[n] recomputes
+  uint8_t unit;                        // OBD_UNIT_* of the result
+  uint8_t decimals;
+  Derived_Function function;
+} Derived_Def;
+
+class Derived_Engine
+{
+  public:
+    Derived_Engine();
+    bool begin(const Derived_Def* definitions, byte count);
+    byte update(const OBD_Sample* sample, OBD_Sample* outputs, byte max);
+
+    uint32_t evaluations;
+    uint32_t skipped;     // triggered without an input or a value
+
+  private:
+    byte source(uint16_t pid);
+    bool evaluate(byte channel, uint32_t timestamp, OBD_Sample* output);
+
+    const Derived_Def* definitions;          // PROGMEM
+    byte channels;
+    byte source_count;
+    uint16_t received;                       // bit per source seen since begin()
+    OBD_Sample sources[DERIVED_SOURCES_MAX]; // latest sample of each input
+    uint8_t dependents[DERIVED_SOURCES_MAX]; // bit per channel an update recomputes
+    byte inputs[DERIVED_CHANNELS_MAX][DERIVED_INPUTS_MAX]; // index into sources
+    byte input_count[DERIVED_CHANNELS_MAX];
+};
+
+#endif // _derived_engine_h_
@@ -0,0 +1,549 @@
+/*
+ Simulated ECUs on an in-process bus
+ by:
+ date:
+ license:
+ */
+
+#include "ECU_Sim.h"
+
+// ECU_Sim::state
+#define ECU_SIM_IDLE  0
+#define ECU_SIM_NRC   1 // negative response waiting for its time
+#define ECU_SIM_READY 2 // single or first frame waiting for its time
+#define ECU_SIM_WAIT  3 // first frame sent, waiting for flow control
+#define ECU_SIM_CF    4 // sending consecutive frames
+
+static const char sim_vin[OBD_VIN_LENGTH + 1] PROGMEM = "1FAHP3F20CL123456";
+
+/*
+ Only ECU #1 is present until configure() says otherwise. It answers
+ every service within 10 ms.
+*/
+ECU_Sim::ECU_Sim()
+{
+  ECU_Sim_Config engine = {5, 5, ECU_SIM_DIAG | ECU_SIM_INFO | ECU_SIM_RDBI, NRC_PR, 0, 0};
+
+  memset(config, 0, sizeof(config));
+  for (byte i = 0; i < ECU_SIM_ECUS; i++)
+  {
+    state[i] = ECU_SIM_IDLE;
+    request_length[i] = 0;
+    flow_control[i] = false;
+  }
+  configure(0, &engine);
+
+  value_count = 0;
+  seed = 0xACE1;
+  requests = 0;
+  responses = 0;
+  negatives = 0;
+}
+
+/*
+ Set up ECU n, answering on ID_REPLY_1 + n.
+*/
+void ECU_Sim::configure(byte ecu, const ECU_Sim_Config* settings)
+{
+  if (ecu < ECU_SIM_ECUS)
+  {
+    config[ecu] = *settings;
+    state[ecu] = ECU_SIM_IDLE;
+  }
+}
+
+/*
+ Answer with raw for a PID or DID from now on, instead of the waveform.
+ Once the table is full further channels keep their waveform.
+*/
+void ECU_Sim::setValue(uint16_t channel, int32_t raw)
+{
+  for (byte i = 0; i < value_count; i++)
+  {
+    if (values[i].channel == channel)
+    {
+      values[i].raw = raw;
+      return;
+    }
+  }
+
+  if (value_count < ECU_SIM_VALUES)
+  {
+    values[value_count].channel = channel;
+    values[value_count].raw = raw;
+    value_count++;
+  }
+}
+
+/*
+
+*/
+void ECU_Sim::clearValues()
+{
+  value_count = 0;
+}
+
+/*
+ A frame the tester sent: a functional request every present ECU answers,
+ a physical request or flow control for one ECU.
+*/
+void ECU_Sim::receive(const OBD_Frame* frame, uint32_t now)
+{
+  byte pci = frame->data[0] & 0xF0;
+  byte count = frame->data[0] & 0x0F;
+
+  if (frame->id == ID_REQUEST)
+  {
+    if ((pci == ISO_TP_PCI_SF) && (count > 0) && (count < frame->length))
+    {
+      requests++;
+      for (byte ecu = 0; ecu < ECU_SIM_ECUS; ecu++)
+      {
+        request(ecu, frame->data + 1, count, now);
+      }
+    }
+    return;
+  }
+
+  if ((frame->id < ID_REQUEST_1) || (frame->id >= ID_REQUEST_1 + ECU_SIM_ECUS))
+  {
+    return;
+  }
+
+  byte ecu = frame->id - ID_REQUEST_1;
+
+  if ((pci == ISO_TP_PCI_FC) && (state[ecu] == ECU_SIM_WAIT))
+  {
+    if ((frame->data[0] & 0x0F) == ISO_TP_FS_CTS)
+    {
+      // Block size is ignored, the whole answer follows at STmin
+      sequence[ecu] = 1;
+      due[ecu] = now;
+      state[ecu] = ECU_SIM_CF;
+    }
+    else if ((frame->data[0] & 0x0F) != ISO_TP_FS_WAIT)
+    {
+      state[ecu] = ECU_SIM_IDLE;
+    }
+  }
+  else if ((pci == ISO_TP_PCI_SF) && (count > 0) && (count < frame->length))
+  {
+    requests++;
+    request(ecu, frame->data + 1, count, now);
+  }
+  else if (pci == ISO_TP_PCI_FF)
+  {
+    uint16_t total = ((frame->data[0] & 0x0F) << 8) | frame->data[1];
+
+    // Too long for the request buffer, the request is ignored
+    if ((total <= OBD_SF_PAYLOAD) || (total > ECU_SIM_REQUEST))
+    {
+      request_length[ecu] = 0;
+      return;
+    }
+
+    memcpy(request_data[ecu], frame->data + 2, 6);
+    request_length[ecu] = total;
+    request_offset[ecu] = 6;
+    request_sequence[ecu] = 1;
+    flow_control[ecu] = true;
+  }
+  else if ((pci == ISO_TP_PCI_CF) && (request_length[ecu] != 0))
+  {
+    byte remaining = request_length[ecu] - request_offset[ecu];
+
+    if (count != request_sequence[ecu])
+    {
+      request_length[ecu] = 0;
+      return;
+    }
+
+    if (remaining > 7)
+    {
+      remaining = 7;
+    }
+    memcpy(request_data[ecu] + request_offset[ecu], frame->data + 1, remaining);
+    request_offset[ecu] += remaining;
+    request_sequence[ecu] = (request_sequence[ecu] + 1) & 0x0F;
+
+    if (request_offset[ecu] >= request_length[ecu])
+    {
+      requests++;
+      request(ecu, request_data[ecu], request_length[ecu], now);
+      request_length[ecu] = 0;
+    }
+  }
+}
+
+/*
+ Next answer frame whose time has come, as the controller would have
+ received it. Returns false if no ECU has anything due.
+*/
+bool ECU_Sim::transmit(uint32_t now, OBD_Frame* frame)
+{
+  for (byte ecu = 0; ecu < ECU_SIM_ECUS; ecu++)
+  {
+    if (flow_control[ecu])
+    {
+      // Clear to send the rest at once, no separation time
+      frame->id = ID_REPLY_1 + ecu;
+      frame->timestamp = now;
+      frame->length = 8;
+      memset(frame->data, 0, sizeof(frame->data));
+      frame->data[0] = ISO_TP_PCI_FC | ISO_TP_FS_CTS;
+      flow_control[ecu] = false;
+      return true;
+    }
+
+    if ((state[ecu] == ECU_SIM_IDLE) || ((int32_t)(now - due[ecu]) < 0))
+    {
+      continue;
+    }
+
+    frame->id = ID_REPLY_1 + ecu;
+    frame->timestamp = now;
+    frame->length = 8;
+    memset(frame->data, 0, sizeof(frame->data));
+
+    switch (state[ecu])
+    {
+      case ECU_SIM_NRC:
+        frame->data[0] = 3;
+        frame->data[1] = SIDNR;
+        frame->data[2] = sid[ecu];
+        frame->data[3] = config[ecu].nrc;
+        negatives++;
+        if (config[ecu].nrc == NRC_RCRRP)
+        {
+          due[ecu] = now + ECU_SIM_PENDING;
+          state[ecu] = ECU_SIM_READY;
+        }
+        else
+        {
+          state[ecu] = ECU_SIM_IDLE;
+        }
+        return true;
+
+      case ECU_SIM_READY:
+        if (length[ecu] <= OBD_SF_PAYLOAD)
+        {
+          frame->data[0] = ISO_TP_PCI_SF | length[ecu];
+          memcpy(frame->data + 1, data[ecu], length[ecu]);
+          state[ecu] = ECU_SIM_IDLE;
+          responses++;
+        }
+        else
+        {
+          frame->data[0] = ISO_TP_PCI_FF | (length[ecu] >> 8);
+          frame->data[1] = length[ecu];
+          memcpy(frame->data + 2, data[ecu], 6);
+          offset[ecu] = 6;
+          due[ecu] = now + ISO_TP_N_BS;
+          state[ecu] = ECU_SIM_WAIT;
+        }
+        return true;
+
+      case ECU_SIM_WAIT:
+        // No flow control in time, the answer is dropped
+        state[ecu] = ECU_SIM_IDLE;
+        break;
+
+      case ECU_SIM_CF:
+      {
+        byte count = length[ecu] - offset[ecu];
+
+        if (count > 7)
+        {
+          count = 7;
+        }
+        frame->data[0] = ISO_TP_PCI_CF | sequence[ecu];
+        memcpy(frame->data + 1, data[ecu] + offset[ecu], count);
+        offset[ecu] += count;
+        sequence[ecu] = (sequence[ecu] + 1) & 0x0F;
+        if (offset[ecu] >= length[ecu])
+        {
+          state[ecu] = ECU_SIM_IDLE;
+          responses++;
+        }
+        return true;
+      }
+    }
+  }
+
+  return false;
+}
+
+/*
+ Prepare the answer of one ECU. A busy ECU ignores the request, one
+ without the service stays silent like a real ECU on a functional request.
+*/
+void ECU_Sim::request(byte ecu, const byte* payload, byte count, uint32_t now)
+{
+  byte service;
+
+  switch (payload[0])
+  {
+    case SIDRQ_DIAG:
+      service = ECU_SIM_DIAG;
+      break;
+    case SIDRQ_INFO:
+      service = ECU_SIM_INFO;
+      break;
+    case SIDRQ_RDBI:
+      service = ECU_SIM_RDBI;
+      break;
+    default:
+      return;
+  }
+
+  if (((config[ecu].services & service) == 0) || (state[ecu] != ECU_SIM_IDLE))
+  {
+    return;
+  }
+
+  length[ecu] = answer(ecu, payload, count, data[ecu], now);
+  if (length[ecu] == 0)
+  {
+    return;
+  }
+
+  sid[ecu] = payload[0];
+  due[ecu] = now + responseTime(ecu);
+  state[ecu] = ECU_SIM_READY;
+
+  if ((config[ecu].nrc != NRC_PR) && ((random16() & 0xFF) < config[ecu].nrc_rate))
+  {
+    state[ecu] = ECU_SIM_NRC;
+  }
+}
+
+/*
+ Positive response payload, starting at the response SID. Returns its
+ length, 0 if nothing asked for is known.
+*/
+uint16_t ECU_Sim::answer(byte ecu, const byte* payload, byte count, byte* out, uint32_t now)
+{
+  switch (payload[0])
+  {
+    case SIDRQ_DIAG:
+      return answerDiag(ecu, payload, count, out, now);
+
+    case SIDRQ_INFO:
+      out[0] = SIDPR_INFO;
+      out[1] = payload[1];
+      if ((count == 2) && (payload[1] == INFOTYPE_VIN))
+      {
+        // One data item, the 17 VIN characters
+        out[2] = 1;
+        memcpy_P(out + 3, sim_vin, OBD_VIN_LENGTH);
+        return 3 + OBD_VIN_LENGTH;
+      }
+      if ((count == 2) && (payload[1] == 0x00))
+      {
+        // Supported InfoTypes, only $02
+        out[2] = 0x40;
+        out[3] = 0x00;
+        out[4] = 0x00;
+        out[5] = 0x00;
+        return 6;
+      }
+      return 0;
+
+    case SIDRQ_RDBI:
+      return answerRDBI(payload, count, out, now);
+  }
+
+  return 0;
+}
+
+/*
+ Service $01: every PID of the request the dictionary knows and the ECU
+ answers, in order. The supported PID ranges follow from them as well.
+*/
+uint16_t ECU_Sim::answerDiag(byte ecu, const byte* payload, byte count, byte* out, uint32_t now)
+{
+  WWH_OBD_PID field;
+  uint16_t used = 1;
+
+  out[0] = SIDPR_DIAG;
+
+  for (byte i = 1; i < count; i++)
+  {
+    byte pid = payload[i];
+
+    if ((pid & 0x1F) == 0)
+    {
+      uint32_t bits = 0;
+
+      if (used + 5 > ECU_SIM_PAYLOAD)
+      {
+        break;
+      }
+
+      for (byte n = 1; n <= 32; n++)
+      {
+        if ((pid + n <= 0xFF) && WWH_OBD::lookupPID(pid + n, &field) && !(field.flags & PID_FLAG_NONE) &&
+            answers(ecu, pid + n))
+        {
+          bits |= 1UL << (32 - n);
+        }
+      }
+
+      out[used++] = pid;
+      out[used++] = bits >> 24;
+      out[used++] = bits >> 16;
+      out[used++] = bits >> 8;
+      out[used++] = bits;
+      continue;
+    }
+
+    if ((WWH_OBD::lookupPID(pid, &field) == false) || (field.flags & PID_FLAG_NONE) ||
+        !answers(ecu, pid) || (used + 1 + field.length > ECU_SIM_PAYLOAD))
+    {
+      continue;
+    }
+
+    out[used++] = pid;
+    encode(&field, pid, now, out + used);
+    used += field.length;
+  }
+
+  return (used > 1) ? used : 0;
+}
+
+/*
+ True if the ECU's share of the dictionary includes Service $01 pid.
+*/
+bool ECU_Sim::answers(byte ecu, byte pid)
+{
+  if (config[ecu].pids == 0)
+  {
+    return true;
+  }
+
+  return (pgm_read_byte(&config[ecu].pids[pid >> 3]) & (1 << (pid & 0x07))) != 0;
+}
+
+/*
+ ReadDataByIdentifier: every DID of the request Ford_OBD knows, each
+ followed by its data record.
+*/
+uint16_t ECU_Sim::answerRDBI(const byte* payload, byte count, byte* out, uint32_t now)
+{
+  Ford_OBD_DID did;
+  uint16_t used = 1;
+
+  out[0] = SIDPR_RDBI;
+
+  for (byte i = 1; i + 1 < count; i += 2)
+  {
+    uint16_t id = (payload[i] << 8) + payload[i + 1];
+
+    if ((Ford_OBD::lookupDID(id, &did) == false) || (used + 2 + did.field.length > ECU_SIM_PAYLOAD))
+    {
+      continue;
+    }
+
+    out[used++] = payload[i];
+    out[used++] = payload[i + 1];
+    encode(&did.field, id, now, out + used);
+    used += did.field.length;
+  }
+
+  return (used > 1) ? used : 0;
+}
+
+/*
+ Data bytes of a PID or DID: the value placed in its field, the other
+ bytes zero.
+*/
+void ECU_Sim::encode(const WWH_OBD_PID* field, uint16_t channel, uint32_t now, byte* out)
+{
+  uint32_t raw = value(field, channel, now);
+  byte mask = field->bitmask;
+
+  memset(out, 0, field->length);
+
+  if (mask != 0xFF)
+  {
+    while ((mask & 0x01) == 0)
+    {
+      mask >>= 1;
+      raw <<= 1;
+    }
+    raw &= field->bitmask;
+  }
+
+  for (byte i = 0; i < field->size; i++)
+  {
+    out[field->start + field->size - 1 - i] = raw >> (8 * i);
+  }
+}
+
+/*
+ Raw value of a channel: the last setValue(), otherwise a triangle wave
+ over the field's range with a period of a few seconds, different for
+ every channel.
+*/
+int32_t ECU_Sim::value(const WWH_OBD_PID* field, uint16_t channel, uint32_t now)
+{
+  uint32_t top;
+  uint32_t period = 2000 + (channel & 0xFF) * 40;
+  uint32_t half = period / 2;
+  uint32_t phase = now % period;
+
+  for (byte i = 0; i < value_count; i++)
+  {
+    if (values[i].channel == channel)
+    {
+      return values[i].raw;
+    }
+  }
+
+  if (field->bitmask != 0xFF)
+  {
+    top = field->bitmask;
+    while ((top & 0x01) == 0)
+    {
+      top >>= 1;
+    }
+  }
+  else
+  {
+    top = (field->size >= 2) ? 0xFFFF : 0xFF;
+  }
+
+  if (phase >= half)
+  {
+    phase = period - phase;
+  }
+
+  return (phase * top) / half;
+}
+
+/*
+ Response time of an ECU including its jitter.
+*/
+uint32_t ECU_Sim::responseTime(byte ecu)
+{
+  uint32_t time = config[ecu].latency;
+
+  if (config[ecu].jitter > 0)
+  {
+    time += ((uint32_t)random16() * (config[ecu].jitter + 1)) >> 16;
+  }
+
+  return time;
+}
+
+/*
+ 16 bit xorshift, repeatable from run to run.
+*/
+uint16_t ECU_Sim::random16()
+{
+  seed ^= seed << 7;
+  seed ^= seed >> 9;
+  seed ^= seed << 8;
+
+  return seed;
+}
@@ -0,0 +1,115 @@
+/*
+ Simulated ECUs on an in-process bus
+ by:
+ date:
+ license:
+
+ Stands in for the vehicle so the polling path can be exercised without a
+ car. Request frames the sketch would put on the bus go to receive(), the
+ answers come back out of transmit() once their response time has passed,
+ as if read from the controller.
+
+ Every simulated ECU answers on its own ID_REPLY_n and segments long
+ answers with ISO 15765-2, waiting for the tester's flow control. Physical
+ requests may be segmented as well, up to ECU_SIM_REQUEST bytes. The
+ services are Service $01 for every PID in the WWH_OBD dictionary, or the
+ share of it an ECU's config.pids names, Service
+ $09 InfoType $02 (VIN) and UDS ReadDataByIdentifier for the Ford_OBD DIDs,
+ several DIDs per request. Response time, jitter and injected negative
+ responses (NRC_BRR, NRC_RCRRP) are set per ECU.
+
+ Values follow a triangle wave per PID, or whatever setValue() was last
+ given, so a recorded session can be replayed.
+ */
+#ifndef ecu_sim_h_
+#define ecu_sim_h_
+
+#include <Arduino.h>
+#include "OBD_Frame.h"
+#include "WWH_OBD.h"
+#include "Ford_OBD.h"
+#include "ISO_TP.h"
+#include "OBD_Supported.h"
+
+#if defined(ARDUINO_ARCH_AVR)
+#define ECU_SIM_ECUS   2
+#define ECU_SIM_VALUES 8
+#else
+#define ECU_SIM_ECUS   8
+#define ECU_SIM_VALUES 32
+#endif
+#define ECU_SIM_PAYLOAD OBD_RECV_BUF_SIZE
+#define ECU_SIM_REQUEST (1 + 2 * FORD_GROUP_MAX) // longest request, a full DID group
+
+#define ECU_SIM_PENDING 200 // milliseconds an NRC_RCRRP holds the answer back
+
+// ECU_Sim_Config::services
+#define ECU_SIM_DIAG 0x01 // Service $01
+#define ECU_SIM_INFO 0x02 // Service $09
+#define ECU_SIM_RDBI 0x04 // UDS $22, Ford DIDs
+
+typedef struct
+{
+  uint16_t latency;  // milliseconds from request to the first response frame
+  uint16_t jitter;   // up to this many milliseconds more, at random
+  uint8_t services;  // ECU_SIM_*, 0 = ECU not present
+  uint8_t nrc;       // NRC_BRR or NRC_RCRRP injected, NRC_PR for none
+  uint8_t nrc_rate;  // requests out of 256 that get the NRC
+  const uint8_t* pids; // PROGMEM, 32 bytes, bit n set for Service $01 PID n; 0 for all
+} ECU_Sim_Config;
+
+typedef struct
+{
+  int32_t raw;
+  uint16_t channel; // PID or DID
+} ECU_Sim_Value;
+
+class ECU_Sim
+{
+  public:
+    ECU_Sim();
+    void configure(byte ecu, const ECU_Sim_Config* config);
+    void setValue(uint16_t channel, int32_t raw);
+    void clearValues();
+    void receive(const OBD_Frame* frame, uint32_t now);
+    bool transmit(uint32_t now, OBD_Frame* frame);
+
+    uint32_t requests;
+    uint32_t responses;
+    uint32_t negatives;
+
+  private:
+    void request(byte ecu, const byte* payload, byte length, uint32_t now);
+    uint16_t answer(byte ecu, const byte* payload, byte length, byte* data, uint32_t now);
+    uint16_t answerDiag(byte ecu, const byte* payload, byte length, byte* data, uint32_t now);
+    bool answers(byte ecu, byte pid);
+    uint16_t answerRDBI(const byte* payload, byte length, byte* data, uint32_t now);
+    void encode(const WWH_OBD_PID* field, uint16_t channel, uint32_t now, byte* data);
+    int32_t value(const WWH_OBD_PID* field, uint16_t channel, uint32_t now);
+    uint32_t responseTime(byte ecu);
+    uint16_t random16();
+
+    ECU_Sim_Config config[ECU_SIM_ECUS];
+
+    // Answer each ECU is sending
+    uint32_t due[ECU_SIM_ECUS];
+    uint16_t length[ECU_SIM_ECUS];
+    uint16_t offset[ECU_SIM_ECUS];
+    uint8_t state[ECU_SIM_ECUS];
+    uint8_t sequence[ECU_SIM_ECUS];
+    uint8_t sid[ECU_SIM_ECUS];
+    byte data[ECU_SIM_ECUS][ECU_SIM_PAYLOAD];
+
+    // Segmented request each ECU is receiving
+    uint8_t request_length[ECU_SIM_ECUS];
+    uint8_t request_offset[ECU_SIM_ECUS];
+    uint8_t request_sequence[ECU_SIM_ECUS];
+    bool flow_control[ECU_SIM_ECUS]; // to send for a first frame
+    byte request_data[ECU_SIM_ECUS][ECU_SIM_REQUEST];
+
+    ECU_Sim_Value values[ECU_SIM_VALUES];
+    byte value_count;
+    uint16_t seed;
+};
+
+#endif // _ecu_sim_h_
@@ -0,0 +1,383 @@
+/*
+ Rolling flight recorder with triggered capture
+ by:
+ date:
+ license:
+ */
+
+#include "Flight_Recorder.h"
+
+/*
+
+*/
+Flight_Recorder::Flight_Recorder()
+{
+  triggers = 0;
+  trigger_count = 0;
+  begin(0, 0, 0, 0);
+}
+
+/*
+ Record into ring, size records owned by the caller. A trigger keeps pre
+ milliseconds before it and post after.
+*/
+void Flight_Recorder::begin(SD_Log_Record* ring, uint16_t size, uint16_t pre, uint16_t post)
+{
+  this->ring = ring;
+  this->size = size;
+  this->pre = pre;
+  this->post = post;
+  tail = 0;
+  count = 0;
+  tail_base = 0;
+  head_time = 0;
+  active = false;
+  closing = false;
+  pending = 0;
+  closing_left = 0;
+  drain_at = 0;
+  drain_base = 0;
+  end = 0;
+  drained_until = 0;
+  have_drained = false;
+  armed = 0;
+  records = 0;
+  overruns = 0;
+  captures = 0;
+}
+
+/*
+ Take a PROGMEM table of threshold triggers, checked on every record.
+*/
+void Flight_Recorder::watch(const Recorder_Trigger* triggers, byte count)
+{
+  this->triggers = triggers;
+  trigger_count = (count < RECORDER_TRIGGERS_MAX) ? count : RECORDER_TRIGGERS_MAX;
+  armed = 0;
+}
+
+/*
+ Add a record, dropping the oldest if the ring is full. Returns false if
+ the record was refused because the oldest belongs to a window still
+ waiting for the card.
+*/
+bool Flight_Recorder::append(uint16_t channel, uint32_t timestamp, int32_t raw)
+{
+  int32_t gap = timestamp - head_time;
+  SD_Log_Record* record;
+
+  if (size == 0)
+  {
+    return false;
+  }
+
+  if ((count > 0) && ((gap > 32767) || (gap < -32768)))
+  {
+    if (active == false)
+    {
+      // Nothing that old is worth keeping
+      count = 0;
+    }
+    else
+    {
+      gap = (gap > 0) ? 32767 : -32768;
+    }
+  }
+  if (count == 0)
+  {
+    tail_base = timestamp;
+    head_time = timestamp;
+    gap = 0;
+  }
+
+  if (count == size)
+  {
+    if (active && (pending == count))
+    {
+      overruns++;
+      return false;
+    }
+    tail_base += ring[tail].delta;
+    tail = (tail + 1) % size;
+    count--;
+  }
+
+  record = &ring[(tail + count) % size];
+  record->delta = gap;
+  record->channel = channel;
+  record->raw = raw;
+  count++;
+  records++;
+  head_time += gap;
+  if (active)
+  {
+    pending++;
+  }
+
+  check(channel, timestamp, raw);
+
+  return true;
+}
+
+/*
+ Freeze the window around timestamp, or make the one draining reach
+ post past it. reason is recorded with it.
+*/
+void Flight_Recorder::trigger(uint32_t timestamp, byte reason)
+{
+  if (active == false)
+  {
+    start(timestamp);
+  }
+  else if ((int32_t)(timestamp + post - end) > 0)
+  {
+    end = timestamp + post;
+    closing = false;
+  }
+
+  append(RECORDER_CHANNEL_TRIGGER, timestamp, reason);
+}
+
+/*
+ Hand up to max records of the window to log, as many as it takes
+ without dropping. The window is done once every record appended until
+ RECORDER_LATE past its end was handed on. Returns the records moved.
+*/
+uint16_t Flight_Recorder::drain(SD_Log* log, uint32_t now, uint16_t max)
+{
+  uint16_t moved = 0;
+
+  if (active == false)
+  {
+    return 0;
+  }
+
+  close(now);
+
+  while ((pending > 0) && (moved < max) && log->ready() && ((closing == false) || (closing_left > 0)))
+  {
+    const SD_Log_Record* record = &ring[drain_at];
+
+    drain_base += record->delta;
+    log->append(record->channel, drain_base, record->raw);
+    drain_at = (drain_at + 1) % size;
+    pending--;
+    if (closing)
+    {
+      closing_left--;
+    }
+    moved++;
+  }
+
+  closed(log);
+
+  return moved;
+}
+
+/*
+ Hand the window to log as one Series_Codec block of the channel of the
+ first record not yet handed on, if log has a buffer free. Returns the
+ records moved.
+*/
+uint16_t Flight_Recorder::compress(SD_Log* log, uint32_t now)
+{
+  Series_Encoder encoder;
+  uint16_t moved = 0;
+  uint16_t left;
+  byte* buffer = 0;
+
+  if (active == false)
+  {
+    return 0;
+  }
+
+  close(now);
+  skipTaken();
+
+  left = closing ? closing_left : pending;
+  if ((left > 0) && (closing || (pending >= size / 2)))
+  {
+    buffer = log->series();
+  }
+
+  if (buffer != 0)
+  {
+    uint16_t channel = ring[drain_at].channel;
+    uint16_t index = drain_at;
+    uint32_t time = drain_base;
+    uint32_t first = 0;
+
+    encoder.begin(buffer, SD_LOG_SERIES_SIZE, channel, SERIES_DELTA);
+    for (uint16_t i = 0; i < left; i++)
+    {
+      SD_Log_Record* record = &ring[index];
+
+      time += record->delta;
+      if (record->channel == channel)
+      {
+        if (encoder.append(time, record->raw) == false)
+        {
+          break;
+        }
+        if (moved == 0)
+        {
+          first = time;
+        }
+        record->channel = RECORDER_CHANNEL_TAKEN;
+        moved++;
+      }
+      index = (index + 1) % size;
+    }
+    encoder.finish();
+    log->sealSeries(first, moved);
+    skipTaken();
+  }
+
+  closed(log);
+
+  return moved;
+}
+
+/*
+ True while a window waits for the card.
+*/
+bool Flight_Recorder::capturing()
+{
+  return active;
+}
+
+/*
+ Milliseconds between the oldest and the newest record held.
+*/
+uint32_t Flight_Recorder::span()
+{
+  if (count == 0)
+  {
+    return 0;
+  }
+
+  return head_time - (tail_base + ring[tail].delta);
+}
+
+/*
+ Fire the thresholds of channel that raw crossed.
+*/
+void Flight_Recorder::check(uint16_t channel, uint32_t timestamp, int32_t raw)
+{
+  Recorder_Trigger entry;
+
+  for (byte i = 0; i < trigger_count; i++)
+  {
+    if (pgm_read_word(&triggers[i].channel) != channel)
+    {
+      continue;
+    }
+
+    memcpy_P(&entry, &triggers[i], sizeof(Recorder_Trigger));
+
+    int32_t value = (entry.flags & RECORDER_MAGNITUDE) ? abs(raw) : raw;
+    bool over = ((entry.flags & RECORDER_ABOVE) && (value > entry.level)) ||
+                ((entry.flags & RECORDER_BELOW) && (value < entry.level));
+    uint16_t bit = 1 << i;
+
+    if (over == false)
+    {
+      armed |= bit;
+    }
+    else if (armed & bit)
+    {
+      armed &= ~bit;
+      trigger(timestamp, i);
+    }
+  }
+}
+
+/*
+ Find the first record of the window, pre before timestamp but after the
+ last window, by walking the ring from the oldest record once.
+*/
+void Flight_Recorder::start(uint32_t timestamp)
+{
+  uint32_t from = timestamp - pre;
+  uint32_t time = tail_base;
+  uint16_t index = tail;
+  uint16_t skipped = 0;
+
+  if (have_drained && ((int32_t)(drained_until - from) >= 0))
+  {
+    from = drained_until + 1;
+  }
+
+  while (skipped < count)
+  {
+    uint32_t at = time + ring[index].delta;
+
+    if ((int32_t)(at - from) >= 0)
+    {
+      break;
+    }
+    time = at;
+    index = (index + 1) % size;
+    skipped++;
+  }
+
+  active = true;
+  closing = false;
+  drain_at = index;
+  drain_base = time;
+  pending = count - skipped;
+  end = timestamp + post;
+}
+
+/*
+ Close the window once RECORDER_LATE past its end, to the records
+ appended until then.
+*/
+void Flight_Recorder::close(uint32_t now)
+{
+  if ((closing == false) && ((int32_t)(now - end) > RECORDER_LATE))
+  {
+    closing = true;
+    closing_left = pending;
+  }
+}
+
+/*
+ Finish a closed window whose records were all handed on. Returns true
+ if it did.
+*/
+bool Flight_Recorder::closed(SD_Log* log)
+{
+  if ((closing == false) || (closing_left > 0))
+  {
+    return false;
+  }
+
+  active = false;
+  closing = false;
+  pending = 0;
+  drained_until = drain_base;
+  have_drained = true;
+  captures++;
+  log->seal();
+
+  return true;
+}
+
+/*
+ Move the start of the window past the records compress() has taken.
+*/
+void Flight_Recorder::skipTaken()
+{
+  while ((pending > 0) && ((closing == false) || (closing_left > 0)) &&
+         (ring[drain_at].channel == RECORDER_CHANNEL_TAKEN))
+  {
+    drain_base += ring[drain_at].delta;
+    drain_at = (drain_at + 1) % size;
+    pending--;
+    if (closing)
+    {
+      closing_left--;
+    }
+  }
+}
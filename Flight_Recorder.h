@@ -0,0 +1,114 @@
+/*
+ Rolling flight recorder with triggered capture
+ by:
+ date:
+ license:
+
+ Writing every channel at full rate to the card all the time costs more
+ than it is worth; what matters sits in a few seconds around an event.
+ The recorder keeps the newest records of every channel in a ring in
+ RAM, in the SD_Log record format with the delta to the record before.
+ The oldest record is dropped for each new one, so the ring always holds
+ the last size records, however many seconds that is at the rates the
+ channels run at.
+
+ A trigger, a threshold crossed on any channel or a call to trigger()
+ for a button or the like, freezes the window from pre milliseconds
+ before it to post milliseconds after. drain() hands the window to an
+ SD_Log a block at a time as the card takes it, from the loop, while
+ recording goes on; the ring only refuses new records if the card falls
+ so far behind that the window would be overwritten. A trigger while a
+ window is draining extends it, so a long event is one capture. Every
+ trigger is recorded on RECORDER_CHANNEL_TRIGGER.
+
+ compress() hands the window over instead as Series_Codec blocks, one
+ channel's records to a block, which takes several times fewer blocks
+ than drain() for the steady channels the IMU and the dashboard produce.
+ Each block is one walk from the first record not yet handed on that
+ takes every record of its channel until the block is full, marking them
+ RECORDER_CHANNEL_TAKEN in the ring for the walks after it. It starts
+ once the window has half the ring waiting or has closed, so every
+ channel has seconds of records to a block rather than the few since
+ the last walk.
+
+ A threshold trigger fires when its channel crosses the level, and only
+ arms once the channel was seen on the quiet side, so neither a value
+ held above the level nor one that already was at power up fires again
+ and again.
+ */
+#ifndef flight_recorder_h_
+#define flight_recorder_h_
+
+#include <Arduino.h>
+#include "SD_Log.h"
+#include "Series_Codec.h"
+
+#define RECORDER_TRIGGERS_MAX 16
+#define RECORDER_LATE         250  // milliseconds a record may be stamped before it is appended
+
+// Log channel of a trigger, raw is the index of the threshold or RECORDER_MANUAL
+#define RECORDER_CHANNEL_TRIGGER 0xFF40
+#define RECORDER_MANUAL          0xFF
+
+// Ring channel of a record compress() has handed on
+#define RECORDER_CHANNEL_TAKEN 0xFFFF
+
+// Recorder_Trigger::flags
+#define RECORDER_ABOVE     0x01 // fires when the value goes above level
+#define RECORDER_BELOW     0x02 // fires when the value goes below level
+#define RECORDER_MAGNITUDE 0x04 // compares the value without its sign
+
+typedef struct
+{
+  uint16_t channel; // OBD_Sample::pid or a log channel
+  uint8_t flags;    // RECORDER_*
+  int32_t level;    // in the channel's raw units
+} Recorder_Trigger;
+
+class Flight_Recorder
+{
+  public:
+    Flight_Recorder();
+    void begin(SD_Log_Record* ring, uint16_t size, uint16_t pre, uint16_t post);
+    void watch(const Recorder_Trigger* triggers, byte count);
+    bool append(uint16_t channel, uint32_t timestamp, int32_t raw);
+    void trigger(uint32_t timestamp, byte reason);
+    uint16_t drain(SD_Log* log, uint32_t now, uint16_t max);
+    uint16_t compress(SD_Log* log, uint32_t now);
+    bool capturing();
+    uint32_t span();
+
+    uint32_t records;
+    uint32_t overruns; // records refused because the window had not drained
+    uint32_t captures; // windows written out
+
+  private:
+    void check(uint16_t channel, uint32_t timestamp, int32_t raw);
+    void start(uint32_t timestamp);
+    void close(uint32_t now);
+    bool closed(SD_Log* log);
+    void skipTaken();
+
+    SD_Log_Record* ring;
+    uint16_t size;
+    uint16_t tail;              // oldest record
+    uint16_t count;
+    uint32_t tail_base;         // time of the record before the oldest
+    uint32_t head_time;         // time of the newest record
+    uint16_t pre;
+    uint16_t post;
+    bool active;                // a window is being drained
+    bool closing;               // its end has passed, only closing_left records remain
+    uint16_t pending;           // records from drain_at to the newest
+    uint16_t closing_left;
+    uint16_t drain_at;          // next record of the window to drain
+    uint32_t drain_base;        // time of the record before it
+    uint32_t end;               // last millisecond of the window
+    uint32_t drained_until;     // time of the last record drained, windows do not overlap
+    bool have_drained;
+    const Recorder_Trigger* triggers; // PROGMEM
+    byte trigger_count;
+    uint16_t armed;             // bit per trigger seen on the quiet side
+};
+
+#endif // _flight_recorder_h_
@@ -11,58 +11,250 @@ Ford_OBD::Ford_OBD()
 }
 
 /*
+ Single frame ReadDataByIdentifier request for one DID into the caller's
+ frame data. Returns the DLC.
+*/
+byte Ford_OBD::encodeQuery(uint16_t did, byte* data)
+{
+  memset(data, 0, OBD_FRAME_SIZE);
+  data[0] = 0x03;
+  data[1] = SIDRQ_RDBI;
+  data[2] = did >> 8;
+  data[3] = did;
+
+  return OBD_FRAME_SIZE;
+}
+
+// Data length and scaling of the known DIDs, sorted by DID for lookupDID().
+// Lengths follow the Ford GMRDB definitions; every DID in a multi-DID
+// ReadDataByIdentifier response depends on the lengths before it.
+//        did,                   start, size, length, bitmask, flags, unit, mul, div, offset
+static const Ford_OBD_DID did_dictionary[] PROGMEM = {
+  {FORD_PID_GEAR,       {0, 1, 1, 0xFF, 1, OBD_UNIT_NONE, 501, 100, 0}},              // A*0.501
+  {FORD_PID_TR,         {0, 1, 1, 0xFF, PID_FLAG_HEX, OBD_UNIT_NONE, 1, 1, 0}},
+  {FORD_PID_TRD,        {0, 1, 1, 0xFF, 0, OBD_UNIT_COUNT, 1, 1, 0}},                 // A = Gear
+  {FORD_GMRDB_DID_1E00, {0, 2, 2, 0xFF, PID_FLAG_SIGNED, OBD_UNIT_NM, 1, 1, 0}},
+  {FORD_GMRDB_DID_1E01, {0, 1, 1, 0xFF, PID_FLAG_HEX, OBD_UNIT_NONE, 1, 1, 0}},
+  {FORD_GMRDB_DID_1E02, {0, 2, 2, 0xFF, 0, OBD_UNIT_RPM, 1, 1, 0}},
+  {FORD_GMRDB_DID_1E03, {0, 4, 4, 0xFF, PID_FLAG_HEX, OBD_UNIT_NONE, 1, 1, 0}},
+  {FORD_GMRDB_DID_1E04, {0, 1, 1, 0xFF, PID_FLAG_HEX, OBD_UNIT_NONE, 1, 1, 0}},
+  {FORD_GMRDB_DID_1E09, {0, 1, 1, 0xFF, PID_FLAG_HEX, OBD_UNIT_NONE, 1, 1, 0}},
+  {FORD_GMRDB_DID_1E0A, {0, 2, 2, 0xFF, 0, OBD_UNIT_KPA, 1, 1, 0}},
+  {FORD_GMRDB_DID_1E0B, {0, 1, 1, 0xFF, 1, OBD_UNIT_PERCENT, 1000, 255, 0}},    // A*100/255
+  {FORD_GMRDB_DID_1E0C, {0, 1, 1, 0xFF, PID_FLAG_HEX, OBD_UNIT_NONE, 1, 1, 0}},
+  {FORD_GMRDB_DID_1E0D, {0, 1, 1, 0xFF, PID_FLAG_HEX, OBD_UNIT_NONE, 1, 1, 0}},
+  {FORD_GMRDB_DID_1E0E, {0, 1, 1, 0xFF, PID_FLAG_HEX, OBD_UNIT_NONE, 1, 1, 0}},
+  {FORD_GMRDB_DID_1E0F, {0, 1, 1, 0xFF, PID_FLAG_HEX, OBD_UNIT_NONE, 1, 1, 0}},
+  {FORD_GMRDB_DID_1E10, {0, 1, 1, 0xFF, PID_FLAG_HEX, OBD_UNIT_NONE, 1, 1, 0}},
+  {FORD_GMRDB_DID_1E11, {0, 2, 2, 0xFF, 0, OBD_UNIT_MA, 1, 1, 0}},
+  {FORD_GMRDB_DID_1E12, {0, 1, 1, 0xFF, 0, OBD_UNIT_COUNT, 1, 1, 0}},
+  {FORD_GMRDB_DID_1E13, {0, 2, 2, 0xFF, 2, OBD_UNIT_RPM, 25, 1, 0}},            // ((A*256)+B)/4
+  {FORD_GMRDB_DID_1E14, {0, 2, 2, 0xFF, 2 | PID_FLAG_SIGNED, OBD_UNIT_RPM, 25, 1, 0}},
+  {FORD_GMRDB_DID_1E15, {0, 2, 2, 0xFF, 3, OBD_UNIT_NONE, 1, 1, 0}},            // ((A*256)+B)/1000
+  {FORD_GMRDB_DID_1E16, {0, 2, 2, 0xFF, 3, OBD_UNIT_NONE, 1, 1, 0}},
+  {FORD_GMRDB_DID_1E17, {0, 1, 1, 0xFF, PID_FLAG_HEX, OBD_UNIT_NONE, 1, 1, 0}},
+  {FORD_GMRDB_DID_1E18, {0, 1, 1, 0xFF, PID_FLAG_HEX, OBD_UNIT_NONE, 1, 1, 0}},
+  {FORD_GMRDB_DID_1E19, {0, 2, 2, 0xFF, 3, OBD_UNIT_NONE, 1, 1, 0}},
+  {FORD_GMRDB_DID_1E1A, {0, 2, 2, 0xFF, 0, OBD_UNIT_KPA, 1, 1, 0}},
+  {FORD_GMRDB_DID_1E1B, {0, 2, 2, 0xFF, 2, OBD_UNIT_RPM, 25, 1, 0}},
+  {FORD_GMRDB_DID_1E1C, {0, 2, 2, 0xFF, 1 | PID_FLAG_SIGNED, OBD_UNIT_DEGC, 5, 4, 0}}, // ((A*256)+B)/8
+  {FORD_GMRDB_DID_1E1D, {0, 2, 2, 0xFF, 3, OBD_UNIT_VOLT, 1, 1, 0}},
+  {FORD_GMRDB_DID_1E1F, {0, 1, 1, 0xFF, 0, OBD_UNIT_COUNT, 1, 1, 0}},
+  {FORD_GMRDB_DID_1E21, {0, 1, 1, 0xFF, PID_FLAG_HEX, OBD_UNIT_NONE, 1, 1, 0}},
+  {FORD_GMRDB_DID_1E22, {0, 1, 1, 0xFF, PID_FLAG_HEX, OBD_UNIT_NONE, 1, 1, 0}},
+  {FORD_GMRDB_DID_1E23, {0, 1, 1, 0xFF, PID_FLAG_HEX, OBD_UNIT_NONE, 1, 1, 0}},
+  {FORD_GMRDB_DID_1E24, {0, 1, 1, 0xFF, PID_FLAG_HEX, OBD_UNIT_NONE, 1, 1, 0}},
+  {FORD_GMRDB_DID_1E25, {0, 1, 1, 0xFF, PID_FLAG_HEX, OBD_UNIT_NONE, 1, 1, 0}},
+  {FORD_PID_BPA,        {0, 1, 1, 0xFF, PID_FLAG_HEX, OBD_UNIT_NONE, 1, 1, 0}}
+};
+
+#define DID_DICTIONARY_SIZE (sizeof(did_dictionary) / sizeof(Ford_OBD_DID))
+
+/*
+ Binary search the DID dictionary in flash. Returns false for unknown DIDs.
+*/
+bool Ford_OBD::lookupDID(uint16_t did, Ford_OBD_DID* desc)
+{
+  byte low = 0;
+  byte high = DID_DICTIONARY_SIZE;
+
+  while (low < high)
+  {
+    byte mid = (low + high) / 2;
+    uint16_t mid_did = pgm_read_word(&did_dictionary[mid].did);
+
+    if (mid_did == did)
+    {
+      memcpy_P(desc, &did_dictionary[mid], sizeof(Ford_OBD_DID));
+      return true;
+    }
+    else if (mid_did < did)
+    {
+      low = mid + 1;
+    }
+    else
+    {
+      high = mid;
+    }
+  }
+
+  return false;
+}
+
+/*
+ Scale the data record of a DID, where data[0] is the first byte after the DID.
+*/
+void Ford_OBD::scaleDID(const Ford_OBD_DID* desc, const byte* data, uint32_t timestamp, OBD_Sample* sample)
+{
+  sample->timestamp = timestamp;
+  sample->pid = desc->did;
+  sample->raw = WWH_OBD::extractPID(&desc->field, data);
+
+  if (desc->field.flags & PID_FLAG_HEX)
+  {
+    sample->value = sample->raw;
+    sample->unit = OBD_UNIT_BITS;
+    sample->decimals = 0;
+    sample->digits = desc->field.size * 2;
+  }
+  else
+  {
+    sample->value = WWH_OBD::scalePID(&desc->field, sample->raw);
+    sample->unit = desc->field.unit;
+    sample->decimals = desc->field.flags & PID_FLAG_DECIMALS;
+    sample->digits = 0;
+  }
+}
+
+/*
+ Decode a single frame ReadDataByIdentifier response into a sample without
+ any text formatting. Returns false for negative responses and unknown DIDs.
+*/
+bool Ford_OBD::decodeSample(const byte* data, uint32_t timestamp, OBD_Sample* sample)
+{
+  Ford_OBD_DID desc;
+
+  if ((data[1] != SIDPR_RDBI) || (lookupDID((data[2] << 8) + data[3], &desc) == false))
+  {
+    return false;
+  }
+
+  scaleDID(&desc, data + 4, timestamp, sample);
+
+  return true;
+}
+
+/*
+ ReadDataByIdentifier request payload for a group of DIDs, SID first.
+ Returns its length; more than three DIDs need a multi-frame request.
+*/
+byte Ford_OBD::encodeGroup(const uint16_t* dids, byte count, byte* payload)
+{
+  byte length = 0;
+
+  if (count > FORD_GROUP_MAX)
+  {
+    count = FORD_GROUP_MAX;
+  }
+
+  payload[length++] = SIDRQ_RDBI;
+  for (byte i = 0; i < count; i++)
+  {
+    payload[length++] = dids[i] >> 8;
+    payload[length++] = dids[i];
+  }
+
+  return length;
+}
 
+/*
+ Split a multi-DID ReadDataByIdentifier response payload, starting at the
+ response SID, into one sample per DID. Every record length comes from the
+ dictionary, so decoding stops at the first unknown DID. Returns the number
+ of samples written.
 */
-byte* Ford_OBD::encodeQuery(uint16_t pid)
+byte Ford_OBD::decodeGroup(const byte* payload, uint16_t length, uint32_t timestamp, OBD_Sample* samples, byte max)
 {
-  byte J1979_data[] = {0x03, 0x22, pid , 0x00, 0x00, 0x00, 0x00, 0x00};
-  //  CAN1.send(ID_REQUEST, stdID, 8, J1979_data);
-  return J1979_data;
+  Ford_OBD_DID desc;
+  byte count = 0;
+  uint16_t i = 1;
+
+  if ((length < 3) || (payload[0] != SIDPR_RDBI))
+  {
+    return 0;
+  }
+
+  while ((i + 2 <= length) && (count < max))
+  {
+    if ((lookupDID((payload[i] << 8) + payload[i + 1], &desc) == false) ||
+        (i + 2 + desc.field.length > length))
+    {
+      break;
+    }
+
+    scaleDID(&desc, payload + i + 2, timestamp, &samples[count++]);
+    i += 2 + desc.field.length;
+  }
+
+  return count;
 }
 
 /*
+ Copy the transmission DIDs found among samples into state. Returns the
+ FORD_TRANS_* bits filled; fields not in the snapshot keep their value.
+*/
+byte Ford_OBD::updateTransState(const OBD_Sample* samples, byte count, Ford_Trans_State* state)
+{
+  byte filled = 0;
+
+  for (byte i = 0; i < count; i++)
+  {
+    switch (samples[i].pid)
+    {
+      case FORD_GMRDB_DID_1E00:
+        state->engine_torque = samples[i].value;
+        filled |= FORD_TRANS_TORQUE;
+        break;
+      case FORD_GMRDB_DID_1E03:
+        state->shifter_status = samples[i].raw;
+        filled |= FORD_TRANS_SHIFTER;
+        break;
+      case FORD_GMRDB_DID_1E12:
+        state->gear_commanded = samples[i].value;
+        filled |= FORD_TRANS_GEAR_C;
+        break;
+      case FORD_GMRDB_DID_1E1F:
+        state->gear_engaged = samples[i].value;
+        filled |= FORD_TRANS_GEAR_E;
+        break;
+    }
+
+    state->timestamp = samples[i].timestamp;
+  }
+
+  state->valid = filled;
+
+  return filled;
+}
 
+/*
+ Decode a ReadDataByIdentifier response frame and append the value to text.
 */
 uint16_t Ford_OBD::decodePID(byte* data, char* text)
 {
   byte decode_buffer_size = 17;
-  byte additional_data_bytes = data[0];
   uint16_t pid = ((data[2] << 8) + data[3]);
   char decode_buffer[decode_buffer_size];
-  double decode_double;
-  float decode_float;
-  int decode_int;
+  OBD_Sample sample;
 
-  switch (pid)
+  if (decodeSample(data, 0, &sample))
   {
-    case FORD_PID_GEAR:
-      // (A*0.501) = 0-127
-      decode_int = data[4] * 0.501;
-      //sprintf(decode_buffer, "%5.2fRPM", decode_float);
-      dtostrf(decode_float, 5, 2, decode_buffer);
-      strlcat(decode_buffer, "RPM", decode_buffer_size);
-      break;
-
-    case FORD_PID_TRD:
-      // A = Gear
-      decode_int = data[4];
-      snprintf(decode_buffer, decode_buffer_size, "%d", decode_int);
-      break;
-
-    default:
-      // Print out all the data
-      decode_buffer[0] = 0;
-      for (byte i = 0; i < 8; i++)
-      {
-        char temp_buffer[3] = {0};
-        if (data[i] < 0x10)                                 // If the data is less than 10 hex it will assign a zero to the front as leading zeros are ignored...
-        {
-          strlcat(decode_buffer, "0", decode_buffer_size);
-        }
-        snprintf(temp_buffer, 3, "%X", data[i]);
-        strlcat(decode_buffer, temp_buffer, decode_buffer_size);
-      }
-      break;
+    formatSample(&sample, decode_buffer);
+  }
+  else
+  {
+    // Print out all the data
+    formatHex(data, 8, decode_buffer);
   }
 
   // Use strlcat instead of strlcpy to allow for building up a string with multiple calls.
@@ -70,4 +262,3 @@ uint16_t Ford_OBD::decodePID(byte* data, char* text)
 
   return pid;
 }
-
@@ -33,7 +33,8 @@
 #define ford_obd_h_
 
 #include <Arduino.h>
-//#include "WWH_OBD.h"
+#include "OBD_Sample.h"
+#include "WWH_OBD.h"
 
 #define FORD_PID_BPA 0xA211  // BRAKE PRESSURE APPLIED SWITCH
 #define FORD_PID_GEAR 0x11B3 // TRANSIMISSION GEAR STATUS NUMBER
@@ -77,12 +78,46 @@
 #define FORD_GMRDB_DID_1E24  0x1E24 // Torque Converter Lockup State - Measured
 #define FORD_GMRDB_DID_1E25  0x1E25 // Torque Converter Lockup State
 
+// Scaling of a Ford DID, reusing the J1979 field description
+typedef struct
+{
+  uint16_t did;
+  WWH_OBD_PID field;
+} Ford_OBD_DID;
+
+// ISO 14229-1 allows several DIDs in one ReadDataByIdentifier request; the
+// response carries each DID followed by its data record, in request order
+#define FORD_GROUP_MAX 8 // DIDs in one snapshot request
+
+// Ford_Trans_State::valid
+#define FORD_TRANS_TORQUE  0x01
+#define FORD_TRANS_SHIFTER 0x02
+#define FORD_TRANS_GEAR_C  0x04
+#define FORD_TRANS_GEAR_E  0x08
+
+// Transmission state from one multi-DID snapshot
+typedef struct
+{
+  uint32_t timestamp;      // of the response
+  int16_t engine_torque;   // FORD_GMRDB_DID_1E00, Nm
+  uint32_t shifter_status; // FORD_GMRDB_DID_1E03, bit mapped
+  uint8_t gear_commanded;  // FORD_GMRDB_DID_1E12
+  uint8_t gear_engaged;    // FORD_GMRDB_DID_1E1F
+  uint8_t valid;           // FORD_TRANS_* filled by the last snapshot
+} Ford_Trans_State;
+
 class Ford_OBD
 {
   public:
     Ford_OBD();
     uint16_t decodePID(byte* data, char* text);
-    byte* encodeQuery(uint16_t pid);
+    bool decodeSample(const byte* data, uint32_t timestamp, OBD_Sample* sample);
+    static byte encodeQuery(uint16_t did, byte* data);
+    static byte encodeGroup(const uint16_t* dids, byte count, byte* payload);
+    static byte decodeGroup(const byte* payload, uint16_t length, uint32_t timestamp, OBD_Sample* samples, byte max);
+    static byte updateTransState(const OBD_Sample* samples, byte count, Ford_Trans_State* state);
+    static bool lookupDID(uint16_t did, Ford_OBD_DID* desc);
+    static void scaleDID(const Ford_OBD_DID* desc, const byte* data, uint32_t timestamp, OBD_Sample* sample);
 
   private:
 };
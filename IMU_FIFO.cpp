@@ -0,0 +1,279 @@
+/*
+ Accelerometer, gyro and magnetometer read in batches from their FIFOs
+ by:
+ date:
+ license:
+ */
+
+#include <Wire.h>
+#include "IMU_FIFO.h"
+
+#define IMU_ENTRY_SIZE 6                                  // X, Y, Z, 16 bits each
+#define IMU_GYRO_BURST (IMU_WIRE_BUFFER / IMU_ENTRY_SIZE) // entries per read
+
+/*
+
+*/
+IMU_FIFO::IMU_FIFO()
+{
+  transactions = 0;
+  overruns = 0;
+  present = 0;
+  next_batch = 0;
+  next_mag = 0;
+  batch_time = 0;
+  accel_count = 0;
+  accel_read = 0;
+  gyro_count = 0;
+  gyro_read = 0;
+}
+
+/*
+ Set the sensors to sample continuously, the ADXL345 and L3GD20 into
+ their FIFOs in stream mode, where a full FIFO drops its oldest entry.
+ Returns the sensors that answered; the others are left alone by read().
+*/
+byte IMU_FIFO::begin()
+{
+  present = 0;
+
+  // 200 Hz, full resolution +-16 g, 3.9 mg per count
+  if (writeRegister(ADXL345_ADDRESS, ADXL345_BW_RATE, 0x0B))
+  {
+    writeRegister(ADXL345_ADDRESS, ADXL345_DATA_FORMAT, 0x0B);
+    writeRegister(ADXL345_ADDRESS, ADXL345_FIFO_CTL, 0x80);
+    writeRegister(ADXL345_ADDRESS, ADXL345_POWER_CTL, 0x08);
+    present |= IMU_ACCEL;
+  }
+
+  // 190 Hz with a 25 Hz cutoff, 500 dps, 17.5 mdps per count
+  if (writeRegister(L3GD20_ADDRESS, L3GD20_CTRL_REG1, 0x5F))
+  {
+    writeRegister(L3GD20_ADDRESS, L3GD20_CTRL_REG4, 0x10);
+    writeRegister(L3GD20_ADDRESS, L3GD20_CTRL_REG5, 0x40);
+    writeRegister(L3GD20_ADDRESS, L3GD20_FIFO_CTRL_REG, 0x40);
+    present |= IMU_GYRO;
+  }
+
+  // 30 Hz, 1.3 Gauss range, 1090 counts per Gauss, continuous
+  if (writeRegister(HMC5883_ADDRESS, HMC5883_CRA, 0x14))
+  {
+    writeRegister(HMC5883_ADDRESS, HMC5883_CRB, 0x20);
+    writeRegister(HMC5883_ADDRESS, HMC5883_MODE, 0x00);
+    present |= IMU_MAG;
+  }
+
+  return present;
+}
+
+/*
+ Up to max samples of the current batch, starting a new batch when one is
+ due, or a magnetometer sample when that is due. Returns 0 once the batch
+ is collected and nothing else is due yet.
+*/
+byte IMU_FIFO::read(uint32_t now, IMU_Sample* samples, byte max)
+{
+  if ((present & IMU_MAG) && ((int32_t)(now - next_mag) >= 0))
+  {
+    next_mag = now + IMU_MAG_PERIOD;
+    return readMag(now, samples);
+  }
+
+  if ((gyro_read >= gyro_count) && (accel_read >= accel_count))
+  {
+    if ((int32_t)(now - next_batch) < 0)
+    {
+      return 0;
+    }
+    startBatch(now);
+  }
+
+  if (gyro_read < gyro_count)
+  {
+    return readGyro(samples, max);
+  }
+  if (accel_read < accel_count)
+  {
+    return readAccel(samples, max);
+  }
+
+  return 0;
+}
+
+/*
+ Read how many entries each FIFO holds; only these are collected, what
+ arrives meanwhile waits for the next batch. The newest entry was taken
+ half a sample period before on average, which is where its timestamp
+ goes.
+*/
+void IMU_FIFO::startBatch(uint32_t now)
+{
+  byte status;
+
+  batch_time = now;
+  next_batch = now + IMU_BATCH_PERIOD;
+  accel_count = 0;
+  accel_read = 0;
+  gyro_count = 0;
+  gyro_read = 0;
+
+  if ((present & IMU_GYRO) && (readRegisters(L3GD20_ADDRESS, L3GD20_FIFO_SRC_REG, &status, 1) == 1))
+  {
+    // FSS counts to 31, OVRN marks the 32nd
+    gyro_count = status & 0x1F;
+    if (status & 0x40)
+    {
+      gyro_count = 32;
+      overruns++;
+    }
+  }
+
+  if ((present & IMU_ACCEL) && (readRegisters(ADXL345_ADDRESS, ADXL345_FIFO_STATUS, &status, 1) == 1))
+  {
+    accel_count = status & 0x3F;
+    if (accel_count >= 32)
+    {
+      overruns++;
+    }
+  }
+}
+
+/*
+ Gyro entries, IMU_GYRO_BURST per transaction.
+*/
+byte IMU_FIFO::readGyro(IMU_Sample* samples, byte max)
+{
+  byte data[IMU_GYRO_BURST * IMU_ENTRY_SIZE];
+  byte count = gyro_count - gyro_read;
+  byte i;
+
+  if (count > IMU_GYRO_BURST)
+  {
+    count = IMU_GYRO_BURST;
+  }
+  if (count > max)
+  {
+    count = max;
+  }
+
+  count = readRegisters(L3GD20_ADDRESS, L3GD20_OUT_X_L | L3GD20_AUTO_INCREMENT, data,
+                        count * IMU_ENTRY_SIZE) / IMU_ENTRY_SIZE;
+
+  for (i = 0; i < count; i++)
+  {
+    const byte* entry = &data[i * IMU_ENTRY_SIZE];
+    byte newer = gyro_count - 1 - gyro_read;
+
+    samples[i].timestamp = batch_time - ((uint32_t)newer * IMU_GYRO_US + IMU_GYRO_US / 2) / 1000;
+    samples[i].channel = IMU_CHANNEL_GYRO;
+    for (byte axis = 0; axis < 3; axis++)
+    {
+      int16_t raw = entry[2 * axis] | (entry[2 * axis + 1] << 8);
+      samples[i].axis[axis] = (int32_t)raw * 35 / 2;
+    }
+    gyro_read++;
+  }
+
+  // Give up on a failed read, the entries stay in the FIFO for the next batch
+  if (count == 0)
+  {
+    gyro_read = gyro_count;
+  }
+
+  return count;
+}
+
+/*
+ Accelerometer entries, one transaction each.
+*/
+byte IMU_FIFO::readAccel(IMU_Sample* samples, byte max)
+{
+  byte data[IMU_ENTRY_SIZE];
+  byte count = 0;
+
+  while ((accel_read < accel_count) && (count < max))
+  {
+    byte newer = accel_count - 1 - accel_read;
+
+    if (readRegisters(ADXL345_ADDRESS, ADXL345_DATAX0, data, IMU_ENTRY_SIZE) != IMU_ENTRY_SIZE)
+    {
+      accel_read = accel_count;
+      break;
+    }
+
+    samples[count].timestamp = batch_time - ((uint32_t)newer * IMU_ACCEL_US + IMU_ACCEL_US / 2) / 1000;
+    samples[count].channel = IMU_CHANNEL_ACCEL;
+    for (byte axis = 0; axis < 3; axis++)
+    {
+      int16_t raw = data[2 * axis] | (data[2 * axis + 1] << 8);
+      samples[count].axis[axis] = (int32_t)raw * 125 / 32;
+    }
+    accel_read++;
+    count++;
+  }
+
+  return count;
+}
+
+/*
+ The latest magnetometer sample, its registers are X, Z, Y.
+*/
+byte IMU_FIFO::readMag(uint32_t now, IMU_Sample* samples)
+{
+  static const byte order[3] = {0, 2, 1};
+  byte data[IMU_ENTRY_SIZE];
+
+  if (readRegisters(HMC5883_ADDRESS, HMC5883_DATA, data, IMU_ENTRY_SIZE) != IMU_ENTRY_SIZE)
+  {
+    return 0;
+  }
+
+  samples[0].timestamp = now;
+  samples[0].channel = IMU_CHANNEL_MAG;
+  for (byte axis = 0; axis < 3; axis++)
+  {
+    const byte* value = &data[2 * order[axis]];
+    int16_t raw = (value[0] << 8) | value[1];
+    samples[0].axis[axis] = (int32_t)raw * 100 / 109;
+  }
+
+  return 1;
+}
+
+/*
+
+*/
+bool IMU_FIFO::writeRegister(byte address, byte reg, byte value)
+{
+  transactions++;
+  Wire.beginTransmission(address);
+  Wire.write(reg);
+  Wire.write(value);
+
+  return Wire.endTransmission() == 0;
+}
+
+/*
+ Read length bytes from reg on, at most IMU_WIRE_BUFFER. Returns the
+ number of bytes received.
+*/
+byte IMU_FIFO::readRegisters(byte address, byte reg, byte* data, byte length)
+{
+  byte received = 0;
+
+  transactions += 2;
+  Wire.beginTransmission(address);
+  Wire.write(reg);
+  if (Wire.endTransmission(false) != 0)
+  {
+    return 0;
+  }
+
+  Wire.requestFrom(address, length);
+  while (Wire.available() && (received < length))
+  {
+    data[received++] = Wire.read();
+  }
+
+  return received;
+}
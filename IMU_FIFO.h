@@ -0,0 +1,105 @@
+/*
+ Accelerometer, gyro and magnetometer read in batches from their FIFOs
+ by:
+ date:
+ license:
+
+ The ADXL345 and L3GD20 sample on their own clocks into 32 entry FIFOs,
+ so the sketch does not have to poll them at their sample rate. Every
+ IMU_BATCH_PERIOD the fill levels are read and the entries collected
+ over the next calls to read(), a few transactions at a time so a batch
+ never holds up the loop for long. The L3GD20 wraps its address from the
+ last output register back to the first while its FIFO is on, so one
+ read takes up to five entries, as many as fit the 32 byte buffer of the
+ Wire library. The ADXL345 only moves to the next entry after a read
+ ends, one transaction per entry. The HMC5883L has no FIFO and is read
+ on its own, once per sample it makes.
+
+ An entry's time is counted back from when the fill level was read, one
+ sample period per newer entry, on the millis() clock the CAN frames
+ are stamped with. Values come out in integer units, mg, mdps and mG, on
+ the sensors' own axes.
+ */
+#ifndef imu_fifo_h_
+#define imu_fifo_h_
+
+#include <Arduino.h>
+
+#define IMU_WIRE_BUFFER  32  // BUFFER_LENGTH of the AVR Wire library
+#define IMU_BATCH_PERIOD 50  // milliseconds between fill level reads, the FIFOs last 160
+#define IMU_ACCEL_US     5000 // 200 Hz
+#define IMU_GYRO_US      5263 // 190 Hz
+#define IMU_MAG_PERIOD   34  // milliseconds, a little slower than its 30 Hz
+
+// IMU_FIFO::begin()
+#define IMU_ACCEL 0x01
+#define IMU_GYRO  0x02
+#define IMU_MAG   0x04
+
+// ADXL345, SDO low
+#define ADXL345_ADDRESS     0x53
+#define ADXL345_BW_RATE     0x2C
+#define ADXL345_POWER_CTL   0x2D
+#define ADXL345_DATA_FORMAT 0x31
+#define ADXL345_DATAX0      0x32
+#define ADXL345_FIFO_CTL    0x38
+#define ADXL345_FIFO_STATUS 0x39
+
+// L3GD20, SA0 high
+#define L3GD20_ADDRESS       0x6B
+#define L3GD20_CTRL_REG1     0x20
+#define L3GD20_CTRL_REG4     0x23
+#define L3GD20_CTRL_REG5     0x24
+#define L3GD20_OUT_X_L       0x28
+#define L3GD20_FIFO_CTRL_REG 0x2E
+#define L3GD20_FIFO_SRC_REG  0x2F
+#define L3GD20_AUTO_INCREMENT 0x80 // set in the register address
+
+// HMC5883L
+#define HMC5883_ADDRESS 0x1E
+#define HMC5883_CRA     0x00
+#define HMC5883_CRB     0x01
+#define HMC5883_MODE    0x02
+#define HMC5883_DATA    0x03 // X, Z, Y, high byte first
+
+// Log channels, X, Y and Z of each sensor, after the GPS
+#define IMU_CHANNEL_ACCEL 0xFF10 // mg
+#define IMU_CHANNEL_GYRO  0xFF13 // mdps
+#define IMU_CHANNEL_MAG   0xFF16 // mG
+
+typedef struct
+{
+  uint32_t timestamp;
+  uint16_t channel;   // IMU_CHANNEL_*, the channel of the X axis
+  int32_t axis[3];    // X, Y, Z
+} IMU_Sample;
+
+class IMU_FIFO
+{
+  public:
+    IMU_FIFO();
+    byte begin();
+    byte read(uint32_t now, IMU_Sample* samples, byte max);
+
+    uint32_t transactions;
+    uint32_t overruns;    // a FIFO was found full, older entries may be lost
+
+  private:
+    void startBatch(uint32_t now);
+    byte readGyro(IMU_Sample* samples, byte max);
+    byte readAccel(IMU_Sample* samples, byte max);
+    byte readMag(uint32_t now, IMU_Sample* samples);
+    bool writeRegister(byte address, byte reg, byte value);
+    byte readRegisters(byte address, byte reg, byte* data, byte length);
+
+    byte present;        // IMU_ACCEL, IMU_GYRO and IMU_MAG that answered
+    uint32_t next_batch;
+    uint32_t next_mag;
+    uint32_t batch_time; // when the fill levels were read
+    byte accel_count;    // entries in this batch
+    byte accel_read;
+    byte gyro_count;
+    byte gyro_read;
+};
+
+#endif // _imu_fifo_h_
@@ -0,0 +1,356 @@
+/*
+ ISO 15765-2 Transport Layer (ISO-TP, DoCAN)
+ by:
+ date:
+ license:
+ */
+
+#include "ISO_TP.h"
+
+// ISO_TP::tx_state
+#define ISO_TP_TX_IDLE 0
+#define ISO_TP_TX_SF   1 // single frame waiting for transmit()
+#define ISO_TP_TX_FF   2 // first frame waiting for transmit()
+#define ISO_TP_TX_WAIT 3 // waiting for flow control
+#define ISO_TP_TX_CF   4 // sending consecutive frames
+
+// ISO 15765-4:2011 - the physical request identifier of an ECU is its
+// response identifier minus 8
+#define ISO_TP_FC_ID(id) ((id) - (ID_REPLY_1 - ID_REQUEST_1))
+
+/*
+
+*/
+ISO_TP::ISO_TP()
+{
+  for (byte i = 0; i < ISO_TP_CHANNELS; i++)
+  {
+    channels[i].id = 0;
+    channels[i].flow = false;
+  }
+
+  tx_state = ISO_TP_TX_IDLE;
+  errors = 0;
+  overflows = 0;
+  timeouts = 0;
+}
+
+/*
+ Feed a received frame. When a message completes, payload and length
+ point at it in place and ISO_TP_RX_COMPLETE is returned.
+*/
+byte ISO_TP::receive(const OBD_Frame* frame, uint32_t now, const byte** payload, uint16_t* length)
+{
+  ISO_TP_Channel* rx;
+  byte count;
+
+  if ((frame->id < ID_REPLY_1) || (frame->id > ID_REPLY_8) || (frame->length < 1))
+  {
+    return ISO_TP_RX_NONE;
+  }
+
+  switch (frame->data[0] & 0xF0)
+  {
+    case ISO_TP_PCI_SF:
+      count = frame->data[0] & 0x0F;
+      if ((count == 0) || (count >= frame->length))
+      {
+        errors++;
+        return ISO_TP_RX_ERROR;
+      }
+      *payload = frame->data + 1;
+      *length = count;
+      return ISO_TP_RX_COMPLETE;
+
+    case ISO_TP_PCI_FF:
+      rx = channel(frame->id, true);
+      if (rx == 0)
+      {
+        overflows++;
+        return ISO_TP_RX_ERROR;
+      }
+      rx->length = ((frame->data[0] & 0x0F) << 8) + frame->data[1];
+      if ((rx->length <= OBD_SF_PAYLOAD) || (frame->length < 8))
+      {
+        rx->id = 0;
+        errors++;
+        return ISO_TP_RX_ERROR;
+      }
+      // An oversized message is refused with an overflow flow control
+      memcpy(rx->data, frame->data + 2, 6);
+      rx->received = 6;
+      rx->sequence = 1;
+      rx->block = ISO_TP_BS;
+      rx->deadline = now + ISO_TP_N_CR;
+      rx->flow = true;
+      return ISO_TP_RX_PARTIAL;
+
+    case ISO_TP_PCI_CF:
+      rx = channel(frame->id, false);
+      if ((rx == 0) || (rx->length > ISO_TP_BUF_SIZE))
+      {
+        return ISO_TP_RX_NONE;
+      }
+      if ((frame->data[0] & 0x0F) != rx->sequence)
+      {
+        rx->id = 0;
+        errors++;
+        return ISO_TP_RX_ERROR;
+      }
+      count = rx->length - rx->received;
+      if (count > 7)
+      {
+        count = 7;
+      }
+      if (count >= frame->length)
+      {
+        count = frame->length - 1;
+      }
+      memcpy(rx->data + rx->received, frame->data + 1, count);
+      rx->received += count;
+      rx->sequence = (rx->sequence + 1) & 0x0F;
+      rx->deadline = now + ISO_TP_N_CR;
+
+      if (rx->received >= rx->length)
+      {
+        // The buffer stays valid until the next first frame is received
+        rx->id = 0;
+        *payload = rx->data;
+        *length = rx->length;
+        return ISO_TP_RX_COMPLETE;
+      }
+
+      if ((ISO_TP_BS != 0) && (--rx->block == 0))
+      {
+        rx->block = ISO_TP_BS;
+        rx->flow = true;
+      }
+      return ISO_TP_RX_PARTIAL;
+
+    case ISO_TP_PCI_FC:
+      if ((tx_state == ISO_TP_TX_IDLE) || (frame->id != tx_id + (ID_REPLY_1 - ID_REQUEST_1)))
+      {
+        return ISO_TP_RX_NONE;
+      }
+      flowControl(now, frame->data);
+      return ISO_TP_RX_FLOW;
+  }
+
+  return ISO_TP_RX_NONE;
+}
+
+/*
+ Start sending a message. Anything longer than a single frame has to be
+ physically addressed. The payload is not copied and has to stay valid
+ until busy() returns false.
+*/
+bool ISO_TP::send(uint32_t id, const byte* payload, uint16_t length)
+{
+  if ((tx_state != ISO_TP_TX_IDLE) || (length == 0) || (length > 0x0FFF) ||
+      ((length > OBD_SF_PAYLOAD) && (id == ID_REQUEST)))
+  {
+    return false;
+  }
+
+  tx_id = id;
+  tx_data = payload;
+  tx_length = length;
+  tx_offset = 0;
+  tx_state = (length > OBD_SF_PAYLOAD) ? ISO_TP_TX_FF : ISO_TP_TX_SF;
+
+  return true;
+}
+
+/*
+ Next frame to put on the bus: pending flow controls first, then the
+ message being sent. Returns false if nothing is due right now.
+*/
+bool ISO_TP::transmit(uint32_t now, OBD_Frame* frame)
+{
+  byte count;
+
+  for (byte i = 0; i < ISO_TP_CHANNELS; i++)
+  {
+    if (channels[i].flow)
+    {
+      pad(frame, ISO_TP_FC_ID(channels[i].id), now);
+      channels[i].flow = false;
+
+      if (channels[i].length > ISO_TP_BUF_SIZE)
+      {
+        frame->data[0] = ISO_TP_PCI_FC | ISO_TP_FS_OVFLW;
+        channels[i].id = 0;
+        overflows++;
+      }
+      else
+      {
+        frame->data[0] = ISO_TP_PCI_FC | ISO_TP_FS_CTS;
+        frame->data[1] = ISO_TP_BS;
+        frame->data[2] = ISO_TP_STMIN;
+      }
+      return true;
+    }
+  }
+
+  switch (tx_state)
+  {
+    case ISO_TP_TX_SF:
+      pad(frame, tx_id, now);
+      frame->data[0] = ISO_TP_PCI_SF | tx_length;
+      memcpy(frame->data + 1, tx_data, tx_length);
+      tx_state = ISO_TP_TX_IDLE;
+      return true;
+
+    case ISO_TP_TX_FF:
+      pad(frame, tx_id, now);
+      frame->data[0] = ISO_TP_PCI_FF | (tx_length >> 8);
+      frame->data[1] = tx_length;
+      memcpy(frame->data + 2, tx_data, 6);
+      tx_offset = 6;
+      tx_sequence = 1;
+      tx_deadline = now + ISO_TP_N_BS;
+      tx_state = ISO_TP_TX_WAIT;
+      return true;
+
+    case ISO_TP_TX_CF:
+      if ((int32_t)(now - tx_deadline) < 0)
+      {
+        return false;
+      }
+      count = tx_length - tx_offset;
+      if (count > 7)
+      {
+        count = 7;
+      }
+      pad(frame, tx_id, now);
+      frame->data[0] = ISO_TP_PCI_CF | tx_sequence;
+      memcpy(frame->data + 1, tx_data + tx_offset, count);
+      tx_offset += count;
+      tx_sequence = (tx_sequence + 1) & 0x0F;
+      tx_deadline = now + tx_stmin;
+
+      if (tx_offset >= tx_length)
+      {
+        tx_state = ISO_TP_TX_IDLE;
+      }
+      else if ((tx_block != 0) && (--tx_block == 0))
+      {
+        tx_deadline = now + ISO_TP_N_BS;
+        tx_state = ISO_TP_TX_WAIT;
+      }
+      return true;
+  }
+
+  return false;
+}
+
+/*
+ Abandon reassembly and transmission that ran past N_Cr or N_Bs.
+*/
+void ISO_TP::expire(uint32_t now)
+{
+  for (byte i = 0; i < ISO_TP_CHANNELS; i++)
+  {
+    if ((channels[i].id != 0) && ((int32_t)(now - channels[i].deadline) >= 0))
+    {
+      channels[i].id = 0;
+      channels[i].flow = false;
+      timeouts++;
+    }
+  }
+
+  if ((tx_state == ISO_TP_TX_WAIT) && ((int32_t)(now - tx_deadline) >= 0))
+  {
+    tx_state = ISO_TP_TX_IDLE;
+    timeouts++;
+  }
+}
+
+/*
+ True while a message is being sent.
+*/
+bool ISO_TP::busy()
+{
+  return (tx_state != ISO_TP_TX_IDLE);
+}
+
+/*
+ Channel receiving from id. A new first frame restarts the channel of its
+ ECU, or takes a free one.
+*/
+ISO_TP_Channel* ISO_TP::channel(uint32_t id, bool allocate)
+{
+  ISO_TP_Channel* free_channel = 0;
+
+  for (byte i = 0; i < ISO_TP_CHANNELS; i++)
+  {
+    if (channels[i].id == id)
+    {
+      return &channels[i];
+    }
+    if ((channels[i].id == 0) && (channels[i].flow == false) && (free_channel == 0))
+    {
+      free_channel = &channels[i];
+    }
+  }
+
+  if (allocate && (free_channel != 0))
+  {
+    free_channel->id = id;
+  }
+
+  return allocate ? free_channel : 0;
+}
+
+/*
+ Apply a flow control from the ECU we are sending to.
+*/
+void ISO_TP::flowControl(uint32_t now, const byte* data)
+{
+  if (tx_state != ISO_TP_TX_WAIT)
+  {
+    return;
+  }
+
+  switch (data[0] & 0x0F)
+  {
+    case ISO_TP_FS_CTS:
+      tx_block = data[1];
+      // 0xF1 - 0xF9 are 100 - 900 microseconds, round up to a millisecond
+      if (data[2] <= 0x7F)
+      {
+        tx_stmin = data[2];
+      }
+      else if ((data[2] >= 0xF1) && (data[2] <= 0xF9))
+      {
+        tx_stmin = 1;
+      }
+      else
+      {
+        tx_stmin = 0x7F;
+      }
+      tx_deadline = now;
+      tx_state = ISO_TP_TX_CF;
+      break;
+
+    case ISO_TP_FS_WAIT:
+      tx_deadline = now + ISO_TP_N_BS;
+      break;
+
+    default:
+      tx_state = ISO_TP_TX_IDLE;
+      overflows++;
+      break;
+  }
+}
+
+/*
+ Start a frame with DLC 8 and zero padding as ISO 15765-4 requires.
+*/
+void ISO_TP::pad(OBD_Frame* frame, uint32_t id, uint32_t now)
+{
+  frame->id = id;
+  frame->timestamp = now;
+  frame->length = 8;
+  memset(frame->data, 0, sizeof(frame->data));
+}
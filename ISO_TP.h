@@ -0,0 +1,116 @@
+/*
+ ISO 15765-2 Transport Layer (ISO-TP, DoCAN)
+ by:
+ date:
+ license:
+
+ Segments and reassembles diagnostic messages that do not fit a single
+ CAN frame, such as the Service $09 VIN, batched Service $01 replies and
+ multi-DID UDS ReadDataByIdentifier replies.
+
+ Reassembly uses a fixed pool of ISO_TP_CHANNELS buffers, one per ECU
+ talking at the same time, so nothing is allocated at run time. Completed
+ payloads are handed to the caller in place: a single frame payload
+ points into the received frame, a multi-frame payload into its channel
+ buffer, which stays valid until the next first frame is received.
+
+ ISO 15765-2 Definitions:
+ SF = Single Frame
+ FF = First Frame
+ CF = Consecutive Frame
+ FC = Flow Control
+ BS = Block Size
+ SN = Sequence Number
+ STmin = Separation Time minimum
+ */
+#ifndef iso_tp_h_
+#define iso_tp_h_
+
+#include <Arduino.h>
+#include "OBD_Frame.h"
+#include "WWH_OBD.h"
+
+// Reassembly buffers, one per ECU answering at the same time
+#if defined(ARDUINO_ARCH_AVR)
+#define ISO_TP_CHANNELS 2
+#else
+#define ISO_TP_CHANNELS 8
+#endif
+#define ISO_TP_BUF_SIZE OBD_RECV_BUF_SIZE
+
+// ISO 15765-2:2011
+// Flow control we send as a receiver. No further flow control and no
+// separation time lets the ECU send as fast as it can.
+#define ISO_TP_BS    0x00
+#define ISO_TP_STMIN 0x00
+
+// ISO 15765-4:2011
+// Network layer timing for legislated OBD
+#define ISO_TP_N_BS 75  // milliseconds waiting for a flow control
+#define ISO_TP_N_CR 150 // milliseconds waiting for a consecutive frame
+
+// ISO 15765-2:2011
+// N_PCItype
+#define ISO_TP_PCI_SF 0x00
+#define ISO_TP_PCI_FF 0x10
+#define ISO_TP_PCI_CF 0x20
+#define ISO_TP_PCI_FC 0x30
+
+// FlowStatus
+#define ISO_TP_FS_CTS    0x00 // ContinueToSend
+#define ISO_TP_FS_WAIT   0x01 // Wait
+#define ISO_TP_FS_OVFLW  0x02 // Overflow
+
+// Result of ISO_TP::receive()
+#define ISO_TP_RX_NONE     0 // not a diagnostic frame for us
+#define ISO_TP_RX_COMPLETE 1 // payload ready
+#define ISO_TP_RX_PARTIAL  2 // first or consecutive frame consumed
+#define ISO_TP_RX_FLOW     3 // flow control consumed by the transmitter
+#define ISO_TP_RX_ERROR    4 // wrong sequence number, overflow or no free channel
+
+typedef struct
+{
+  uint32_t id;       // CAN identifier of the sending ECU, 0 = free
+  uint32_t deadline; // N_Cr
+  uint16_t length;   // message length from the first frame
+  uint16_t received;
+  uint8_t sequence;  // next expected SN
+  uint8_t block;     // CFs left before the next flow control
+  bool flow;         // flow control still has to be sent
+  uint8_t data[ISO_TP_BUF_SIZE];
+} ISO_TP_Channel;
+
+class ISO_TP
+{
+  public:
+    ISO_TP();
+    byte receive(const OBD_Frame* frame, uint32_t now, const byte** payload, uint16_t* length);
+    bool send(uint32_t id, const byte* payload, uint16_t length);
+    bool transmit(uint32_t now, OBD_Frame* frame);
+    void expire(uint32_t now);
+    bool busy();
+
+    uint32_t errors;
+    uint32_t overflows;
+    uint32_t timeouts;
+
+  private:
+    ISO_TP_Channel* channel(uint32_t id, bool allocate);
+    void flowControl(uint32_t now, const byte* data);
+    static void pad(OBD_Frame* frame, uint32_t id, uint32_t now);
+
+    ISO_TP_Channel channels[ISO_TP_CHANNELS];
+
+    // Message being sent, owned by the caller until busy() is false
+    const byte* tx_data;
+    uint32_t tx_id;
+    uint32_t tx_deadline; // N_Bs while waiting, next CF time while sending
+    uint16_t tx_length;
+    uint16_t tx_offset;
+    uint8_t tx_state;
+    uint8_t tx_sequence;
+    uint8_t tx_block;
+    uint8_t tx_stmin;
+};
+
+#endif // _iso_tp_h_
@@ -0,0 +1,207 @@
+/*
+ Shadow of the 16x2 character LCD
+ by:
+ date:
+ license:
+ */
+
+#include "LCD_Buffer.h"
+
+/*
+
+*/
+LCD_Buffer::LCD_Buffer()
+{
+  lcd = 0;
+  cells_written = 0;
+  cursor_moves = 0;
+  next_flush = 0;
+  frame_cells[0] = 0;
+  frame_cells[1] = 0;
+  memset(shown, ' ', sizeof(shown));
+  clear();
+  lcd_col = 0;
+  lcd_row = LCD_ROWS;
+}
+
+/*
+ Draw on display from now on. The display has just been cleared by its own
+ begin(), so the shadow starts out blank as well.
+*/
+void LCD_Buffer::begin(Adafruit_RGBLCDShield* display)
+{
+  lcd = display;
+  memset(shown, ' ', sizeof(shown));
+  clear();
+  lcd_row = LCD_ROWS;
+}
+
+/*
+ Blank the shadow and home the cursor. Nothing is sent; cells that are
+ blank on the display already stay clean.
+*/
+void LCD_Buffer::clear()
+{
+  for (byte r = 0; r < LCD_ROWS; r++)
+  {
+    dirty_cells[r] = 0;
+    for (byte c = 0; c < LCD_COLS; c++)
+    {
+      cells[r][c] = ' ';
+      if (shown[r][c] != ' ')
+      {
+        dirty_cells[r] |= 1 << c;
+      }
+    }
+  }
+
+  col = 0;
+  row = 0;
+}
+
+/*
+
+*/
+void LCD_Buffer::home()
+{
+  col = 0;
+  row = 0;
+}
+
+/*
+
+*/
+void LCD_Buffer::setCursor(byte col, byte row)
+{
+  this->col = col;
+  this->row = (row < LCD_ROWS) ? row : LCD_ROWS - 1;
+}
+
+/*
+ Print's only output. Characters past the end of a row are dropped rather
+ than wrapped into display memory nobody sees.
+*/
+size_t LCD_Buffer::write(uint8_t c)
+{
+  if (col >= LCD_COLS)
+  {
+    return 0;
+  }
+
+  cells[row][col] = c;
+  if (shown[row][col] != (char)c)
+  {
+    dirty_cells[row] |= 1 << col;
+  }
+  else
+  {
+    dirty_cells[row] &= ~(1 << col);
+  }
+  col++;
+
+  return 1;
+}
+
+/*
+ Start a refresh if one is due, and carry on with the one in progress.
+ Returns the number of cells written.
+*/
+byte LCD_Buffer::flush(uint32_t now)
+{
+  if (((frame_cells[0] | frame_cells[1]) == 0) && ((int32_t)(now - next_flush) >= 0))
+  {
+    frame_cells[0] = dirty_cells[0];
+    frame_cells[1] = dirty_cells[1];
+    next_flush = now + LCD_FLUSH_PERIOD;
+  }
+
+  return update(LCD_FLUSH_WRITES, frame_cells);
+}
+
+/*
+ Write every dirty cell now, for screens that wait in a loop of their own.
+*/
+byte LCD_Buffer::sync()
+{
+  frame_cells[0] = 0;
+  frame_cells[1] = 0;
+
+  return update(2 * LCD_ROWS * LCD_COLS, dirty_cells);
+}
+
+/*
+ Number of cells waiting to be written.
+*/
+byte LCD_Buffer::dirty()
+{
+  byte count = 0;
+
+  for (byte r = 0; r < LCD_ROWS; r++)
+  {
+    for (uint16_t bits = dirty_cells[r]; bits != 0; bits &= bits - 1)
+    {
+      count++;
+    }
+  }
+
+  return count;
+}
+
+/*
+ Write the pending cells that are still dirty, left to right, using at
+ most max characters and cursor moves; a move costs as much as a
+ character over I2C. The display advances its cursor after each
+ character, so a run of dirty cells needs only one move. Returns the
+ number of cells written.
+*/
+byte LCD_Buffer::update(byte max, uint16_t* pending)
+{
+  byte written = 0;
+  byte sends = 0;
+  byte cost;
+
+  if (lcd == 0)
+  {
+    return 0;
+  }
+
+  for (byte r = 0; r < LCD_ROWS; r++)
+  {
+    // Cells changed back to what is shown need nothing
+    pending[r] &= dirty_cells[r];
+
+    for (byte c = 0; (c < LCD_COLS) && (pending[r] != 0); c++)
+    {
+      if ((pending[r] & (1 << c)) == 0)
+      {
+        continue;
+      }
+
+      cost = ((lcd_row != r) || (lcd_col != c)) ? 2 : 1;
+      if (sends + cost > max)
+      {
+        cells_written += written;
+        return written;
+      }
+
+      if (cost > 1)
+      {
+        lcd->setCursor(c, r);
+        cursor_moves++;
+      }
+
+      lcd->write(cells[r][c]);
+      shown[r][c] = cells[r][c];
+      dirty_cells[r] &= ~(1 << c);
+      pending[r] &= ~(1 << c);
+      lcd_row = r;
+      lcd_col = c + 1;
+      written++;
+      sends += cost;
+    }
+  }
+
+  cells_written += written;
+
+  return written;
+}
@@ -0,0 +1,62 @@
+/*
+ Shadow of the 16x2 character LCD
+ by:
+ date:
+ license:
+
+ Every character sent to the RGB LCD shield goes through the MCP23017 port
+ expander as several I2C transactions, a cursor move just as many, so
+ redrawing whole rows every pass costs more loop time than the CAN bus.
+ The screens print into this RAM copy instead, starting from clear() each
+ pass; a cell only becomes dirty when its character differs from what
+ the display shows. Every LCD_FLUSH_PERIOD flush() takes the cells dirty
+ at that moment and writes them, LCD_FLUSH_WRITES at a time, so a
+ full redraw is spread over a few loop passes and never holds up the bus
+ for long. Cells that change again meanwhile wait for the next period, so
+ fast changing values cannot keep the display busy.
+ */
+#ifndef lcd_buffer_h_
+#define lcd_buffer_h_
+
+#include <Arduino.h>
+#include <Adafruit_RGBLCDShield.h>
+
+#define LCD_COLS 16
+#define LCD_ROWS 2
+
+#define LCD_FLUSH_PERIOD 200 // milliseconds between display updates
+#define LCD_FLUSH_WRITES 4   // characters and cursor moves per flush() call
+
+class LCD_Buffer : public Print
+{
+  public:
+    LCD_Buffer();
+    void begin(Adafruit_RGBLCDShield* display);
+    void clear();
+    void home();
+    void setCursor(byte col, byte row);
+    virtual size_t write(uint8_t c);
+    using Print::write;
+    byte flush(uint32_t now);
+    byte sync();
+    byte dirty();
+
+    uint32_t cells_written;
+    uint32_t cursor_moves;
+
+  private:
+    byte update(byte max, uint16_t* pending);
+
+    Adafruit_RGBLCDShield* lcd;
+    char cells[LCD_ROWS][LCD_COLS]; // what the screens drew
+    char shown[LCD_ROWS][LCD_COLS]; // what the display shows
+    uint16_t dirty_cells[LCD_ROWS]; // bit n set if column n differs
+    uint16_t frame_cells[LCD_ROWS]; // dirty cells the current refresh writes
+    uint32_t next_flush;
+    byte col;
+    byte row;
+    byte lcd_col;                   // display cursor, LCD_ROWS if unknown
+    byte lcd_row;
+};
+
+#endif // _lcd_buffer_h_
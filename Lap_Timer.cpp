@@ -0,0 +1,381 @@
+/*
+ Run, split and live delta timing from GPS fixes
+ by:
+ date:
+ license:
+ */
+
+#include <math.h>
+#include "Lap_Timer.h"
+
+#define LAP_SCALE_Y   4555     // centimetres per 1e-7 degree of latitude, Q12
+#define LAP_SCALE_X   4560     // the same of longitude on the equator, Q12
+#define LAP_DAY       86400000 // milliseconds
+#define LAP_GAP_MAX   2000     // milliseconds between fixes, more loses the step
+
+/*
+ value * part / whole with part <= whole, in 32 bits. Both are cut to 16
+ bits first, value has to fit 16 bits.
+*/
+static uint32_t fraction(uint32_t value, int32_t part, int32_t whole)
+{
+  while (whole > 0xFFFF)
+  {
+    part >>= 1;
+    whole >>= 1;
+  }
+
+  return (whole > 0) ? value * (uint32_t)part / (uint32_t)whole : 0;
+}
+
+/*
+ Integer square root, one bit per round.
+*/
+static uint32_t squareRoot(uint32_t value)
+{
+  uint32_t root = 0;
+  uint32_t bit = 1UL << 30;
+
+  while (bit > value)
+  {
+    bit >>= 2;
+  }
+  while (bit != 0)
+  {
+    if (value >= root + bit)
+    {
+      value -= root + bit;
+      root = (root >> 1) + bit;
+    }
+    else
+    {
+      root >>= 1;
+    }
+    bit >>= 2;
+  }
+
+  return root;
+}
+
+/*
+
+*/
+Lap_Timer::Lap_Timer()
+{
+  gates = 0;
+  circuit = false;
+  origin_lat = 0;
+  origin_lon = 0;
+  scale_x = LAP_SCALE_X;
+  begin(0, 0, false);
+}
+
+/*
+ Take a course of count gates, four values each: latitude and longitude
+ of A, then of B, in 1e-7 degrees. The cosine for the longitude scale is
+ the only floating point, once per course. Returns false if the course
+ does not fit.
+*/
+bool Lap_Timer::begin(const int32_t* positions, byte count, bool circuit)
+{
+  gates = 0;
+  this->circuit = circuit;
+  crossing = 0;
+  elapsed = 0;
+  delta = 0;
+  last_run = 0;
+  best_run = 0;
+  gate = 0;
+  next = 0;
+  started = false;
+  have_fix = false;
+  last_x = 0;
+  last_y = 0;
+  last_time = 0;
+  last_timestamp = 0;
+  clock = 0;
+  start_clock = 0;
+  distance = 0;
+  traced_distance = 0;
+  traced_time = 0;
+  current_points = 0;
+  reference_points = 0;
+  reference_distance = 0;
+  memset(splits, 0, sizeof(splits));
+
+  if ((count > LAP_GATES_MAX) || (count < (circuit ? 1 : 2)))
+  {
+    return false;
+  }
+
+  origin_lat = positions[0];
+  origin_lon = positions[1];
+  scale_x = (int32_t)(LAP_SCALE_X * cos(origin_lat * 1e-7 * M_PI / 180) + 0.5);
+
+  for (byte i = 0; i < count; i++)
+  {
+    GPS_Fix a;
+    GPS_Fix b;
+    Lap_Gate* entry = &course[i];
+    int32_t bx;
+    int32_t by;
+
+    a.latitude = positions[4 * i];
+    a.longitude = positions[4 * i + 1];
+    b.latitude = positions[4 * i + 2];
+    b.longitude = positions[4 * i + 3];
+    if ((toPlane(&a, &entry->x, &entry->y) == false) || (toPlane(&b, &bx, &by) == false))
+    {
+      return false;
+    }
+
+    entry->dx = bx - entry->x;
+    entry->dy = by - entry->y;
+    entry->center_x = entry->x + entry->dx / 2;
+    entry->center_y = entry->y + entry->dy / 2;
+    entry->reach = squareRoot((entry->dx / 2) * (entry->dx / 2) + (entry->dy / 2) * (entry->dy / 2)) + LAP_STEP_MAX;
+  }
+
+  gates = count;
+
+  return true;
+}
+
+/*
+ Take a fix, one per epoch. Returns LAP_START, LAP_SPLIT or LAP_FINISH
+ if the step from the previous fix crossed the next gate, else LAP_NONE.
+ On a circuit a crossing of the start both finishes a lap and starts the
+ next, LAP_FINISH is returned for the first lap on.
+*/
+byte Lap_Timer::update(const GPS_Fix* fix)
+{
+  const byte needed = GPS_VALID_POSITION | GPS_VALID_TIME;
+  byte event = LAP_NONE;
+  bool begun = false;
+  int32_t x;
+  int32_t y;
+  int32_t part;
+  int32_t whole;
+  uint32_t gap;
+  uint32_t step;
+
+  if ((gates == 0) || ((fix->valid & needed) != needed))
+  {
+    return LAP_NONE;
+  }
+  if (toPlane(fix, &x, &y) == false)
+  {
+    have_fix = false;
+    return LAP_NONE;
+  }
+
+  gap = fix->time - last_time;
+  if (fix->time < last_time)
+  {
+    gap += LAP_DAY;
+  }
+
+  // Without a good previous fix there is no step to test, start over here
+  if ((have_fix == false) || (gap == 0) || (gap > LAP_GAP_MAX) ||
+      (abs(x - last_x) > LAP_STEP_MAX) || (abs(y - last_y) > LAP_STEP_MAX))
+  {
+    have_fix = true;
+    last_x = x;
+    last_y = y;
+    last_time = fix->time;
+    last_timestamp = fix->timestamp;
+    return LAP_NONE;
+  }
+
+  step = squareRoot((x - last_x) * (x - last_x) + (y - last_y) * (y - last_y));
+
+  if (cross(&course[next], x, y, &part, &whole))
+  {
+    uint32_t at = clock + fraction(gap, part, whole);
+    uint32_t before = fraction(step, part, whole);
+    byte finish = circuit ? 0 : gates - 1;
+
+    crossing = last_timestamp + fraction(fix->timestamp - last_timestamp, part, whole);
+    gate = next;
+
+    if (started && (next == finish))
+    {
+      trace(distance + before, at - start_clock);
+      last_run = at - start_clock;
+      splits[next] = last_run;
+      if ((best_run == 0) || (last_run < best_run))
+      {
+        best_run = last_run;
+        memcpy(reference, current, sizeof(reference));
+        reference_points = current_points;
+        reference_distance = distance + before;
+      }
+      event = LAP_FINISH;
+      started = false;
+      next = 0;
+    }
+    else if (next != 0)
+    {
+      splits[next] = at - start_clock;
+      event = LAP_SPLIT;
+      next = (next + 1 < gates) ? next + 1 : 0;
+    }
+
+    // A start, or on a circuit the finish that begins the next lap
+    if ((gate == 0) && (circuit || (event == LAP_NONE)))
+    {
+      startRun(at, step - before);
+      event = (event == LAP_NONE) ? LAP_START : event;
+      next = (gates > 1) ? 1 : 0;
+      begun = true;
+    }
+  }
+
+  if (started && (begun == false))
+  {
+    distance += step;
+  }
+
+  clock += gap;
+  have_fix = true;
+  last_x = x;
+  last_y = y;
+  last_time = fix->time;
+  last_timestamp = fix->timestamp;
+
+  if (started)
+  {
+    elapsed = clock - start_clock;
+    trace(distance, elapsed);
+
+    // The best run's elapsed time at this distance, its finish after the
+    // last point of its trace
+    uint32_t point = distance / LAP_TRACE_STEP;
+    if (point < reference_points)
+    {
+      uint32_t from = reference[point] * 10UL;
+      uint32_t from_distance = point * LAP_TRACE_STEP;
+      uint32_t to = best_run;
+      uint32_t span = reference_distance - from_distance;
+
+      if (point + 1 < reference_points)
+      {
+        to = reference[point + 1] * 10UL;
+        span = LAP_TRACE_STEP;
+      }
+      if (distance - from_distance < span)
+      {
+        delta = (int32_t)elapsed - (int32_t)(from + fraction(to - from, distance - from_distance, span));
+      }
+      else
+      {
+        delta = (int32_t)elapsed - (int32_t)best_run;
+      }
+    }
+    else if (reference_points > 0)
+    {
+      delta = (int32_t)elapsed - (int32_t)best_run;
+    }
+  }
+
+  return event;
+}
+
+/*
+ True between a start and a finish.
+*/
+bool Lap_Timer::running()
+{
+  return started;
+}
+
+/*
+ Centimetres east and north of the start gate's A. False if the fix is
+ further than LAP_RANGE, the products would not fit 32 bits.
+*/
+bool Lap_Timer::toPlane(const GPS_Fix* fix, int32_t* x, int32_t* y)
+{
+  int32_t lat = fix->latitude - origin_lat;
+  int32_t lon = fix->longitude - origin_lon;
+  const int32_t limit = (int32_t)LAP_RANGE * 4096 / LAP_SCALE_Y;
+
+  if ((lat > limit) || (lat < -limit) || (lon > limit) || (lon < -limit))
+  {
+    return false;
+  }
+
+  *x = (lon * scale_x) / 4096;
+  *y = (lat * LAP_SCALE_Y) / 4096;
+
+  return true;
+}
+
+/*
+ Whether the step from the previous fix to x, y crosses the gate from
+ right to left of A to B, that is with A on the driver's left. part /
+ whole is how far along the step the line is crossed.
+*/
+bool Lap_Timer::cross(const Lap_Gate* gate, int32_t x, int32_t y, int32_t* part, int32_t* whole)
+{
+  int32_t step_x = x - last_x;
+  int32_t step_y = y - last_y;
+  int32_t to_x = gate->x - last_x;
+  int32_t to_y = gate->y - last_y;
+  int32_t along_gate;
+
+  // Nowhere near, the products below would not even fit
+  if ((abs(x - gate->center_x) > gate->reach) || (abs(y - gate->center_y) > gate->reach))
+  {
+    return false;
+  }
+
+  *whole = gate->dx * step_y - gate->dy * step_x;
+  if (*whole <= 0)
+  {
+    return false;
+  }
+
+  *part = gate->dx * to_y - gate->dy * to_x;
+  along_gate = step_x * to_y - step_y * to_x;
+
+  return (*part >= 0) && (*part <= *whole) && (along_gate >= 0) && (along_gate <= *whole);
+}
+
+/*
+ A run starts at time on the clock, distance past the gate already.
+*/
+void Lap_Timer::startRun(uint32_t time, uint32_t distance)
+{
+  started = true;
+  start_clock = time;
+  this->distance = 0;
+  traced_distance = 0;
+  traced_time = 0;
+  current_points = 0;
+  delta = 0;
+  trace(0, 0);
+  this->distance = distance;
+}
+
+/*
+ Note the elapsed time at every LAP_TRACE_STEP passed since the last
+ call, interpolated along the way. A step is at most LAP_STEP_MAX, so
+ this is a few points per fix at most.
+*/
+void Lap_Timer::trace(uint32_t distance, uint32_t time)
+{
+  while ((current_points < LAP_TRACE_POINTS) && ((uint32_t)current_points * LAP_TRACE_STEP <= distance))
+  {
+    uint32_t target = (uint32_t)current_points * LAP_TRACE_STEP;
+    uint32_t at = traced_time;
+
+    if (distance > traced_distance)
+    {
+      at += fraction(time - traced_time, target - traced_distance, distance - traced_distance);
+    }
+    current[current_points++] = at / 10;
+  }
+
+  traced_distance = distance;
+  traced_time = time;
+}
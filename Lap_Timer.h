@@ -0,0 +1,107 @@
+/*
+ Run, split and live delta timing from GPS fixes
+ by:
+ date:
+ license:
+
+ A course is a list of gates, each a line from A to B given as two GPS
+ positions with A on the driver's left: the start first, then the
+ splits, the finish last. On a circuit the start is also the finish and
+ every crossing of it begins the next lap.
+
+ begin() turns the gates into centimetres on a flat plane around the
+ start, which is accurate to well within a GPS fix over a few
+ kilometres. update() converts each fix to the same plane with 32-bit
+ integer arithmetic only and tests the step from the previous fix
+ against the one gate that comes next, so the work per fix does not grow
+ with the course. A crossing is interpolated along the step between the
+ two fixes, so times are not bound to the 100 ms between fixes.
+
+ While a run goes on, the elapsed time is noted every LAP_TRACE_STEP of
+ distance driven. The trace of the best run is the reference; the live
+ delta compares the elapsed time with the reference's at the same
+ distance, a table lookup.
+ */
+#ifndef lap_timer_h_
+#define lap_timer_h_
+
+#include <Arduino.h>
+#include "NMEA_Parser.h"
+
+#define LAP_GATES_MAX    8
+#define LAP_TRACE_POINTS 100  // LAP_TRACE_STEP apart, runs up to 2 km
+#define LAP_TRACE_STEP   2000 // centimetres
+#define LAP_STEP_MAX     10000 // centimetres between fixes, more is a bad fix
+#define LAP_RANGE        300000 // centimetres from the start the plane reaches
+
+// Lap_Timer::update()
+#define LAP_NONE   0
+#define LAP_START  1
+#define LAP_SPLIT  2
+#define LAP_FINISH 3
+
+// Log channels
+#define LAP_CHANNEL_START  0xFF20 // raw 0
+#define LAP_CHANNEL_SPLIT  0xFF21 // milliseconds since the start
+#define LAP_CHANNEL_FINISH 0xFF22 // run time in milliseconds
+#define LAP_CHANNEL_DELTA  0xFF23 // milliseconds against the best run, ahead is negative
+
+typedef struct
+{
+  int32_t x;        // A, centimetres east of the start gate's A
+  int32_t y;        // centimetres north
+  int32_t dx;       // B - A
+  int32_t dy;
+  int32_t center_x; // middle of the gate
+  int32_t center_y;
+  int32_t reach;    // half the width plus LAP_STEP_MAX
+} Lap_Gate;
+
+class Lap_Timer
+{
+  public:
+    Lap_Timer();
+    bool begin(const int32_t* positions, byte count, bool circuit);
+    byte update(const GPS_Fix* fix);
+    bool running();
+
+    uint32_t crossing;              // millis() of the last crossing, the fixes' clock
+    uint32_t elapsed;               // milliseconds of the run at the last fix
+    int32_t delta;                  // milliseconds against the best run, 0 without one
+    uint32_t splits[LAP_GATES_MAX]; // milliseconds from the start to each gate, this run's or the last
+    uint32_t last_run;
+    uint32_t best_run;              // 0 until a run was finished
+    byte gate;                      // gate of the last crossing
+
+  private:
+    bool toPlane(const GPS_Fix* fix, int32_t* x, int32_t* y);
+    bool cross(const Lap_Gate* gate, int32_t x, int32_t y, int32_t* part, int32_t* whole);
+    void startRun(uint32_t time, uint32_t distance);
+    void trace(uint32_t distance, uint32_t time);
+
+    Lap_Gate course[LAP_GATES_MAX];
+    byte gates;
+    bool circuit;
+    int32_t origin_lat;
+    int32_t origin_lon;
+    int32_t scale_x;                // centimetres per 1e-7 degree of longitude, Q12
+    byte next;                      // gate to cross next
+    bool started;
+    bool have_fix;
+    int32_t last_x;                 // previous fix on the plane
+    int32_t last_y;
+    uint32_t last_time;             // its UTC milliseconds
+    uint32_t last_timestamp;        // and millis()
+    uint32_t clock;                 // milliseconds of fix time since begin(), past midnight too
+    uint32_t start_clock;           // clock at the start crossing
+    uint32_t distance;              // centimetres since the start
+    uint32_t traced_distance;       // where trace() was last called
+    uint32_t traced_time;
+    uint16_t current[LAP_TRACE_POINTS];   // elapsed time in 10 ms every LAP_TRACE_STEP
+    uint16_t reference[LAP_TRACE_POINTS]; // the same of the best run
+    byte current_points;
+    byte reference_points;
+    uint32_t reference_distance;    // centimetres of the best run
+};
+
+#endif // _lap_timer_h_
@@ -0,0 +1,400 @@
+/*
+ Streaming NMEA 0183 parser for the GPS receiver
+ by:
+ date:
+ license:
+ */
+
+#include "NMEA_Parser.h"
+
+// Parser states
+#define NMEA_IDLE      0 // waiting for '$'
+#define NMEA_FIELDS    1
+#define NMEA_CHECKSUM1 2
+#define NMEA_CHECKSUM2 3
+
+// Sentence types, the last three characters of the address
+#define NMEA_RMC 1
+#define NMEA_GGA 2
+#define NMEA_ADDRESS_RMC (((uint32_t)'R' << 16) | ((uint32_t)'M' << 8) | 'C')
+#define NMEA_ADDRESS_GGA (((uint32_t)'G' << 16) | ((uint32_t)'G' << 8) | 'A')
+
+#define NMEA_FIELDS_MAX 20 // more commas than any sentence read here has
+
+/*
+
+*/
+NMEA_Parser::NMEA_Parser()
+{
+  memset(&current, 0, sizeof(current));
+  memset(&staged, 0, sizeof(staged));
+  sentences = 0;
+  checksum_errors = 0;
+  start = 0;
+  value = 0;
+  fraction = 0;
+  length = 0;
+  point = false;
+  negative = false;
+  letter = 0;
+  type = 0;
+  index = 0;
+  state = NMEA_IDLE;
+  sum = 0;
+  received = 0;
+  updated = false;
+}
+
+/*
+ Digit value of a hex character, 16 if it is none.
+*/
+static byte hexDigit(char c)
+{
+  if ((c >= '0') && (c <= '9'))
+  {
+    return c - '0';
+  }
+  if ((c >= 'A') && (c <= 'F'))
+  {
+    return c - 'A' + 10;
+  }
+
+  return 16;
+}
+
+/*
+ Take the next character from the receiver, received at now. Returns
+ true when it completed an RMC or GGA sentence with a good checksum.
+*/
+bool NMEA_Parser::parse(char c, uint32_t now)
+{
+  byte digit;
+
+  if (c == '$')
+  {
+    // A '$' always starts over, even in the middle of a broken sentence
+    staged = current;
+    start = now;
+    value = 0;
+    fraction = 0;
+    length = 0;
+    point = false;
+    negative = false;
+    letter = 0;
+    type = 0;
+    index = 0;
+    sum = 0;
+    state = NMEA_FIELDS;
+    return false;
+  }
+
+  switch (state)
+  {
+    case NMEA_FIELDS:
+      if (c == '*')
+      {
+        field();
+        state = NMEA_CHECKSUM1;
+        break;
+      }
+      if ((c < ' ') || (c > '~'))
+      {
+        state = NMEA_IDLE;
+        break;
+      }
+      sum ^= c;
+
+      if (c == ',')
+      {
+        field();
+        index++;
+        value = 0;
+        fraction = 0;
+        length = 0;
+        point = false;
+        negative = false;
+        letter = 0;
+
+        // Nothing of another sentence is needed, skip to the next '$'
+        if (((index == 1) && (type == 0)) || (index > NMEA_FIELDS_MAX))
+        {
+          state = NMEA_IDLE;
+        }
+        break;
+      }
+
+      if (length == 0)
+      {
+        letter = c;
+      }
+      length++;
+
+      if (index == 0)
+      {
+        // The address only matters by its last three characters
+        value = (value << 8) | (byte)c;
+      }
+      else if ((c >= '0') && (c <= '9'))
+      {
+        if (point == false)
+        {
+          value = value * 10 + (c - '0');
+        }
+        else if (fraction < NMEA_FIELD_DECIMALS)
+        {
+          value = value * 10 + (c - '0');
+          fraction++;
+        }
+      }
+      else if (c == '.')
+      {
+        point = true;
+      }
+      else if (c == '-')
+      {
+        negative = true;
+      }
+      break;
+
+    case NMEA_CHECKSUM1:
+      digit = hexDigit(c);
+      if (digit > 15)
+      {
+        checksum_errors++;
+        state = NMEA_IDLE;
+        break;
+      }
+      received = digit << 4;
+      state = NMEA_CHECKSUM2;
+      break;
+
+    case NMEA_CHECKSUM2:
+      digit = hexDigit(c);
+      state = NMEA_IDLE;
+      if ((digit > 15) || ((received | digit) != sum))
+      {
+        checksum_errors++;
+        break;
+      }
+      accept();
+      return true;
+
+    default:
+      break;
+  }
+
+  return false;
+}
+
+/*
+ True once after each new RMC sentence, which carries everything that is
+ logged. GGA only adds to the fix.
+*/
+bool NMEA_Parser::available()
+{
+  if (updated == false)
+  {
+    return false;
+  }
+
+  updated = false;
+
+  return true;
+}
+
+/*
+
+*/
+const GPS_Fix* NMEA_Parser::fix()
+{
+  return &current;
+}
+
+/*
+ Checksum of a sentence body, the characters between '$' and '*'. Used
+ to build the commands sent to the receiver.
+*/
+byte NMEA_Parser::checksum(const char* body)
+{
+  byte sum = 0;
+
+  while (*body != 0)
+  {
+    sum ^= *body;
+    body++;
+  }
+
+  return sum;
+}
+
+/*
+ Store the field that just ended in the staged fix. Empty fields, as
+ sent while there is no fix, leave the value it had.
+*/
+void NMEA_Parser::field()
+{
+  if (index == 0)
+  {
+    if ((value & 0xFFFFFF) == NMEA_ADDRESS_RMC)
+    {
+      type = NMEA_RMC;
+    }
+    else if ((value & 0xFFFFFF) == NMEA_ADDRESS_GGA)
+    {
+      type = NMEA_GGA;
+    }
+    return;
+  }
+
+  if (length == 0)
+  {
+    return;
+  }
+
+  // Time and position sit in the same fields of both sentences, one
+  // further on in RMC for its status field
+  byte position = index;
+  if (type == NMEA_RMC)
+  {
+    if (index == 2)
+    {
+      if (letter == 'A')
+      {
+        staged.valid |= GPS_VALID_POSITION | GPS_VALID_SPEED;
+      }
+      else
+      {
+        staged.valid &= ~(GPS_VALID_POSITION | GPS_VALID_SPEED);
+      }
+      return;
+    }
+    if ((index >= 3) && (index <= 6))
+    {
+      position = index - 1;
+    }
+  }
+
+  switch (position)
+  {
+    case 1:
+      // hhmmss.sss
+      value = scaled(3);
+      staged.time = (value / 10000000) * 3600000UL + ((value / 100000) % 100) * 60000UL + value % 100000;
+      staged.valid |= GPS_VALID_TIME;
+      return;
+    case 2:
+      staged.latitude = degrees();
+      return;
+    case 3:
+      if ((letter == 'S') && (staged.latitude > 0))
+      {
+        staged.latitude = -staged.latitude;
+      }
+      return;
+    case 4:
+      staged.longitude = degrees();
+      return;
+    case 5:
+      if ((letter == 'W') && (staged.longitude > 0))
+      {
+        staged.longitude = -staged.longitude;
+      }
+      return;
+    default:
+      break;
+  }
+
+  if (type == NMEA_RMC)
+  {
+    switch (index)
+    {
+      case 7:
+        // knots, 1852 m per nautical mile
+        staged.speed = scaled(2) * 1852 / 360;
+        break;
+      case 8:
+        staged.course = scaled(2);
+        break;
+      case 9:
+        staged.date = value;
+        staged.valid |= GPS_VALID_DATE;
+        break;
+    }
+  }
+  else
+  {
+    switch (index)
+    {
+      case 6:
+        staged.quality = value;
+        if (value > 0)
+        {
+          staged.valid |= GPS_VALID_POSITION | GPS_VALID_ALTITUDE;
+        }
+        else
+        {
+          staged.valid &= ~(GPS_VALID_POSITION | GPS_VALID_ALTITUDE);
+        }
+        break;
+      case 7:
+        staged.satellites = value;
+        break;
+      case 8:
+        staged.hdop = scaled(2);
+        break;
+      case 9:
+        staged.altitude = negative ? -(int32_t)scaled(2) : (int32_t)scaled(2);
+        break;
+    }
+  }
+}
+
+/*
+ The checksum matched, the staged values become the fix. A new UTC time
+ starts a new epoch and takes the time its first sentence began.
+*/
+void NMEA_Parser::accept()
+{
+  if (((current.valid & GPS_VALID_TIME) == 0) || (staged.time != current.time))
+  {
+    staged.timestamp = start;
+  }
+
+  current = staged;
+  sentences++;
+
+  if (type == NMEA_RMC)
+  {
+    updated = true;
+  }
+}
+
+/*
+ The field's digits with exactly the given number of fraction digits.
+*/
+uint32_t NMEA_Parser::scaled(byte digits)
+{
+  uint32_t result = value;
+
+  for (byte i = fraction; i < digits; i++)
+  {
+    result *= 10;
+  }
+  for (byte i = digits; i < fraction; i++)
+  {
+    result /= 10;
+  }
+
+  return result;
+}
+
+/*
+ ddmm.mmmmm or dddmm.mmmmm in 1e-7 degrees. A minute is 1e7 / 60 of
+ those, which is 5 / 3 per 1e-5 minute.
+*/
+int32_t NMEA_Parser::degrees()
+{
+  uint32_t minutes = scaled(5);
+
+  return (minutes / 10000000) * 10000000 + (minutes % 10000000) * 5 / 3;
+}
@@ -0,0 +1,93 @@
+/*
+ Streaming NMEA 0183 parser for the GPS receiver
+ by:
+ date:
+ license:
+
+ parse() takes one character at a time as it comes off the UART, so no
+ sentence is ever buffered: each field is folded into an integer as its
+ digits arrive and stored when its comma is seen. The values of a
+ sentence are staged and only become the current fix once the checksum
+ after '*' matches, a damaged sentence leaves the fix as it was.
+
+ Only $--RMC and $--GGA are read, any talker (GP, GN, GL). Positions are
+ kept in signed 1e-7 degrees, the resolution a 32-bit integer gives and
+ more than any receiver delivers, without floating point.
+
+ The timestamp of a fix is the time handed to parse() with the '$' that
+ opened the first sentence of its epoch, on the same millis() clock the
+ CAN frames are stamped with, so positions and OBD samples line up in
+ the log.
+ */
+#ifndef nmea_parser_h_
+#define nmea_parser_h_
+
+#include <Arduino.h>
+
+#define NMEA_FIELD_DECIMALS 5 // fraction digits kept, 1e-5 minutes is about 2 cm
+
+// GPS_Fix.valid
+#define GPS_VALID_TIME     0x01
+#define GPS_VALID_DATE     0x02
+#define GPS_VALID_POSITION 0x04 // RMC status A or GGA quality above 0
+#define GPS_VALID_SPEED    0x08
+#define GPS_VALID_ALTITUDE 0x10
+
+// Log channels of the position, above the Ford DIDs
+#define GPS_CHANNEL_LAT    0xFF00 // 1e-7 degrees
+#define GPS_CHANNEL_LON    0xFF01 // 1e-7 degrees
+#define GPS_CHANNEL_SPEED  0xFF02 // millimetres per second
+#define GPS_CHANNEL_COURSE 0xFF03 // 0.01 degrees
+
+typedef struct
+{
+  uint32_t timestamp; // millis() at the start of the epoch's first sentence
+  uint32_t time;      // UTC milliseconds since midnight
+  uint32_t date;      // ddmmyy
+  int32_t latitude;   // 1e-7 degrees, north positive
+  int32_t longitude;  // 1e-7 degrees, east positive
+  int32_t altitude;   // centimetres above mean sea level
+  uint32_t speed;     // millimetres per second over ground
+  uint16_t course;    // 0.01 degrees from true north
+  uint16_t hdop;      // 0.01
+  uint8_t quality;    // GGA fix quality, 0 for none
+  uint8_t satellites;
+  uint8_t valid;      // GPS_VALID_*
+} GPS_Fix;
+
+class NMEA_Parser
+{
+  public:
+    NMEA_Parser();
+    bool parse(char c, uint32_t now);
+    bool available();
+    const GPS_Fix* fix();
+    static byte checksum(const char* body);
+
+    uint32_t sentences;       // RMC and GGA accepted
+    uint32_t checksum_errors;
+
+  private:
+    void field();
+    void accept();
+    uint32_t scaled(byte digits);
+    int32_t degrees();
+
+    GPS_Fix current;
+    GPS_Fix staged;
+    uint32_t start;      // time of the '$' of this sentence
+    uint32_t value;      // digits of the field so far, decimal point removed
+    byte fraction;       // digits after the point in value
+    byte length;         // characters in the field
+    bool point;
+    bool negative;
+    char letter;         // first character of the field, N/S/E/W/A/V
+    byte type;           // NMEA_RMC, NMEA_GGA or 0 while the address is read
+    byte index;          // field number, 0 is the address
+    byte state;
+    byte sum;            // XOR of the characters between '$' and '*'
+    byte received;       // checksum as sent
+    bool updated;
+};
+
+#endif // _nmea_parser_h_
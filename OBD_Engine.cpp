@@ -0,0 +1,568 @@
+/*
+ On-Board Diagnostics request/response engine
+ by:
+ date:
+ license:
+ */
+
+#include "OBD_Engine.h"
+
+/*
+
+*/
+OBD_Engine::OBD_Engine()
+{
+  for (byte i = 0; i < OBD_ENGINE_SLOTS; i++)
+  {
+    slots[i].state = OBD_SLOT_FREE;
+  }
+
+  routes = 0;
+  window = 1;
+  next_sequence = 0;
+  requests_sent = 0;
+  responses = 0;
+  negatives = 0;
+  timeouts = 0;
+}
+
+/*
+ Number of requests allowed on the bus at the same time. ISO 15765-4
+ expects one, some ECUs will queue more.
+*/
+void OBD_Engine::setWindow(byte window)
+{
+  if (window < 1)
+  {
+    window = 1;
+  }
+  else if (window > OBD_ENGINE_SLOTS)
+  {
+    window = OBD_ENGINE_SLOTS;
+  }
+
+  this->window = window;
+}
+
+/*
+ Learn PID owners from the replies and address requests to them.
+*/
+void OBD_Engine::setRoutes(OBD_Routes* routes)
+{
+  this->routes = routes;
+}
+
+/*
+ Queue a request. Returns false if the same request is already queued or
+ outstanding, or if every slot is in use.
+*/
+bool OBD_Engine::request(byte sid, uint16_t pid)
+{
+  OBD_Transaction* slot;
+  byte pids[1];
+
+  pids[0] = pid;
+  slot = allocate(sid, pids, (sid == SIDRQ_RDBI) ? 0 : 1, pid);
+  if (slot == 0)
+  {
+    return false;
+  }
+
+  if (sid == SIDRQ_RDBI)
+  {
+    Ford_OBD::encodeQuery(pid, slot->request);
+  }
+  else
+  {
+    WWH_OBD::encodeQuery(sid, pid, slot->request);
+  }
+
+  return true;
+}
+
+/*
+ Queue a single PID or DID request the caller encoded into frame with
+ WWH_OBD::encodeQuery() or Ford_OBD::encodeQuery(). The frame has to stay
+ as it is until the request is answered or given up; transmit() hands it
+ out with only the ID and time changed.
+*/
+bool OBD_Engine::request(OBD_Frame* frame)
+{
+  OBD_Transaction* slot;
+  byte sid = frame->data[1];
+  uint16_t pid = (sid == SIDRQ_RDBI) ? ((frame->data[2] << 8) | frame->data[3]) : frame->data[2];
+  byte pids[1];
+
+  pids[0] = pid;
+  slot = allocate(sid, pids, (sid == SIDRQ_RDBI) ? 0 : 1, pid);
+  if (slot == 0)
+  {
+    return false;
+  }
+
+  slot->frame = frame;
+
+  return true;
+}
+
+/*
+ Queue up to OBD_BATCH_MAX Service $01 PIDs as a single request. The
+ response payload has to fit the transport, see WWH_OBD::batchSize().
+*/
+bool OBD_Engine::requestBatch(byte sid, const byte* pids, byte count)
+{
+  OBD_Transaction* slot;
+
+  if ((count == 0) || (count > OBD_BATCH_MAX))
+  {
+    return false;
+  }
+
+  slot = allocate(sid, pids, count, pids[0]);
+  if (slot == 0)
+  {
+    return false;
+  }
+
+  WWH_OBD::encodeBatch(sid, pids, count, slot->request);
+
+  return true;
+}
+
+/*
+ Track a request the caller put on the bus itself, such as a multi-frame
+ ReadDataByIdentifier through ISO_TP, so its response, negative response
+ or timeout is matched like any other. pid is the first DID asked for,
+ target the ECU number it is sent to or OBD_ROUTE_FUNCTIONAL. Returns
+ false if the window is full or the request is already open; the caller
+ should not send it then.
+*/
+bool OBD_Engine::track(byte sid, uint16_t pid, uint32_t deadline, byte target)
+{
+  OBD_Transaction* slot;
+  byte pids[1];
+
+  if (open(target) == false)
+  {
+    return false;
+  }
+
+  pids[0] = pid;
+  slot = allocate(sid, pids, 0, pid);
+  if (slot == 0)
+  {
+    return false;
+  }
+
+  slot->external = true;
+  slot->target = target;
+  slot->state = OBD_SLOT_SENT;
+  slot->deadline = deadline;
+  requests_sent++;
+
+  return true;
+}
+
+/*
+ Free the slot track() took for sid and pid when the caller could not
+ send the request after all, as if it had never been tracked.
+*/
+void OBD_Engine::cancel(byte sid, uint16_t pid)
+{
+  for (byte i = 0; i < OBD_ENGINE_SLOTS; i++)
+  {
+    if ((slots[i].state != OBD_SLOT_FREE) && slots[i].external && (slots[i].sid == sid) && (slots[i].pid == pid))
+    {
+      slots[i].state = OBD_SLOT_FREE;
+      requests_sent--;
+    }
+  }
+}
+
+/*
+ ECU number a request for pid goes to, OBD_ROUTE_FUNCTIONAL for all.
+*/
+byte OBD_Engine::target(byte sid, uint16_t pid)
+{
+  if (routes == 0)
+  {
+    return OBD_ROUTE_FUNCTIONAL;
+  }
+
+  return routes->target(sid, pid);
+}
+
+/*
+ The oldest request whose ECU's window allows another request on the bus,
+ the caller's own frame if it queued one, or 0 if there is nothing to send
+ right now. The frame is the caller's to send until the next transmit().
+*/
+OBD_Frame* OBD_Engine::transmit(uint32_t now)
+{
+  OBD_Transaction* slot = 0;
+  OBD_Frame* frame;
+
+  for (byte i = 0; i < OBD_ENGINE_SLOTS; i++)
+  {
+    if ((slots[i].state == OBD_SLOT_HELD) && ((int32_t)(now - slots[i].deadline) >= 0))
+    {
+      slots[i].state = OBD_SLOT_QUEUED;
+    }
+
+    if ((slots[i].state == OBD_SLOT_QUEUED) &&
+        ((slot == 0) || ((int8_t)(slots[i].sequence - slot->sequence) < 0)) &&
+        open(slots[i].target))
+    {
+      slot = &slots[i];
+    }
+  }
+
+  if (slot == 0)
+  {
+    return 0;
+  }
+
+  if (slot->frame != 0)
+  {
+    frame = slot->frame;
+  }
+  else
+  {
+    frame = &out;
+    memcpy(frame->data, slot->request, OBD_FRAME_SIZE);
+  }
+  frame->id = (slot->target == OBD_ROUTE_FUNCTIONAL) ? ID_REQUEST : ID_REQUEST_1 + slot->target;
+  frame->timestamp = now;
+  frame->length = OBD_FRAME_SIZE;
+  frame->bus = 0;
+
+  slot->state = OBD_SLOT_SENT;
+  slot->deadline = now + P2CAN_MAX;
+  requests_sent++;
+
+  return frame;
+}
+
+/*
+ As transmit(now), copied into the caller's frame. Returns false if there
+ is nothing to send right now.
+*/
+bool OBD_Engine::transmit(uint32_t now, OBD_Frame* frame)
+{
+  OBD_Frame* next = transmit(now);
+
+  if (next == 0)
+  {
+    return false;
+  }
+
+  *frame = *next;
+
+  return true;
+}
+
+/*
+ Match a received payload, starting at the response SID, against the
+ outstanding requests. Returns one of OBD_RX_*; the caller decodes
+ OBD_RX_RESPONSE and OBD_RX_UNMATCHED payloads.
+*/
+byte OBD_Engine::receive(uint32_t id, const byte* payload, uint16_t length, uint32_t now)
+{
+  OBD_Transaction* slot;
+  byte sid;
+  byte ecu = id - ID_REPLY_1;
+
+  if ((id < ID_REPLY_1) || (id > ID_REPLY_8) || (length < 2))
+  {
+    return OBD_RX_IGNORED;
+  }
+
+  sid = payload[0];
+
+  if (sid == SIDNR)
+  {
+    // The negative response only carries the SID, take the oldest request
+    slot = match(payload[1], 0xFFFF, ecu);
+    if ((slot == 0) || (length < 3))
+    {
+      return OBD_RX_IGNORED;
+    }
+
+    if (payload[2] == NRC_RCRRP)
+    {
+      slot->deadline = now + P2STAR_CAN_MAX;
+      return OBD_RX_PENDING;
+    }
+
+    // Only requests built here can be repeated here
+    if ((payload[2] == NRC_BRR) && (slot->retries < OBD_ENGINE_RETRIES) && !slot->external)
+    {
+      slot->retries++;
+      slot->state = OBD_SLOT_HELD;
+      slot->deadline = now + P2CAN_MAX;
+      return OBD_RX_PENDING;
+    }
+
+    // The owner refused, the PIDs may belong to another ECU after all
+    if ((routes != 0) && (slot->target != OBD_ROUTE_FUNCTIONAL))
+    {
+      for (byte i = 0; i < slot->count; i++)
+      {
+        routes->forget(slot->sid, slot->request[2 + i]);
+      }
+      routes->forget(slot->sid, slot->pid);
+    }
+
+    slot->state = OBD_SLOT_FREE;
+    negatives++;
+    return OBD_RX_NEGATIVE;
+  }
+
+  if ((sid & 0x40) == 0)
+  {
+    return OBD_RX_IGNORED;
+  }
+
+  if ((sid == SIDPR_RDBI) && (length < 3))
+  {
+    return OBD_RX_IGNORED;
+  }
+
+  if (routes != 0)
+  {
+    routes->learn(ecu, payload, length);
+  }
+
+  slot = match(sid & ~0x40, responsePID(sid & ~0x40, payload), ecu);
+  if (slot == 0)
+  {
+    return OBD_RX_UNMATCHED;
+  }
+
+  slot->state = OBD_SLOT_FREE;
+  responses++;
+
+  return OBD_RX_RESPONSE;
+}
+
+/*
+ Drop requests whose response deadline has passed. Returns how many expired.
+*/
+byte OBD_Engine::expire(uint32_t now)
+{
+  byte expired = 0;
+
+  for (byte i = 0; i < OBD_ENGINE_SLOTS; i++)
+  {
+    if ((slots[i].state == OBD_SLOT_SENT) && ((int32_t)(now - slots[i].deadline) >= 0))
+    {
+      if ((routes != 0) && (slots[i].target != OBD_ROUTE_FUNCTIONAL))
+      {
+        for (byte j = 0; j < slots[i].count; j++)
+        {
+          routes->missed(slots[i].sid, slots[i].request[2 + j]);
+        }
+        if (slots[i].count == 0)
+        {
+          routes->missed(slots[i].sid, slots[i].pid);
+        }
+      }
+      slots[i].state = OBD_SLOT_FREE;
+      expired++;
+    }
+  }
+
+  timeouts += expired;
+
+  return expired;
+}
+
+/*
+ True if the request is queued or waiting for its response.
+*/
+bool OBD_Engine::pending(byte sid, uint16_t pid)
+{
+  for (byte i = 0; i < OBD_ENGINE_SLOTS; i++)
+  {
+    if ((slots[i].state != OBD_SLOT_FREE) && (slots[i].sid == sid) && contains(&slots[i], pid))
+    {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/*
+ Number of requests on the bus waiting for a response.
+*/
+byte OBD_Engine::outstanding()
+{
+  byte count = 0;
+
+  for (byte i = 0; i < OBD_ENGINE_SLOTS; i++)
+  {
+    if (slots[i].state == OBD_SLOT_SENT)
+    {
+      count++;
+    }
+  }
+
+  return count;
+}
+
+/*
+ Number of requests waiting to be sent.
+*/
+byte OBD_Engine::queued()
+{
+  byte count = 0;
+
+  for (byte i = 0; i < OBD_ENGINE_SLOTS; i++)
+  {
+    if ((slots[i].state == OBD_SLOT_QUEUED) || (slots[i].state == OBD_SLOT_HELD))
+    {
+      count++;
+    }
+  }
+
+  return count;
+}
+
+/*
+ Claim a free slot for a new request, unless one of its PIDs is already
+ queued or outstanding. The caller fills in its request.
+*/
+OBD_Transaction* OBD_Engine::allocate(byte sid, const byte* pids, byte count, uint16_t pid)
+{
+  OBD_Transaction* slot = 0;
+
+  for (byte i = 0; i < OBD_ENGINE_SLOTS; i++)
+  {
+    if (slots[i].state == OBD_SLOT_FREE)
+    {
+      if (slot == 0)
+      {
+        slot = &slots[i];
+      }
+    }
+    else if (slots[i].sid == sid)
+    {
+      if (contains(&slots[i], pid))
+      {
+        return 0;
+      }
+
+      for (byte j = 0; j < count; j++)
+      {
+        if (contains(&slots[i], pids[j]))
+        {
+          return 0;
+        }
+      }
+    }
+  }
+
+  if (slot == 0)
+  {
+    return 0;
+  }
+
+  slot->sid = sid;
+  slot->pid = pid;
+  slot->count = count;
+  slot->target = target(sid, pid);
+  for (byte i = 0; i < count; i++)
+  {
+    // A batch only goes to one ECU if it owns every PID
+    if (target(sid, pids[i]) != slot->target)
+    {
+      slot->target = OBD_ROUTE_FUNCTIONAL;
+    }
+  }
+  slot->frame = 0;
+  slot->state = OBD_SLOT_QUEUED;
+  slot->sequence = next_sequence++;
+  slot->retries = 0;
+  slot->external = false;
+
+  return slot;
+}
+
+/*
+ Oldest outstanding request for sid and pid that ECU number ecu was asked,
+ 0xFFFF matches any pid.
+*/
+OBD_Transaction* OBD_Engine::match(byte sid, uint16_t pid, byte ecu)
+{
+  OBD_Transaction* slot = 0;
+
+  for (byte i = 0; i < OBD_ENGINE_SLOTS; i++)
+  {
+    if ((slots[i].state == OBD_SLOT_SENT) && (slots[i].sid == sid) &&
+        ((slots[i].target == OBD_ROUTE_FUNCTIONAL) || (slots[i].target == ecu)) &&
+        ((pid == 0xFFFF) || contains(&slots[i], pid)) &&
+        ((slot == 0) || ((int8_t)(slots[i].sequence - slot->sequence) < 0)))
+    {
+      slot = &slots[i];
+    }
+  }
+
+  return slot;
+}
+
+/*
+ True if the window allows another request to target: a physical request
+ counts against its own ECU, a functional one against every ECU.
+*/
+bool OBD_Engine::open(byte target)
+{
+  byte count = 0;
+
+  for (byte i = 0; i < OBD_ENGINE_SLOTS; i++)
+  {
+    if ((slots[i].state == OBD_SLOT_SENT) &&
+        ((target == OBD_ROUTE_FUNCTIONAL) || (slots[i].target == OBD_ROUTE_FUNCTIONAL) ||
+         (slots[i].target == target)))
+    {
+      count++;
+    }
+  }
+
+  return (count < window);
+}
+
+/*
+ True if a request asks for pid, either alone or as part of a batch.
+*/
+bool OBD_Engine::contains(const OBD_Transaction* slot, uint16_t pid)
+{
+  if (slot->pid == pid)
+  {
+    return true;
+  }
+
+  for (byte i = 0; i < slot->count; i++)
+  {
+    if (slot->request[2 + i] == pid)
+    {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/*
+ PID, InfoType or DID a positive response is answering. A batched
+ Service $01 response starts with the first supported PID.
+*/
+uint16_t OBD_Engine::responsePID(byte sid, const byte* data)
+{
+  if (sid == SIDRQ_RDBI)
+  {
+    return (data[1] << 8) + data[2];
+  }
+
+  return data[1];
+}
@@ -0,0 +1,121 @@
+/*
+ On-Board Diagnostics request/response engine
+ by:
+ date:
+ license:
+
+ Tracks outstanding Service $01/$02/$09 and UDS ReadDataByIdentifier
+ requests without blocking the main loop. Several Service $01 PIDs can
+ share one request through requestBatch(). Requests are queued with
+ request(), put on the bus one at a time through transmit(), and replies
+ are matched back to their request by SID and PID/DID in receive(), so a
+ reply arriving late can no longer be paired with the wrong PID. Replies
+ are complete payloads, reassembled by ISO_TP where needed.
+
+ A caller polling the same requests over and over encodes each frame once
+ and queues it with request(frame): the slot points at the caller's frame
+ and transmit() hands that frame out, only its ID and time filled in. A
+ request queued by SID and PID is encoded into the slot when it is queued,
+ a batch from whichever PIDs are due as well, and handed out through the
+ engine's own frame. Either way every repeat after NRC_BRR sends the
+ frame as it was encoded.
+
+ ISO 15031-5:2011 / ISO 15765-4:2011
+ A request is answered within P2CAN_MAX, or within
+ P2STAR_CAN_MAX after each requestCorrectlyReceived-ResponsePending.
+ Only one request is outstanding per ECU unless setWindow() says otherwise.
+ Requests too long for a single frame are sent through ISO_TP by the
+ caller and only tracked here.
+
+ With OBD_Routes attached through setRoutes(), every positive reply
+ teaches it which ECU owns the PIDs, and a request whose PIDs all have
+ the same owner goes to that ECU on its ID_REQUEST_n instead of the
+ functional ID_REQUEST. A physical request only takes its own ECU's
+ window, so requests to different ECUs are on the bus together, and
+ only that ECU's reply completes it. A functional request takes every
+ ECU's window.
+ */
+#ifndef obd_engine_h_
+#define obd_engine_h_
+
+#include <Arduino.h>
+#include "OBD_Frame.h"
+#include "WWH_OBD.h"
+#include "Ford_OBD.h"
+#include "OBD_Routes.h"
+
+// ISO 15765-4:2011
+// Enhanced response timing after a response pending
+#define P2STAR_CAN_MAX 5000 // milliseconds, after NRC_RCRRP
+
+#define OBD_ENGINE_SLOTS   8 // queued plus outstanding requests
+#define OBD_ENGINE_RETRIES 3 // repeats after NRC_BRR before giving up
+
+// Result of OBD_Engine::receive()
+#define OBD_RX_IGNORED    0 // not an OBD response
+#define OBD_RX_RESPONSE   1 // positive response to an outstanding request
+#define OBD_RX_UNMATCHED  2 // positive response nobody was waiting for
+#define OBD_RX_NEGATIVE   3 // negative response, request completed
+#define OBD_RX_PENDING    4 // NRC_RCRRP or NRC_BRR, request still open
+
+// OBD_Transaction::state
+#define OBD_SLOT_FREE   0
+#define OBD_SLOT_QUEUED 1 // waiting for transmit()
+#define OBD_SLOT_HELD   2 // waiting to repeat after NRC_BRR
+#define OBD_SLOT_SENT   3 // waiting for the response
+
+typedef struct
+{
+  uint32_t deadline; // response timeout once sent, retry time once held
+  uint16_t pid;      // PID, or DID for SIDRQ_RDBI
+  OBD_Frame* frame;  // the caller's encoded request, or 0 for request[]
+  uint8_t request[OBD_FRAME_SIZE]; // frame data, batched PIDs from request[2]
+  uint8_t count;     // PIDs batched, 0 for a single PID or DID
+  uint8_t sid;
+  uint8_t state;     // OBD_SLOT_*
+  uint8_t sequence;  // queue order
+  uint8_t retries;
+  uint8_t target;    // ECU number, or OBD_ROUTE_FUNCTIONAL
+  bool external;     // sent by the caller, see track()
+} OBD_Transaction;
+
+class OBD_Engine
+{
+  public:
+    OBD_Engine();
+    void setWindow(byte window);
+    void setRoutes(OBD_Routes* routes);
+    bool request(byte sid, uint16_t pid);
+    bool request(OBD_Frame* frame);
+    bool requestBatch(byte sid, const byte* pids, byte count);
+    bool track(byte sid, uint16_t pid, uint32_t deadline, byte target);
+    void cancel(byte sid, uint16_t pid);
+    byte target(byte sid, uint16_t pid);
+    OBD_Frame* transmit(uint32_t now);
+    bool transmit(uint32_t now, OBD_Frame* frame);
+    byte receive(uint32_t id, const byte* payload, uint16_t length, uint32_t now);
+    byte expire(uint32_t now);
+    bool pending(byte sid, uint16_t pid);
+    byte outstanding();
+    byte queued();
+
+    uint32_t requests_sent;
+    uint32_t responses;
+    uint32_t negatives;
+    uint32_t timeouts;
+
+  private:
+    OBD_Transaction* allocate(byte sid, const byte* pids, byte count, uint16_t pid);
+    OBD_Transaction* match(byte sid, uint16_t pid, byte ecu);
+    bool open(byte target);
+    static bool contains(const OBD_Transaction* slot, uint16_t pid);
+    static uint16_t responsePID(byte sid, const byte* data);
+
+    OBD_Transaction slots[OBD_ENGINE_SLOTS];
+    OBD_Frame out;     // transmit() builds the slots' own requests here
+    OBD_Routes* routes;
+    byte window;
+    byte next_sequence;
+};
+
+#endif // _obd_engine_h_
@@ -0,0 +1,21 @@
+/*
+ CAN frame as passed between the CAN driver and the OBD layers
+ by:
+ date:
+ license:
+ */
+#ifndef obd_frame_h_
+#define obd_frame_h_
+
+#include <Arduino.h>
+
+typedef struct
+{
+  uint32_t id;        // 11 bit CAN identifier
+  uint32_t timestamp; // millis() when the frame was received
+  uint8_t length;     // DLC
+  uint8_t data[8];
+  uint8_t bus;        // CAN_Bus::index of the controller it came in on
+} OBD_Frame;
+
+#endif // _obd_frame_h_
@@ -0,0 +1,213 @@
+/*
+ Learned PID ownership for physically addressed requests
+ by:
+ date:
+ license:
+ */
+
+#include "OBD_Routes.h"
+
+/*
+
+*/
+OBD_Routes::OBD_Routes()
+{
+  clear();
+}
+
+/*
+ Forget every route and counter, for another vehicle.
+*/
+void OBD_Routes::clear()
+{
+  memset(routes, 0, sizeof(routes));
+  memset(replies, 0, sizeof(replies));
+  duplicates = 0;
+  dropped = 0;
+}
+
+/*
+ Feed a positive response payload from ECU number ecu (0 for ID_REPLY_1),
+ starting at the response SID. Every PID of a batched Service $01 reply
+ is learned, otherwise the PID, InfoType or DID it starts with.
+*/
+void OBD_Routes::learn(byte ecu, const byte* payload, uint16_t length)
+{
+  byte sid = payload[0] & ~0x40;
+
+  if ((ecu >= OBD_ROUTE_ECUS) || (length < 2))
+  {
+    return;
+  }
+
+  replies[ecu]++;
+
+  if (sid == SIDRQ_DIAG)
+  {
+    for (uint16_t i = 1; i < length; )
+    {
+      byte pid_length = WWH_OBD::pidLength(payload[i]);
+
+      learnPID(sid, payload[i], ecu);
+      if (pid_length == 0)
+      {
+        break;
+      }
+      i += 1 + pid_length;
+    }
+  }
+  else if ((sid == SIDRQ_RDBI) && (length >= 3))
+  {
+    learnPID(sid, (payload[1] << 8) + payload[2], ecu);
+  }
+  else
+  {
+    learnPID(sid, payload[1], ecu);
+  }
+}
+
+/*
+ ECU number to send a request for pid to, or OBD_ROUTE_FUNCTIONAL while
+ it has no owner yet.
+*/
+byte OBD_Routes::target(byte sid, uint16_t pid)
+{
+  OBD_Route* route = find(sid, pid);
+
+  if ((route == 0) || (route->count < OBD_ROUTE_LEARN))
+  {
+    return OBD_ROUTE_FUNCTIONAL;
+  }
+
+  return route->ecu;
+}
+
+/*
+ True if ECU number ecu is, or is about to become, the owner of pid, or
+ nobody is. Counts a duplicate otherwise.
+*/
+bool OBD_Routes::keep(byte sid, uint16_t pid, byte ecu)
+{
+  OBD_Route* route = find(sid, pid);
+
+  if ((route == 0) || (route->ecu == ecu))
+  {
+    return true;
+  }
+
+  duplicates++;
+  return false;
+}
+
+/*
+ A physical request for pid went unanswered.
+*/
+void OBD_Routes::missed(byte sid, uint16_t pid)
+{
+  OBD_Route* route = find(sid, pid);
+
+  if ((route != 0) && (route->count >= OBD_ROUTE_LEARN) && (++route->misses >= OBD_ROUTE_MISSES))
+  {
+    route->count = 0;
+    dropped++;
+  }
+}
+
+/*
+ The owner refused pid, ask every ECU again.
+*/
+void OBD_Routes::forget(byte sid, uint16_t pid)
+{
+  OBD_Route* route = find(sid, pid);
+
+  if (route != 0)
+  {
+    route->count = 0;
+    dropped++;
+  }
+}
+
+/*
+ Number of PIDs and DIDs sent physically.
+*/
+byte OBD_Routes::learned()
+{
+  byte count = 0;
+
+  for (byte i = 0; i < OBD_ROUTES; i++)
+  {
+    if (routes[i].count >= OBD_ROUTE_LEARN)
+    {
+      count++;
+    }
+  }
+
+  return count;
+}
+
+/*
+ One PID answered by ecu. The first ECU heard becomes the candidate, a
+ lower address takes over until the route is learned, and once it is the
+ other ECUs no longer change it.
+*/
+void OBD_Routes::learnPID(byte sid, uint16_t pid, byte ecu)
+{
+  OBD_Route* route;
+
+  if ((sid == SIDRQ_DIAG) && ((pid & 0x1F) == 0))
+  {
+    return;
+  }
+
+  route = find(sid, pid);
+  if (route == 0)
+  {
+    for (byte i = 0; i < OBD_ROUTES; i++)
+    {
+      if (routes[i].count == 0)
+      {
+        route = &routes[i];
+        break;
+      }
+    }
+    if (route == 0)
+    {
+      // Table full, the PID stays functional
+      return;
+    }
+    route->sid = sid;
+    route->pid = pid;
+    route->ecu = ecu;
+    route->count = 0;
+  }
+
+  if (ecu == route->ecu)
+  {
+    if (route->count < OBD_ROUTE_LEARN)
+    {
+      route->count++;
+    }
+    route->misses = 0;
+  }
+  else if ((route->count < OBD_ROUTE_LEARN) && (ecu < route->ecu))
+  {
+    route->ecu = ecu;
+    route->count = 1;
+  }
+}
+
+/*
+ Route in use for sid and pid, learned or not.
+*/
+OBD_Route* OBD_Routes::find(byte sid, uint16_t pid)
+{
+  for (byte i = 0; i < OBD_ROUTES; i++)
+  {
+    if ((routes[i].count != 0) && (routes[i].sid == sid) && (routes[i].pid == pid))
+    {
+      return &routes[i];
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,73 @@
+/*
+ Learned PID ownership for physically addressed requests
+ by:
+ date:
+ license:
+
+ A functional request on ID_REQUEST is answered by every ECU that knows
+ the PID, each on its own ID_REPLY_n, and all but one of those replies
+ cost bus time for nothing. OBD_Routes watches the positive replies and
+ learns which ECU owns each PID or DID asked for: the ECU that answered
+ it OBD_ROUTE_LEARN times, the lower address winning a PID several ECUs
+ answer since the engine controller sits on ID_REPLY_1. From then on
+ target() names that ECU and OBD_Engine sends the request physically on
+ its ID_REQUEST_n, so it draws exactly one reply.
+
+ A route is dropped again after OBD_ROUTE_MISSES physical requests in a
+ row go unanswered, or on a negative response, and the PID goes back to
+ functional requests until it is learned anew. The "PIDs supported"
+ ranges are always asked of every ECU and never routed.
+
+ keep() tells the caller whether a reply is the owner's. The others are
+ counted and should not overwrite the owner's samples.
+ */
+#ifndef obd_routes_h_
+#define obd_routes_h_
+
+#include <Arduino.h>
+#include "WWH_OBD.h"
+
+#if defined(ARDUINO_ARCH_AVR)
+#define OBD_ROUTES 8
+#else
+#define OBD_ROUTES 32
+#endif
+
+#define OBD_ROUTE_ECUS       8    // ID_REPLY_1 - ID_REPLY_8
+#define OBD_ROUTE_FUNCTIONAL 0xFF // target() before a PID is learned
+#define OBD_ROUTE_LEARN      2    // replies from the same ECU before it owns the PID
+#define OBD_ROUTE_MISSES     2    // unanswered physical requests before the route is dropped
+
+typedef struct
+{
+  uint16_t pid;      // PID, InfoType or DID
+  uint8_t sid;
+  uint8_t ecu;       // owner, 0 for ID_REPLY_1
+  uint8_t count;     // replies from ecu while learning, 0 = free
+  uint8_t misses;
+} OBD_Route;
+
+class OBD_Routes
+{
+  public:
+    OBD_Routes();
+    void clear();
+    void learn(byte ecu, const byte* payload, uint16_t length);
+    byte target(byte sid, uint16_t pid);
+    bool keep(byte sid, uint16_t pid, byte ecu);
+    void missed(byte sid, uint16_t pid);
+    void forget(byte sid, uint16_t pid);
+    byte learned();
+
+    uint16_t replies[OBD_ROUTE_ECUS]; // positive replies from each ECU
+    uint32_t duplicates;              // replies from an ECU not owning the PID
+    uint16_t dropped;                 // routes given up
+
+  private:
+    void learnPID(byte sid, uint16_t pid, byte ecu);
+    OBD_Route* find(byte sid, uint16_t pid);
+
+    OBD_Route routes[OBD_ROUTES];
+};
+
+#endif // _obd_routes_h_
@@ -0,0 +1,95 @@
+/*
+ On-Board Diagnostics decoded sample
+ by:
+ date:
+ license:
+ */
+
+#include "OBD_Sample.h"
+
+// Indexed by OBD_UNIT_*
+static const char unit_text[OBD_UNIT_MAX + 1][5] PROGMEM = {
+  "", "%", "*C", "kPa", "Pa", "RPM", "km/h", "deg", "g/s", "V", "s", "min", "km", "", "L/h", "Nm", "", "", "mA", "kg/h", "mg"
+};
+
+static const char hex_digits[] = "0123456789ABCDEF";
+
+/*
+ Write count bytes as upper case hex, returns the number of characters written.
+*/
+byte formatHex(const byte* data, byte count, char* text)
+{
+  byte len = 0;
+
+  for (byte i = 0; i < count; i++)
+  {
+    text[len++] = hex_digits[data[i] >> 4];
+    text[len++] = hex_digits[data[i] & 0x0F];
+  }
+  text[len] = 0;
+
+  return len;
+}
+
+/*
+ Write a fixed point value with the given number of implied decimals,
+ returns the number of characters written.
+*/
+byte formatFixed(int32_t value, byte decimals, char* text)
+{
+  char digits[11];
+  byte count = 0;
+  byte len = 0;
+  uint32_t magnitude = value;
+
+  if (value < 0)
+  {
+    text[len++] = '-';
+    magnitude = 0 - magnitude;
+  }
+
+  do
+  {
+    digits[count++] = '0' + (magnitude % 10);
+    magnitude /= 10;
+  } while ((magnitude != 0) || (count <= decimals));
+
+  while (count > 0)
+  {
+    text[len++] = digits[--count];
+    if ((count == decimals) && (count != 0))
+    {
+      text[len++] = '.';
+    }
+  }
+  text[len] = 0;
+
+  return len;
+}
+
+/*
+ Write the value and unit of a sample, text must hold at least 17 characters.
+ Returns the number of characters written.
+*/
+byte formatSample(const OBD_Sample* sample, char* text)
+{
+  byte len;
+
+  if (sample->unit == OBD_UNIT_BITS)
+  {
+    byte data[4];
+    byte count = (sample->digits + 1) / 2;
+
+    data[0] = sample->raw >> 24;
+    data[1] = sample->raw >> 16;
+    data[2] = sample->raw >> 8;
+    data[3] = sample->raw;
+
+    return formatHex(data + 4 - count, count, text);
+  }
+
+  len = formatFixed(sample->value, sample->decimals, text);
+  strcpy_P(text + len, unit_text[sample->unit]);
+
+  return len + strlen(text + len);
+}
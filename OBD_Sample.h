@@ -0,0 +1,55 @@
+/*
+ On-Board Diagnostics decoded sample
+ by:
+ date:
+ license:
+
+ A decoded PID or DID value kept as integers so that logging, shift lights
+ and derived channels can work on numbers without parsing text back. Text
+ is only produced by formatSample() when a display actually needs it.
+ */
+#ifndef obd_sample_h_
+#define obd_sample_h_
+
+#include <Arduino.h>
+
+// Units of the decoded values
+#define OBD_UNIT_NONE    0x00
+#define OBD_UNIT_PERCENT 0x01 // %
+#define OBD_UNIT_DEGC    0x02 // degree C
+#define OBD_UNIT_KPA     0x03 // kPa
+#define OBD_UNIT_PA      0x04 // Pa
+#define OBD_UNIT_RPM     0x05 // min-1
+#define OBD_UNIT_KMH     0x06 // km/h
+#define OBD_UNIT_DEG     0x07 // degree (angle)
+#define OBD_UNIT_GS      0x08 // g/s
+#define OBD_UNIT_VOLT    0x09 // V
+#define OBD_UNIT_SEC     0x0A // s
+#define OBD_UNIT_MIN     0x0B // min
+#define OBD_UNIT_KM      0x0C // km
+#define OBD_UNIT_LAMBDA  0x0D // equivalence ratio
+#define OBD_UNIT_LPH     0x0E // L/h
+#define OBD_UNIT_NM      0x0F // Nm
+#define OBD_UNIT_COUNT   0x10 // counts
+#define OBD_UNIT_BITS    0x11 // bit mapped, shown as hex
+#define OBD_UNIT_MA      0x12 // mA
+#define OBD_UNIT_KGH     0x13 // kg/h
+#define OBD_UNIT_MG      0x14 // mg, per stroke
+#define OBD_UNIT_MAX     0x14
+
+typedef struct
+{
+  uint32_t timestamp; // millis() when the response was received
+  int32_t raw;        // data bytes as sent by the ECU, sign extended
+  int32_t value;      // scaled value in units of 10^-decimals
+  uint16_t pid;       // PID, or DID for UDS ReadDataByIdentifier
+  uint8_t unit;       // OBD_UNIT_*
+  uint8_t decimals;   // implied decimals
+  uint8_t digits;     // hex digits shown for OBD_UNIT_BITS, 0 otherwise
+} OBD_Sample;
+
+byte formatSample(const OBD_Sample* sample, char* text);
+byte formatFixed(int32_t value, byte decimals, char* text);
+byte formatHex(const byte* data, byte count, char* text);
+
+#endif // _obd_sample_h_
@@ -0,0 +1,338 @@
+/*
+ Rate based polling scheduler
+ by:
+ date:
+ license:
+ */
+
+#include "OBD_Scheduler.h"
+
+// Round trip assumed until the first response is measured, 1/16 milliseconds
+#define OBD_SCHED_COST_INIT (10 * 16)
+
+/*
+
+*/
+OBD_Scheduler::OBD_Scheduler()
+{
+  clear();
+}
+
+/*
+ Drop every channel.
+*/
+void OBD_Scheduler::clear()
+{
+  count = 0;
+  window_start = 0;
+  cost = OBD_SCHED_COST_INIT;
+}
+
+/*
+ Add a channel polled at rate tenths of a Hz, see OBD_HZ(). Returns the
+ channel index, or -1 if the table is full or the rate is out of range.
+*/
+int8_t OBD_Scheduler::add(byte sid, uint16_t pid, uint16_t rate, byte priority)
+{
+  OBD_Channel* channel;
+
+  if ((count >= OBD_SCHED_CHANNELS) || (rate == 0) || (rate > 10000))
+  {
+    return -1;
+  }
+
+  channel = &list[count];
+  channel->sid = sid;
+  channel->pid = pid;
+  channel->rate = rate;
+  channel->period = 10000 / rate;
+  channel->priority = priority;
+  channel->due = 0;
+  channel->sent = 0;
+  channel->achieved = 0;
+  channel->samples = 0;
+  channel->in_flight = false;
+  if (sid == SIDRQ_RDBI)
+  {
+    Ford_OBD::encodeQuery(pid, channel->request.data);
+  }
+  else
+  {
+    WWH_OBD::encodeQuery(sid, pid, channel->request.data);
+  }
+
+  return count++;
+}
+
+/*
+ Queue every channel that is due. Due Service $01 PIDs share a request
+ with the others going to the same ECU, as long as the response fits in
+ max_payload bytes. Returns the number of channels queued.
+*/
+byte OBD_Scheduler::poll(uint32_t now, OBD_Engine* engine, byte max_payload)
+{
+  byte pids[OBD_BATCH_MAX];
+  int8_t chosen[OBD_BATCH_MAX];
+  byte batch = 0;
+  byte queued = 0;
+  int8_t index;
+
+  if ((now - window_start) >= OBD_SCHED_WINDOW)
+  {
+    for (byte i = 0; i < count; i++)
+    {
+      list[i].achieved = ((uint32_t)list[i].samples * 10000) / (now - window_start);
+      list[i].samples = 0;
+    }
+    window_start = now;
+  }
+
+  // A request the engine gave up on is free to go again
+  for (byte i = 0; i < count; i++)
+  {
+    if (list[i].in_flight && (engine->pending(list[i].sid, list[i].pid) == false))
+    {
+      list[i].in_flight = false;
+    }
+  }
+
+  // One batch per ECU the due PIDs are routed to
+  for (;;)
+  {
+    int8_t skipped[OBD_SCHED_CHANNELS];
+    byte skips = 0;
+    byte target = OBD_ROUTE_FUNCTIONAL;
+    bool accepted;
+
+    batch = 0;
+    while (batch < OBD_BATCH_MAX)
+    {
+      index = earliest(now, SIDRQ_DIAG, true);
+      if (index < 0)
+      {
+        break;
+      }
+
+      // Reserve it so the next earliest() looks further
+      list[index].in_flight = true;
+
+      if (batch == 0)
+      {
+        target = engine->target(SIDRQ_DIAG, list[index].pid);
+      }
+      else if (engine->target(SIDRQ_DIAG, list[index].pid) != target)
+      {
+        // Another ECU's, for the next batch
+        skipped[skips++] = index;
+        continue;
+      }
+
+      pids[batch] = list[index].pid;
+      if (WWH_OBD::batchSize(pids, batch + 1, max_payload) <= batch)
+      {
+        list[index].in_flight = false;
+        break;
+      }
+
+      chosen[batch++] = index;
+    }
+
+    for (byte i = 0; i < skips; i++)
+    {
+      list[skipped[i]].in_flight = false;
+    }
+
+    if (batch == 0)
+    {
+      break;
+    }
+
+    if (batch == 1)
+    {
+      accepted = engine->request(&list[chosen[0]].request);
+    }
+    else
+    {
+      accepted = engine->requestBatch(SIDRQ_DIAG, pids, batch);
+    }
+
+    for (byte i = 0; i < batch; i++)
+    {
+      list[chosen[i]].in_flight = false;
+      if (accepted)
+      {
+        issue(&list[chosen[i]], now);
+        queued++;
+      }
+    }
+
+    if (accepted == false)
+    {
+      break;
+    }
+  }
+
+  while ((index = earliest(now, SIDRQ_DIAG, false)) >= 0)
+  {
+    if (engine->request(&list[index].request) == false)
+    {
+      break;
+    }
+    issue(&list[index], now);
+    queued++;
+  }
+
+  return queued;
+}
+
+/*
+ Count a response for the channel and measure the round trip.
+*/
+void OBD_Scheduler::received(byte sid, uint16_t pid, uint32_t now)
+{
+  for (byte i = 0; i < count; i++)
+  {
+    if ((list[i].sid == sid) && (list[i].pid == pid))
+    {
+      if (list[i].in_flight)
+      {
+        uint32_t latency = now - list[i].sent;
+
+        if (latency > P2STAR_CAN_MAX)
+        {
+          latency = P2STAR_CAN_MAX;
+        }
+        cost += ((int32_t)(latency * 16) - (int32_t)cost) / 8;
+        list[i].in_flight = false;
+      }
+      list[i].samples++;
+      return;
+    }
+  }
+}
+
+/*
+ Share of the bus and ECU time the requested rates need, in per mille of
+ the measured round trip. Service $01 PIDs are assumed to share requests,
+ but never fewer requests than the fastest of them needs.
+*/
+uint16_t OBD_Scheduler::load()
+{
+  uint32_t diag_sum = 0;
+  uint32_t diag_max = 0;
+  uint32_t other_sum = 0;
+  uint32_t requests;
+
+  for (byte i = 0; i < count; i++)
+  {
+    if (list[i].sid == SIDRQ_DIAG)
+    {
+      diag_sum += list[i].rate;
+      if (list[i].rate > diag_max)
+      {
+        diag_max = list[i].rate;
+      }
+    }
+    else
+    {
+      other_sum += list[i].rate;
+    }
+  }
+
+  requests = diag_sum / OBD_BATCH_MAX;
+  if (requests < diag_max)
+  {
+    requests = diag_max;
+  }
+  requests += other_sum;
+
+  // tenths of requests per second times 1/16 ms per request
+  requests = (requests * cost) / 160;
+
+  return (requests > 0xFFFF) ? 0xFFFF : requests;
+}
+
+/*
+ True if the requested rates fit in the measured round trip budget.
+*/
+bool OBD_Scheduler::feasible()
+{
+  return (load() <= 1000);
+}
+
+/*
+
+*/
+byte OBD_Scheduler::channels()
+{
+  return count;
+}
+
+/*
+
+*/
+const OBD_Channel* OBD_Scheduler::channel(byte index)
+{
+  return (index < count) ? &list[index] : 0;
+}
+
+/*
+ Requested rate of a channel in tenths of a Hz.
+*/
+uint16_t OBD_Scheduler::requested(byte index)
+{
+  return (index < count) ? list[index].rate : 0;
+}
+
+/*
+ Rate a channel achieved over the last window in tenths of a Hz.
+*/
+uint16_t OBD_Scheduler::achieved(byte index)
+{
+  return (index < count) ? list[index].achieved : 0;
+}
+
+/*
+ Due channel with the earliest deadline, the lower priority number winning
+ a tie. batchable selects Service sid channels, otherwise every other one.
+ Returns -1 if nothing is due.
+*/
+int8_t OBD_Scheduler::earliest(uint32_t now, byte sid, bool batchable)
+{
+  int8_t best = -1;
+
+  for (byte i = 0; i < count; i++)
+  {
+    OBD_Channel* channel = &list[i];
+
+    if (channel->in_flight || ((int32_t)(now - channel->due) < 0) ||
+        ((channel->sid == sid) != batchable))
+    {
+      continue;
+    }
+
+    if ((best < 0) || ((int32_t)(channel->due - list[best].due) < 0) ||
+        ((channel->due == list[best].due) && (channel->priority < list[best].priority)))
+    {
+      best = i;
+    }
+  }
+
+  return best;
+}
+
+/*
+ Mark a channel as requested and move its deadline one period on. A
+ channel that fell behind restarts from now instead of bursting.
+*/
+void OBD_Scheduler::issue(OBD_Channel* channel, uint32_t now)
+{
+  channel->in_flight = true;
+  channel->sent = now;
+  channel->due += channel->period;
+
+  if ((int32_t)(now - channel->due) >= 0)
+  {
+    channel->due = now + channel->period;
+  }
+}
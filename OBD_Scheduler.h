@@ -0,0 +1,81 @@
+/*
+ Rate based polling scheduler
+ by:
+ date:
+ license:
+
+ Every channel is a Service $01 PID or a UDS DID with a target rate and a
+ priority. poll() queues the channels whose deadline has passed on the
+ OBD_Engine, earliest deadline first with the priority breaking ties, and
+ packs due Service $01 PIDs into one batched request per ECU they are
+ routed to, see OBD_Routes.
+
+ Every channel's request frame is encoded once, by add(), and a due
+ channel that has no other PID to share a request with is queued as that
+ frame, see OBD_Engine::request(frame). Only batches are encoded per poll,
+ from whichever PIDs are due.
+
+ Each request costs about one round trip on the bus and in the ECU. The
+ scheduler measures that round trip and reports through load() whether
+ the requested rates fit in the time available; achieved() gives the rate
+ each channel actually got over the last second.
+ */
+#ifndef obd_scheduler_h_
+#define obd_scheduler_h_
+
+#include <Arduino.h>
+#include "OBD_Frame.h"
+#include "WWH_OBD.h"
+#include "OBD_Engine.h"
+
+#if defined(ARDUINO_ARCH_AVR)
+#define OBD_SCHED_CHANNELS 8 // the dashboard's, each holds its request frame
+#else
+#define OBD_SCHED_CHANNELS 16
+#endif
+#define OBD_SCHED_WINDOW   1000 // milliseconds over which achieved rates are counted
+
+// Rates are kept in tenths of a Hz so slow channels can go below 1 Hz
+#define OBD_HZ(hz) ((hz) * 10)
+
+typedef struct
+{
+  uint32_t due;       // next deadline
+  uint32_t sent;      // when the request went out
+  uint16_t pid;       // PID, or DID for SIDRQ_RDBI
+  uint16_t period;    // milliseconds between requests
+  uint16_t rate;      // requested, tenths of a Hz
+  uint16_t achieved;  // over the last window, tenths of a Hz
+  uint16_t samples;   // in the current window
+  uint8_t sid;
+  uint8_t priority;   // 0 is the most important
+  bool in_flight;
+  OBD_Frame request;  // encoded by add()
+} OBD_Channel;
+
+class OBD_Scheduler
+{
+  public:
+    OBD_Scheduler();
+    void clear();
+    int8_t add(byte sid, uint16_t pid, uint16_t rate, byte priority);
+    byte poll(uint32_t now, OBD_Engine* engine, byte max_payload);
+    void received(byte sid, uint16_t pid, uint32_t now);
+    uint16_t load();
+    bool feasible();
+    byte channels();
+    const OBD_Channel* channel(byte index);
+    uint16_t requested(byte index);
+    uint16_t achieved(byte index);
+
+  private:
+    int8_t earliest(uint32_t now, byte sid, bool batchable);
+    void issue(OBD_Channel* channel, uint32_t now);
+
+    OBD_Channel list[OBD_SCHED_CHANNELS];
+    uint32_t window_start;
+    uint16_t cost;  // measured round trip, 1/16 milliseconds
+    byte count;
+};
+
+#endif // _obd_scheduler_h_
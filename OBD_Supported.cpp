@@ -0,0 +1,289 @@
+/*
+ Supported PID discovery and cache
+ by:
+ date:
+ license:
+ */
+
+#include "OBD_Supported.h"
+
+// Every "PIDs supported" PID, requested in two batches
+static const byte range_pids[] = {0x00, 0x20, 0x40, 0x60, 0x80, 0xA0, 0xC0, 0xE0};
+
+/*
+
+*/
+OBD_Supported::OBD_Supported()
+{
+  memset(&cache, 0, sizeof(cache));
+  memset(any, 0, sizeof(any));
+  state = OBD_SUP_IDLE;
+  step = 0;
+  answered = 0;
+  dirty = false;
+  cache_hit = false;
+  discovery_time = 0;
+}
+
+/*
+ Start by asking for the VIN, which decides whether the cached sets can be
+ used or the chain has to be walked.
+*/
+void OBD_Supported::begin(uint32_t now)
+{
+  started = now;
+  state = OBD_SUP_VIN;
+  step = 0;
+  cache_hit = false;
+}
+
+/*
+ Queue the requests the current step needs. Call on every pass of the
+ poll loop until ready().
+
+ The engine is done with a functional request at the first reply, while
+ the other ECUs may take until P2CAN_MAX after it and ignore a request
+ that arrives as they answer the last one. So every step waits that long
+ after the engine let go of its request before the next goes out, and
+ the last one before the sets are ready.
+*/
+void OBD_Supported::poll(OBD_Engine* engine, uint32_t now)
+{
+  switch (state)
+  {
+    case OBD_SUP_VIN:
+      if ((now - started) < OBD_TIMEOUT_SHORT)
+      {
+        engine->request(SIDRQ_INFO, INFOTYPE_VIN);
+        break;
+      }
+      // No VIN from this vehicle, discover without a key
+      memset(&cache, 0, sizeof(cache));
+      state = OBD_SUP_DISCOVER;
+      answered = now - P2CAN_MAX;
+      // fall through
+
+    case OBD_SUP_DISCOVER:
+      if ((step & 1) && (engine->pending(SIDRQ_DIAG, range_pids[(step == 1) ? 0 : OBD_BATCH_MAX]) == false))
+      {
+        answered = now;
+        step++;
+      }
+      else if (((step & 1) == 0) && ((now - answered) >= P2CAN_MAX))
+      {
+        if (step == 0)
+        {
+          step += engine->requestBatch(SIDRQ_DIAG, range_pids, OBD_BATCH_MAX);
+        }
+        else if (step == 2)
+        {
+          step += engine->requestBatch(SIDRQ_DIAG, range_pids + OBD_BATCH_MAX, sizeof(range_pids) - OBD_BATCH_MAX);
+        }
+        else
+        {
+          state = OBD_SUP_READY;
+          discovery_time = now - started;
+          dirty = (cache.ecus != 0);
+        }
+      }
+      break;
+  }
+}
+
+/*
+ Feed a Service $01 or $09 response payload from ECU id.
+*/
+void OBD_Supported::update(uint32_t id, const byte* payload, uint16_t length, uint32_t now)
+{
+  byte ecu = id - ID_REPLY_1;
+
+  if ((id < ID_REPLY_1) || (ecu >= OBD_SUPPORTED_ECUS) || (length < 2))
+  {
+    return;
+  }
+
+  if ((state == OBD_SUP_VIN) && (payload[0] == SIDPR_INFO) && (payload[1] == INFOTYPE_VIN) &&
+      (length >= 3 + OBD_VIN_LENGTH))
+  {
+    // 49 02 01 followed by the 17 VIN characters
+    if ((cache.magic == OBD_SUPPORTED_MAGIC) && (memcmp(cache.vin, payload + 3, OBD_VIN_LENGTH) == 0))
+    {
+      cache_hit = true;
+      state = OBD_SUP_READY;
+      discovery_time = now - started;
+    }
+    else
+    {
+      memset(&cache, 0, sizeof(cache));
+      memcpy(cache.vin, payload + 3, OBD_VIN_LENGTH);
+      merge();
+      state = OBD_SUP_DISCOVER;
+      answered = now;
+    }
+    return;
+  }
+
+  if ((state != OBD_SUP_DISCOVER) || (payload[0] != SIDPR_DIAG))
+  {
+    return;
+  }
+
+  // Bitmap PIDs are 4 data bytes each, anything else is not ours
+  for (byte i = 1; i + 5 <= length; i += 5)
+  {
+    byte pid = payload[i];
+    const byte* data = payload + i + 1;
+
+    if ((pid & 0x1F) != 0)
+    {
+      break;
+    }
+
+    cache.bits[ecu][pid >> 3] |= 1 << (pid & 0x07);
+
+    for (byte j = 0; j < 32; j++)
+    {
+      // Bit 7 of A is PID+1, bit 0 of D is PID+$20
+      uint16_t supported_pid = pid + 1 + j;
+
+      if ((supported_pid <= 0xFF) && (data[j >> 3] & (0x80 >> (j & 0x07))))
+      {
+        cache.bits[ecu][supported_pid >> 3] |= 1 << (supported_pid & 0x07);
+      }
+    }
+
+    cache.ecus |= 1 << ecu;
+  }
+
+  merge();
+}
+
+/*
+ True once the sets are known, from the cache or from discovery.
+*/
+bool OBD_Supported::ready()
+{
+  return (state == OBD_SUP_READY);
+}
+
+/*
+ True if any ECU supports pid. Before any ECU answered every PID counts as
+ supported, so nothing is hidden on a vehicle that ignores PID $00.
+*/
+bool OBD_Supported::supported(byte pid)
+{
+  if (cache.ecus == 0)
+  {
+    return true;
+  }
+
+  return (any[pid >> 3] & (1 << (pid & 0x07))) != 0;
+}
+
+/*
+ True if ECU number ecu (0 for ID_REPLY_1) supports pid.
+*/
+bool OBD_Supported::supported(byte ecu, byte pid)
+{
+  if (ecu >= OBD_SUPPORTED_ECUS)
+  {
+    return false;
+  }
+
+  return (cache.bits[ecu][pid >> 3] & (1 << (pid & 0x07))) != 0;
+}
+
+/*
+ Next supported PID after pid in the given direction, skipping the
+ "PIDs supported" PIDs. Returns pid if there is none.
+*/
+byte OBD_Supported::next(byte pid, int8_t direction)
+{
+  byte candidate = pid;
+
+  for (uint16_t i = 0; i < 0xFF; i++)
+  {
+    candidate += direction;
+    if (((candidate & 0x1F) != 0) && supported(candidate))
+    {
+      return candidate;
+    }
+  }
+
+  return pid;
+}
+
+/*
+ Take over sets saved by image(). Returns false if the image is not valid.
+*/
+bool OBD_Supported::load(const OBD_Supported_Image* image)
+{
+  if ((image->magic != OBD_SUPPORTED_MAGIC) || (image->crc != crc(image)))
+  {
+    return false;
+  }
+
+  cache = *image;
+  merge();
+
+  return true;
+}
+
+/*
+ The sets ready to be stored, keyed by the VIN.
+*/
+const OBD_Supported_Image* OBD_Supported::image()
+{
+  cache.magic = OBD_SUPPORTED_MAGIC;
+  cache.crc = crc(&cache);
+
+  return &cache;
+}
+
+/*
+ True once after discovery found new sets that should be stored.
+*/
+bool OBD_Supported::changed()
+{
+  bool was_dirty = dirty;
+
+  dirty = false;
+
+  return was_dirty;
+}
+
+/*
+
+*/
+void OBD_Supported::merge()
+{
+  memset(any, 0, sizeof(any));
+
+  for (byte ecu = 0; ecu < OBD_SUPPORTED_ECUS; ecu++)
+  {
+    for (byte i = 0; i < sizeof(any); i++)
+    {
+      any[i] |= cache.bits[ecu][i];
+    }
+  }
+}
+
+/*
+ CRC-16/CCITT over the image, excluding the crc itself.
+*/
+uint16_t OBD_Supported::crc(const OBD_Supported_Image* image)
+{
+  const byte* data = (const byte*)image;
+  uint16_t crc = 0xFFFF;
+
+  for (uint16_t i = 0; i < offsetof(OBD_Supported_Image, crc); i++)
+  {
+    crc ^= (uint16_t)data[i] << 8;
+    for (byte bit = 0; bit < 8; bit++)
+    {
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1);
+    }
+  }
+
+  return crc;
+}
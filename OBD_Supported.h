@@ -0,0 +1,82 @@
+/*
+ Supported PID discovery and cache
+ by:
+ date:
+ license:
+
+ SAE J1979 Section 6.1.2.2 - PID $00 reports which of PIDs $01 - $20 an
+ ECU supports, PID $20 which of $21 - $40 and so on, the last bit of each
+ range telling whether the next range exists. The ranges are requested as
+ batched Service $01 requests and kept as one packed 256 bit set per ECU,
+ so supported() is a single bit test. Each request is followed by
+ P2CAN_MAX for the slower ECUs, as the engine stops waiting at the first
+ reply.
+
+ The sets are keyed by the VIN (Service $09 InfoType $02). image() and
+ load() let the sketch keep them in the Uno's EEPROM or the Due's flash,
+ and a warm start on the same vehicle skips discovery entirely.
+ */
+#ifndef obd_supported_h_
+#define obd_supported_h_
+
+#include <Arduino.h>
+#include "WWH_OBD.h"
+#include "OBD_Engine.h"
+
+#if defined(ARDUINO_ARCH_AVR)
+#define OBD_SUPPORTED_ECUS 2
+#else
+#define OBD_SUPPORTED_ECUS 8
+#endif
+
+#define OBD_SUPPORTED_MAGIC 0x5350 // "SP"
+#define OBD_VIN_LENGTH 17
+#define INFOTYPE_VIN 0x02 // SAE J1979 Service $09 InfoType, Vehicle Identification Number
+
+// OBD_Supported::state
+#define OBD_SUP_IDLE     0
+#define OBD_SUP_VIN      1 // waiting for the VIN to check the cache
+#define OBD_SUP_DISCOVER 2 // walking the PID $00/$20/$40/... chain, P2CAN_MAX after each request
+#define OBD_SUP_READY    3
+
+typedef struct
+{
+  uint16_t magic;
+  char vin[OBD_VIN_LENGTH];
+  uint8_t ecus;                          // bit n set if ECU n answered
+  uint8_t bits[OBD_SUPPORTED_ECUS][32];  // bit n set if PID n is supported
+  uint16_t crc;
+} OBD_Supported_Image;
+
+class OBD_Supported
+{
+  public:
+    OBD_Supported();
+    void begin(uint32_t now);
+    void poll(OBD_Engine* engine, uint32_t now);
+    void update(uint32_t id, const byte* payload, uint16_t length, uint32_t now);
+    bool ready();
+    bool supported(byte pid);
+    bool supported(byte ecu, byte pid);
+    byte next(byte pid, int8_t direction);
+    bool load(const OBD_Supported_Image* image);
+    const OBD_Supported_Image* image();
+    bool changed();
+
+    uint32_t discovery_time; // milliseconds from begin() to ready()
+    bool cache_hit;
+
+  private:
+    void merge();
+    static uint16_t crc(const OBD_Supported_Image* image);
+
+    OBD_Supported_Image cache;
+    uint8_t any[32]; // union of all ECUs
+    uint32_t started;
+    uint32_t answered; // when the engine let go of the last request
+    uint8_t state;
+    uint8_t step;
+    bool dirty;
+};
+
+#endif // _obd_supported_h_
@@ -0,0 +1,267 @@
+/*
+ Binary session log
+ by:
+ date:
+ license:
+ */
+
+#include "SD_Log.h"
+
+// CRC-16/CCITT a nibble at a time, a whole block has to be cheap on the AVR
+static const uint16_t crc_nibble[16] PROGMEM = {
+  0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+  0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF
+};
+
+/*
+
+*/
+SD_Log::SD_Log()
+{
+  begin();
+}
+
+/*
+ Start a new log, dropping anything not yet written.
+*/
+void SD_Log::begin()
+{
+  records = 0;
+  blocks = 0;
+  dropped = 0;
+  sequence = 0;
+  filling = 0;
+  full = 0;
+
+  for (byte i = 0; i < SD_LOG_BUFFERS; i++)
+  {
+    buffers[i].header.count = 0;
+  }
+}
+
+/*
+ Add a record to the filling block. Returns false if the record had to be
+ dropped because the card has not taken the sealed blocks yet, which is
+ also the fate of a record too far in time from the block's others once
+ their block is sealed for it.
+*/
+bool SD_Log::append(uint16_t channel, uint32_t timestamp, int32_t raw)
+{
+  SD_Log_Block* current = &buffers[filling];
+  int32_t gap = timestamp - last;
+
+  if (full >= SD_LOG_BUFFERS)
+  {
+    dropped++;
+    return false;
+  }
+
+  // A gap too long for the delta starts a new block with its own time
+  if ((current->header.count > 0) && ((gap > 32767) || (gap < -32768)))
+  {
+    seal();
+    return append(channel, timestamp, raw);
+  }
+
+  if (current->header.count == 0)
+  {
+    current->header.timestamp = timestamp;
+    last = timestamp;
+  }
+
+  SD_Log_Record* record = &current->records[current->header.count++];
+
+  record->delta = timestamp - last;
+  record->channel = channel;
+  record->raw = raw;
+  last = timestamp;
+  records++;
+
+  if (current->header.count >= SD_LOG_RECORDS)
+  {
+    seal();
+  }
+
+  return true;
+}
+
+/*
+
+*/
+bool SD_Log::append(const OBD_Sample* sample)
+{
+  return append(sample->pid, sample->timestamp, sample->raw);
+}
+
+/*
+ Seal a block that has been filling for SD_LOG_SEAL, so a quiet bus still
+ reaches the card.
+*/
+void SD_Log::poll(uint32_t now)
+{
+  SD_Log_Block* current = &buffers[filling];
+
+  if ((full < SD_LOG_BUFFERS) && (current->header.count > 0) &&
+      ((now - current->header.timestamp) >= SD_LOG_SEAL))
+  {
+    seal();
+  }
+}
+
+/*
+ Close the filling block and queue it for the card. Unused records are
+ zeroed so the block never carries stale data.
+*/
+void SD_Log::seal()
+{
+  SD_Log_Block* current = &buffers[filling];
+
+  if ((current->header.count == 0) || (full >= SD_LOG_BUFFERS))
+  {
+    return;
+  }
+
+  memset(&current->records[current->header.count], 0,
+         (SD_LOG_RECORDS - current->header.count) * sizeof(SD_Log_Record));
+
+  close(SD_LOG_KIND_RECORDS);
+}
+
+/*
+ Room for a Series_Codec block of SD_LOG_SERIES_SIZE bytes, zeroed, in a
+ buffer of its own: records filling are sealed first. 0 while every
+ buffer waits for the card.
+*/
+byte* SD_Log::series()
+{
+  seal();
+
+  if (full >= SD_LOG_BUFFERS)
+  {
+    return 0;
+  }
+
+  memset(buffers[filling].records, 0, SD_LOG_SERIES_SIZE);
+
+  return (byte*)buffers[filling].records;
+}
+
+/*
+ Queue the block series() handed out, samples of it from timestamp on.
+*/
+void SD_Log::sealSeries(uint32_t timestamp, uint16_t samples)
+{
+  SD_Log_Block* current = &buffers[filling];
+
+  if ((samples == 0) || (current->header.count > 0) || (full >= SD_LOG_BUFFERS))
+  {
+    return;
+  }
+
+  current->header.timestamp = timestamp;
+  close(SD_LOG_KIND_SERIES);
+  records += samples;
+}
+
+/*
+ Fill in the header of the filling block and hand it to the card.
+*/
+void SD_Log::close(uint8_t kind)
+{
+  SD_Log_Block* current = &buffers[filling];
+
+  current->header.magic = SD_LOG_MAGIC;
+  current->header.version = SD_LOG_VERSION;
+  current->header.sequence = sequence++;
+  current->header.kind = kind;
+  current->header.reserved = 0;
+  current->header.crc = 0;
+  current->header.crc = crc((const byte*)current, SD_LOG_BLOCK_SIZE);
+
+  full++;
+  filling = (filling + 1) % SD_LOG_BUFFERS;
+  blocks++;
+}
+
+/*
+ True if a record appended now would be kept.
+*/
+bool SD_Log::ready()
+{
+  return full < SD_LOG_BUFFERS;
+}
+
+/*
+ Oldest sealed block waiting to be written, SD_LOG_BLOCK_SIZE bytes, or 0.
+*/
+const byte* SD_Log::block()
+{
+  if (full == 0)
+  {
+    return 0;
+  }
+
+  return (const byte*)&buffers[(filling + SD_LOG_BUFFERS - full) % SD_LOG_BUFFERS];
+}
+
+/*
+ The block from block() is on the card, its buffer can fill again.
+*/
+void SD_Log::written()
+{
+  if (full > 0)
+  {
+    buffers[(filling + SD_LOG_BUFFERS - full) % SD_LOG_BUFFERS].header.count = 0;
+    full--;
+  }
+}
+
+/*
+ CRC-16/CCITT, continuing from crc so a block can be checked in pieces.
+*/
+uint16_t SD_Log::crc(const byte* data, uint16_t length, uint16_t crc)
+{
+  for (uint16_t i = 0; i < length; i++)
+  {
+    crc = (crc << 4) ^ pgm_read_word(&crc_nibble[(crc >> 12) ^ (data[i] >> 4)]);
+    crc = (crc << 4) ^ pgm_read_word(&crc_nibble[(crc >> 12) ^ (data[i] & 0x0F)]);
+  }
+
+  return crc;
+}
+
+/*
+ True if a block read back has the right magic and CRC.
+*/
+bool SD_Log::valid(const SD_Log_Block* block)
+{
+  const byte* data = (const byte*)block;
+  const byte zero[sizeof(block->header.crc)] = {0, 0};
+  uint16_t check;
+
+  if ((block->header.magic != SD_LOG_MAGIC) || (block->header.count > SD_LOG_RECORDS))
+  {
+    return false;
+  }
+
+  // As sealed, with the crc field still zero
+  check = crc(data, offsetof(SD_Log_Header, crc));
+  check = crc(zero, sizeof(zero), check);
+  check = crc(data + sizeof(SD_Log_Header), SD_LOG_BLOCK_SIZE - sizeof(SD_Log_Header), check);
+
+  return (check == block->header.crc);
+}
+
+/*
+ Milliseconds from the previous record of a block read back to this one,
+ unsigned in version 1 logs.
+*/
+int32_t SD_Log::delta(const SD_Log_Block* block, byte record)
+{
+  if (block->header.version < 2)
+  {
+    return (uint16_t)block->records[record].delta;
+  }
+
+  return block->records[record].delta;
+}
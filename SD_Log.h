@@ -0,0 +1,122 @@
+/*
+ Binary session log
+ by:
+ date:
+ license:
+
+ The log is a plain sequence of 512 byte blocks, one SD card sector each,
+ so every block can be read on its own. A block starts with a header
+ holding a magic number, a running sequence number, the time of its first
+ record and a CRC-16/CCITT over the whole block, followed by fixed size
+ records of a timestamp delta, a channel and the raw value. The delta is
+ signed: sources that stamp a sample with when it was taken rather than
+ when it was read, the GPS and the IMU FIFOs, log it behind records
+ already written.
+
+ Records fill one of SD_LOG_BUFFERS block buffers while the ones sealed
+ before it wait for the card. A block is handed out as soon as it is
+ full or SD_LOG_SEAL milliseconds old and written() gives its buffer back;
+ only when every buffer is waiting is ready() false and append() drops.
+ The sketch writes the sealed blocks from writeLog(), one a pass, never
+ on the path that appends, into a file it has grown ahead of them with
+ zeroed sectors: each block is a whole sector written in place, on the
+ card without a flush, so a power cut costs only what is still in RAM,
+ the block filling and a sealed one for at most a pass.
+
+ The Uno's 2 KB have room for one buffer beside the SD library's own 512
+ byte cache, so there records appended between a seal and the next
+ writeLog() are dropped. On the SAM3X8E the flight recorder's ring holds
+ the records while the card is busy as well, drain() stopping at ready().
+
+ A block of kind SD_LOG_KIND_SERIES carries one channel's records as a
+ Series_Codec block in the room of the records instead, for the flight
+ recorder's windows: series() hands out the filling buffer's room and
+ sealSeries() queues it, with no append() between the two. Its count is
+ 0, so a reader that does not know the kind sees an empty block.
+
+ A reader skips blocks with a bad magic or CRC and uses the sequence
+ numbers to spot gaps. The zeroed sectors past the last block written
+ have a magic of 0.
+
+ All fields are little endian, as on the AVR and SAM3X8E.
+ */
+#ifndef sd_log_h_
+#define sd_log_h_
+
+#include <Arduino.h>
+#include "OBD_Sample.h"
+
+#define SD_LOG_BLOCK_SIZE 512
+#define SD_LOG_MAGIC      0x4C41 // "AL"
+#define SD_LOG_VERSION    2      // 1 had unsigned deltas
+#define SD_LOG_RECORDS    62     // (SD_LOG_BLOCK_SIZE - header) / record
+#if defined(ARDUINO_ARCH_AVR)
+#define SD_LOG_BUFFERS    1      // no RAM for a second beside the SD library's cache
+#else
+#define SD_LOG_BUFFERS    2      // one filling while the other waits for the card
+#endif
+#define SD_LOG_SEAL       1000   // milliseconds a block may stay partly filled
+#define SD_LOG_SERIES_SIZE 496   // room of the records for a Series_Codec block
+
+// SD_Log_Header::kind
+#define SD_LOG_KIND_RECORDS 0
+#define SD_LOG_KIND_SERIES  1
+
+typedef struct
+{
+  uint16_t magic;
+  uint8_t version;
+  uint8_t count;      // records used
+  uint32_t sequence;  // block number since the log was opened
+  uint32_t timestamp; // millis() of the first record
+  uint8_t kind;       // SD_LOG_KIND_*, 0 before kinds were added
+  uint8_t reserved;
+  uint16_t crc;       // CRC-16/CCITT over the block with crc = 0
+} SD_Log_Header;
+
+typedef struct
+{
+  int16_t delta;    // milliseconds since the previous record, or the header
+  uint16_t channel; // OBD_Sample::pid
+  int32_t raw;      // OBD_Sample::raw, scaled on the host
+} SD_Log_Record;
+
+typedef struct
+{
+  SD_Log_Header header;
+  SD_Log_Record records[SD_LOG_RECORDS];
+} SD_Log_Block;
+
+class SD_Log
+{
+  public:
+    SD_Log();
+    void begin();
+    bool append(uint16_t channel, uint32_t timestamp, int32_t raw);
+    bool append(const OBD_Sample* sample);
+    void poll(uint32_t now);
+    void seal();
+    byte* series();
+    void sealSeries(uint32_t timestamp, uint16_t samples);
+    bool ready();
+    const byte* block();
+    void written();
+    static uint16_t crc(const byte* data, uint16_t length, uint16_t crc = 0xFFFF);
+    static bool valid(const SD_Log_Block* block);
+    static int32_t delta(const SD_Log_Block* block, byte record);
+
+    uint32_t records;
+    uint32_t blocks;
+    uint32_t dropped; // records lost because every block was waiting for the card
+
+  private:
+    void close(uint8_t kind);
+
+    SD_Log_Block buffers[SD_LOG_BUFFERS];
+    uint32_t last;     // timestamp of the last record in the filling block
+    uint32_t sequence;
+    uint8_t filling;   // buffer being filled
+    uint8_t full;      // buffers waiting for the card, oldest first
+};
+
+#endif // _sd_log_h_
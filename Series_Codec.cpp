@@ -0,0 +1,430 @@
+/*
+ Delta-of-delta and XOR compression of one channel's samples
+ by:
+ date:
+ license:
+ */
+
+#include "Series_Codec.h"
+
+// Bits of each class behind the prefixes 10, 110, 1110 and 1111
+static const byte timestamp_widths[4] = {7, 9, 12, 32};
+static const byte delta_widths[4] = {6, 12, 20, 32};
+
+/*
+ Small magnitudes of either sign to small codes: 0, -1, 1, -2, 2 ...
+*/
+static uint32_t zigzag(int32_t value)
+{
+  return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+/*
+
+*/
+static int32_t unzigzag(uint32_t code)
+{
+  return (int32_t)((code >> 1) ^ (0 - (code & 1)));
+}
+
+/*
+ Zero bits above the highest one of a non-zero value, a byte at a time
+ first so the AVR does not shift 32 bits in a loop.
+*/
+static byte leadingZeros(uint32_t value)
+{
+  byte zeros = 0;
+
+  while ((value & 0xFF000000UL) == 0)
+  {
+    value <<= 8;
+    zeros += 8;
+  }
+  while ((value & 0x80000000UL) == 0)
+  {
+    value <<= 1;
+    zeros++;
+  }
+
+  return zeros;
+}
+
+/*
+ Zero bits below the lowest one of a non-zero value.
+*/
+static byte trailingZeros(uint32_t value)
+{
+  byte zeros = 0;
+
+  while ((value & 0xFF) == 0)
+  {
+    value >>= 8;
+    zeros += 8;
+  }
+  while ((value & 1) == 0)
+  {
+    value >>= 1;
+    zeros++;
+  }
+
+  return zeros;
+}
+
+/*
+
+*/
+Series_Encoder::Series_Encoder()
+{
+  begin(0, 0, 0, SERIES_XOR);
+}
+
+/*
+ Start a block of channel in buffer, size bytes, header included.
+*/
+void Series_Encoder::begin(byte* buffer, uint16_t size, uint16_t channel, byte mode)
+{
+  Series_Header header;
+
+  this->buffer = buffer;
+  this->size = (size > SERIES_HEADER) ? (uint32_t)(size - SERIES_HEADER) * 8 : 0;
+  this->mode = mode;
+  used = 0;
+  samples = 0;
+  last_timestamp = 0;
+  last_interval = 0;
+  last_value = 0;
+  leading = 0xFF;
+  trailing = 0;
+
+  if (this->size > 0)
+  {
+    header.magic = SERIES_MAGIC;
+    header.mode = mode;
+    header.count = 0;
+    header.channel = channel;
+    memcpy(buffer, &header, SERIES_HEADER);
+  }
+}
+
+/*
+ Add a sample. Returns false, and leaves the block as it was, once the
+ longest sample might not fit; finish() the block and begin another.
+*/
+bool Series_Encoder::append(uint32_t timestamp, int32_t value)
+{
+  if (used + SERIES_MAX_BITS > size)
+  {
+    return false;
+  }
+
+  if (samples == 0)
+  {
+    put(timestamp, 32);
+    put(value, 32);
+  }
+  else
+  {
+    uint32_t interval = timestamp - last_timestamp;
+
+    putClass(zigzag((int32_t)(interval - last_interval)), timestamp_widths);
+    last_interval = interval;
+
+    if (mode == SERIES_DELTA)
+    {
+      putClass(zigzag(value - last_value), delta_widths);
+    }
+    else
+    {
+      uint32_t bits = (uint32_t)value ^ (uint32_t)last_value;
+
+      if (bits == 0)
+      {
+        put(0, 1);
+      }
+      else
+      {
+        byte zeros_high = leadingZeros(bits);
+        byte zeros_low = trailingZeros(bits);
+
+        if ((leading != 0xFF) && (zeros_high >= leading) && (zeros_low >= trailing))
+        {
+          put(2, 2);
+          put(bits >> trailing, 32 - leading - trailing);
+        }
+        else
+        {
+          byte length = 32 - zeros_high - zeros_low;
+
+          put(3, 2);
+          put(zeros_high, 5);
+          put(length - 1, 5);
+          put(bits >> zeros_low, length);
+          leading = zeros_high;
+          trailing = zeros_low;
+        }
+      }
+    }
+  }
+
+  last_timestamp = timestamp;
+  last_value = value;
+  samples++;
+
+  return true;
+}
+
+/*
+ Write the sample count to the header. Returns the bytes of the block.
+*/
+uint16_t Series_Encoder::finish()
+{
+  if (size == 0)
+  {
+    return 0;
+  }
+
+  // Series_Header::count, little endian as on the targets
+  buffer[2] = samples & 0xFF;
+  buffer[3] = samples >> 8;
+
+  return SERIES_HEADER + (used + 7) / 8;
+}
+
+/*
+ Samples in the block so far.
+*/
+uint16_t Series_Encoder::count()
+{
+  return samples;
+}
+
+/*
+ The low bits of value, highest first, filling each byte from its top.
+*/
+void Series_Encoder::put(uint32_t value, byte bits)
+{
+  byte* data = buffer + SERIES_HEADER;
+
+  while (bits > 0)
+  {
+    byte offset = used & 7;
+    byte room = 8 - offset;
+    byte take = (bits < room) ? bits : room;
+    byte chunk = (byte)(value >> (bits - take)) & (0xFF >> (8 - take));
+
+    if (offset == 0)
+    {
+      data[used >> 3] = 0;
+    }
+    data[used >> 3] |= chunk << (room - take);
+    used += take;
+    bits -= take;
+  }
+}
+
+/*
+ A zigzag code in the smallest class of widths it fits.
+*/
+void Series_Encoder::putClass(uint32_t zigzag, const byte* widths)
+{
+  if (zigzag == 0)
+  {
+    put(0, 1);
+    return;
+  }
+
+  for (byte k = 0; k < 3; k++)
+  {
+    if (zigzag < (1UL << widths[k]))
+    {
+      // k + 1 ones and a zero
+      put(((1 << (k + 1)) - 1) << 1, k + 2);
+      put(zigzag, widths[k]);
+      return;
+    }
+  }
+
+  put(0x0F, 4);
+  put(zigzag, widths[3]);
+}
+
+/*
+
+*/
+Series_Decoder::Series_Decoder()
+{
+  begin(0, 0);
+}
+
+/*
+ Start reading a block of length bytes. Returns false if it is not one.
+*/
+bool Series_Decoder::begin(const byte* block, uint16_t length)
+{
+  next = 0;
+  end = 0;
+  window = 0;
+  available = 0;
+  decoded = 0;
+  last_timestamp = 0;
+  last_interval = 0;
+  last_value = 0;
+  leading = 0;
+  this->length = 0;
+  memset(&header, 0, sizeof(header));
+
+  if ((block == 0) || (length < SERIES_HEADER))
+  {
+    return false;
+  }
+
+  memcpy(&header, block, SERIES_HEADER);
+  if ((header.magic != SERIES_MAGIC) || (header.mode > SERIES_DELTA))
+  {
+    header.count = 0;
+    return false;
+  }
+
+  next = block + SERIES_HEADER;
+  end = block + length;
+
+  return true;
+}
+
+/*
+ Decode up to max further samples. Returns how many were decoded.
+*/
+uint16_t Series_Decoder::decode(uint32_t* timestamps, int32_t* values, uint16_t max)
+{
+  uint16_t n = 0;
+
+  if ((decoded == 0) && (header.count > 0) && (max > 0))
+  {
+    last_timestamp = get(32);
+    last_value = get(32);
+    timestamps[n] = last_timestamp;
+    values[n] = last_value;
+    n++;
+    decoded++;
+  }
+
+  while ((decoded < header.count) && (n < max))
+  {
+    last_interval += unzigzag(getClass(timestamp_widths));
+    last_timestamp += last_interval;
+
+    if (header.mode == SERIES_DELTA)
+    {
+      last_value += unzigzag(getClass(delta_widths));
+    }
+    else if (get(1) != 0)
+    {
+      if (get(1) != 0)
+      {
+        leading = get(5);
+        length = get(5) + 1;
+      }
+      last_value ^= get(length) << (32 - leading - length);
+    }
+
+    timestamps[n] = last_timestamp;
+    values[n] = last_value;
+    n++;
+    decoded++;
+  }
+
+  return n;
+}
+
+/*
+ Samples in the block.
+*/
+uint16_t Series_Decoder::count()
+{
+  return header.count;
+}
+
+/*
+
+*/
+uint16_t Series_Decoder::channel()
+{
+  return header.channel;
+}
+
+/*
+ The next bits, 1 to 32 of them.
+*/
+uint32_t Series_Decoder::get(byte bits)
+{
+  uint32_t value;
+
+  if (available < bits)
+  {
+    refill();
+  }
+
+  value = (uint32_t)(window >> (64 - bits));
+  window <<= bits;
+  available -= bits;
+
+  return value;
+}
+
+/*
+ A zigzag code behind its class prefix.
+*/
+uint32_t Series_Decoder::getClass(const byte* widths)
+{
+  byte top;
+  byte ones;
+
+  if (available < 4)
+  {
+    refill();
+  }
+
+  top = (byte)(window >> 60);
+  ones = (top < 8) ? 0 : (top < 12) ? 1 : (top < 14) ? 2 : (top < 15) ? 3 : 4;
+
+  if (ones == 0)
+  {
+    window <<= 1;
+    available -= 1;
+    return 0;
+  }
+
+  // 10, 110, 1110 or 1111
+  byte prefix = (ones < 4) ? ones + 1 : 4;
+  window <<= prefix;
+  available -= prefix;
+
+  return get(widths[ones - 1]);
+}
+
+/*
+ Top the window up to at least 56 bits, eight bytes in one load while
+ there are that many left. Bits past the end of the block read as 0.
+*/
+void Series_Decoder::refill()
+{
+  if (end - next >= 8)
+  {
+    uint64_t bytes = 0;
+
+    for (byte i = 0; i < 8; i++)
+    {
+      bytes = (bytes << 8) | next[i];
+    }
+    window |= bytes >> available;
+    next += (63 - available) >> 3;
+    available |= 56;
+    return;
+  }
+
+  while ((available <= 56) && (next < end))
+  {
+    window |= (uint64_t)*next++ << (56 - available);
+    available += 8;
+  }
+}
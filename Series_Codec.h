@@ -0,0 +1,114 @@
+/*
+ Delta-of-delta and XOR compression of one channel's samples
+ by:
+ date:
+ license:
+
+ The Gorilla scheme for time series, on the integer samples the logs
+ carry. A block holds one channel: a header, the first timestamp and
+ value in full, then for every further sample
+
+   timestamp  the change of the interval since the previous sample,
+              zigzag coded in the smallest of five bit-length classes
+              behind a unary prefix, so a steady rate costs one bit:
+                0                          unchanged
+                10    + 7 bits             up to 63 ms either way
+                110   + 9 bits             up to 255 ms
+                1110  + 12 bits            up to 2047 ms
+                1111  + 32 bits            anything
+   value      SERIES_XOR: XOR with the previous value, one bit if equal,
+              else the bits between its leading and trailing zeros,
+              reusing the previous window where they fit
+                0                          equal
+                10    + window bits        inside the previous window
+                11    + 5 bits leading zeros + 5 bits length - 1 + bits
+              SERIES_DELTA: the change since the previous value,
+              zigzag coded in classes as the timestamps
+                0                          equal
+                10    + 6 bits             up to 31 either way
+                110   + 12 bits            up to 2047
+                1110  + 20 bits            up to 2^19 - 1
+                1111  + 32 bits            anything
+
+ XOR suits values that keep most of their bits, delta values that move
+ in small steps around a level, sensor axes and counters.
+
+ Series_Encoder writes into a buffer the caller owns, one byte at a time
+ with 32-bit arithmetic only, so it can run inline on the AVR and SAM as
+ samples arrive. append() refuses a sample once the worst case would not
+ fit, so a block never ends in a partial sample. Series_Decoder reads a
+ block back 64 bits at a time, for the host.
+ */
+#ifndef series_codec_h_
+#define series_codec_h_
+
+#include <Arduino.h>
+
+#define SERIES_XOR   0
+#define SERIES_DELTA 1
+
+#define SERIES_MAGIC    0x53 // "S"
+#define SERIES_HEADER   6    // magic, mode, count, channel
+#define SERIES_MAX_BITS 80   // longest sample, 4 + 32 timestamp and 2 + 5 + 5 + 32 value bits
+
+typedef struct
+{
+  uint8_t magic;
+  uint8_t mode;      // SERIES_XOR or SERIES_DELTA
+  uint16_t count;    // samples in the block
+  uint16_t channel;  // OBD_Sample::pid or a log channel
+} Series_Header;
+
+class Series_Encoder
+{
+  public:
+    Series_Encoder();
+    void begin(byte* buffer, uint16_t size, uint16_t channel, byte mode);
+    bool append(uint32_t timestamp, int32_t value);
+    uint16_t finish();
+    uint16_t count();
+
+  private:
+    void put(uint32_t value, byte bits);
+    void putClass(uint32_t zigzag, const byte* widths);
+
+    byte* buffer;
+    uint32_t size;           // bits
+    uint32_t used;           // bits
+    byte mode;
+    uint16_t samples;
+    uint32_t last_timestamp;
+    uint32_t last_interval;
+    int32_t last_value;
+    byte leading;            // window of the last XOR, leading = 0xFF before one
+    byte trailing;
+};
+
+class Series_Decoder
+{
+  public:
+    Series_Decoder();
+    bool begin(const byte* block, uint16_t length);
+    uint16_t decode(uint32_t* timestamps, int32_t* values, uint16_t max);
+    uint16_t count();
+    uint16_t channel();
+
+  private:
+    uint32_t get(byte bits);
+    uint32_t getClass(const byte* widths);
+    void refill();
+
+    const byte* next;
+    const byte* end;
+    uint64_t window;         // unread bits, first one in bit 63
+    byte available;
+    Series_Header header;
+    uint16_t decoded;
+    uint32_t last_timestamp;
+    uint32_t last_interval;
+    int32_t last_value;
+    byte leading;
+    byte length;
+};
+
+#endif // _series_codec_h_
@@ -0,0 +1,279 @@
+/*
+ Fixed-point streaming filters
+ by:
+ date:
+ license:
+ */
+
+#include "Stream_Filter.h"
+
+#define FILTER_EMPTY_MIN 0x7FFFFFFFL        // an empty bucket never wins
+#define FILTER_EMPTY_MAX (-0x7FFFFFFFL - 1)
+
+/*
+
+*/
+EMA_Filter::EMA_Filter()
+{
+  begin(0);
+}
+
+/*
+ Weight of a new sample is 2^-shift, about the average of the last
+ 2^shift samples.
+*/
+void EMA_Filter::begin(byte shift)
+{
+  this->shift = shift;
+  state = 0;
+  have_value = false;
+}
+
+/*
+ Returns the new average. The first sample is taken as it is so the
+ average does not have to climb from 0.
+*/
+int32_t EMA_Filter::update(int32_t value)
+{
+  if (have_value == false)
+  {
+    state = value * 256;
+    have_value = true;
+  }
+  else
+  {
+    state += (value * 256 - state) >> shift;
+  }
+
+  return this->value();
+}
+
+/*
+ Rounded to the nearest unit.
+*/
+int32_t EMA_Filter::value()
+{
+  return (state + 128) >> 8;
+}
+
+/*
+ True once a sample was taken.
+*/
+bool EMA_Filter::primed()
+{
+  return have_value;
+}
+
+/*
+
+*/
+MinMax_Filter::MinMax_Filter()
+{
+  begin(1000);
+}
+
+/*
+ Window in milliseconds, at least FILTER_BUCKETS.
+*/
+void MinMax_Filter::begin(uint16_t window)
+{
+  bucket_length = window / FILTER_BUCKETS;
+  if (bucket_length == 0)
+  {
+    bucket_length = 1;
+  }
+  filled = 0;
+  current = 0;
+  bucket_start = 0;
+  older_min = FILTER_EMPTY_MIN;
+  older_max = FILTER_EMPTY_MAX;
+}
+
+/*
+ Samples are expected in time order; an older one counts for the current
+ bucket.
+*/
+void MinMax_Filter::update(uint32_t timestamp, int32_t value)
+{
+  if ((filled == 0) || ((int32_t)(timestamp - bucket_start) >= (int32_t)bucket_length))
+  {
+    roll(timestamp, value);
+    return;
+  }
+
+  if (value < bucket_min[current])
+  {
+    bucket_min[current] = value;
+  }
+  if (value > bucket_max[current])
+  {
+    bucket_max[current] = value;
+  }
+}
+
+/*
+ Least value in the window, 0 before the first sample.
+*/
+int32_t MinMax_Filter::minimum()
+{
+  if (filled == 0)
+  {
+    return 0;
+  }
+
+  return (older_min < bucket_min[current]) ? older_min : bucket_min[current];
+}
+
+/*
+ Greatest value in the window, 0 before the first sample.
+*/
+int32_t MinMax_Filter::maximum()
+{
+  if (filled == 0)
+  {
+    return 0;
+  }
+
+  return (older_max > bucket_max[current]) ? older_max : bucket_max[current];
+}
+
+/*
+ Begin the bucket timestamp falls into with value, leaving the buckets
+ skipped on the way empty, and fold the ones still in the window.
+*/
+void MinMax_Filter::roll(uint32_t timestamp, int32_t value)
+{
+  uint32_t steps = FILTER_BUCKETS;
+
+  if (filled != 0)
+  {
+    steps = (timestamp - bucket_start) / bucket_length;
+  }
+
+  if (steps >= FILTER_BUCKETS)
+  {
+    // Nothing left of the window
+    filled = 1;
+    current = 0;
+    bucket_start = timestamp;
+  }
+  else
+  {
+    bucket_start += steps * bucket_length;
+    while (steps-- > 0)
+    {
+      current = (current + 1) % FILTER_BUCKETS;
+      bucket_min[current] = FILTER_EMPTY_MIN;
+      bucket_max[current] = FILTER_EMPTY_MAX;
+      if (filled < FILTER_BUCKETS)
+      {
+        filled++;
+      }
+    }
+  }
+
+  bucket_min[current] = value;
+  bucket_max[current] = value;
+
+  older_min = FILTER_EMPTY_MIN;
+  older_max = FILTER_EMPTY_MAX;
+  for (byte i = 1; i < filled; i++)
+  {
+    byte bucket = (current + FILTER_BUCKETS - i) % FILTER_BUCKETS;
+
+    if (bucket_min[bucket] < older_min)
+    {
+      older_min = bucket_min[bucket];
+    }
+    if (bucket_max[bucket] > older_max)
+    {
+      older_max = bucket_max[bucket];
+    }
+  }
+}
+
+/*
+
+*/
+Rate_Filter::Rate_Filter()
+{
+  begin(0);
+}
+
+/*
+ Least milliseconds between the two samples a rate is taken from.
+*/
+void Rate_Filter::begin(uint16_t period)
+{
+  this->period = period;
+  last_timestamp = 0;
+  last_value = 0;
+  have_value = false;
+}
+
+/*
+ Returns true and the change per second in rate once period has passed
+ since the sample the last rate was taken from.
+*/
+bool Rate_Filter::update(uint32_t timestamp, int32_t value, int32_t* rate)
+{
+  int32_t elapsed = (int32_t)(timestamp - last_timestamp);
+  int32_t step;
+
+  if (have_value == false)
+  {
+    have_value = true;
+    last_timestamp = timestamp;
+    last_value = value;
+    return false;
+  }
+  if ((elapsed <= 0) || (elapsed < (int32_t)period))
+  {
+    return false;
+  }
+
+  step = value - last_value;
+  if (step > FILTER_RATE_STEP_MAX)
+  {
+    step = FILTER_RATE_STEP_MAX;
+  }
+  else if (step < -FILTER_RATE_STEP_MAX)
+  {
+    step = -FILTER_RATE_STEP_MAX;
+  }
+
+  *rate = step * 1000 / elapsed;
+  last_timestamp = timestamp;
+  last_value = value;
+
+  return true;
+}
+
+/*
+ Integer square root, one bit per round.
+*/
+uint32_t filterRoot(uint32_t value)
+{
+  uint32_t root = 0;
+  uint32_t bit = 1UL << 30;
+
+  while (bit > value)
+  {
+    bit >>= 2;
+  }
+  while (bit != 0)
+  {
+    if (value >= root + bit)
+    {
+      value -= root + bit;
+      root = (root >> 1) + bit;
+    }
+    else
+    {
+      root >>= 1;
+    }
+    bit >>= 2;
+  }
+
+  return root;
+}
@@ -0,0 +1,88 @@
+/*
+ Fixed-point streaming filters
+ by:
+ date:
+ license:
+
+ Filters for derived channels that take one sample at a time in constant
+ time and keep their state in the object, without the heap or floating
+ point, so they fit the per-sample budget of an AVR.
+
+ EMA_Filter is an exponential moving average with a weight of 2^-shift,
+ one shift and one add per sample. State is kept with 8 extra bits so
+ small steps are not lost; values have to stay within +-2^22.
+
+ MinMax_Filter keeps the least and greatest value of the last window
+ milliseconds in FILTER_BUCKETS buckets. A sample only touches the newest
+ bucket; the buckets before it are folded once when a new bucket begins,
+ so the work per sample is a constant and a bucket roll costs
+ FILTER_BUCKETS compares. The window moves in steps of a bucket: it
+ covers between FILTER_BUCKETS - 1 and FILTER_BUCKETS buckets of time.
+
+ Rate_Filter is the change per second between samples at least period
+ milliseconds apart, so a fast channel with coarse steps does not give
+ mostly zeros and spikes. Steps are clamped to FILTER_RATE_STEP_MAX so
+ the product with 1000 fits 32 bits.
+ */
+#ifndef stream_filter_h_
+#define stream_filter_h_
+
+#include <Arduino.h>
+
+#define FILTER_BUCKETS       8
+#define FILTER_RATE_STEP_MAX 2000000
+
+class EMA_Filter
+{
+  public:
+    EMA_Filter();
+    void begin(byte shift);
+    int32_t update(int32_t value);
+    int32_t value();
+    bool primed();
+
+  private:
+    int32_t state; // value * 256
+    byte shift;
+    bool have_value;
+};
+
+class MinMax_Filter
+{
+  public:
+    MinMax_Filter();
+    void begin(uint16_t window);
+    void update(uint32_t timestamp, int32_t value);
+    int32_t minimum();
+    int32_t maximum();
+
+  private:
+    void roll(uint32_t timestamp, int32_t value);
+
+    int32_t bucket_min[FILTER_BUCKETS];
+    int32_t bucket_max[FILTER_BUCKETS];
+    int32_t older_min;       // of the buckets before the current one
+    int32_t older_max;
+    uint32_t bucket_start;   // timestamp the current bucket began
+    uint16_t bucket_length;  // milliseconds
+    byte current;
+    byte filled;             // buckets in the window, the current one included
+};
+
+class Rate_Filter
+{
+  public:
+    Rate_Filter();
+    void begin(uint16_t period);
+    bool update(uint32_t timestamp, int32_t value, int32_t* rate);
+
+  private:
+    uint32_t last_timestamp;
+    int32_t last_value;
+    uint16_t period;
+    bool have_value;
+};
+
+uint32_t filterRoot(uint32_t value);
+
+#endif // _stream_filter_h_
@@ -0,0 +1,108 @@
+/*
+ Button events from the LCD shield's port expander
+ by:
+ date:
+ license:
+ */
+
+#include "UI_Buttons.h"
+
+/*
+
+*/
+UI_Buttons::UI_Buttons()
+{
+  changed = false;
+  last = 0;
+  head = 0;
+  tail = 0;
+  dropped = 0;
+
+  for (byte i = 0; i < 5; i++)
+  {
+    changed_at[i] = 0;
+  }
+}
+
+/*
+ Called from the INTA interrupt.
+*/
+void UI_Buttons::interrupt()
+{
+  changed = true;
+}
+
+/*
+ True once after the expander signalled a change.
+*/
+bool UI_Buttons::pending()
+{
+  if (changed == false)
+  {
+    return false;
+  }
+
+  changed = false;
+
+  return true;
+}
+
+/*
+ Take the buttons held now, a bit per button as readButtons() returns
+ them, and queue an event for each one newly pressed. Releases are not
+ events, and neither is a press sooner than UI_BUTTONS_DEBOUNCE after the
+ button's last edge, which is how contact bounce looks.
+*/
+void UI_Buttons::update(byte state, uint32_t now)
+{
+  byte changes;
+  byte pressed;
+
+  state &= UI_BUTTONS_MASK;
+  changes = state ^ last;
+  pressed = state & ~last;
+  last = state;
+
+  for (byte i = 0; i < 5; i++)
+  {
+    byte button = 1 << i;
+    bool settled = ((now - changed_at[i]) >= UI_BUTTONS_DEBOUNCE);
+
+    if ((changes & button) == 0)
+    {
+      continue;
+    }
+    changed_at[i] = now;
+
+    if (((pressed & button) == 0) || (settled == false))
+    {
+      continue;
+    }
+
+    if ((byte)(head - tail) >= UI_BUTTONS_QUEUE)
+    {
+      dropped++;
+      continue;
+    }
+    queue[head & (UI_BUTTONS_QUEUE - 1)] = button;
+    head++;
+  }
+}
+
+/*
+ Oldest queued button press, 0 if there is none.
+*/
+byte UI_Buttons::next()
+{
+  byte button;
+
+  if (head == tail)
+  {
+    return 0;
+  }
+
+  button = queue[tail & (UI_BUTTONS_QUEUE - 1)];
+  tail++;
+
+  return button;
+}
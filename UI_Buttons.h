@@ -0,0 +1,54 @@
+/*
+ Button events from the LCD shield's port expander
+ by:
+ date:
+ license:
+
+ The five buttons of the RGB LCD shield sit on port A of its MCP23017.
+ With interrupt-on-change enabled the expander pulls INTA low when a
+ button changes and holds it low until the port is read, so the
+ loop only spends I2C time on buttons after one actually moved. INTA is
+ not routed to a header on the shield and needs a wire to an interrupt
+ pin.
+
+ interrupt() only notes the change, I2C cannot run inside an interrupt;
+ the sketch reads the port and hands the buttons to update(), which
+ queues one event per button pressed. The queue does not care where the
+ states come from, so a host program can feed it directly.
+ */
+#ifndef ui_buttons_h_
+#define ui_buttons_h_
+
+#include <Arduino.h>
+
+#define UI_BUTTONS_QUEUE    8  // power of two
+#define UI_BUTTONS_MASK     0x1F // BUTTON_SELECT .. BUTTON_LEFT, GPA0 - GPA4
+#define UI_BUTTONS_DEBOUNCE 40 // milliseconds a button has to be released before a press
+
+// MCP23017 registers with IOCON.BANK = 0, as Adafruit_MCP23017 leaves them
+#define MCP23017_ADDRESS_BASE 0x20
+#define MCP23017_GPINTENA 0x04
+#define MCP23017_INTCONA  0x08
+#define MCP23017_GPIOA    0x12
+
+class UI_Buttons
+{
+  public:
+    UI_Buttons();
+    void interrupt();
+    bool pending();
+    void update(byte state, uint32_t now);
+    byte next();
+
+    uint16_t dropped;
+
+  private:
+    volatile bool changed;
+    byte last;                    // buttons held at the last update
+    uint32_t changed_at[5];       // last edge per button, for the debounce
+    byte queue[UI_BUTTONS_QUEUE];
+    byte head;
+    byte tail;
+};
+
+#endif // _ui_buttons_h_
@@ -0,0 +1,81 @@
+/*
+ Display mode state machine
+ by:
+ date:
+ license:
+ */
+
+#include "UI_Mode.h"
+
+// Buttons without an entry do nothing in that mode
+static const UI_Transition transitions[] PROGMEM = {
+  {UI_MENU,   BUTTON_DOWN,   UI_DASH,   UI_ACT_NONE},
+  {UI_MENU,   BUTTON_UP,     UI_INFO,   UI_ACT_NONE},
+  {UI_MENU,   BUTTON_LEFT,   UI_FORD,   UI_ACT_NONE},
+  {UI_MENU,   BUTTON_RIGHT,  UI_LISTEN, UI_ACT_NONE},
+  {UI_DASH,   BUTTON_UP,     UI_MENU,   UI_ACT_NONE},
+  {UI_DASH,   BUTTON_SELECT, UI_DASH,   UI_ACT_REPORT},
+  {UI_DASH,   BUTTON_DOWN,   UI_DASH,   UI_ACT_MARK},
+  {UI_INFO,   BUTTON_LEFT,   UI_INFO,   UI_ACT_PID_PREV},
+  {UI_INFO,   BUTTON_RIGHT,  UI_INFO,   UI_ACT_PID_NEXT},
+  {UI_INFO,   BUTTON_DOWN,   UI_MENU,   UI_ACT_NONE},
+  {UI_FORD,   BUTTON_RIGHT,  UI_MENU,   UI_ACT_NONE},
+  {UI_FORD,   BUTTON_SELECT, UI_FORD,   UI_ACT_MARK},
+  {UI_LISTEN, BUTTON_UP,     UI_MENU,   UI_ACT_NONE},
+  {UI_LISTEN, BUTTON_SELECT, UI_LISTEN, UI_ACT_MARK}
+};
+
+#define TRANSITION_COUNT (sizeof(transitions) / sizeof(UI_Transition))
+
+static const char mode_names[][7] PROGMEM = {"MENU", "DASH", "INFO", "FORD", "LISTEN"};
+
+/*
+
+*/
+UI_Mode::UI_Mode()
+{
+  current = UI_MENU;
+}
+
+/*
+ Apply one button event. Returns UI_ACT_ENTER when it changed the mode,
+ the transition's own action otherwise.
+*/
+byte UI_Mode::handle(byte button)
+{
+  UI_Transition transition;
+
+  for (byte i = 0; i < TRANSITION_COUNT; i++)
+  {
+    memcpy_P(&transition, &transitions[i], sizeof(UI_Transition));
+
+    if ((transition.state == current) && (transition.button == button))
+    {
+      if (transition.next != current)
+      {
+        current = transition.next;
+        return UI_ACT_ENTER;
+      }
+
+      return transition.action;
+    }
+  }
+
+  return UI_ACT_NONE;
+}
+
+/*
+
+*/
+byte UI_Mode::state()
+{
+  return current;
+}
+
+/*
+ Name of a mode in flash, for F()-style printing.
+*/
+const char* UI_Mode::name(byte state)
+{
+  return mode_names[(state <= UI_LISTEN) ? state : UI_MENU];
+}
@@ -0,0 +1,54 @@
+/*
+ Display mode state machine
+ by:
+ date:
+ license:
+
+ Which screen is shown and what each button does on it, as one table of
+ transitions instead of a bool per mode. handle() never waits: it takes
+ one button event, moves to the next mode and returns the action the
+ sketch has to carry out, so the bus and the log keep running whatever
+ the display shows.
+ */
+#ifndef ui_mode_h_
+#define ui_mode_h_
+
+#include <Arduino.h>
+#include <Adafruit_RGBLCDShield.h>
+
+// UI_Mode::state()
+#define UI_MENU   0
+#define UI_DASH   1 // dashboard(), scheduled Service $01 PIDs
+#define UI_INFO   2 // vehicleInfo(), one PID at a time
+#define UI_FORD   3 // fordInfo(), Ford transmission snapshot
+#define UI_LISTEN 4 // listenInfo(), broadcast signals only, nothing is sent
+
+// Returned by UI_Mode::handle()
+#define UI_ACT_NONE     0
+#define UI_ACT_ENTER    1 // the mode changed
+#define UI_ACT_PID_PREV 2
+#define UI_ACT_PID_NEXT 3
+#define UI_ACT_REPORT   4 // rates and buffer use to the serial port
+#define UI_ACT_MARK     5 // freeze the flight recorder's window
+
+typedef struct
+{
+  uint8_t state;
+  uint8_t button; // BUTTON_*
+  uint8_t next;
+  uint8_t action; // UI_ACT_*, UI_ACT_ENTER is implied by a new state
+} UI_Transition;
+
+class UI_Mode
+{
+  public:
+    UI_Mode();
+    byte handle(byte button);
+    byte state();
+    static const char* name(byte state);
+
+  private:
+    byte current;
+};
+
+#endif // _ui_mode_h_
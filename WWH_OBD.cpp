@@ -46,96 +46,445 @@ WWH_OBD::WWH_OBD()
 }
 
 /*
+ Single frame request for one PID into the caller's frame data. A freeze
+ frame request asks for frame 0. Returns the DLC.
+*/
+byte WWH_OBD::encodeQuery(byte sid, byte pid, byte* data)
+{
+  memset(data, 0, OBD_FRAME_SIZE);
+  data[1] = sid;
+  data[2] = pid;
+  data[0] = (sid == SIDRQ_FF) ? 0x03 : 0x02;
+
+  return OBD_FRAME_SIZE;
+}
 
+/*
+ Single frame request for up to OBD_BATCH_MAX PIDs into the caller's frame
+ data. Returns the DLC, 0 if the PIDs do not fit.
 */
-byte* WWH_OBD::encodeQuery(unsigned char sid, unsigned char pid)
+byte WWH_OBD::encodeBatch(byte sid, const byte* pids, byte count, byte* data)
 {
-  byte J1979_data[] = {0x02, sid, pid, 0x00, 0x00, 0x00, 0x00, 0x00};
-  //  CAN1.send(ID_REQUEST, stdID, 8, J1979_data);
-  return J1979_data;
+  if ((count == 0) || (count > OBD_BATCH_MAX))
+  {
+    return 0;
+  }
+
+  memset(data, 0, OBD_FRAME_SIZE);
+  data[0] = 1 + count;
+  data[1] = sid;
+  memcpy(data + 2, pids, count);
+
+  return OBD_FRAME_SIZE;
 }
 
+// SAE J1979-DA Revised OCT2011 and later
+// APPENDIX B - PID scaling shorthands, see WWH_OBD_PID for the arithmetic
+//                     start, size, length, bitmask, flags, unit, mul, div, offset
+#define PID_UNDEF          {0, 0, 0, 0xFF, PID_FLAG_NONE, OBD_UNIT_NONE, 1, 1, 0}
+#define PID_BITS(size)     {0, size, size, 0xFF, PID_FLAG_HEX, OBD_UNIT_NONE, 1, 1, 0}
+#define PID_PCT            {0, 1, 1, 0xFF, 1, OBD_UNIT_PERCENT, 1000, 255, 0}   // A*100/255
+#define PID_TEMP           {0, 1, 1, 0xFF, 0, OBD_UNIT_DEGC, 1, 1, -40}         // A-40
+#define PID_TRIM           {0, 1, 1, 0xFF, 1 | PID_FLAG_VARLEN, OBD_UNIT_PERCENT, 125, 16, -1000} // (A-128)*100/128
+#define PID_O2V            {0, 1, 2, 0xFF, 3, OBD_UNIT_VOLT, 5, 1, 0}           // A/200
+#define PID_O2ER(length)   {0, 2, length, 0xFF, 4, OBD_UNIT_LAMBDA, 625, 2048, 0} // ((A*256)+B)*2/65536
+#define PID_CATT           {0, 2, 2, 0xFF, 1, OBD_UNIT_DEGC, 1, 1, -400}        // ((A*256)+B)/10-40
+#define PID_TORQ           {0, 1, 1, 0xFF, 0, OBD_UNIT_PERCENT, 1, 1, -125}     // A-125
+#define PID_UINT(size, u)  {0, size, size, 0xFF, 0, u, 1, 1, 0}
+
+// Indexed directly by PID, so a lookup is a single flash read
+static const WWH_OBD_PID pid_dictionary[PID_DICTIONARY_LAST + 1] PROGMEM = {
+  PID_BITS(4),                                                 // 0x00 PIDs supported $01-$20
+  {0, 1, 4, 0x7F, 0, OBD_UNIT_COUNT, 1, 1, 0},                 // 0x01 Monitor status (DTC count)
+  PID_BITS(2),                                                 // 0x02 DTCFRZF
+  PID_BITS(2),                                                 // 0x03 FUELSYS
+  PID_PCT,                                                     // 0x04 LOAD_PCT
+  PID_TEMP,                                                    // 0x05 ECT
+  PID_TRIM,                                                    // 0x06 SHRTFT13
+  PID_TRIM,                                                    // 0x07 LONGFT13
+  PID_TRIM,                                                    // 0x08 SHRTFT24
+  PID_TRIM,                                                    // 0x09 LONGFT24
+  {0, 1, 1, 0xFF, 0, OBD_UNIT_KPA, 3, 1, 0},                   // 0x0A FP, A*3
+  PID_UINT(1, OBD_UNIT_KPA),                                   // 0x0B MAP
+  {0, 2, 2, 0xFF, 2, OBD_UNIT_RPM, 25, 1, 0},                  // 0x0C RPM, ((A*256)+B)/4
+  PID_UINT(1, OBD_UNIT_KMH),                                   // 0x0D SPEED
+  {0, 1, 1, 0xFF, 1, OBD_UNIT_DEG, 5, 1, -640},                // 0x0E SPARKADV, A/2-64
+  PID_TEMP,                                                    // 0x0F IAT
+  {0, 2, 2, 0xFF, 2, OBD_UNIT_GS, 1, 1, 0},                    // 0x10 MAF, ((A*256)+B)/100
+  PID_PCT,                                                     // 0x11 TP
+  PID_BITS(1),                                                 // 0x12 AIR_STAT
+  PID_BITS(1),                                                 // 0x13 O2SLOC2
+  PID_O2V,                                                     // 0x14 O2S11
+  PID_O2V,                                                     // 0x15 O2S12
+  PID_O2V,                                                     // 0x16 O2S13
+  PID_O2V,                                                     // 0x17 O2S14
+  PID_O2V,                                                     // 0x18 O2S21
+  PID_O2V,                                                     // 0x19 O2S22
+  PID_O2V,                                                     // 0x1A O2S23
+  PID_O2V,                                                     // 0x1B O2S24
+  PID_BITS(1),                                                 // 0x1C OBDSUP
+  PID_BITS(1),                                                 // 0x1D O2SLOC4
+  PID_BITS(1),                                                 // 0x1E PTO_STAT
+  PID_UINT(2, OBD_UNIT_SEC),                                   // 0x1F RUNTM
+  PID_BITS(4),                                                 // 0x20 PIDs supported $21-$40
+  PID_UINT(2, OBD_UNIT_KM),                                    // 0x21 MIL_DIST
+  {0, 2, 2, 0xFF, 3, OBD_UNIT_KPA, 79, 1, 0},                  // 0x22 FRP, ((A*256)+B)*0.079
+  {0, 2, 2, 0xFF, 0, OBD_UNIT_KPA, 10, 1, 0},                  // 0x23 FRP, ((A*256)+B)*10
+  PID_O2ER(4),                                                 // 0x24 EQ_RAT11
+  PID_O2ER(4),                                                 // 0x25 EQ_RAT12
+  PID_O2ER(4),                                                 // 0x26 EQ_RAT13
+  PID_O2ER(4),                                                 // 0x27 EQ_RAT14
+  PID_O2ER(4),                                                 // 0x28 EQ_RAT21
+  PID_O2ER(4),                                                 // 0x29 EQ_RAT22
+  PID_O2ER(4),                                                 // 0x2A EQ_RAT23
+  PID_O2ER(4),                                                 // 0x2B EQ_RAT24
+  PID_PCT,                                                     // 0x2C EGR_PCT
+  {0, 1, 1, 0xFF, 1, OBD_UNIT_PERCENT, 125, 16, -1000},        // 0x2D EGR_ERR, (A-128)*100/128
+  PID_PCT,                                                     // 0x2E EVAP_PCT
+  PID_PCT,                                                     // 0x2F FLI
+  PID_UINT(1, OBD_UNIT_COUNT),                                 // 0x30 WARM_UPS
+  PID_UINT(2, OBD_UNIT_KM),                                    // 0x31 CLR_DIST
+  {0, 2, 2, 0xFF, 2 | PID_FLAG_SIGNED, OBD_UNIT_PA, 25, 1, 0}, // 0x32 EVAP_VP, ((A*256)+B)/4
+  PID_UINT(1, OBD_UNIT_KPA),                                   // 0x33 BARO
+  PID_O2ER(4),                                                 // 0x34 EQ_RAT11
+  PID_O2ER(4),                                                 // 0x35 EQ_RAT12
+  PID_O2ER(4),                                                 // 0x36 EQ_RAT13
+  PID_O2ER(4),                                                 // 0x37 EQ_RAT14
+  PID_O2ER(4),                                                 // 0x38 EQ_RAT21
+  PID_O2ER(4),                                                 // 0x39 EQ_RAT22
+  PID_O2ER(4),                                                 // 0x3A EQ_RAT23
+  PID_O2ER(4),                                                 // 0x3B EQ_RAT24
+  PID_CATT,                                                    // 0x3C CATEMP11
+  PID_CATT,                                                    // 0x3D CATEMP21
+  PID_CATT,                                                    // 0x3E CATEMP12
+  PID_CATT,                                                    // 0x3F CATEMP22
+  PID_BITS(4),                                                 // 0x40 PIDs supported $41-$60
+  PID_BITS(4),                                                 // 0x41 Monitor status this driving cycle
+  {0, 2, 2, 0xFF, 3, OBD_UNIT_VOLT, 1, 1, 0},                  // 0x42 VPWR, ((A*256)+B)/1000
+  {0, 2, 2, 0xFF, 1, OBD_UNIT_PERCENT, 1000, 255, 0},          // 0x43 LOAD_ABS, ((A*256)+B)*100/255
+  PID_O2ER(2),                                                 // 0x44 LAMBDA
+  PID_PCT,                                                     // 0x45 TP_R
+  PID_TEMP,                                                    // 0x46 AAT
+  PID_PCT,                                                     // 0x47 TP_B
+  PID_PCT,                                                     // 0x48 TP_C
+  PID_PCT,                                                     // 0x49 APP_D
+  PID_PCT,                                                     // 0x4A APP_E
+  PID_PCT,                                                     // 0x4B APP_F
+  PID_PCT,                                                     // 0x4C TAC_PCT
+  PID_UINT(2, OBD_UNIT_MIN),                                   // 0x4D MIL_TIME
+  PID_UINT(2, OBD_UNIT_MIN),                                   // 0x4E CLR_TIME
+  {0, 1, 4, 0xFF, 0, OBD_UNIT_NONE, 1, 1, 0},                  // 0x4F EQ_RAT max
+  {0, 1, 4, 0xFF, 0, OBD_UNIT_GS, 10, 1, 0},                   // 0x50 MAF max, A*10
+  PID_BITS(1),                                                 // 0x51 FUEL_TYP
+  PID_PCT,                                                     // 0x52 ALCH_PCT
+  {0, 2, 2, 0xFF, 3, OBD_UNIT_KPA, 5, 1, 0},                   // 0x53 EVAP_VPA, ((A*256)+B)/200
+  {0, 2, 2, 0xFF, PID_FLAG_SIGNED, OBD_UNIT_PA, 1, 1, 0},      // 0x54 EVAP_VP
+  PID_TRIM,                                                    // 0x55 STSO2FT1
+  PID_TRIM,                                                    // 0x56 LGSO2FT1
+  PID_TRIM,                                                    // 0x57 STSO2FT2
+  PID_TRIM,                                                    // 0x58 LGSO2FT2
+  {0, 2, 2, 0xFF, 0, OBD_UNIT_KPA, 10, 1, 0},                  // 0x59 FRP, ((A*256)+B)*10
+  PID_PCT,                                                     // 0x5A APP_R
+  PID_PCT,                                                     // 0x5B BAT_PWR
+  PID_TEMP,                                                    // 0x5C EOT
+  {0, 2, 2, 0xFF, 2, OBD_UNIT_DEG, 25, 32, -21000},            // 0x5D FUEL_TIMING, ((A*256)+B)/128-210
+  {0, 2, 2, 0xFF, 2, OBD_UNIT_LPH, 5, 1, 0},                   // 0x5E FUEL_RATE, ((A*256)+B)/20
+  PID_BITS(1),                                                 // 0x5F EMIS_SUP
+  PID_BITS(4),                                                 // 0x60 PIDs supported $61-$80
+  PID_TORQ,                                                    // 0x61 TQ_DD
+  PID_TORQ,                                                    // 0x62 TQ_ACT
+  PID_UINT(2, OBD_UNIT_NM),                                    // 0x63 TQ_REF
+  {0, 1, 5, 0xFF, 0, OBD_UNIT_PERCENT, 1, 1, -125},            // 0x64 TQ_MAX1 (idle), A-125
+  PID_BITS(2),                                                 // 0x65 Auxiliary inputs / outputs
+  {1, 2, 5, 0xFF, 2, OBD_UNIT_GS, 25, 8, 0},                   // 0x66 MAF sensor A, ((B*256)+C)/32
+  {1, 1, 3, 0xFF, 0, OBD_UNIT_DEGC, 1, 1, -40},                // 0x67 ECT sensor 1, B-40
+  {1, 1, 7, 0xFF, 0, OBD_UNIT_DEGC, 1, 1, -40},                // 0x68 IAT bank 1 sensor 1, B-40
+  {1, 1, 7, 0xFF, 1, OBD_UNIT_PERCENT, 1000, 255, 0},          // 0x69 Commanded EGR A duty, B*100/255
+  {1, 1, 5, 0xFF, 1, OBD_UNIT_PERCENT, 1000, 255, 0},          // 0x6A Commanded intake air flow A, B*100/255
+  {1, 1, 5, 0xFF, 0, OBD_UNIT_DEGC, 1, 1, -40},                // 0x6B EGR temperature bank 1 sensor 1, B-40
+  {1, 1, 5, 0xFF, 1, OBD_UNIT_PERCENT, 1000, 255, 0},          // 0x6C Commanded throttle actuator A, B*100/255
+  {1, 2, 11, 0xFF, 0, OBD_UNIT_KPA, 10, 1, 0},                 // 0x6D Commanded fuel rail pressure A, ((B*256)+C)*10
+  {1, 2, 9, 0xFF, 0, OBD_UNIT_KPA, 10, 1, 0},                  // 0x6E Commanded injection pressure A, ((B*256)+C)*10
+  {1, 1, 3, 0xFF, 0, OBD_UNIT_KPA, 1, 1, 0},                   // 0x6F Turbocharger compressor inlet pressure A, B
+  {1, 2, 10, 0xFF, 2, OBD_UNIT_KPA, 25, 8, 0},                 // 0x70 Commanded boost pressure A, ((B*256)+C)/32
+  {1, 1, 6, 0xFF, 1, OBD_UNIT_PERCENT, 1000, 255, 0},          // 0x71 Commanded VGT A position, B*100/255
+  {1, 1, 5, 0xFF, 1, OBD_UNIT_PERCENT, 1000, 255, 0},          // 0x72 Commanded wastegate A position, B*100/255
+  {1, 2, 5, 0xFF, 2, OBD_UNIT_KPA, 1, 1, 0},                   // 0x73 Exhaust pressure bank 1, ((B*256)+C)/100
+  {1, 2, 5, 0xFF, 0, OBD_UNIT_RPM, 10, 1, 0},                  // 0x74 Turbocharger A RPM, ((B*256)+C)*10
+  {1, 1, 7, 0xFF, 0, OBD_UNIT_DEGC, 1, 1, -40},                // 0x75 Turbocharger A compressor inlet temperature, B-40
+  {1, 1, 7, 0xFF, 0, OBD_UNIT_DEGC, 1, 1, -40},                // 0x76 Turbocharger B compressor inlet temperature, B-40
+  {1, 1, 5, 0xFF, 0, OBD_UNIT_DEGC, 1, 1, -40},                // 0x77 Charge air cooler temperature bank 1, B-40
+  {1, 2, 9, 0xFF, 1, OBD_UNIT_DEGC, 1, 1, -400},               // 0x78 EGT bank 1 sensor 1, ((B*256)+C)/10-40
+  {1, 2, 9, 0xFF, 1, OBD_UNIT_DEGC, 1, 1, -400},               // 0x79 EGT bank 2 sensor 1, ((B*256)+C)/10-40
+  {1, 2, 7, 0xFF, 2 | PID_FLAG_SIGNED, OBD_UNIT_KPA, 1, 1, 0}, // 0x7A DPF bank 1 delta pressure, ((B*256)+C)/100
+  {1, 2, 7, 0xFF, 2 | PID_FLAG_SIGNED, OBD_UNIT_KPA, 1, 1, 0}, // 0x7B DPF bank 2 delta pressure, ((B*256)+C)/100
+  {1, 2, 9, 0xFF, 1, OBD_UNIT_DEGC, 1, 1, -400},               // 0x7C DPF bank 1 inlet temperature, ((B*256)+C)/10-40
+  PID_BITS(1),                                                 // 0x7D NOx NTE control area status
+  PID_BITS(1),                                                 // 0x7E PM NTE control area status
+  {1, 4, 13, 0xFF, 0, OBD_UNIT_SEC, 1, 1, 0},                  // 0x7F Total engine run time
+  PID_BITS(4),                                                 // 0x80 PIDs supported $81-$A0
+  {1, 4, 21, 0xFF, 0, OBD_UNIT_SEC, 1, 1, 0},                  // 0x81 Run time of AECD #1
+  {1, 4, 21, 0xFF, 0, OBD_UNIT_SEC, 1, 1, 0},                  // 0x82 Run time of AECD #6
+  {0, 1, 5, 0xFF, PID_FLAG_HEX, OBD_UNIT_NONE, 1, 1, 0},       // 0x83 NOx sensor
+  PID_TEMP,                                                    // 0x84 Manifold surface temperature
+  {0, 1, 10, 0xFF, PID_FLAG_HEX, OBD_UNIT_NONE, 1, 1, 0},      // 0x85 NOx reagent system
+  {0, 1, 5, 0xFF, PID_FLAG_HEX, OBD_UNIT_NONE, 1, 1, 0},       // 0x86 PM sensor
+  {1, 2, 5, 0xFF, 2, OBD_UNIT_KPA, 25, 8, 0},                  // 0x87 Intake manifold absolute pressure A, ((B*256)+C)/32
+  {0, 1, 13, 0xFF, PID_FLAG_HEX, OBD_UNIT_NONE, 1, 1, 0},      // 0x88 SCR inducement system
+  {1, 4, 41, 0xFF, 0, OBD_UNIT_SEC, 1, 1, 0},                  // 0x89 Run time of AECD #11
+  {1, 4, 41, 0xFF, 0, OBD_UNIT_SEC, 1, 1, 0},                  // 0x8A Run time of AECD #16
+  {0, 1, 7, 0xFF, PID_FLAG_HEX, OBD_UNIT_NONE, 1, 1, 0},       // 0x8B Diesel aftertreatment
+  {0, 1, 17, 0xFF, PID_FLAG_HEX, OBD_UNIT_NONE, 1, 1, 0},      // 0x8C O2 sensor (wide range)
+  PID_PCT,                                                     // 0x8D TP_G
+  PID_TORQ,                                                    // 0x8E Engine friction percent torque
+  {0, 1, 5, 0xFF, PID_FLAG_HEX, OBD_UNIT_NONE, 1, 1, 0},       // 0x8F PM sensor bank 1 & 2
+  PID_BITS(3),                                                 // 0x90 WWH-OBD vehicle OBD system information
+  PID_BITS(5),                                                 // 0x91 WWH-OBD ECU OBD system information
+  PID_BITS(2),                                                 // 0x92 Fuel system control
+  PID_BITS(3),                                                 // 0x93 WWH-OBD vehicle OBD counters support
+  {0, 1, 12, 0xFF, PID_FLAG_HEX, OBD_UNIT_NONE, 1, 1, 0},      // 0x94 NOx warning and inducement system
+  PID_UNDEF,                                                   // 0x95 ISO/SAE reserved
+  PID_UNDEF,                                                   // 0x96 ISO/SAE reserved
+  PID_UNDEF,                                                   // 0x97 ISO/SAE reserved
+  {1, 2, 9, 0xFF, 1, OBD_UNIT_DEGC, 1, 1, -400},               // 0x98 EGT bank 1 sensor 5, ((B*256)+C)/10-40
+  {1, 2, 9, 0xFF, 1, OBD_UNIT_DEGC, 1, 1, -400},               // 0x99 EGT bank 2 sensor 5, ((B*256)+C)/10-40
+  {0, 1, 6, 0xFF, PID_FLAG_HEX, OBD_UNIT_NONE, 1, 1, 0},       // 0x9A Hybrid/EV system data
+  {0, 1, 4, 0xFF, PID_FLAG_HEX, OBD_UNIT_NONE, 1, 1, 0},       // 0x9B Diesel exhaust fluid sensor
+  {0, 1, 17, 0xFF, PID_FLAG_HEX, OBD_UNIT_NONE, 1, 1, 0},      // 0x9C O2 sensor data
+  {0, 2, 4, 0xFF, 2, OBD_UNIT_GS, 2, 1, 0},                    // 0x9D Engine fuel rate, ((A*256)+B)/50
+  {0, 2, 2, 0xFF, 1, OBD_UNIT_KGH, 2, 1, 0},                   // 0x9E Engine exhaust flow rate, ((A*256)+B)/5
+  {0, 1, 9, 0xFF, PID_FLAG_HEX, OBD_UNIT_NONE, 1, 1, 0},       // 0x9F Fuel system percentage use
+  PID_BITS(4),                                                 // 0xA0 PIDs supported $A1-$C0
+  {0, 1, 9, 0xFF, PID_FLAG_HEX, OBD_UNIT_NONE, 1, 1, 0},       // 0xA1 NOx sensor corrected data
+  {0, 2, 2, 0xFF, 2, OBD_UNIT_MG, 25, 8, 0},                   // 0xA2 Cylinder fuel rate, ((A*256)+B)/32
+  {0, 1, 9, 0xFF, PID_FLAG_HEX, OBD_UNIT_NONE, 1, 1, 0},       // 0xA3 Evap system vapor pressure
+  {1, 1, 4, 0xF0, 0, OBD_UNIT_NONE, 1, 1, 0},                  // 0xA4 Transmission actual gear, B bits 7-4
+  {1, 1, 4, 0xFF, 1, OBD_UNIT_PERCENT, 5, 1, 0},               // 0xA5 Commanded DEF dosing, B/2
+  {0, 4, 4, 0xFF, 1, OBD_UNIT_KM, 1, 1, 0},                    // 0xA6 Odometer, ((A*2^24)+(B*2^16)+(C*256)+D)/10
+  {0, 1, 4, 0xFF, PID_FLAG_HEX, OBD_UNIT_NONE, 1, 1, 0},       // 0xA7 NOx sensor concentration sensors 3 and 4
+  {0, 1, 4, 0xFF, PID_FLAG_HEX, OBD_UNIT_NONE, 1, 1, 0},       // 0xA8 NOx sensor corrected concentration sensors 3 and 4
+  {0, 1, 4, 0xFF, PID_FLAG_HEX, OBD_UNIT_NONE, 1, 1, 0},       // 0xA9 ABS disable switch state
+  PID_UNDEF,                                                   // 0xAA ISO/SAE reserved
+  PID_UNDEF,                                                   // 0xAB ISO/SAE reserved
+  PID_UNDEF,                                                   // 0xAC ISO/SAE reserved
+  PID_UNDEF,                                                   // 0xAD ISO/SAE reserved
+  PID_UNDEF,                                                   // 0xAE ISO/SAE reserved
+  PID_UNDEF,                                                   // 0xAF ISO/SAE reserved
+  PID_UNDEF,                                                   // 0xB0 ISO/SAE reserved
+  PID_UNDEF,                                                   // 0xB1 ISO/SAE reserved
+  PID_UNDEF,                                                   // 0xB2 ISO/SAE reserved
+  PID_UNDEF,                                                   // 0xB3 ISO/SAE reserved
+  PID_UNDEF,                                                   // 0xB4 ISO/SAE reserved
+  PID_UNDEF,                                                   // 0xB5 ISO/SAE reserved
+  PID_UNDEF,                                                   // 0xB6 ISO/SAE reserved
+  PID_UNDEF,                                                   // 0xB7 ISO/SAE reserved
+  PID_UNDEF,                                                   // 0xB8 ISO/SAE reserved
+  PID_UNDEF,                                                   // 0xB9 ISO/SAE reserved
+  PID_UNDEF,                                                   // 0xBA ISO/SAE reserved
+  PID_UNDEF,                                                   // 0xBB ISO/SAE reserved
+  PID_UNDEF,                                                   // 0xBC ISO/SAE reserved
+  PID_UNDEF,                                                   // 0xBD ISO/SAE reserved
+  PID_UNDEF,                                                   // 0xBE ISO/SAE reserved
+  PID_UNDEF,                                                   // 0xBF ISO/SAE reserved
+  PID_BITS(4)                                                  // 0xC0 PIDs supported $C1-$E0
+};
+
 /*
+ Copy the dictionary entry for pid out of flash. Returns false if the PID
+ is not described and the caller should fall back to a raw dump.
+*/
+bool WWH_OBD::lookupPID(byte pid, WWH_OBD_PID* desc)
+{
+  if (pid > PID_DICTIONARY_LAST)
+  {
+    return false;
+  }
+
+  memcpy_P(desc, &pid_dictionary[pid], sizeof(WWH_OBD_PID));
+
+  return ((desc->flags & PID_FLAG_NONE) == 0);
+}
 
+/*
+ Pull the raw field described by desc out of the data bytes of a response,
+ where data[0] is data byte A.
 */
-byte WWH_OBD::decodePID(byte* data, char* text)
+int32_t WWH_OBD::extractPID(const WWH_OBD_PID* desc, const byte* data)
 {
-  byte decode_buffer_size = 17;
-  byte pid = data[2];
-  char decode_buffer[decode_buffer_size];
-  double decode_double;
-  float decode_float;
-  int decode_int;
+  const byte* field = data + desc->start;
+  uint32_t raw = 0;
 
-  switch (pid)
+  for (byte i = 0; i < desc->size; i++)
   {
-    case PID_FUELSYS:
-      snprintf(decode_buffer, decode_buffer_size, "BITFIELD");
-      break;
-    case PID_ECT:
-      // A - 40 [degree C]
-      decode_int = data[3] - 40;
-      snprintf(decode_buffer, decode_buffer_size, "%d*C", decode_int);
-      break;
+    raw = (raw << 8) | field[i];
+  }
 
-    case PID_RPM:
-      // ((A*256)+B)/4 [RPM]
-      decode_float = ((data[3] << 8) + data[4]) / 4.0;
-      //sprintf(decode_buffer, "%5.2fRPM", decode_float);
-      dtostrf(decode_float, 5, 2, decode_buffer);
-      strlcat(decode_buffer, "RPM", decode_buffer_size);
-      break;
+  if (desc->bitmask != 0xFF)
+  {
+    byte mask = desc->bitmask;
 
-    case PID_SPEED:
-      // A [km]
-      decode_int = data[3];
-      snprintf(decode_buffer, decode_buffer_size, "%dkm", decode_int);
-      break;
+    raw &= mask;
+    while ((mask & 0x01) == 0)
+    {
+      mask >>= 1;
+      raw >>= 1;
+    }
+  }
 
-    case PID_MAF:
-      // ((256*A)+B) / 100  [g/s]
-      decode_int = ((data[3] << 8) + data[4]) / 100;
-      snprintf(decode_buffer, decode_buffer_size, "%dg/s", decode_int);
-      break;
+  if ((desc->flags & PID_FLAG_SIGNED) && (desc->size < 4))
+  {
+    byte shift = 32 - (desc->size * 8);
+    return ((int32_t)(raw << shift)) >> shift;
+  }
 
-    case PID_O2S11:
-      // A * 0.005   (B-128) * 100/128 (if B==0xFF, sensor is not used in trim calc)
-      decode_int = data[3] * 0.005;
-      snprintf(decode_buffer, decode_buffer_size, "%dV", decode_int);
-      break;
+  return raw;
+}
 
-    case PID_LOAD_PCT:
-    case PID_TP:				// Throttle Position
-    case PID_LOAD_ABS:
-    case PID_TP_R:
-    case PID_TP_B:
-    case PID_TP_C:
-    case PID_APP_D:
-    case PID_APP_E:
-    case PID_APP_F:
-    case PID_TAC_PCT:
-    case PID_ALCH_PCT:
-    case PID_APP_R:
-    case PID_BAT_PWR:
-      decode_float = (data[3] * 100.0) / 255.0;
-      //sprintf(decode_buffer, "%3.1f%%", decode_float);
-      dtostrf(decode_float, 3, 1, decode_buffer);
-      strlcat(decode_buffer, "%", decode_buffer_size);
-      break;
-    default:
-      // Print out all the data
-      decode_buffer[0] = 0;
-      for (byte i = 0; i < 8; i++)
+/*
+ Apply the dictionary scaling to a raw field.
+*/
+int32_t WWH_OBD::scalePID(const WWH_OBD_PID* desc, int32_t raw)
+{
+  return ((raw * (int32_t)desc->mul) / (int32_t)desc->div) + desc->offset;
+}
+
+/*
+ Decode a Service $01/$02 response frame into a sample without any
+ text formatting. Returns false for PIDs that are not in the dictionary.
+*/
+bool WWH_OBD::decodeSample(const byte* data, uint32_t timestamp, OBD_Sample* sample)
+{
+  return decodeData(data[2], data + 3, timestamp, sample);
+}
+
+/*
+ Decode the data bytes of one PID, where data[0] is data byte A.
+*/
+bool WWH_OBD::decodeData(byte pid, const byte* data, uint32_t timestamp, OBD_Sample* sample)
+{
+  WWH_OBD_PID desc;
+
+  if (lookupPID(pid, &desc) == false)
+  {
+    return false;
+  }
+
+  sample->timestamp = timestamp;
+  sample->pid = pid;
+  sample->raw = extractPID(&desc, data);
+
+  if (desc.flags & PID_FLAG_HEX)
+  {
+    sample->value = sample->raw;
+    sample->unit = OBD_UNIT_BITS;
+    sample->decimals = 0;
+    sample->digits = desc.size * 2;
+  }
+  else
+  {
+    sample->value = scalePID(&desc, sample->raw);
+    sample->unit = desc.unit;
+    sample->decimals = desc.flags & PID_FLAG_DECIMALS;
+    sample->digits = 0;
+  }
+
+  return true;
+}
+
+/*
+ Split a Service $01 response payload, starting at the response SID, into
+ one sample per PID using the data length of each PID. Returns the number
+ of samples written; decoding stops at the first PID of unknown length.
+*/
+byte WWH_OBD::decodeBatch(const byte* payload, byte length, uint32_t timestamp, OBD_Sample* samples, byte max)
+{
+  byte count = 0;
+  byte i = 1;
+
+  while ((i < length) && (count < max))
+  {
+    byte pid = payload[i];
+    byte pid_length = pidLength(pid);
+
+    if ((pid_length == 0) || (i + 1 + pid_length > length))
+    {
+      // A lone PID of variable length is still the whole payload
+      if ((i == 1) && (pid_length == 0) && decodeData(pid, payload + 2, timestamp, &samples[count]))
       {
-        char temp_buffer[3] = {0};
-        if (data[i] < 0x10)                                 // If the data is less than 10 hex it will assign a zero to the front as leading zeros are ignored...
-        {
-          strlcat(decode_buffer, "0", decode_buffer_size);
-        }
-        snprintf(temp_buffer, 3, "%X", data[i]);
-        strlcat(decode_buffer, temp_buffer, decode_buffer_size);
+        count++;
       }
       break;
+    }
+
+    if (decodeData(pid, payload + i + 1, timestamp, &samples[count]))
+    {
+      count++;
+    }
+
+    i += 1 + pid_length;
+  }
+
+  return count;
+}
+
+/*
+ Number of data bytes a PID returns, 0 if unknown or variable.
+*/
+byte WWH_OBD::pidLength(byte pid)
+{
+  WWH_OBD_PID desc;
+
+  if ((lookupPID(pid, &desc) == false) || (desc.flags & PID_FLAG_VARLEN))
+  {
+    return 0;
+  }
+
+  return desc.length;
+}
+
+/*
+ How many of the leading pids fit in one Service $01 request whose
+ response payload, including the response SID, is at most max_payload
+ bytes. A PID of unknown length is only ever requested on its own.
+*/
+byte WWH_OBD::batchSize(const byte* pids, byte count, byte max_payload)
+{
+  byte payload = 1;
+  byte n;
+
+  for (n = 0; (n < count) && (n < OBD_BATCH_MAX); n++)
+  {
+    byte pid_length = pidLength(pids[n]);
+
+    if ((pid_length == 0) || (payload + 1 + pid_length > max_payload))
+    {
+      break;
+    }
+
+    payload += 1 + pid_length;
+  }
+
+  return (n == 0) ? 1 : n;
+}
+
+/*
+ Decode a Service $01/$02 response frame and append the value to text.
+*/
+byte WWH_OBD::decodePID(byte* data, char* text)
+{
+  byte decode_buffer_size = 17;
+  byte pid = data[2];
+  char decode_buffer[decode_buffer_size];
+  OBD_Sample sample;
+
+  if (decodeSample(data, 0, &sample))
+  {
+    formatSample(&sample, decode_buffer);
+  }
+  else
+  {
+    // Print out all the data
+    formatHex(data, 8, decode_buffer);
   }
 
   // Use strlcat instead of strlcpy to allow for building up a string with multiple calls.
@@ -143,4 +492,3 @@ byte WWH_OBD::decodePID(byte* data, char* text)
 
   return pid;
 }
-
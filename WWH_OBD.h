@@ -135,6 +135,7 @@ ISO/IEC 10731
 #define wwh_obd_h_
 
 #include <Arduino.h>
+#include "OBD_Sample.h"
 
 // ISO 15031-5:2011
 // Section 6.2.2.7, Table 7
@@ -195,33 +196,45 @@ ISO/IEC 10731
 
 // ISO 15031-5:2011
 // Section 6.3.4, Table 16
-
+// SAE J1979-DA Revised OCT2011
+// APPENDIX B - Scaling of the primary data field of each Service $01/$02 PID.
+// The engineering value is computed with integer math only:
+//   value = (raw * mul) / div + offset
+// and is expressed in units of 10^-decimals, so PID_RPM ((A*256)+B)/4 with
+// two decimals becomes raw * 25 and 0x0C 0x1A reads back as 768.50 RPM.
+// Every entry keeps raw * mul within a signed 32 bit integer, the 4 byte
+// run time and odometer counters up to 2^31.
 typedef struct
 {
-  const char display[9];
-  uint8_t pid;
-  uint8_t start;    // starting with which data byte
+  uint8_t start;    // starting with which data byte (0 = A)
   uint8_t size;     // taking up how many bytes
+  uint8_t length;   // data bytes the PID returns in total
   uint8_t bitmask;  // if less than a byte, which bits are used
+  uint8_t flags;    // PID_FLAG_* and number of decimals
+  uint8_t unit;     // OBD_UNIT_*
+  uint16_t mul;
+  uint16_t div;
+  int16_t offset;
 } WWH_OBD_PID;
 
-//WWH_OBD_PID pid_dictionary[] = {
-//  {"DTC_CNT" , 0x01, 0, 1, 0x7F},
-//  {"MIL"     , 0x01, 0, 1, 0x80},
-//  {"MIS_SUP" , 0x01, 1, 1, 0x01},
-//  {"FUEL_SUP", 0x01, 1, 1, 0x02},
-//  {"CCM_SUP" , 0x01, 1, 1, 0x04},
-//  {"N/A"     , 0x01, 1, 1, 0x08},
-//  {"MIS_RDY" , 0x01, 1, 1, 0x10},
-//  {"FUEL_RDY", 0x01, 1, 1, 0x20},
-//  {"CCM_RDY" , 0x01, 1, 1, 0x40},
-//  /* Bit 7 is unused */
-//  {"CAT_SUP" , 0x01, 2, 1, 0x01},
-//  {"HCAT_SUP", 0x01, 2, 1, 0x02},
-//
-//  {"DTCFRZF" , 0x02, 0, 1, 0xFF},
-//  {"FUELSYS" , 0x03, 0, 1, 0xFF}
-//};
+#define PID_FLAG_DECIMALS 0x07 // mask for the number of implied decimals
+#define PID_FLAG_SIGNED   0x10 // raw data is two's complement
+#define PID_FLAG_HEX      0x20 // bit mapped / encoded, display raw hex
+#define PID_FLAG_NONE     0x40 // PID not defined, dump the whole frame
+#define PID_FLAG_VARLEN   0x80 // length depends on the O2 sensor layout, never batched
+
+// SAE J1979 Section 6.1.2.1 - a Service $01 request carries up to six PIDs
+#define OBD_BATCH_MAX 6
+// ISO 15765-2 - payload of a single frame on classical CAN
+#define OBD_SF_PAYLOAD 7
+// ISO 15765-4 - request frames always carry 8 data bytes, padded
+#define OBD_FRAME_SIZE 8
+
+// Last PID described by the dictionary, "PIDs supported $C1 - $E0". The
+// reserved PIDs below it are PID_UNDEF and fall back to a dump like the
+// PIDs above it, and of the PIDs reporting several sensors or a status
+// record only data byte A is decoded, as hex.
+#define PID_DICTIONARY_LAST 0xC0
 
 // ISO 14229-1:2013
 // Annex C, Table C.1
@@ -301,6 +314,8 @@ typedef struct
 // SAE J1979-DA Revised OCT2011
 // APPENDIX B - (NORMATIVE)
 // PIDS (PARAMETER ID) FOR SERVICES $01 AND $02 SCALING AND DEFINITION
+#define PID_SUPPORTED 0x00 // PIDs supported [$01 - $20], repeated every $20 PIDs
+#define PID_MONITOR 0x01 // Monitor status since DTCs cleared
 #define PID_DTCFRZF 0x02 // DTC that caused required freeze frame data storage
 #define PID_FUELSYS 0x03 // Fuel system status
 #define PID_LOAD_PCT 0x04 // Calculated LOAD Value
@@ -359,6 +374,9 @@ typedef struct
 
 #define PID_APP_R 0x5A // Relative Accelerator Pedal Position
 #define PID_BAT_PWR 0x5B // Hybrid/EV Battery Pack Remaining Charge
+#define PID_TP_G 0x8D // Absolute Throttle Position G
+#define PID_GEAR 0xA4 // Transmission Actual Gear
+#define PID_ODO 0xA6 // Odometer
 
 // ISO 15765-4:2011
 // Table 6
@@ -417,6 +435,11 @@ typedef struct
 
 #define SIDNR 0x7F // Negative Response Service Identifier
 
+// ISO 14229-1:2013
+// Section 10.2 - ReadDataByIdentifier (0x22) service
+#define SIDRQ_RDBI 0x22 // ReadDataByIdentifier request SID
+#define SIDPR_RDBI 0x62 // ReadDataByIdentifier response SID
+
 // SAE J1979, Appendix E
 // Unit and Scaling Definition for Service $06
 
@@ -425,7 +448,16 @@ class WWH_OBD
   public:
     WWH_OBD();
     byte decodePID(byte* data, char* text);
-    byte* encodeQuery(unsigned char sid, unsigned char pid);
+    static byte encodeQuery(byte sid, byte pid, byte* data);
+    static byte encodeBatch(byte sid, const byte* pids, byte count, byte* data);
+    bool decodeSample(const byte* data, uint32_t timestamp, OBD_Sample* sample);
+    bool decodeData(byte pid, const byte* data, uint32_t timestamp, OBD_Sample* sample);
+    byte decodeBatch(const byte* payload, byte length, uint32_t timestamp, OBD_Sample* samples, byte max);
+    static byte pidLength(byte pid);
+    static byte batchSize(const byte* pids, byte count, byte max_payload);
+    static bool lookupPID(byte pid, WWH_OBD_PID* desc);
+    static int32_t extractPID(const WWH_OBD_PID* desc, const byte* data);
+    static int32_t scalePID(const WWH_OBD_PID* desc, int32_t raw);
 
   private:
 };
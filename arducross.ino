@@ -10,22 +10,110 @@
 #include <variant.h>
 #include <CAN_SAM3X8E.h>
 #else
-#error “This library only supports boards with an AVR or SAM processor.”
+#error "This library only supports boards with an AVR or SAM processor."
 #endif
 
-//#include <SD.h>
-#include <SoftwareSerial.h>
+#include <SD.h>
 #include <Wire.h>
 #include <Adafruit_MCP23017.h>
 #include <Adafruit_RGBLCDShield.h>
 #include "WWH_OBD.h"
 #include "Ford_OBD.h"
+#include "OBD_Engine.h"
+#include "OBD_Routes.h"
+#include "ISO_TP.h"
+#include "OBD_Supported.h"
+#include "OBD_Scheduler.h"
+#include "CAN_Ring.h"
+#include "CAN_Driver.h"
+#include "CAN_Bus.h"
+#include "CAN_Controller.h"
+#include "CAN_Signal.h"
+#include "SD_Log.h"
+#include "ECU_Sim.h"
+#include "LCD_Buffer.h"
+#include "UI_Buttons.h"
+#include "UI_Mode.h"
+#include "NMEA_Parser.h"
+#include "IMU_FIFO.h"
+#include "Lap_Timer.h"
+#include "Stream_Filter.h"
+#include "Derived_Engine.h"
+#include "Flight_Recorder.h"
+#if defined(ARDUINO_ARCH_AVR)
+#include <EEPROM.h>
+#else
+#include <DueFlashStorage.h>
+#endif
+
+// The IDE generates these, they are written out so the sketch also builds
+// as plain C++ for the host tools
+bool deriveGear(const OBD_Sample* const* inputs, int32_t* value);
+bool deriveSlip(const OBD_Sample* const* inputs, int32_t* value);
+bool deriveG(const OBD_Sample* const* inputs, int32_t* value);
+bool derivePeakG(const OBD_Sample* const* inputs, int32_t* value);
+bool deriveRPMRate(const OBD_Sample* const* inputs, int32_t* value);
+bool deriveResponse(const OBD_Sample* const* inputs, int32_t* value);
+void beginButtons();
+void buttonInterrupt();
+byte readButtonPort();
+void pollButtons();
+void beginGPS();
+void gpsCommand(const char* body);
+void pollGPS();
+void timeLap(const GPS_Fix* fix);
+void appendLap(uint16_t channel, uint32_t timestamp, int32_t raw);
+byte beginIMU();
+void pollIMU();
+void deriveAxes(const IMU_Sample* sample);
+void openLog();
+void logRecord(uint16_t channel, uint32_t timestamp, int32_t raw);
+void markEvent(byte reason);
+void beginRecorder(byte imu_found);
+void writeLog();
+void writeBlock();
+void growLog();
+void loadSupported();
+void saveSupported();
+void mainMenu();
+void canReceive();
+void pollBus();
+void canSend(const OBD_Frame* frame);
+void listenBuses(bool on);
+void queueRequests(uint32_t now);
+void requestSnapshot(uint32_t now);
+void scheduleDash();
+void reportRates();
+uint16_t replyPID(const OBD_Frame* frame);
+void cacheReply(const OBD_Frame* frame);
+OBD_Frame* findReply(byte sid, uint16_t pid);
+void cacheSamples(const byte* payload, uint16_t length, uint32_t timestamp, byte ecu);
+void cacheSignals(const OBD_Frame* frame);
+void cacheSnapshot(const byte* payload, uint16_t length, uint32_t timestamp);
+void cacheSample(const OBD_Sample* sample);
+void deriveSamples(const OBD_Sample* sample);
+void storeSample(const OBD_Sample* sample);
+OBD_Sample* findSample(uint16_t pid);
+void appendSample(uint16_t pid);
+void vehicleInfo();
+void dashboard();
+void fordInfo();
+void listenInfo();
+void initialization();
+void init_fail();
 
 // The shield uses the I2C SCL and SDA pins. On classic Arduinos
 // this is Analog 4 and 5 so you can't use those for analogRead() anymore
 // However, you can connect other I2C sensors to the I2C bus and share
 // the I2C bus.
 Adafruit_RGBLCDShield lcd = Adafruit_RGBLCDShield();
+// Screens draw here, only the changed characters go out to lcd
+LCD_Buffer screen;
+
+// INTA of the shield's MCP23017, wired to a spare interrupt pin by hand
+#define BUTTON_INT_PIN 3
+UI_Buttons buttons;
+UI_Mode ui;
 
 // These #defines make it easy to set the backlight color
 #define OFF 0x0
@@ -37,16 +125,45 @@ Adafruit_RGBLCDShield lcd = Adafruit_RGBLCDShield();
 #define VIOLET 0x5
 #define WHITE 0x7
 
-// set up variables using the SD utility library functions:
-//Sd2Card card;
-//SdVolume volume;
-//SdFile root;
+// Session log, every cached sample is recorded while a card is present, through
+// the flight recorder where there is one. The file is grown with zeroed sectors
+// ahead of the blocks and flushed every LOG_GROW of them, so a block is written
+// in place inside the file's recorded size and needs no flush of its own.
+#define LOG_GROW 16                            // blocks grown between flushes
+#define LOG_MODE (O_READ | O_WRITE | O_CREAT)  // FILE_WRITE without O_APPEND, so seek() places the blocks
+File log_file;
+SD_Log session_log;
+bool logging = false;
+uint32_t log_blocks; // blocks written
+uint32_t log_size;   // blocks in the file, written or zeroed
+
+// Flight recorder: every channel at full rate in RAM and only the seconds
+// around a trigger on the card. The AVR boards have no RAM to spare and
+// log everything as it comes.
+#if defined(ARDUINO_ARCH_SAM)
+#define RECORDER_RECORDS 8192 // 64 KB of the 96 KB
+#endif
+#define RECORDER_PRE  3000    // milliseconds kept before a trigger
+#define RECORDER_POST 2000    // and after
+#ifdef RECORDER_RECORDS
+SD_Log_Record recorder_ring[RECORDER_RECORDS];
+Flight_Recorder recorder;
+#endif
+
+// Thresholds that freeze a window, raw units of the channel
+const Recorder_Trigger recorder_triggers[] PROGMEM = {
+  {DERIVED_CHANNEL_G, RECORDER_ABOVE, 1000},                          // high-g corner, mg
+  {IMU_CHANNEL_GYRO + 2, RECORDER_ABOVE | RECORDER_MAGNITUDE, 90000}, // spin, yaw in mdps
+  {DERIVED_CHANNEL_RPM_RATE, RECORDER_ABOVE, 3000},                   // shift flare, min-1 per second
+  {PID_MONITOR, RECORDER_ABOVE, 0}                                    // a DTC was stored
+};
 
 // change this to match your SD shield or module;
 // Arduino Ethernet shield: pin 4
 // Adafruit SD shields and modules: pin 10
 // Sparkfun SD shield: pin 8
-const int chipSelect = 10;
+// Sparkfun CAN-BUS shield: pin 9, pin 10 is the MCP2515
+const int chipSelect = 9;
 
 // First we define our CAN mode and rate.
 
@@ -61,49 +178,257 @@ const int chipSelect = 10;
 
 #if defined(ARDUINO_ARCH_AVR)
 // Can't use CAN0 or CAN1 as variable names, as they are defined in
-CAN_MCP2515 CANbus(10); // Create CAN channel using pin 10 for SPI chip select
+#define CAN_CS_PIN 10
+CAN_MCP2515 CANbus0(CAN_CS_PIN); // Create CAN channel using pin 10 for SPI chip select
+#define CAN_BUSES 1
 #elif defined(ARDUINO_ARCH_SAM)
 // Can't use CAN0 or CAN1 as variable names, as they are defined in
-CAN_SAM3X8E CANbus(0);  // Create CAN channel on CAN bus 0
-//CAN1.init(SystemCoreClock, CAN_BPS_500K);
+CAN_SAM3X8E CANbus0(0);  // Create CAN channel on CAN bus 0, the OBD connector
+CAN_SAM3X8E CANbus1(1);  // and on CAN bus 1, the second vehicle bus
+#define CAN_BUSES 2
+// Ford puts transmission and body data on a medium speed bus
+#define bitrate1 CAN_BPS_125K
+// Broadcasts only, at most 11 frames in 10 ms at 125 kbit/s
+#define CAN_BUS1_PERIOD 10 // milliseconds between polls
 #else
 #error This library only supports boards with an AVR or SAM processor.
 #endif
 
-SoftwareSerial gps =  SoftwareSerial(8, 7);
+#if defined(ARDUINO_ARCH_AVR)
+#define CAN_INT_PIN 2 // MCP2515 INT, low while a receive buffer is full
+#endif
+
+// Requests and replies go on bus 0, the other bus is only listened to
+#define CAN_BUS_OBD 0
+
+// Each controller fills its own ring, merged in time order by pollBus()
+#if defined(ARDUINO_ARCH_AVR)
+CAN_Controller can_controller0(&CANbus0, CAN_CS_PIN);
+#else
+CAN_Controller can_controller0(&CANbus0, 0);
+CAN_Controller can_controller1(&CANbus1, 1);
+#endif
+CAN_Bus can_buses[CAN_BUSES];
+CAN_Merge can_merge;
+
+// Answer requests from simulated ECUs instead of the bus, to try the
+// sketch without a car. The CAN receive interrupt is left off.
+//#define ECU_SIM
+#ifdef ECU_SIM
+ECU_Sim ecu_sim;
+#endif
+
+// GPS receiver on the second hardware UART, Serial1 of a Mega or Due,
+// read by the core's receive interrupt into its buffer. An Uno has only
+// the UART that goes to USB, there the sketch runs without GPS.
+#if defined(ARDUINO_ARCH_SAM) || defined(HAVE_HWSERIAL1)
+#define GPS_SERIAL Serial1
+#endif
+// RMC and GGA at 10 Hz are about 1500 characters a second. At 38400 baud
+// the 64 byte receive buffer of the AVR core lasts 16 ms, longer than
+// the slowest loop pass.
+#define GPS_BAUD 38400
+#define GPS_PERIOD 100 // milliseconds between fixes
+NMEA_Parser gps;
+
+// Timing gates of the course, latitude and longitude of A, then of B, in
+// 1e-7 degrees, with A on the driver's left. Start first, finish last;
+// on a circuit the start is the finish and the last gate a split. Only
+// with a GPS, the timer's trace takes RAM an Uno does not have to spare.
+#ifdef GPS_SERIAL
+#define COURSE_GATES   2
+#define COURSE_CIRCUIT false
+const int32_t course_gates[COURSE_GATES * 4] = {
+  380001234, -1220004321, 380002345, -1220003210,  // start
+  380011234, -1220004321, 380012345, -1220003210   // finish
+};
+Lap_Timer lap_timer;
+#endif
+
+// ADXL345, L3GD20 and HMC5883L on the shield's I2C bus
+#define I2C_CLOCK 400000 // every device on the bus takes fast mode
+#define IMU_CHUNK 5      // samples collected per loop pass
+IMU_FIFO imu;
 
 WWH_OBD   OBD;
 Ford_OBD FOBD;
+CAN_Signal signals;
+OBD_Engine engine;
+OBD_Routes routes; // which ECU answers which PID, learned from the replies
+ISO_TP isotp;
+OBD_Supported supported_pids;
+OBD_Scheduler scheduler;
+
+// Supported PID sets are kept keyed by VIN, at the start of the EEPROM on
+// the Uno. The Due has none, so they get the last two pages of flash bank
+// 1, which a sketch only reaches past 500 KB. An upload erases them.
+#if defined(ARDUINO_ARCH_AVR)
+#define SUPPORTED_EEPROM_ADDRESS 0
+#else
+#define SUPPORTED_FLASH_ADDRESS (IFLASH1_SIZE - 2 * IFLASH1_PAGE_SIZE)
+DueFlashStorage flash_storage;
+#endif
+
+// Latest reply to each request the current mode is interested in
+#define REPLY_CACHE_SIZE 6
+OBD_Frame reply_cache[REPLY_CACHE_SIZE];
+byte reply_cache_next = 0;
+
+// Latest decoded Service $01 values and derived channels
+#define SAMPLE_CACHE_SIZE 16
+OBD_Sample sample_cache[SAMPLE_CACHE_SIZE];
+byte sample_cache_used = 0;
+byte sample_cache_next = 0;
+
+// PIDs shown by dashboard(), read by the derived channels or watched by the
+// flight recorder, polled at their
+// own rate in tenths of a Hz and batched into as few requests as the
+// reassembly buffer allows
+const byte dash_pids[] = {PID_APP_R, PID_TP_R, PID_RPM, PID_LOAD_PCT, PID_SPEED, PID_MONITOR};
+const uint16_t dash_rates[] = {OBD_HZ(20), OBD_HZ(20), OBD_HZ(50), OBD_HZ(10), OBD_HZ(10), OBD_HZ(1)};
+
+// Derived channels, see the table before setup()
+#define DERIVED_OUTPUTS     6    // results one sample can cause
+#define DERIVED_TIRE_MM     1990 // rolling circumference of the driven wheels
+#define DERIVED_FINAL_DRIVE 3650 // final drive ratio * 1000
+#define DERIVED_LOCKUP_SLIP 2000 // converter slip under 20 min-1 is taken as locked
+#define DERIVED_PEDAL_MIN   50   // 5 %, less gives no response
+Derived_Engine derived;
+EMA_Filter slip_filter;
+EMA_Filter rpm_rate_filter;
+Rate_Filter rpm_rate;
+MinMax_Filter peak_g;
+
+#define UI_PERIOD 25 // milliseconds between display refreshes
+uint32_t ui_time = 0;
 
 const byte buffer_size = 100;
 char buffer[buffer_size];  //Data will be temporarily stored to this buffer before being written to the file
-char tempbuf[15];
-char lat_str[14];
-char lon_str[14];
 
 int read_size = 0; //Used as an indicator for how many characters are read from the file
 int count = 0;     //Miscellaneous variable
 
-uint8_t buttons;
-bool dash = false;
-bool info = false;
-bool ford = false;
-// Ford transmission related info
-int engine_torque; // 1E00
-uint32_t shifter_status; // 1E03
-uint8_t gear_commanded; // 1E12
-uint8_t gear_engaged; // 1E1F
-
-char *parseptr;
-char buffidx;
-uint8_t hour, minute, second, year, month, date;
-uint32_t latitude, longitude;
-uint8_t groundspeed, trackangle;
-char latdir, longdir;
-char status;
-uint32_t waypoint = 0;
+
+// Ford transmission related info, read as one multi-DID snapshot
+#define FORD_SNAPSHOT_PERIOD 100 // milliseconds between snapshots
+const uint16_t ford_group[] = {FORD_GMRDB_DID_1E00, FORD_GMRDB_DID_1E03, FORD_GMRDB_DID_1E12, FORD_GMRDB_DID_1E1F,
+                               FORD_GMRDB_DID_1E14, FORD_GMRDB_DID_1E15};
+byte ford_request[1 + 2 * FORD_GROUP_MAX]; // encoded once by setup(), held by ISO_TP while it is sent
+byte ford_length;
+Ford_Trans_State trans_state;
+uint32_t ford_snapshot = 0;
+uint32_t ford_shown = 0;
 
 uint8_t selected_pid = PID_RPM;
+OBD_Frame info_request; // selected_pid's, encoded whenever it changes
+
+/*
+ Overall ratio from engine to wheels over the final drive, the gear the
+ transmission is in: min-1 * 60 * circumference / (km/h * 10^6 * final drive).
+ Nothing below walking pace, where one km/h is too coarse.
+*/
+bool deriveGear(const OBD_Sample* const* inputs, int32_t* value)
+{
+  uint32_t rpm = inputs[0]->value / 100;
+  int32_t speed = inputs[1]->value;
+
+  if ((speed < 5) || (rpm == 0))
+  {
+    return false;
+  }
+
+  *value = rpm * (60UL * DERIVED_TIRE_MM) / ((uint32_t)speed * 10 * DERIVED_FINAL_DRIVE);
+
+  return true;
+}
+
+/*
+ Slip of the torque converter in % of engine speed from its speed ratio,
+ 0 while the measured slip says it is locked, where the ratio only
+ jitters in its last digit.
+*/
+bool deriveSlip(const OBD_Sample* const* inputs, int32_t* value)
+{
+  int32_t slip = 0;
+
+  if (abs(inputs[0]->value) >= DERIVED_LOCKUP_SLIP)
+  {
+    slip = 1000 - inputs[1]->value;
+  }
+
+  *value = slip_filter.update(slip);
+
+  return true;
+}
+
+/*
+ Length of the horizontal acceleration, run once per sample on its Y.
+*/
+bool deriveG(const OBD_Sample* const* inputs, int32_t* value)
+{
+  int32_t x = inputs[0]->value;
+  int32_t y = inputs[1]->value;
+
+  *value = filterRoot((uint32_t)(x * x) + (uint32_t)(y * y));
+
+  return true;
+}
+
+/*
+
+*/
+bool derivePeakG(const OBD_Sample* const* inputs, int32_t* value)
+{
+  peak_g.update(inputs[0]->timestamp, inputs[0]->value);
+  *value = peak_g.maximum();
+
+  return true;
+}
+
+/*
+ Change of RPM per second over at least 100 ms, smoothed.
+*/
+bool deriveRPMRate(const OBD_Sample* const* inputs, int32_t* value)
+{
+  int32_t rate;
+
+  if (rpm_rate.update(inputs[0]->timestamp, inputs[0]->value / 100, &rate) == false)
+  {
+    return false;
+  }
+
+  *value = rpm_rate_filter.update(rate);
+
+  return true;
+}
+
+/*
+ How hard the engine answers the pedal: RPM change per second per % of
+ pedal, while the pedal is pressed.
+*/
+bool deriveResponse(const OBD_Sample* const* inputs, int32_t* value)
+{
+  int32_t pedal = inputs[1]->value;
+
+  if (pedal < DERIVED_PEDAL_MIN)
+  {
+    return false;
+  }
+
+  *value = inputs[0]->value * 10 / pedal;
+
+  return true;
+}
+
+// Inputs of each derived channel and which of them trigger it
+const Derived_Def derived_channels[] PROGMEM = {
+  {DERIVED_CHANNEL_GEAR, {PID_RPM, PID_SPEED, 0}, 0x03, OBD_UNIT_NONE, 2, deriveGear},
+  {DERIVED_CHANNEL_SLIP, {FORD_GMRDB_DID_1E14, FORD_GMRDB_DID_1E15, 0}, 0x02, OBD_UNIT_PERCENT, 1, deriveSlip},
+  {DERIVED_CHANNEL_G, {IMU_CHANNEL_ACCEL, IMU_CHANNEL_ACCEL + 1, 0}, 0x02, OBD_UNIT_NONE, 0, deriveG},
+  {DERIVED_CHANNEL_PEAK_G, {DERIVED_CHANNEL_G, 0, 0}, 0x01, OBD_UNIT_NONE, 0, derivePeakG},
+  {DERIVED_CHANNEL_RPM_RATE, {PID_RPM, 0, 0}, 0x01, OBD_UNIT_RPM, 0, deriveRPMRate},
+  {DERIVED_CHANNEL_RESPONSE, {DERIVED_CHANNEL_RPM_RATE, PID_APP_R, 0}, 0x01, OBD_UNIT_RPM, 0, deriveResponse}
+};
 
 /*
 
@@ -116,19 +441,76 @@ void setup() {
     ; // wait for serial port to connect. Needed for Leonardo only
   }
 
-  //  gps.begin(9600);
+  beginGPS();
+#ifdef GPS_SERIAL
+  lap_timer.begin(course_gates, COURSE_GATES, COURSE_CIRCUIT);
+#endif
+
+  slip_filter.begin(2);
+  rpm_rate.begin(100);
+  rpm_rate_filter.begin(2);
+  peak_g.begin(2000);
+  derived.begin(derived_channels, sizeof(derived_channels) / sizeof(derived_channels[0]));
 
   // set up the LCD's number of columns and rows:
-  lcd.begin(16, 2);
+  lcd.begin(LCD_COLS, LCD_ROWS);
   lcd.setBacklight(WHITE);
+  screen.begin(&lcd);
+  beginButtons();
+  // lcd.begin() started Wire at 100 kHz
+  Wire.setClock(I2C_CLOCK);
+  byte imu_found = beginIMU();
 
   Serial.println("Arducross");  /* For debug use */
 
-  mainMenu();
+  can_buses[CAN_BUS_OBD].begin(&can_controller0, CAN_BUS_OBD, bitrate); //Set CAN mode and speed.
+#if CAN_BUSES > 1
+  can_buses[1].begin(&can_controller1, 1, bitrate1);
+  can_buses[1].schedule(CAN_BUS1_PERIOD, CAN_BUS_BUDGET);
+#endif
+  can_merge.begin(can_buses, CAN_BUSES);
+
+  // Which bus carries a message differs between vehicles, listen on both
+  for (byte b = 0; b < CAN_BUSES; b++)
+  {
+    for (byte i = 0; i < signals.messages(); i++)
+    {
+      can_buses[b].ring.subscribe(signals.message(i));
+    }
+  }
+
+  // Keep everything else out of the controllers' few buffers
+  for (byte b = 0; b < CAN_BUSES; b++)
+  {
+    if (can_buses[b].filter() == false)
+    {
+      Serial.print(F("CAN filters failed on bus "));
+      Serial.println(b);
+      lcd.print(F("Filters failed"));
+      init_fail();
+    }
+  }
+
+#if defined(ARDUINO_ARCH_AVR) && !defined(ECU_SIM)
+  // The MCP2515 only holds two frames, empty it as soon as it raises INT
+  pinMode(CAN_INT_PIN, INPUT);
+  SPI.usingInterrupt(digitalPinToInterrupt(CAN_INT_PIN));
+  attachInterrupt(digitalPinToInterrupt(CAN_INT_PIN), canReceive, FALLING);
+#endif
+
+  openLog();
+  beginRecorder(imu_found);
 
-  CAN1.begin(bitrate); //Set CAN mode and speed.
+  loadSupported();
+  engine.setRoutes(&routes);
+  supported_pids.begin(millis());
 
-//  if (CAN1.readMode() == MCP2515_MODE_NORMAL) // Check to see if we set the Mode and speed correctly. For debugging purposes only.
+  // The requests the screens poll over and over are encoded once, the
+  // dashboard's by the scheduler as it adds them
+  ford_length = Ford_OBD::encodeGroup(ford_group, sizeof(ford_group) / sizeof(ford_group[0]), ford_request);
+  WWH_OBD::encodeQuery(SIDRQ_DIAG, selected_pid, info_request.data);
+
+//  if (CANbus0.readMode() == MCP2515_MODE_NORMAL) // Check to see if we set the Mode and speed correctly. For debugging purposes only.
 //  {
 //    Serial.println(F("CAN Initialization complete"));
 //    lcd.print(F("Init complete"));
@@ -141,7 +523,7 @@ void setup() {
 //  }
 
 //  lcd.setCursor(0, 1);
-//  if (CAN1.readRate() == bitrate)
+//  if (CANbus0.readRate() == bitrate)
 //  {
 //    Serial.print (F("CAN speed set to: "));
 //    lcd.print(F("Speed: "));
@@ -159,7 +541,7 @@ void setup() {
 //
 //  delay(2000);
 
-  lcd.clear();
+  screen.clear();
 }
 
 /*
@@ -167,431 +549,1240 @@ void setup() {
 */
 void loop() {
 
-  if (dash)
-  {
-    dashboard();
-  }
-  else if (info)
-  {
-    vehicleInfo();
-  }
-  else if (ford)
+  pollBus();
+  pollGPS();
+  pollIMU();
+  writeLog();
+  pollButtons();
+  screen.flush(millis());
+
+  // The screens are drawn every UI_PERIOD, the bus is serviced every pass
+  if ((millis() - ui_time) < UI_PERIOD)
   {
-    fordInfo();
+    return;
   }
-  else
+  ui_time = millis();
+
+  switch (ui.state())
   {
-    mainMenu();
+    case UI_DASH:
+      dashboard();
+      break;
+    case UI_INFO:
+      vehicleInfo();
+      break;
+    case UI_FORD:
+      fordInfo();
+      break;
+    case UI_LISTEN:
+      listenInfo();
+      break;
+    default:
+      mainMenu();
+      break;
   }
+}
+
+/*
+ Let the shield's MCP23017 pull INTA low when a button changes. Its
+ registers are written directly: Adafruit_MCP23017::begin() would turn
+ the LCD pins back into inputs.
+*/
+void beginButtons()
+{
+  Wire.beginTransmission(MCP23017_ADDRESS_BASE);
+  Wire.write(MCP23017_GPINTENA);
+  Wire.write(UI_BUTTONS_MASK);
+  Wire.endTransmission();
+
+  // Compare against the previous value, so presses and releases interrupt
+  Wire.beginTransmission(MCP23017_ADDRESS_BASE);
+  Wire.write(MCP23017_INTCONA);
+  Wire.write(0x00);
+  Wire.endTransmission();
 
-  delay(25);
+  readButtonPort();
+
+  pinMode(BUTTON_INT_PIN, INPUT_PULLUP);
+  attachInterrupt(digitalPinToInterrupt(BUTTON_INT_PIN), buttonInterrupt, FALLING);
 }
 
 /*
 
 */
-void supportedPIDs()
+void buttonInterrupt()
 {
-  bool supportedList[20][8] = {0};
+  buttons.interrupt();
 }
 
 /*
+ Buttons held now, as readButtons() returns them. Reading the port also
+ releases INTA.
+*/
+byte readButtonPort()
+{
+  Wire.beginTransmission(MCP23017_ADDRESS_BASE);
+  Wire.write(MCP23017_GPIOA);
+  Wire.endTransmission();
+  Wire.requestFrom(MCP23017_ADDRESS_BASE, 1);
+
+  // The buttons pull their pins low
+  return ~Wire.read() & UI_BUTTONS_MASK;
+}
 
+/*
+ Read the buttons only after the expander signalled a change, and carry
+ out what each press means in the current mode. The LCD library reads
+ the same port while it writes and so may release INTA early, but the
+ interrupt has been noted by then; INTA still low catches a missed edge.
 */
-void mainMenu()
+void pollButtons()
 {
-  lcd.print(F("U:Vehicle Info"));
-  // set the cursor to column 0, line 1
-  // (note: line 1 is the second row, since counting begins with 0):
-  lcd.setCursor(0, 1);
-  lcd.print(F("D:Dashboard"));
+  byte button;
 
-  while (1)
+  if (buttons.pending() || (digitalRead(BUTTON_INT_PIN) == LOW))
   {
-    buttons = lcd.readButtons();
+    buttons.update(readButtonPort(), millis());
+  }
 
-    if (buttons & BUTTON_DOWN) {
-      dash = true;
-      info = false;
-      ford = false;
-      lcd.print(F("DASH"));
-      Serial.println(F("DASH"));
-      break;
-    }
-    else if (buttons & BUTTON_UP)
-    {
-      dash = false;
-      info = true;
-      ford = false;
-      lcd.print(F("INFO"));
-      Serial.println(F("INFO"));
-      break;
-    }
-    else if (buttons & BUTTON_LEFT)
+  while ((button = buttons.next()) != 0)
+  {
+    switch (ui.handle(button))
     {
-      dash = false;
-      info = false;
-      ford = true;
-      lcd.print(F("FORD"));
-      Serial.println(F("FORD"));
-      break;
+      case UI_ACT_ENTER:
+        screen.clear();
+        Serial.println((const __FlashStringHelper*)UI_Mode::name(ui.state()));
+        listenBuses(ui.state() == UI_LISTEN);
+        break;
+
+      case UI_ACT_PID_PREV:
+        selected_pid = supported_pids.next(selected_pid, -1);
+        WWH_OBD::encodeQuery(SIDRQ_DIAG, selected_pid, info_request.data);
+        Serial.print(F("selected_pid = 0x"));
+        Serial.println(selected_pid, HEX);
+        break;
+
+      case UI_ACT_PID_NEXT:
+        selected_pid = supported_pids.next(selected_pid, 1);
+        WWH_OBD::encodeQuery(SIDRQ_DIAG, selected_pid, info_request.data);
+        Serial.print(F("selected_pid = 0x"));
+        Serial.println(selected_pid, HEX);
+        break;
+
+      case UI_ACT_REPORT:
+        reportRates();
+        break;
+
+      case UI_ACT_MARK:
+        markEvent(RECORDER_MANUAL);
+        Serial.println(F("Mark"));
+        break;
     }
-
-    delay(5);
   }
-
-  lcd.clear();
 }
 
 /*
-
+ Bring the receiver to GPS_BAUD, 10 Hz and only the sentences the parser
+ reads. MTK receivers start at 9600 baud but keep a changed rate while
+ their backup battery lasts, so the rate change is sent at 9600 and the
+ rest at GPS_BAUD either way.
 */
-uint32_t parsedecimal(char *str) {
-  uint32_t d = 0;
-
-  while (str[0] != 0) {
-    if ((str[0] > '9') || (str[0] < '0'))
-      return d;
-    d *= 10;
-    d += str[0] - '0';
-    str++;
-  }
-  return d;
+void beginGPS()
+{
+#ifdef GPS_SERIAL
+  char command[48];
+
+  GPS_SERIAL.begin(9600);
+  snprintf(command, sizeof(command), "PMTK251,%lu", (unsigned long)GPS_BAUD);
+  gpsCommand(command);
+  GPS_SERIAL.flush();
+  GPS_SERIAL.end();
+  GPS_SERIAL.begin(GPS_BAUD);
+  delay(100);
+
+  // RMC and GGA in every fix, nothing else
+  gpsCommand("PMTK314,0,1,0,1,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0");
+  snprintf(command, sizeof(command), "PMTK220,%u", (unsigned)GPS_PERIOD);
+  gpsCommand(command);
+#endif
 }
 
 /*
-
+ Send $body*checksum to the receiver.
 */
-void query_ecu(byte sid, byte pid)
+void gpsCommand(const char* body)
 {
-  byte J1979_data[] = {0x02, sid, pid, 0x00, 0x00, 0x00, 0x00, 0x00};
-  CAN1.write(ID_REQUEST, CAN_BASE_FRAME, 8, J1979_data);
+#ifdef GPS_SERIAL
+  char checksum[3];
+
+  snprintf(checksum, sizeof(checksum), "%02X", NMEA_Parser::checksum(body));
+  GPS_SERIAL.print('$');
+  GPS_SERIAL.print(body);
+  GPS_SERIAL.print('*');
+  GPS_SERIAL.print(checksum);
+  GPS_SERIAL.print("\r\n");
+#else
+  (void)body;
+#endif
 }
 
 /*
-
+ Feed everything the UART received to the parser and log each new fix.
+ A character still in the buffer arrived a character time, ten bits, per
+ character behind it before now; that keeps the fix timestamps within a
+ millisecond of the CAN frame stamps however late the loop gets to them.
 */
-void vehicleInfo()
+void pollGPS()
 {
-  byte decoded_pid;
-  unsigned long can_ID;                                       // assign a variable for Message ID
-  byte can_length;                                            //assign a variable for length
-  byte can_data[8];                                           //assign an array for data
-
-  lcd.home();
-  buffer[0] = 0;
+#ifdef GPS_SERIAL
+  uint32_t now = millis();
+  const GPS_Fix* fix;
+  int waiting;
 
-  buttons = lcd.readButtons();
-
-  if (buttons & BUTTON_LEFT) {
-    selected_pid--;
-    lcd.clear();
-    Serial.print(F("selected_pid = 0x"));
-    Serial.println(selected_pid, HEX);
-  }
-  else if (buttons & BUTTON_RIGHT)
+  while ((waiting = GPS_SERIAL.available()) > 0)
   {
-    selected_pid++;
-    lcd.clear();
-    Serial.print(F("selected_pid = 0x"));
-    Serial.println(selected_pid, HEX);
+    gps.parse(GPS_SERIAL.read(), now - (uint32_t)waiting * 10000 / GPS_BAUD);
   }
-  else if (buttons & BUTTON_DOWN)
+
+  if (gps.available() == false)
   {
-    lcd.clear();
-    info = false;
-    dash = false;
-    ford = false;
     return;
   }
 
-  query_ecu(SIDRQ_DIAG, selected_pid);
+  fix = gps.fix();
+  if (logging && (fix->valid & GPS_VALID_POSITION))
+  {
+    logRecord(GPS_CHANNEL_LAT, fix->timestamp, fix->latitude);
+    logRecord(GPS_CHANNEL_LON, fix->timestamp, fix->longitude);
+    logRecord(GPS_CHANNEL_SPEED, fix->timestamp, fix->speed);
+    logRecord(GPS_CHANNEL_COURSE, fix->timestamp, fix->course);
+  }
 
-  if (CAN1.available() == true) {          // Check to see if a valid message has been received.
+  timeLap(fix);
+#endif
+}
 
-    //CAN1.read(&message);                     //read message, it will follow the J1939 structure of ID,Priority, source address, destination address, DLC, PGN,
-    CAN1.read(&can_ID, &can_length, can_data);                        // read Message and assign data through reference operator &
+#ifdef GPS_SERIAL
+/*
+ Run the fix through the lap timer, logging the crossings at the time
+ they were interpolated to and the live delta with every fix of a run.
+*/
+void timeLap(const GPS_Fix* fix)
+{
+  byte event = lap_timer.update(fix);
 
-    if (can_ID == ID_REPLY_1)
-    {
-      decoded_pid = OBD.decodePID(can_data, buffer);
-      //      lcd.print("ID:");
-      //      lcd.print(can_ID, HEX);
-      lcd.print(F("Len:"));
-      lcd.print(can_length);                           // Displays message length
-      lcd.print(F(" PID:"));
-      if (decoded_pid < 0x10)                   //Adds a leading zero
+  switch (event)
+  {
+    case LAP_START:
+      appendLap(LAP_CHANNEL_START, lap_timer.crossing, 0);
+      break;
+    case LAP_SPLIT:
+      appendLap(LAP_CHANNEL_SPLIT, lap_timer.crossing, lap_timer.splits[lap_timer.gate]);
+      break;
+    case LAP_FINISH:
+      appendLap(LAP_CHANNEL_FINISH, lap_timer.crossing, lap_timer.last_run);
+      Serial.print(F("Run "));
+      Serial.print(lap_timer.last_run);
+      Serial.print(F(" ms, best "));
+      Serial.println(lap_timer.best_run);
+      // On a circuit the finish started the next lap
+      if (lap_timer.running())
       {
-        lcd.print("0");
-      }
-      lcd.print(decoded_pid, HEX);           //Display PID
-
-      lcd.setCursor(0, 1);
-      lcd.print(buffer);
-
-      //#define SERIAL_DEBUG
-#ifdef SERIAL_DEBUG
-      Serial.print(F("Time | "));
-      Serial.print(millis());
-      Serial.print(F(" | ID"));
-      Serial.print(F(" | "));
-      Serial.print(can_ID, HEX);                                // Displays received ID
-      Serial.print(F(" | "));
-      Serial.print(F("Data Length"));
-      Serial.print(F(" | "));
-      Serial.print(can_length, HEX);                           // Displays message length
-      Serial.print(F(" | "));
-      Serial.print(F("Data"));
-      for (byte i = 0; i < can_length; i++) {
-        Serial.print(" | ");
-        if (can_data[i] < 0x10)                                 // If the data is less than 10 hex it will assign a zero to the front as leading zeros are ignored...
-        {
-          Serial.print(F("0"));
-        }
-        Serial.print(can_data[i], HEX);                         // Displays message data
-
+        appendLap(LAP_CHANNEL_START, lap_timer.crossing, 0);
       }
-      Serial.println();                                     // adds a line
-#endif
-    }
+      break;
   }
-  else
+
+  if (lap_timer.running() && (lap_timer.best_run != 0))
   {
-#define LCD_FIT_TEST
-#ifdef LCD_FIT_TEST
-    can_ID = ID_REPLY_1;
-    can_length = 8;
-    can_data[0] = 0x04;
-    can_data[1] = SIDPR_DIAG;
-    can_data[2] = selected_pid;
-    can_data[3] = 0x7F;
-    can_data[4] = 0xFF;
-    can_data[5] = 0x00;
-    can_data[6] = 0x00;
-    can_data[7] = 0x00;
-
-    decoded_pid = OBD.decodePID(can_data, buffer);
-    //    lcd.print("ID:");
-    //    lcd.print(can_ID, HEX);
-    lcd.print(F("Len:"));
-    lcd.print(can_length);                           // Displays message length
-    lcd.print(F(" PID:"));
-    if (decoded_pid < 0x10)                   //Adds a leading zero
-    {
-      lcd.print(F("0"));
-    }
-    lcd.print(decoded_pid, HEX);           //Display PID
-#else
-    lcd.print(F("NO CAN MESSAGE"));
-#endif
-    lcd.setCursor(0, 1);
-    lcd.print(buffer);
+    appendLap(LAP_CHANNEL_DELTA, fix->timestamp, lap_timer.delta);
   }
-
 }
 
 /*
 
 */
-void dashboard()
+void appendLap(uint16_t channel, uint32_t timestamp, int32_t raw)
 {
-  byte decoded_pid;
-  unsigned long can_ID;                                       // assign a variable for Message ID
-  byte can_length;                                            //assign a variable for length
-  byte can_data[8];                                           //assign an array for data
-
-  lcd.home();
-  buffer[0] = 0;
-
-  buttons = lcd.readButtons();
+  logRecord(channel, timestamp, raw);
+}
+#endif
 
-  if (buttons & BUTTON_LEFT) {
-    //    selected_pid--;
-    //    lcd.clear();
-    //    Serial.print("selected_pid = 0x");
-    //    Serial.println(selected_pid, HEX);
-  }
-  else if (buttons & BUTTON_RIGHT)
-  {
-    //    selected_pid++;
-    //    lcd.clear();
-    //    Serial.print("selected_pid = ");
-    //    Serial.println(selected_pid);
-  }
-  else if (buttons & BUTTON_UP)
-  {
-    lcd.clear();
-    info = false;
-    dash = false;
-    ford = false;
-    return;
-  }
+/*
+ Returns the sensors that answered, IMU_ACCEL, IMU_GYRO and IMU_MAG.
+*/
+byte beginIMU()
+{
+  byte found = imu.begin();
 
-  query_ecu(SIDRQ_DIAG, PID_APP_R);
+  Serial.print(F("IMU:"));
+  Serial.print((found & IMU_ACCEL) ? F(" accel") : F(" -"));
+  Serial.print((found & IMU_GYRO) ? F(" gyro") : F(" -"));
+  Serial.println((found & IMU_MAG) ? F(" mag") : F(" -"));
 
-  if (CAN1.available() == true) {          // Check to see if a valid message has been received.
+  return found;
+}
 
-    //CAN1.read(&message);                     //read message, it will follow the J1939 structure of ID,Priority, source address, destination address, DLC, PGN,
-    CAN1.read(&can_ID, &can_length, can_data);                        // read Message and assign data through reference operator &
+/*
+ Collect one chunk of IMU samples per pass, log every axis and pass the
+ accelerometer on to the derived channels.
+*/
+void pollIMU()
+{
+  IMU_Sample samples[IMU_CHUNK];
+  byte count = imu.read(millis(), samples, IMU_CHUNK);
 
-    if (can_ID == ID_REPLY_1)
+  for (byte i = 0; i < count; i++)
+  {
+    if (logging)
     {
-      decoded_pid = OBD.decodePID(can_data, buffer);
+      for (byte axis = 0; axis < 3; axis++)
+      {
+        logRecord(samples[i].channel + axis, samples[i].timestamp, samples[i].axis[axis]);
+      }
     }
-  }
-  else
-  {
-    //Serial.println("No CAN message available");
-    //strlcpy(buffer, "NO APP", buffer_size);
-  }
-  //Serial.println("Done with RPM");
-
-  // Add a space between values
-  strlcat(buffer, " ", buffer_size);
-
-  query_ecu(SIDRQ_DIAG, PID_TP_R);
-
-  if (CAN1.available() == true) {          // Check to see if a valid message has been received.
-
-    //CAN1.read(&message);                     //read message, it will follow the J1939 structure of ID,Priority, source address, destination address, DLC, PGN,
-    CAN1.read(&can_ID, &can_length, can_data);                        // read Message and assign data through reference operator &
-
-    if (can_ID == ID_REPLY_1)
+    if (samples[i].channel == IMU_CHANNEL_ACCEL)
     {
-      decoded_pid = OBD.decodePID(can_data, buffer);
+      deriveAxes(&samples[i]);
     }
   }
-  else
-  {
-    //strlcat(buffer, "NO TP", buffer_size);
-  }
+}
 
-  lcd.print(buffer);
+/*
+ Hand X and Y of an accelerometer sample to the derived channels, Y last
+ as it triggers the combined g. The axes are not cached, only logged.
+*/
+void deriveAxes(const IMU_Sample* sample)
+{
+  OBD_Sample axis;
 
-  lcd.setCursor(0, 1);
-  buffer[0] = 0;
+  axis.timestamp = sample->timestamp;
+  axis.unit = OBD_UNIT_NONE;
+  axis.decimals = 0;
+  axis.digits = 0;
+  for (byte i = 0; i < 2; i++)
+  {
+    axis.pid = sample->channel + i;
+    axis.raw = sample->axis[i];
+    axis.value = sample->axis[i];
+    deriveSamples(&axis);
+  }
+}
 
-  query_ecu(SIDRQ_DIAG, PID_RPM);
+/*
+ Start a new log file, LOG000.BIN, LOG001.BIN, ... Without a card the
+ sketch runs as before, only nothing is recorded.
+*/
+void openLog()
+{
+  char name[13];
 
-  if (CAN1.available() == true) {          // Check to see if a valid message has been received.
+  if (SD.begin(chipSelect) == false)
+  {
+    Serial.println(F("No SD card"));
+    return;
+  }
 
-    //CAN1.read(&message);                     //read message, it will follow the J1939 structure of ID,Priority, source address, destination address, DLC, PGN,
-    CAN1.read(&can_ID, &can_length, can_data);                        // read Message and assign data through reference operator &
+  for (uint16_t i = 0; i < 1000; i++)
+  {
+    snprintf(name, sizeof(name), "LOG%03u.BIN", i);
 
-    if (can_ID == ID_REPLY_1)
+    if (SD.exists(name) == false)
     {
-      decoded_pid = OBD.decodePID(can_data, buffer);
+      log_file = SD.open(name, LOG_MODE);
+      logging = log_file;
+      break;
     }
   }
-  else
-  {
-    //strlcpy(buffer, "NO RPM", buffer_size);
-  }
-
-  // Add a space between values
-  strlcat(buffer, " ", buffer_size);
-
-  query_ecu(SIDRQ_DIAG, PID_LOAD_PCT);
 
-  if (CAN1.available() == true) {          // Check to see if a valid message has been received.
-
-    //CAN1.read(&message);                     //read message, it will follow the J1939 structure of ID,Priority, source address, destination address, DLC, PGN,
-    CAN1.read(&can_ID, &can_length, can_data);                        // read Message and assign data through reference operator &
-
-    if (can_ID == ID_REPLY_1)
+  if (logging)
+  {
+    session_log.begin();
+    log_blocks = 0;
+    log_size = 0;
+    while (log_size < 2 * LOG_GROW)
     {
-      decoded_pid = OBD.decodePID(can_data, buffer);
+      growLog();
     }
+    Serial.print(F("Logging to "));
+    Serial.println(name);
   }
-  else
+}
+
+/*
+ Record a value, into the flight recorder where there is one, else
+ straight into the session log.
+*/
+void logRecord(uint16_t channel, uint32_t timestamp, int32_t raw)
+{
+  if (logging == false)
   {
-    //strlcat(buffer, "NO LOAD", buffer_size);
+    return;
   }
 
-  lcd.print(buffer);
+#ifdef RECORDER_RECORDS
+  recorder.append(channel, timestamp, raw);
+#else
+  session_log.append(channel, timestamp, raw);
+#endif
+}
 
-  // in order, show:
-  // pedal posistion
-  //   PID_APP_D
-  //   PID_APP_E
-  //   PID_APP_F
-  // throttle position
-  //
-  // engine rpm
-  // speed
+/*
+ Freeze the recorder's window around now, or without a recorder mark
+ the log, for a button press or anything else the sketch notices.
+*/
+void markEvent(byte reason)
+{
+#ifdef RECORDER_RECORDS
+  if (logging)
+  {
+    recorder.trigger(millis(), reason);
+  }
+#else
+  logRecord(RECORDER_CHANNEL_TRIGGER, millis(), reason);
+#endif
+}
 
+/*
+ Start the flight recorder and report how many seconds of every channel
+ it holds, from the rates each set of channels is configured for. Only
+ one screen's requests are on the bus at a time.
+*/
+void beginRecorder(byte imu_found)
+{
+#ifdef RECORDER_RECORDS
+  uint16_t imu = 0;
+  uint16_t gps = 0;
+  uint16_t dash = 0;
+  uint16_t ford;
+  uint16_t total;
+
+  recorder.begin(recorder_ring, RECORDER_RECORDS, RECORDER_PRE, RECORDER_POST);
+  recorder.watch(recorder_triggers, sizeof(recorder_triggers) / sizeof(recorder_triggers[0]));
+
+  // Records per second: three axes per sensor, combined and peak g with the accelerometer
+  if (imu_found & IMU_ACCEL)
+  {
+    imu += 5 * (1000000UL / IMU_ACCEL_US);
+  }
+  if (imu_found & IMU_GYRO)
+  {
+    imu += 3 * (1000000UL / IMU_GYRO_US);
+  }
+  if (imu_found & IMU_MAG)
+  {
+    imu += 3 * (1000 / IMU_MAG_PERIOD);
+  }
+#ifdef GPS_SERIAL
+  // Position, speed, course and the lap delta
+  gps = 5 * (1000 / GPS_PERIOD);
+#endif
+  // The gear with every RPM and speed sample, RPM rate and response at 10 Hz
+  for (byte i = 0; i < sizeof(dash_pids); i++)
+  {
+    dash += dash_rates[i] / 10;
+  }
+  dash += (OBD_HZ(50) + OBD_HZ(10)) / 10 + 20;
+  // The snapshot and the converter slip
+  ford = (sizeof(ford_group) / sizeof(ford_group[0]) + 1) * (1000 / FORD_SNAPSHOT_PERIOD);
+  total = imu + gps + ((dash > ford) ? dash : ford);
+
+  Serial.print(F("Recorder: "));
+  Serial.print(RECORDER_RECORDS);
+  Serial.print(F(" records, IMU "));
+  Serial.print(imu);
+  Serial.print(F("/s, GPS "));
+  Serial.print(gps);
+  Serial.print(F("/s, dash "));
+  Serial.print(dash);
+  Serial.print(F("/s, Ford "));
+  Serial.print(ford);
+  Serial.print(F("/s: "));
+  Serial.print((float)RECORDER_RECORDS / total, 1);
+  Serial.println(F(" s"));
+#else
+  (void)imu_found;
+#endif
 }
 
 /*
+ Hand the recorder's window on a compressed channel at a time, seal a
+ block old enough and hand it to the card, at most one block per pass.
+*/
+void writeLog()
+{
+  if (logging == false)
+  {
+    return;
+  }
 
+#ifdef RECORDER_RECORDS
+  recorder.compress(&session_log, millis());
+#endif
+  session_log.poll(millis());
+  writeBlock();
+}
+
+/*
+ Write the oldest sealed block, if there is one, over the next zeroed
+ sector: a whole sector in place goes straight to the card. Then keep
+ the file grown by 2 * LOG_GROW blocks ahead of it, a sector a pass at
+ most, so the blocks always land below the size the last flush recorded.
 */
-void fordInfo()
+void writeBlock()
 {
-  byte decoded_pid;
-  unsigned long can_ID;                                       // assign a variable for Message ID
-  byte can_length;                                            //assign a variable for length
-  byte can_data[8];                                           //assign an array for data
+  const byte* block = session_log.block();
 
-  lcd.home();
-  buffer[0] = 0;
+  if (block != 0)
+  {
+    log_file.seek(log_blocks * SD_LOG_BLOCK_SIZE);
+    log_file.write(block, SD_LOG_BLOCK_SIZE);
+    session_log.written();
+    log_blocks++;
+  }
+
+  if (log_size < log_blocks + 2 * LOG_GROW)
+  {
+    growLog();
+  }
+}
+
+/*
+ Append a zeroed sector to the log file, flushing every LOG_GROW so its
+ size on the card follows. The zeros go through the library's cache in
+ pieces, the Uno has no RAM for a sector of them.
+*/
+void growLog()
+{
+  byte zeros[32];
+
+  memset(zeros, 0, sizeof(zeros));
+  log_file.seek(log_size * SD_LOG_BLOCK_SIZE);
+  for (byte i = 0; i < SD_LOG_BLOCK_SIZE / sizeof(zeros); i++)
+  {
+    log_file.write(zeros, sizeof(zeros));
+  }
+  log_size++;
+
+  if ((log_size % LOG_GROW) == 0)
+  {
+    log_file.flush();
+  }
+}
+
+/*
+ Restore the supported PID sets of the last vehicle.
+*/
+void loadSupported()
+{
+#if defined(ARDUINO_ARCH_AVR)
+  OBD_Supported_Image image;
+  byte* data = (byte*)&image;
+
+  for (uint16_t i = 0; i < sizeof(image); i++)
+  {
+    data[i] = EEPROM.read(SUPPORTED_EEPROM_ADDRESS + i);
+  }
+
+  supported_pids.load(&image);
+#else
+  supported_pids.load((const OBD_Supported_Image*)flash_storage.readAddress(SUPPORTED_FLASH_ADDRESS));
+#endif
+}
+
+/*
+ Store newly discovered supported PID sets, only writing the bytes that
+ changed to spare the EEPROM, or on the Due the pages if anything did.
+*/
+void saveSupported()
+{
+#if defined(ARDUINO_ARCH_AVR)
+  const byte* data = (const byte*)supported_pids.image();
+
+  for (uint16_t i = 0; i < sizeof(OBD_Supported_Image); i++)
+  {
+    if (EEPROM.read(SUPPORTED_EEPROM_ADDRESS + i) != data[i])
+    {
+      EEPROM.write(SUPPORTED_EEPROM_ADDRESS + i, data[i]);
+    }
+  }
+#else
+  const OBD_Supported_Image* image = supported_pids.image();
+
+  if (memcmp(flash_storage.readAddress(SUPPORTED_FLASH_ADDRESS), image, sizeof(OBD_Supported_Image)) != 0)
+  {
+    flash_storage.write(SUPPORTED_FLASH_ADDRESS, (byte*)image, sizeof(OBD_Supported_Image));
+  }
+#endif
+}
+
+/*
+ Mode selection, the buttons are handled by pollButtons().
+*/
+void mainMenu()
+{
+  screen.clear();
+  screen.print(F("U:Vehicle Info"));
+  // set the cursor to column 0, line 1
+  // (note: line 1 is the second row, since counting begins with 0):
+  screen.setCursor(0, 1);
+  screen.print(F("D:Dashboard"));
+}
+
+/*
+ Move the frames the MCP2515 holds into the OBD bus ring, run as the INT
+ pin interrupt. The SAM3X8E driver buffers frames under its own interrupt,
+ so there pollBus() polls each bus instead.
+*/
+void canReceive()
+{
+  can_buses[CAN_BUS_OBD].poll(millis());
+}
+
+/*
+ Drain received frames into the engine, time out lost requests and keep
+ the requests of the current mode on the bus. Never waits for a reply.
+*/
+void pollBus()
+{
+  OBD_Frame frame;
+  const OBD_Frame* request;
+  const byte* payload;
+  uint16_t length;
+  uint32_t now = millis();
+
+#if defined(ARDUINO_ARCH_SAM)
+  for (byte b = 0; b < CAN_BUSES; b++)
+  {
+    can_buses[b].poll(now);
+  }
+#endif
 
-  buttons = lcd.readButtons();
+#ifdef ECU_SIM
+  while (ecu_sim.transmit(now, &frame))
+  {
+    frame.bus = CAN_BUS_OBD;
+    can_buses[CAN_BUS_OBD].ring.push(&frame);
+  }
+#endif
+
+  // Oldest first across the buses
+  while (can_merge.pop(&frame)) {
+
+    if (((frame.id & CAN_RING_REPLY_MASK) != CAN_RING_REPLY_FILTER) || (frame.bus != CAN_BUS_OBD))
+    {
+      cacheSignals(&frame);
+      continue;
+    }
+
+    if (isotp.receive(&frame, now, &payload, &length) != ISO_TP_RX_COMPLETE)
+    {
+      continue;
+    }
 
-  if (buttons & BUTTON_LEFT) {
-    //    selected_pid--;
-    //    lcd.clear();
-    //    Serial.print("selected_pid = 0x");
-    //    Serial.println(selected_pid, HEX);
+    switch (engine.receive(frame.id, payload, length, now))
+    {
+      case OBD_RX_RESPONSE:
+      case OBD_RX_UNMATCHED:
+        supported_pids.update(frame.id, payload, length, now);
+        if ((frame.data[0] & 0xF0) == ISO_TP_PCI_SF)
+        {
+          cacheReply(&frame);
+        }
+        if (payload[0] == SIDPR_DIAG)
+        {
+          cacheSamples(payload, length, frame.timestamp, frame.id - ID_REPLY_1);
+        }
+        else if (payload[0] == SIDPR_RDBI)
+        {
+          cacheSnapshot(payload, length, frame.timestamp);
+        }
+        break;
+    }
   }
-  else if (buttons & BUTTON_RIGHT)
+
+  isotp.expire(now);
+  engine.expire(now);
+
+  // Listening only, not even flow control goes out, and the controllers
+  // are in listen-only mode so they do not acknowledge frames either
+  if (ui.state() == UI_LISTEN)
   {
-    lcd.clear();
-    info = false;
-    dash = false;
-    ford = false;
     return;
   }
-  else if (buttons & BUTTON_UP)
+
+  queueRequests(now);
+
+  // Flow control first so a multi-frame reply is never held up
+  while (isotp.transmit(now, &frame))
+  {
+    canSend(&frame);
+  }
+
+  // The requests themselves are handed over as encoded
+  while ((request = engine.transmit(now)) != 0)
+  {
+    canSend(request);
+  }
+}
+
+/*
+ Put a frame on the bus. On the MCP2515 the receive interrupt talks to the
+ same chip over SPI, so it waits until the frame is written.
+*/
+void canSend(const OBD_Frame* frame)
+{
+#ifdef ECU_SIM
+  ecu_sim.receive(frame, millis());
+  return;
+#endif
+
+#if defined(ARDUINO_ARCH_AVR)
+  noInterrupts();
+#endif
+  can_buses[CAN_BUS_OBD].send(frame);
+#if defined(ARDUINO_ARCH_AVR)
+  interrupts();
+#endif
+}
+
+/*
+ Every controller into listen-only mode or out of it, with the receive
+ interrupt held off on the MCP2515 as for canSend().
+*/
+void listenBuses(bool on)
+{
+  for (byte b = 0; b < CAN_BUSES; b++)
+  {
+#if defined(ARDUINO_ARCH_AVR)
+    noInterrupts();
+#endif
+    bool changed = can_buses[b].listen(on);
+#if defined(ARDUINO_ARCH_AVR)
+    interrupts();
+#endif
+    if (changed == false)
+    {
+      Serial.print(F("CAN listen mode failed on bus "));
+      Serial.println(b);
+    }
+  }
+}
+
+/*
+ Queue whatever the current mode displays, once the supported PIDs are
+ known. Requests already in flight are refused by the engine, so each PID
+ is asked again as soon as it answers.
+*/
+void queueRequests(uint32_t now)
+{
+  if (supported_pids.ready() == false)
+  {
+    supported_pids.poll(&engine, now);
+
+    if (supported_pids.ready())
+    {
+      Serial.print(supported_pids.cache_hit ? F("PIDs cached ") : F("PIDs discovered "));
+      Serial.print(supported_pids.discovery_time);
+      Serial.println(F("ms"));
+
+      if (supported_pids.changed())
+      {
+        saveSupported();
+      }
+
+      scheduleDash();
+    }
+    return;
+  }
+
+  switch (ui.state())
+  {
+    case UI_DASH:
+      scheduler.poll(now, &engine, ISO_TP_BUF_SIZE);
+      break;
+    case UI_INFO:
+      if (supported_pids.supported(selected_pid))
+      {
+        engine.request(&info_request);
+      }
+      break;
+    case UI_FORD:
+      requestSnapshot(now);
+      break;
+  }
+}
+
+/*
+ Ask for the whole Ford transmission group in one ReadDataByIdentifier
+ request every FORD_SNAPSHOT_PERIOD. More than three DIDs do not fit a
+ single frame, so the request goes out through ISO_TP and the engine only
+ tracks the response.
+*/
+void requestSnapshot(uint32_t now)
+{
+  if (((int32_t)(now - ford_snapshot) < 0) || isotp.busy())
+  {
+    return;
+  }
+
+  // The response timer starts once the flow control let the request out
+  if (engine.track(SIDRQ_RDBI, ford_group[0], now + ISO_TP_N_BS + P2CAN_MAX, 0) == false)
+  {
+    return;
+  }
+  if (isotp.send(ID_REQUEST_1, ford_request, ford_length) == false)
+  {
+    engine.cancel(SIDRQ_RDBI, ford_group[0]);
+    return;
+  }
+  ford_snapshot = now + FORD_SNAPSHOT_PERIOD;
+}
+
+/*
+ Give every supported dashboard PID its own channel. The rates are only
+ checked against the assumed round trip here, reportRates() shows the
+ measured load with the rates actually achieved.
+*/
+void scheduleDash()
+{
+  scheduler.clear();
+
+  for (byte i = 0; i < sizeof(dash_pids); i++)
+  {
+    if (supported_pids.supported(dash_pids[i]))
+    {
+      // Listed in order of importance
+      scheduler.add(SIDRQ_DIAG, dash_pids[i], dash_rates[i], i);
+    }
+  }
+
+  if (scheduler.feasible() == false)
+  {
+    Serial.print(F("Dash rates exceed the bus, load "));
+    Serial.println(scheduler.load());
+  }
+}
+
+/*
+ Requested against achieved rate of every dashboard channel, in Hz, and
+ how close the receive ring and the log came to overflowing.
+*/
+void reportRates()
+{
+  const OBD_Channel* channel;
+
+  for (byte i = 0; i < scheduler.channels(); i++)
+  {
+    channel = scheduler.channel(i);
+    Serial.print(F("PID 0x"));
+    Serial.print(channel->pid, HEX);
+    Serial.print(F(" | "));
+    Serial.print(scheduler.requested(i) / 10.0, 1);
+    Serial.print(F(" | "));
+    Serial.println(scheduler.achieved(i) / 10.0, 1);
+  }
+
+  Serial.print(F("Load | "));
+  Serial.println(scheduler.load());
+  for (byte ecu = 0; ecu < OBD_ROUTE_ECUS; ecu++)
+  {
+    if (routes.replies[ecu] != 0)
+    {
+      Serial.print(F("ECU 0x"));
+      Serial.print(ID_REPLY_1 + ecu, HEX);
+      Serial.print(F(" | Replies | "));
+      Serial.println(routes.replies[ecu]);
+    }
+  }
+  Serial.print(F("Routed PIDs | "));
+  Serial.print(routes.learned());
+  Serial.print(F(" | Duplicates | "));
+  Serial.print(routes.duplicates);
+  Serial.print(F(" | Dropped | "));
+  Serial.println(routes.dropped);
+  for (byte b = 0; b < CAN_BUSES; b++)
+  {
+    Serial.print(F("Bus "));
+    Serial.print(b);
+    Serial.print(F(" | "));
+    Serial.print(can_buses[b].rate() / 1000);
+    Serial.print(F(" kbit/s | Frames | "));
+    Serial.print(can_buses[b].received);
+    Serial.print(F(" | Deferred | "));
+    Serial.print(can_buses[b].deferred);
+    Serial.print(F(" | Refused | "));
+    Serial.print(can_buses[b].refused);
+    Serial.print(F(" | Ring overflows | "));
+    Serial.print(can_buses[b].ring.lost());
+    Serial.print(F(" | High water | "));
+    Serial.println(can_buses[b].ring.high_water);
+  }
+  Serial.print(F("Log blocks | "));
+  Serial.print(session_log.blocks);
+  Serial.print(F(" | Dropped | "));
+  Serial.println(session_log.dropped);
+#ifdef RECORDER_RECORDS
+  Serial.print(F("Recorder span | "));
+  Serial.print(recorder.span());
+  Serial.print(F(" | Captures | "));
+  Serial.print(recorder.captures);
+  Serial.print(F(" | Overruns | "));
+  Serial.println(recorder.overruns);
+#endif
+}
+
+/*
+ PID or DID a positive response frame carries.
+*/
+uint16_t replyPID(const OBD_Frame* frame)
+{
+  if (frame->data[1] == SIDPR_RDBI)
+  {
+    return (frame->data[2] << 8) + frame->data[3];
+  }
+
+  return frame->data[2];
+}
+
+/*
+
+*/
+void cacheReply(const OBD_Frame* frame)
+{
+  OBD_Frame* entry = findReply(frame->data[1], replyPID(frame));
+
+  if (entry == 0)
+  {
+    entry = &reply_cache[reply_cache_next];
+    reply_cache_next = (reply_cache_next + 1) % REPLY_CACHE_SIZE;
+  }
+
+  *entry = *frame;
+}
+
+/*
+ Latest cached reply for a response SID and PID/DID, or 0.
+*/
+OBD_Frame* findReply(byte sid, uint16_t pid)
+{
+  for (byte i = 0; i < REPLY_CACHE_SIZE; i++)
+  {
+    if ((reply_cache[i].length != 0) && (reply_cache[i].data[1] == sid) &&
+        (replyPID(&reply_cache[i]) == pid))
+    {
+      return &reply_cache[i];
+    }
+  }
+
+  return 0;
+}
+
+/*
+ Split a single or batched Service $01 reply payload from ECU number ecu
+ into the sample cache.
+*/
+void cacheSamples(const byte* payload, uint16_t length, uint32_t timestamp, byte ecu)
+{
+  OBD_Sample samples[OBD_BATCH_MAX];
+  byte count = OBD.decodeBatch(payload, length, timestamp, samples, OBD_BATCH_MAX);
+
+  for (byte i = 0; i < count; i++)
+  {
+    // A PID several ECUs answer is taken from its owner only
+    if (routes.keep(SIDRQ_DIAG, samples[i].pid, ecu) == false)
+    {
+      continue;
+    }
+    cacheSample(&samples[i]);
+    scheduler.received(SIDRQ_DIAG, samples[i].pid, timestamp);
+  }
+}
+
+/*
+ Unpack the known signals of a broadcast frame into the sample cache.
+*/
+void cacheSignals(const OBD_Frame* frame)
+{
+  OBD_Sample samples[4];
+  byte count = signals.decode(frame->id, frame->data, frame->length, frame->timestamp, samples, 4);
+
+  for (byte i = 0; i < count; i++)
+  {
+    cacheSample(&samples[i]);
+  }
+}
+
+/*
+ Split a multi-DID ReadDataByIdentifier reply into the sample cache and
+ the transmission state.
+*/
+void cacheSnapshot(const byte* payload, uint16_t length, uint32_t timestamp)
+{
+  OBD_Sample samples[FORD_GROUP_MAX];
+  byte count = Ford_OBD::decodeGroup(payload, length, timestamp, samples, FORD_GROUP_MAX);
+
+  Ford_OBD::updateTransState(samples, count, &trans_state);
+
+  for (byte i = 0; i < count; i++)
+  {
+    cacheSample(&samples[i]);
+  }
+}
+
+/*
+ Keep a decoded sample and what the derived channels make of it.
+*/
+void cacheSample(const OBD_Sample* sample)
+{
+  storeSample(sample);
+  deriveSamples(sample);
+}
+
+/*
+
+*/
+void deriveSamples(const OBD_Sample* sample)
+{
+  OBD_Sample outputs[DERIVED_OUTPUTS];
+  byte count = derived.update(sample, outputs, DERIVED_OUTPUTS);
+
+  for (byte i = 0; i < count; i++)
+  {
+    storeSample(&outputs[i]);
+  }
+}
+
+/*
+ Replace the cached sample of the same PID, or the oldest entry.
+*/
+void storeSample(const OBD_Sample* sample)
+{
+  OBD_Sample* entry = findSample(sample->pid);
+
+  if (entry == 0)
+  {
+    entry = &sample_cache[sample_cache_next];
+    sample_cache_next = (sample_cache_next + 1) % SAMPLE_CACHE_SIZE;
+    if (sample_cache_used < SAMPLE_CACHE_SIZE)
+    {
+      sample_cache_used++;
+    }
+  }
+
+  *entry = *sample;
+
+  logRecord(sample->pid, sample->timestamp, sample->raw);
+}
+
+/*
+ Latest decoded value of a Service $01 PID or broadcast signal, or 0.
+*/
+OBD_Sample* findSample(uint16_t pid)
+{
+  for (byte i = 0; i < sample_cache_used; i++)
   {
-    byte J1979_data[] = {0x03, 0x22, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
-    CAN1.write(ID_REQUEST, CAN_BASE_FRAME, 8, J1979_data);
+    if (sample_cache[i].pid == pid)
+    {
+      return &sample_cache[i];
+    }
+  }
+
+  return 0;
+}
+
+/*
+ Append the formatted value of a cached sample to buffer.
+*/
+void appendSample(uint16_t pid)
+{
+  OBD_Sample* sample = findSample(pid);
+  char text[17];
 
-    //query_ecu(SIDRQ_DIAG, 0x00);
+  if (sample != 0)
+  {
+    formatSample(sample, text);
+    // Same 16 character limit as WWH_OBD::decodePID()
+    strlcat(buffer, text, 17);
   }
+}
+
+/*
+
+*/
+void vehicleInfo()
+{
+  byte decoded_pid;
+  OBD_Frame* frame;
+
+  screen.clear();
+  buffer[0] = 0;
 
-  if (CAN1.available() == true) {          // Check to see if a valid message has been received.
+  frame = findReply(SIDPR_DIAG, selected_pid);
 
-    //CAN1.read(&message);                     //read message, it will follow the J1939 structure of ID,Priority, source address, destination address, DLC, PGN,
-    CAN1.read(&can_ID, &can_length, can_data);                        // read Message and assign data through reference operator &
+  if (frame != 0) {
 
-    if (can_ID == ID_REPLY_1)
+    decoded_pid = OBD.decodePID(frame->data, buffer);
+    //      lcd.print("ID:");
+    //      lcd.print(frame->id, HEX);
+    screen.print(F("Len:"));
+    screen.print(frame->length);                     // Displays message length
+    screen.print(F(" PID:"));
+    if (decoded_pid < 0x10)                   //Adds a leading zero
     {
-      decoded_pid = OBD.decodePID(can_data, buffer);
-
-      lcd.clear();
-      lcd.print(F("Len:"));
-      Serial.print(F("CAN Length:"));
-      lcd.print(can_length);                           // Displays message length
-      Serial.print(can_length);
-      lcd.print(F(" PID:"));
-      Serial.print(F(" PID:"));
-      if (decoded_pid < 0x10)                   //Adds a leading zero
+      screen.print("0");
+    }
+    screen.print(decoded_pid, HEX);        //Display PID
+
+    screen.setCursor(0, 1);
+    screen.print(buffer);
+
+    //#define SERIAL_DEBUG
+#ifdef SERIAL_DEBUG
+    Serial.print(F("Time | "));
+    Serial.print(frame->timestamp);
+    Serial.print(F(" | ID"));
+    Serial.print(F(" | "));
+    Serial.print(frame->id, HEX);                             // Displays received ID
+    Serial.print(F(" | "));
+    Serial.print(F("Data Length"));
+    Serial.print(F(" | "));
+    Serial.print(frame->length, HEX);                        // Displays message length
+    Serial.print(F(" | "));
+    Serial.print(F("Data"));
+    for (byte i = 0; i < frame->length; i++) {
+      Serial.print(" | ");
+      if (frame->data[i] < 0x10)                              // If the data is less than 10 hex it will assign a zero to the front as leading zeros are ignored...
       {
-        lcd.print(F("0"));
         Serial.print(F("0"));
       }
-      lcd.print(decoded_pid, HEX);           //Display PID
-      Serial.println(decoded_pid, HEX);
-      lcd.setCursor(0, 1);
-      lcd.print(buffer);
-      Serial.println(buffer);
+      Serial.print(frame->data[i], HEX);                      // Displays message data
+
     }
+    Serial.println();                                     // adds a line
+    Serial.print(F("Requests | "));
+    Serial.print(engine.requests_sent);
+    Serial.print(F(" | Responses | "));
+    Serial.print(engine.responses);
+    Serial.print(F(" | Timeouts | "));
+    Serial.println(engine.timeouts);
+#endif
   }
   else
   {
-    //Serial.println("No CAN message available");
-    //strlcpy(buffer, "NO APP", buffer_size);
+    screen.print(F("NO CAN MESSAGE"));
+    screen.setCursor(0, 1);
+    screen.print(buffer);
   }
+
+}
+
+/*
+
+*/
+void dashboard()
+{
+  screen.clear();
+  buffer[0] = 0;
+
+  appendSample(PID_APP_R);
+
+  // Add a space between values
+  strlcat(buffer, " ", buffer_size);
+
+  appendSample(PID_TP_R);
+
+  screen.print(buffer);
+
+  screen.setCursor(0, 1);
+  buffer[0] = 0;
+
+  appendSample(PID_RPM);
+
+  // Add a space between values
+  strlcat(buffer, " ", buffer_size);
+
+  appendSample(PID_LOAD_PCT);
+
+  screen.print(buffer);
+
+  // in order, show:
+  // pedal posistion
+  //   PID_APP_D
+  //   PID_APP_E
+  //   PID_APP_F
+  // throttle position
+  //
+  // engine rpm
+  // speed
+
+}
+
+/*
+ Ford transmission state from the latest snapshot: torque and gears on the
+ first line, shifter status on the second.
+*/
+void fordInfo()
+{
+  screen.clear();
+  buffer[0] = 0;
+
+  if (trans_state.valid == 0)
+  {
+    return;
+  }
+
+  strlcat(buffer, "Tq:", buffer_size);
+  appendSample(FORD_GMRDB_DID_1E00);
+  strlcat(buffer, " G:", buffer_size);
+  appendSample(FORD_GMRDB_DID_1E12);
+  strlcat(buffer, "/", buffer_size);
+  appendSample(FORD_GMRDB_DID_1E1F);
+
+  screen.print(buffer);
+  if (trans_state.timestamp != ford_shown)
+  {
+    Serial.println(buffer);
+  }
+
+  screen.setCursor(0, 1);
+  buffer[0] = 0;
+
+  strlcat(buffer, "Shift:", buffer_size);
+  appendSample(FORD_GMRDB_DID_1E03);
+
+  screen.print(buffer);
+
+  // Every snapshot goes to the serial port once
+  if (trans_state.timestamp != ford_shown)
+  {
+    Serial.println(buffer);
+    ford_shown = trans_state.timestamp;
+  }
+}
+
+/*
+ Ford transmission and brake state from the broadcast messages alone.
+*/
+void listenInfo()
+{
+  screen.clear();
+  buffer[0] = 0;
+
+  strlcat(buffer, "TR:", buffer_size);
+  appendSample(FORD_PID_TR);
+  strlcat(buffer, " G:", buffer_size);
+  appendSample(FORD_PID_TRD);
+
+  screen.print(buffer);
+
+  screen.setCursor(0, 1);
+  buffer[0] = 0;
+
+  strlcat(buffer, "Brake:", buffer_size);
+  appendSample(FORD_PID_BPA);
+
+  screen.print(buffer);
 }
 
 /*
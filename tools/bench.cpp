@@ -0,0 +1,768 @@
+/*
+ Host microbenchmarks of the decode and polling code
+ by:
+ date:
+ license:
+
+ Times the hot paths of the sketch on the host so a change can be compared
+ against the commit before it. Every benchmark runs until it has used at
+ least BENCH_TIME seconds and prints one CSV line, name,iterations,ns/op
+ and, on x86, TSC cycles/op.
+ The two "loop" benchmarks isolate the bus side of a dashboard and a
+ vehicle info pass: request, reassembly, matching, decoding and
+ formatting. tools/loop_bench times the sketch's whole loop() in every
+ mode, built from arducross.ino itself.
+ The "switch mix (baseline)" row runs the switch decodePID had before the
+ PID dictionary over the same PIDs as the "table mix" row, and the line
+ before the CSV header gives the dictionary's size, all of it flash.
+ "decode and format" compares the integer OBD_Sample path with the float
+ and dtostrf() one for RPM and a percentage. The host has an FPU, the Uno
+ does not, so there the float row is the optimistic one.
+
+ Build from the repository root with CMake, the bench target, or:
+   g++ -std=c++11 -O2 -Itools/host -I. -o bench tools/bench.cpp \
+       tools/host/Arduino.cpp WWH_OBD.cpp Ford_OBD.cpp OBD_Sample.cpp \
+       OBD_Engine.cpp OBD_Routes.cpp ISO_TP.cpp OBD_Scheduler.cpp CAN_Signal.cpp \
+       SD_Log.cpp Stream_Filter.cpp Derived_Engine.cpp
+
+ Usage:
+   bench [filter]   runs the benchmarks whose name contains filter
+ */
+
+#include <chrono>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_CYCLES() __rdtsc()
+#else
+#define BENCH_CYCLES() 0
+#endif
+
+#include "Arduino.h"
+#include "WWH_OBD.h"
+#include "Ford_OBD.h"
+#include "OBD_Sample.h"
+#include "OBD_Engine.h"
+#include "ISO_TP.h"
+#include "OBD_Scheduler.h"
+#include "CAN_Signal.h"
+#include "SD_Log.h"
+#include "Stream_Filter.h"
+#include "Derived_Engine.h"
+
+#define BENCH_TIME 0.2 // seconds per benchmark
+
+// Results are folded in here so the compiler cannot drop the work
+static volatile uint32_t sink;
+
+static WWH_OBD OBD;
+static Ford_OBD FOBD;
+
+typedef void (*Bench)(uint32_t iterations);
+
+/*
+
+*/
+static void benchDecodePID(uint32_t iterations)
+{
+  byte data[8] = {0x04, SIDPR_DIAG, PID_RPM, 0x1A, 0xF8, 0x00, 0x00, 0x00};
+  char text[17];
+
+  for (uint32_t i = 0; i < iterations; i++)
+  {
+    text[0] = 0;
+    data[4] = i;
+    sink += OBD.decodePID(data, text) + text[0];
+  }
+}
+
+/*
+ WWH_OBD::decodePID as it was before the dictionary, a switch with float
+ math and snprintf per case, kept as the reference the table is measured
+ against.
+*/
+static byte decodePIDSwitch(byte* data, char* text)
+{
+  byte decode_buffer_size = 17;
+  byte pid = data[2];
+  char decode_buffer[decode_buffer_size];
+  float decode_float;
+  int decode_int;
+
+  switch (pid)
+  {
+    case PID_FUELSYS:
+      snprintf(decode_buffer, decode_buffer_size, "BITFIELD");
+      break;
+    case PID_ECT:
+      decode_int = data[3] - 40;
+      snprintf(decode_buffer, decode_buffer_size, "%d*C", decode_int);
+      break;
+    case PID_RPM:
+      decode_float = ((data[3] << 8) + data[4]) / 4.0;
+      dtostrf(decode_float, 5, 2, decode_buffer);
+      strlcat(decode_buffer, "RPM", decode_buffer_size);
+      break;
+    case PID_SPEED:
+      decode_int = data[3];
+      snprintf(decode_buffer, decode_buffer_size, "%dkm", decode_int);
+      break;
+    case PID_MAF:
+      decode_int = ((data[3] << 8) + data[4]) / 100;
+      snprintf(decode_buffer, decode_buffer_size, "%dg/s", decode_int);
+      break;
+    case PID_O2S11:
+      decode_int = data[3] * 0.005;
+      snprintf(decode_buffer, decode_buffer_size, "%dV", decode_int);
+      break;
+    case PID_LOAD_PCT:
+    case PID_TP:
+    case PID_LOAD_ABS:
+    case PID_TP_R:
+    case PID_TP_B:
+    case PID_TP_C:
+    case PID_APP_D:
+    case PID_APP_E:
+    case PID_APP_F:
+    case PID_TAC_PCT:
+    case PID_ALCH_PCT:
+    case PID_APP_R:
+    case PID_BAT_PWR:
+      decode_float = (data[3] * 100.0) / 255.0;
+      dtostrf(decode_float, 3, 1, decode_buffer);
+      strlcat(decode_buffer, "%", decode_buffer_size);
+      break;
+    default:
+      decode_buffer[0] = 0;
+      for (byte i = 0; i < 8; i++)
+      {
+        char temp_buffer[3] = {0};
+        if (data[i] < 0x10)
+        {
+          strlcat(decode_buffer, "0", decode_buffer_size);
+        }
+        snprintf(temp_buffer, 3, "%X", data[i]);
+        strlcat(decode_buffer, temp_buffer, decode_buffer_size);
+      }
+      break;
+  }
+
+  strlcat(text, decode_buffer, decode_buffer_size);
+
+  return pid;
+}
+
+// Dashboard PIDs, and BARO which only the table decodes, the switch dumps it
+static const byte decode_mix[] = {PID_RPM, PID_ECT, PID_TP, PID_SPEED, PID_MAF, PID_APP_R, PID_BARO};
+
+#define DECODE_MIX sizeof(decode_mix)
+
+/*
+
+*/
+static void benchDecodeTable(uint32_t iterations)
+{
+  byte data[8] = {0x04, SIDPR_DIAG, 0, 0x1A, 0xF8, 0x00, 0x00, 0x00};
+  char text[17];
+
+  for (uint32_t i = 0; i < iterations; i++)
+  {
+    text[0] = 0;
+    data[2] = decode_mix[i % DECODE_MIX];
+    data[4] = i;
+    sink += OBD.decodePID(data, text) + text[0];
+  }
+}
+
+/*
+
+*/
+static void benchDecodeSwitch(uint32_t iterations)
+{
+  byte data[8] = {0x04, SIDPR_DIAG, 0, 0x1A, 0xF8, 0x00, 0x00, 0x00};
+  char text[17];
+
+  for (uint32_t i = 0; i < iterations; i++)
+  {
+    text[0] = 0;
+    data[2] = decode_mix[i % DECODE_MIX];
+    data[4] = i;
+    sink += decodePIDSwitch(data, text) + text[0];
+  }
+}
+
+/*
+ RPM and a percentage to sample and text the integer way.
+*/
+static void benchDecodeInteger(uint32_t iterations)
+{
+  byte data[2] = {0x1A, 0xF8};
+  OBD_Sample sample;
+  char text[17];
+
+  for (uint32_t i = 0; i < iterations; i++)
+  {
+    data[1] = i;
+    OBD.decodeData((i & 1) ? PID_RPM : PID_TP, data, i, &sample);
+    sink += formatSample(&sample, text);
+  }
+}
+
+/*
+ The same with the float math and dtostrf the baseline used.
+*/
+static void benchDecodeFloat(uint32_t iterations)
+{
+  byte data[2] = {0x1A, 0xF8};
+  float value;
+  char text[17];
+
+  for (uint32_t i = 0; i < iterations; i++)
+  {
+    data[1] = i;
+    if (i & 1)
+    {
+      value = ((data[0] << 8) + data[1]) / 4.0;
+      dtostrf(value, 5, 2, text);
+      strlcat(text, "RPM", sizeof(text));
+    }
+    else
+    {
+      value = (data[0] * 100.0) / 255.0;
+      dtostrf(value, 3, 1, text);
+      strlcat(text, "%", sizeof(text));
+    }
+    sink += text[0];
+  }
+}
+
+/*
+
+*/
+static void benchFordDecodePID(uint32_t iterations)
+{
+  byte data[8] = {0x05, SIDPR_RDBI, 0x1E, 0x14, 0xFF, 0x38, 0x00, 0x00};
+  char text[17];
+
+  for (uint32_t i = 0; i < iterations; i++)
+  {
+    text[0] = 0;
+    data[5] = i;
+    sink += FOBD.decodePID(data, text) + text[0];
+  }
+}
+
+/*
+
+*/
+static void benchEncodeQuery(uint32_t iterations)
+{
+  OBD_Frame frame;
+
+  for (uint32_t i = 0; i < iterations; i++)
+  {
+    sink += WWH_OBD::encodeQuery(SIDRQ_DIAG, i, frame.data) + frame.data[2];
+  }
+}
+
+/*
+
+*/
+static void benchEncodeBatch(uint32_t iterations)
+{
+  byte pids[] = {PID_APP_R, PID_TP_R, PID_RPM, PID_LOAD_PCT};
+  OBD_Frame frame;
+
+  for (uint32_t i = 0; i < iterations; i++)
+  {
+    pids[3] = i;
+    sink += WWH_OBD::encodeBatch(SIDRQ_DIAG, pids, sizeof(pids), frame.data) + frame.data[5];
+  }
+}
+
+/*
+
+*/
+static void benchFordEncodeQuery(uint32_t iterations)
+{
+  OBD_Frame frame;
+
+  for (uint32_t i = 0; i < iterations; i++)
+  {
+    sink += Ford_OBD::encodeQuery(FORD_GMRDB_DID_1E00 + (i & 0x1F), frame.data) + frame.data[3];
+  }
+}
+
+/*
+ Transmit path of one request: queued on the engine, handed out as a
+ frame and completed by its response, without the bus in between.
+*/
+static void benchTransmitPath(uint32_t iterations)
+{
+  static const byte pids[] = {PID_APP_R, PID_TP_R, PID_RPM};
+  static const byte reply[] = {SIDPR_DIAG, PID_APP_R, 0x40};
+  OBD_Engine engine;
+  OBD_Frame frame;
+
+  for (uint32_t now = 0; now < iterations; now++)
+  {
+    engine.requestBatch(SIDRQ_DIAG, pids, sizeof(pids));
+    if (engine.transmit(now, &frame))
+    {
+      sink += frame.data[0];
+    }
+    engine.receive(ID_REPLY_1, reply, sizeof(reply), now);
+  }
+}
+
+/*
+ The same for one PID queued by number, encoded into its slot and copied
+ out to the caller's frame.
+*/
+static void benchTransmitSingle(uint32_t iterations)
+{
+  static const byte reply[] = {SIDPR_DIAG, PID_RPM, 0x1A, 0xF8};
+  OBD_Engine engine;
+  OBD_Frame frame;
+
+  for (uint32_t now = 0; now < iterations; now++)
+  {
+    engine.request(SIDRQ_DIAG, PID_RPM);
+    if (engine.transmit(now, &frame))
+    {
+      sink += frame.data[0];
+    }
+    engine.receive(ID_REPLY_1, reply, sizeof(reply), now);
+  }
+}
+
+/*
+ And queued as a frame encoded once, handed back by pointer.
+*/
+static void benchTransmitEncoded(uint32_t iterations)
+{
+  static const byte reply[] = {SIDPR_DIAG, PID_RPM, 0x1A, 0xF8};
+  OBD_Engine engine;
+  OBD_Frame request;
+  const OBD_Frame* frame;
+
+  WWH_OBD::encodeQuery(SIDRQ_DIAG, PID_RPM, request.data);
+  for (uint32_t now = 0; now < iterations; now++)
+  {
+    engine.request(&request);
+    if ((frame = engine.transmit(now)) != 0)
+    {
+      sink += frame->data[0];
+    }
+    engine.receive(ID_REPLY_1, reply, sizeof(reply), now);
+  }
+}
+
+/*
+
+*/
+static void benchDecodeBatch(uint32_t iterations)
+{
+  const byte payload[] = {SIDPR_DIAG, PID_APP_R, 0x40, PID_TP_R, 0x33, PID_RPM, 0x1A, 0xF8, PID_LOAD_PCT, 0x80};
+  OBD_Sample samples[OBD_BATCH_MAX];
+
+  for (uint32_t i = 0; i < iterations; i++)
+  {
+    sink += OBD.decodeBatch(payload, sizeof(payload), i, samples, OBD_BATCH_MAX) + samples[2].value;
+  }
+}
+
+/*
+
+*/
+static void benchFormatSample(uint32_t iterations)
+{
+  OBD_Sample sample = {0, 0x1AF8, 1726, PID_RPM, OBD_UNIT_RPM, 0, 0};
+  char text[17];
+
+  for (uint32_t i = 0; i < iterations; i++)
+  {
+    sample.value = i;
+    sink += formatSample(&sample, text);
+  }
+}
+
+/*
+
+*/
+static void benchSignalDecode(uint32_t iterations)
+{
+  CAN_Signal signals;
+  byte data[8] = {0x30, 0x3A, 0, 0, 0, 0, 0, 0};
+  OBD_Sample samples[4];
+
+  for (uint32_t i = 0; i < iterations; i++)
+  {
+    data[1] = i;
+    sink += signals.decode(FORD_CAN_ID_TRANS, data, 8, i, samples, 4) + samples[1].value;
+  }
+}
+
+/*
+
+*/
+static void benchLogAppend(uint32_t iterations)
+{
+  static SD_Log log;
+
+  log.begin();
+  for (uint32_t i = 0; i < iterations; i++)
+  {
+    log.append(i & 0x1F, i >> 3, i);
+    if (log.block() != 0)
+    {
+      sink += log.block()[0];
+      log.written();
+    }
+  }
+}
+
+/*
+ The VIN, 20 bytes in a first frame and two consecutive frames.
+*/
+static void benchReassembleVIN(uint32_t iterations)
+{
+  static const byte frames[3][8] = {
+    {0x10, 0x14, 0x49, 0x02, 0x01, '1', 'F', 'A'},
+    {0x21, 'H', 'P', '3', 'F', '2', '0', 'C'},
+    {0x22, 'L', '1', '2', '3', '4', '5', '6'}
+  };
+  ISO_TP isotp;
+  OBD_Frame frame;
+  const byte* payload;
+  uint16_t length;
+
+  frame.id = ID_REPLY_1;
+  frame.length = 8;
+
+  for (uint32_t i = 0; i < iterations; i++)
+  {
+    for (byte f = 0; f < 3; f++)
+    {
+      memcpy(frame.data, frames[f], 8);
+      if (isotp.receive(&frame, i, &payload, &length) == ISO_TP_RX_COMPLETE)
+      {
+        sink += payload[length - 1];
+      }
+    }
+    // Drop the flow control the first frame asked for
+    while (isotp.transmit(i, &frame))
+    {
+    }
+  }
+}
+
+/*
+ One dashboard pass: the scheduler queues the due PIDs, the request goes
+ out, the batched reply comes back through ISO_TP and the engine, and the
+ samples are decoded and formatted.
+*/
+static void benchDashboardPass(uint32_t iterations)
+{
+  OBD_Engine engine;
+  OBD_Scheduler scheduler;
+  ISO_TP isotp;
+  OBD_Frame frame;
+  OBD_Sample samples[OBD_BATCH_MAX];
+  const byte* payload;
+  uint16_t length;
+  char text[17];
+
+  scheduler.add(SIDRQ_DIAG, PID_APP_R, OBD_HZ(1000), 0);
+  scheduler.add(SIDRQ_DIAG, PID_TP_R, OBD_HZ(1000), 1);
+  scheduler.add(SIDRQ_DIAG, PID_RPM, OBD_HZ(1000), 2);
+
+  for (uint32_t now = 0; now < iterations; now++)
+  {
+    scheduler.poll(now, &engine, ISO_TP_BUF_SIZE);
+
+    while (engine.transmit(now, &frame))
+    {
+      // Answer every PID asked for in one single frame
+      OBD_Frame reply = {ID_REPLY_1, now, 8, {0, SIDPR_DIAG, 0, 0, 0, 0, 0, 0}, 0};
+      byte used = 2;
+
+      for (byte i = 2; (i <= frame.data[0]) && (used < 8); i++)
+      {
+        byte pid_length = WWH_OBD::pidLength(frame.data[i]);
+
+        if (used + 1 + pid_length > 8)
+        {
+          break;
+        }
+        reply.data[used++] = frame.data[i];
+        used += pid_length;
+      }
+      reply.data[0] = used - 1;
+
+      if (isotp.receive(&reply, now, &payload, &length) == ISO_TP_RX_COMPLETE)
+      {
+        engine.receive(reply.id, payload, length, now);
+
+        byte count = OBD.decodeBatch(payload, length, now, samples, OBD_BATCH_MAX);
+        for (byte i = 0; i < count; i++)
+        {
+          scheduler.received(SIDRQ_DIAG, samples[i].pid, now);
+          sink += formatSample(&samples[i], text);
+        }
+      }
+    }
+  }
+}
+
+/*
+ One vehicle info pass: a single PID requested, answered and decoded to
+ text.
+*/
+static void benchInfoPass(uint32_t iterations)
+{
+  OBD_Engine engine;
+  OBD_Frame frame;
+  OBD_Frame reply = {ID_REPLY_1, 0, 8, {0x04, SIDPR_DIAG, PID_RPM, 0x1A, 0xF8, 0, 0, 0}, 0};
+  char text[17];
+
+  for (uint32_t now = 0; now < iterations; now++)
+  {
+    engine.request(SIDRQ_DIAG, PID_RPM);
+
+    while (engine.transmit(now, &frame))
+    {
+      engine.receive(reply.id, reply.data + 1, reply.data[0], now);
+      text[0] = 0;
+      sink += OBD.decodePID(reply.data, text);
+    }
+  }
+}
+
+/*
+
+*/
+static void benchEMA(uint32_t iterations)
+{
+  EMA_Filter filter;
+
+  filter.begin(3);
+  for (uint32_t i = 0; i < iterations; i++)
+  {
+    sink += filter.update((int32_t)(i * 2654435761UL) >> 12);
+  }
+}
+
+/*
+ A 200 Hz channel through a 2 s window, so a bucket rolls every 50 samples.
+*/
+static void benchMinMax(uint32_t iterations)
+{
+  MinMax_Filter filter;
+
+  filter.begin(2000);
+  for (uint32_t i = 0; i < iterations; i++)
+  {
+    filter.update(i * 5, (int32_t)(i * 2654435761UL) >> 12);
+    sink += filter.maximum() - filter.minimum();
+  }
+}
+
+/*
+
+*/
+static void benchRate(uint32_t iterations)
+{
+  Rate_Filter filter;
+  int32_t rate = 0;
+
+  filter.begin(100);
+  for (uint32_t i = 0; i < iterations; i++)
+  {
+    filter.update(i * 20, (int32_t)(i * 2654435761UL) >> 12, &rate);
+    sink += rate;
+  }
+}
+
+static EMA_Filter bench_rpm_filter;
+static Rate_Filter bench_rpm_rate;
+
+/*
+
+*/
+static bool benchGear(const OBD_Sample* const* inputs, int32_t* value)
+{
+  uint32_t rpm = inputs[0]->value / 100;
+
+  if (inputs[1]->value < 5)
+  {
+    return false;
+  }
+  *value = rpm * 119400UL / ((uint32_t)inputs[1]->value * 36500);
+
+  return true;
+}
+
+/*
+
+*/
+static bool benchRPMRate(const OBD_Sample* const* inputs, int32_t* value)
+{
+  int32_t rate;
+
+  if (bench_rpm_rate.update(inputs[0]->timestamp, inputs[0]->value / 100, &rate) == false)
+  {
+    return false;
+  }
+  *value = bench_rpm_filter.update(rate);
+
+  return true;
+}
+
+/*
+
+*/
+static bool benchResponse(const OBD_Sample* const* inputs, int32_t* value)
+{
+  if (inputs[1]->value < 50)
+  {
+    return false;
+  }
+  *value = inputs[0]->value * 10 / inputs[1]->value;
+
+  return true;
+}
+
+// The sketch's RPM channels, plus filler so the input scan is as long
+static const Derived_Def bench_channels[] PROGMEM = {
+  {DERIVED_CHANNEL_GEAR, {PID_RPM, PID_SPEED, 0}, 0x03, OBD_UNIT_NONE, 2, benchGear},
+  {DERIVED_CHANNEL_RPM_RATE, {PID_RPM, 0, 0}, 0x01, OBD_UNIT_RPM, 0, benchRPMRate},
+  {DERIVED_CHANNEL_RESPONSE, {DERIVED_CHANNEL_RPM_RATE, PID_APP_R, 0}, 0x01, OBD_UNIT_RPM, 0, benchResponse},
+  {DERIVED_CHANNEL_SLIP, {FORD_GMRDB_DID_1E14, FORD_GMRDB_DID_1E15, 0}, 0x02, OBD_UNIT_PERCENT, 1, benchResponse},
+  {DERIVED_CHANNEL_G, {0xFF10, 0xFF11, 0}, 0x02, OBD_UNIT_NONE, 0, benchResponse}
+};
+
+/*
+ An RPM sample at 50 Hz: the gear every time, and every fifth sample the
+ RPM rate with the response on top of it.
+*/
+static void benchDerivedRPM(uint32_t iterations)
+{
+  Derived_Engine engine;
+  OBD_Sample sample = {0, 0, 0, PID_SPEED, OBD_UNIT_KMH, 0, 0};
+  OBD_Sample outputs[6];
+
+  engine.begin(bench_channels, sizeof(bench_channels) / sizeof(bench_channels[0]));
+  sample.value = 80;
+  engine.update(&sample, outputs, 6);
+  sample.pid = PID_APP_R;
+  sample.value = 400;
+  engine.update(&sample, outputs, 6);
+
+  sample.pid = PID_RPM;
+  for (uint32_t i = 0; i < iterations; i++)
+  {
+    sample.timestamp = i * 20;
+    sample.value = 300000 + (int32_t)(i & 0xFF) * 100;
+    sink += engine.update(&sample, outputs, 6) + outputs[0].value;
+  }
+}
+
+/*
+ A sample none of the channels reads, the cost of every other sample.
+*/
+static void benchDerivedMiss(uint32_t iterations)
+{
+  Derived_Engine engine;
+  OBD_Sample sample = {0, 0, 0, PID_LOAD_PCT, OBD_UNIT_PERCENT, 1, 0};
+  OBD_Sample outputs[6];
+
+  engine.begin(bench_channels, sizeof(bench_channels) / sizeof(bench_channels[0]));
+  for (uint32_t i = 0; i < iterations; i++)
+  {
+    sample.timestamp = i;
+    sink += engine.update(&sample, outputs, 6);
+  }
+}
+
+struct Benchmark
+{
+  const char* name;
+  Bench run;
+};
+
+static const Benchmark benchmarks[] = {
+  {"WWH_OBD::decodePID", benchDecodePID},
+  {"WWH_OBD::decodePID table mix", benchDecodeTable},
+  {"decodePID switch mix (baseline)", benchDecodeSwitch},
+  {"decode and format integer", benchDecodeInteger},
+  {"decode and format float (baseline)", benchDecodeFloat},
+  {"WWH_OBD::encodeQuery", benchEncodeQuery},
+  {"WWH_OBD::encodeBatch", benchEncodeBatch},
+  {"WWH_OBD::decodeBatch", benchDecodeBatch},
+  {"Ford_OBD::decodePID", benchFordDecodePID},
+  {"Ford_OBD::encodeQuery", benchFordEncodeQuery},
+  {"OBD_Engine transmit path", benchTransmitPath},
+  {"OBD_Engine transmit single PID", benchTransmitSingle},
+  {"OBD_Engine transmit encoded frame", benchTransmitEncoded},
+  {"formatSample", benchFormatSample},
+  {"CAN_Signal::decode", benchSignalDecode},
+  {"SD_Log::append", benchLogAppend},
+  {"EMA_Filter::update", benchEMA},
+  {"MinMax_Filter::update", benchMinMax},
+  {"Rate_Filter::update", benchRate},
+  {"Derived_Engine::update RPM", benchDerivedRPM},
+  {"Derived_Engine::update miss", benchDerivedMiss},
+  {"ISO_TP::receive VIN", benchReassembleVIN},
+  {"loop dashboard pass", benchDashboardPass},
+  {"loop info pass", benchInfoPass}
+};
+
+/*
+ Double the iterations until a run takes long enough to trust.
+*/
+static void measure(const Benchmark* benchmark)
+{
+  uint32_t iterations = 1;
+
+  while (true)
+  {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    uint64_t cycles = BENCH_CYCLES();
+    benchmark->run(iterations);
+    cycles = BENCH_CYCLES() - cycles;
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if ((seconds >= BENCH_TIME) || (iterations >= 0x80000000UL))
+    {
+      printf("%s,%u,%.1f,%.1f\n", benchmark->name, iterations, seconds * 1e9 / iterations,
+             (double)cycles / iterations);
+      return;
+    }
+
+    iterations *= 2;
+  }
+}
+
+/*
+
+*/
+int main(int argc, char* argv[])
+{
+  const char* filter = (argc > 1) ? argv[1] : "";
+
+  // The table is all the decode data there is, in flash on the board
+  printf("# PID dictionary $00-$%02X: %u bytes flash, 0 bytes RAM\n", PID_DICTIONARY_LAST,
+         (unsigned)((PID_DICTIONARY_LAST + 1) * sizeof(WWH_OBD_PID)));
+  printf("benchmark,iterations,ns_per_op,cycles_per_op\n");
+
+  for (size_t i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); i++)
+  {
+    if (strstr(benchmarks[i].name, filter) != 0)
+    {
+      measure(&benchmarks[i]);
+    }
+  }
+
+  return 0;
+}
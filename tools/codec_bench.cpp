@@ -0,0 +1,399 @@
+/*
+ Series_Codec compression ratio and speed on session logs
+ by:
+ date:
+ license:
+
+ Splits a session log into one series per channel and encodes each into
+ 512 byte blocks, the card's sector, once with SERIES_XOR and once with
+ SERIES_DELTA, keeping the smaller for the channel. Every block is
+ decoded again and compared with the records it came from.
+
+ The report lists each channel with its samples, bytes in both modes and
+ bits per sample, then the whole session against the SD_Log blocks it
+ would take and against plain 10 byte records of timestamp, channel and
+ value. The encoder is timed per sample in nanoseconds and, on x86, TSC
+ cycles; the decoder in samples per second and GB/s of timestamps and
+ values produced, 8 bytes a sample.
+
+ Without a log, two minutes of the SAM build's channel set are made up:
+ IMU axes at their rates with the FIFO batches' timestamps, a GPS fix
+ moving at road speed, the dashboard PIDs in their raw units with a
+ little bus jitter, and the derived channels.
+
+ Build from the repository root:
+   g++ -std=c++11 -O2 -Itools/host -I. -o codec_bench tools/codec_bench.cpp \
+       tools/host/Arduino.cpp SD_Log.cpp Series_Codec.cpp
+
+ Usage:
+   codec_bench [LOG000.BIN ...]
+ */
+
+#include <chrono>
+#include <map>
+#include <math.h>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_CYCLES() __rdtsc()
+#else
+#define BENCH_CYCLES() 0
+#endif
+
+#include "Arduino.h"
+#include "SD_Log.h"
+#include "Series_Codec.h"
+
+#define BLOCK_SIZE  SD_LOG_BLOCK_SIZE
+#define SIM_SECONDS 120
+#define BENCH_TIME  0.5 // seconds per timing
+
+typedef struct
+{
+  std::vector<uint32_t> timestamps;
+  std::vector<int32_t> values;
+} Series;
+
+typedef struct
+{
+  uint16_t channel;
+  byte mode;
+  uint16_t length;
+  uint16_t first; // index of the first sample in the series
+  byte data[BLOCK_SIZE];
+} Block;
+
+typedef std::map<uint16_t, Series> Session;
+
+/*
+ Every valid block of a log file, records in order per channel.
+*/
+static bool readLog(const char* name, Session* session)
+{
+  FILE* file = fopen(name, "rb");
+  SD_Log_Block block;
+
+  if (file == 0)
+  {
+    perror(name);
+    return false;
+  }
+
+  while (fread(&block, sizeof(block), 1, file) == 1)
+  {
+    uint32_t time = block.header.timestamp;
+
+    if (!SD_Log::valid(&block))
+    {
+      continue;
+    }
+    for (byte r = 0; r < block.header.count; r++)
+    {
+      Series* series = &(*session)[block.records[r].channel];
+
+      time += SD_Log::delta(&block, r);
+      series->timestamps.push_back(time);
+      series->values.push_back(block.records[r].raw);
+    }
+  }
+
+  fclose(file);
+
+  return true;
+}
+
+/*
+ Noise of a few units either way.
+*/
+static int32_t noise(int32_t amplitude)
+{
+  return (rand() % (2 * amplitude + 1)) - amplitude;
+}
+
+/*
+ A sensor read in batches every interval milliseconds, each sample
+ stamped back from the batch by its sample period, as IMU_FIFO does.
+*/
+static void addBatched(Session* session, uint16_t channel, uint32_t period_us, uint16_t interval,
+                       int32_t (*value)(double, byte))
+{
+  for (uint32_t batch = interval; batch <= SIM_SECONDS * 1000; batch += interval)
+  {
+    uint64_t first = ((uint64_t)(batch - interval) * 1000 + period_us - 1) / period_us;
+    uint64_t last = ((uint64_t)batch * 1000) / period_us;
+
+    for (uint64_t k = first; k < last; k++)
+    {
+      uint32_t newer = last - 1 - k;
+      uint32_t stamp = batch - (newer * period_us + period_us / 2) / 1000;
+
+      for (byte axis = 0; axis < 3; axis++)
+      {
+        Series* series = &(*session)[channel + axis];
+
+        series->timestamps.push_back(stamp);
+        series->values.push_back(value(k * period_us / 1e6, axis));
+      }
+    }
+  }
+}
+
+/*
+ mg, cornering and braking of a few hundred mg in steps of the 3.9 mg LSB.
+*/
+static int32_t accel(double t, byte axis)
+{
+  double g = (axis == 2) ? 1000 : 600 * sin(t * (axis ? 0.9 : 0.5));
+
+  return (int32_t)((g + noise(6)) / 3.9) * 39 / 10;
+}
+
+/*
+ mdps in steps of 8.75.
+*/
+static int32_t gyro(double t, byte axis)
+{
+  double dps = (axis == 2) ? 40 * sin(t * 0.9) : 3 * sin(t * 2.0);
+
+  return (int32_t)(dps * 1000 / 8.75 + noise(3)) * 875 / 100;
+}
+
+/*
+ mG, turning slowly with the car.
+*/
+static int32_t mag(double t, byte axis)
+{
+  return (int32_t)(450 * cos(t * 0.2 + axis)) + noise(2);
+}
+
+/*
+ A polled PID: raw value at a period with a few milliseconds of jitter.
+*/
+static void addPolled(Session* session, uint16_t channel, uint32_t period, int32_t (*value)(double))
+{
+  Series* series = &(*session)[channel];
+
+  for (uint32_t t = period; t <= SIM_SECONDS * 1000; t += period)
+  {
+    series->timestamps.push_back(t + rand() % 4);
+    series->values.push_back(value(t / 1000.0));
+  }
+}
+
+static double rpmAt(double t)
+{
+  double cycle = fmod(t, 8.0);
+
+  return 2500 + ((cycle < 6) ? cycle * 700 : 4200 - (cycle - 6) * 1500);
+}
+
+static int32_t rpmRaw(double t) { return (int32_t)(rpmAt(t) * 4) & ~3; }
+static int32_t throttleRaw(double t) { return (fmod(t, 8.0) < 6) ? 230 + noise(1) : 20; }
+static int32_t pedalRaw(double t) { return (fmod(t, 8.0) < 6) ? 235 : 0; }
+static int32_t loadRaw(double t) { return (int32_t)(120 + 60 * sin(t)) + noise(2); }
+static int32_t speedRaw(double t) { return (int32_t)(60 + 40 * sin(t * 0.1)); }
+static int32_t monitorRaw(double) { return 0; }
+static int32_t gearRaw(double t) { return (int32_t)(100 + rpmAt(t) / 100) + noise(1); }
+static int32_t rateRaw(double t) { return (fmod(t, 8.0) < 6) ? 700 + noise(40) : -1500 + noise(40); }
+static int32_t latitude(double t) { return 380000000 + (int32_t)(t * 1800 + 600 * sin(t * 0.3)); }
+static int32_t longitude(double t) { return -1220000000 + (int32_t)(t * 2200 + 900 * cos(t * 0.3)); }
+static int32_t gpsSpeed(double t) { return (int32_t)(25000 + 3000 * sin(t * 0.4)) + noise(30); }
+static int32_t gpsCourse(double t) { return (int32_t)(9000 + 1500 * sin(t * 0.3)) + noise(20); }
+static int32_t lapDelta(double t) { return (int32_t)(t * 8) - 400; }
+
+/*
+ Two minutes of the SAM build's channels.
+*/
+static void makeSession(Session* session)
+{
+  srand(11);
+  addBatched(session, 0xFF10, 5000, 50, accel);
+  addBatched(session, 0xFF13, 5263, 50, gyro);
+  addBatched(session, 0xFF16, 34000, 34, mag);
+  addPolled(session, 0xFF00, 100, latitude);
+  addPolled(session, 0xFF01, 100, longitude);
+  addPolled(session, 0xFF02, 100, gpsSpeed);
+  addPolled(session, 0xFF03, 100, gpsCourse);
+  addPolled(session, 0xFF23, 100, lapDelta);
+  addPolled(session, 0x0C, 20, rpmRaw);
+  addPolled(session, 0x45, 50, throttleRaw);
+  addPolled(session, 0x5A, 50, pedalRaw);
+  addPolled(session, 0x04, 100, loadRaw);
+  addPolled(session, 0x0D, 100, speedRaw);
+  addPolled(session, 0x01, 1000, monitorRaw);
+  addPolled(session, 0xFF30, 20, gearRaw);
+  addPolled(session, 0xFF34, 100, rateRaw);
+}
+
+/*
+ Encode a series into blocks of one mode. Returns the bytes taken.
+*/
+static uint32_t encode(uint16_t channel, const Series& series, byte mode, std::vector<Block>* blocks)
+{
+  Series_Encoder encoder;
+  Block block;
+  uint32_t bytes = 0;
+
+  block.channel = channel;
+  block.mode = mode;
+  block.first = 0;
+  encoder.begin(block.data, BLOCK_SIZE, channel, mode);
+
+  for (size_t i = 0; i < series.timestamps.size(); i++)
+  {
+    if (!encoder.append(series.timestamps[i], series.values[i]))
+    {
+      block.length = encoder.finish();
+      bytes += block.length;
+      blocks->push_back(block);
+      block.first = i;
+      encoder.begin(block.data, BLOCK_SIZE, channel, mode);
+      encoder.append(series.timestamps[i], series.values[i]);
+    }
+  }
+  block.length = encoder.finish();
+  bytes += block.length;
+  blocks->push_back(block);
+
+  return bytes;
+}
+
+/*
+
+*/
+int main(int argc, char* argv[])
+{
+  Session session;
+  std::vector<Block> blocks;
+  uint32_t samples = 0;
+  uint32_t compressed = 0;
+  bool ok = true;
+
+  for (int i = 1; i < argc; i++)
+  {
+    if (!readLog(argv[i], &session))
+    {
+      return 1;
+    }
+  }
+  if (argc == 1)
+  {
+    makeSession(&session);
+  }
+
+  printf("channel,samples,xor_bytes,delta_bytes,bits_per_sample\n");
+  for (Session::iterator it = session.begin(); it != session.end(); ++it)
+  {
+    std::vector<Block> xor_blocks;
+    std::vector<Block> delta_blocks;
+    uint32_t xor_bytes = encode(it->first, it->second, SERIES_XOR, &xor_blocks);
+    uint32_t delta_bytes = encode(it->first, it->second, SERIES_DELTA, &delta_blocks);
+    std::vector<Block>* best = (xor_bytes < delta_bytes) ? &xor_blocks : &delta_blocks;
+    uint32_t bytes = (xor_bytes < delta_bytes) ? xor_bytes : delta_bytes;
+    size_t count = it->second.timestamps.size();
+
+    printf("0x%04X,%u,%u,%u,%.2f\n", it->first, (unsigned)count, xor_bytes, delta_bytes, bytes * 8.0 / count);
+    blocks.insert(blocks.end(), best->begin(), best->end());
+    samples += count;
+    compressed += bytes;
+  }
+
+  // Every block back to what it came from
+  for (size_t b = 0; b < blocks.size(); b++)
+  {
+    const Series& series = session[blocks[b].channel];
+    Series_Decoder decoder;
+    uint32_t timestamps[BLOCK_SIZE * 8];
+    int32_t values[BLOCK_SIZE * 8];
+
+    if (!decoder.begin(blocks[b].data, blocks[b].length) || (decoder.channel() != blocks[b].channel))
+    {
+      ok = false;
+      continue;
+    }
+    uint16_t n = decoder.decode(timestamps, values, BLOCK_SIZE * 8);
+    for (uint16_t i = 0; i < n; i++)
+    {
+      if ((timestamps[i] != series.timestamps[blocks[b].first + i]) ||
+          (values[i] != series.values[blocks[b].first + i]))
+      {
+        ok = false;
+      }
+    }
+  }
+
+  double sd_log = (double)samples / SD_LOG_RECORDS * SD_LOG_BLOCK_SIZE;
+  printf("\n%u samples in %u channels, %u blocks\n", samples, (unsigned)session.size(), (unsigned)blocks.size());
+  printf("encoded %u bytes, %.2f bits per sample\n", compressed, compressed * 8.0 / samples);
+  printf("ratio %.1f against SD_Log blocks (%.0f bytes), %.1f against 10 byte records\n",
+         sd_log / compressed, sd_log, samples * 10.0 / compressed);
+
+  // Encoder, one sample at a time as on the target
+  {
+    Session::iterator it = session.begin();
+    byte data[BLOCK_SIZE];
+    Series_Encoder encoder;
+    uint32_t done = 0;
+    uint64_t cycles = 0;
+    double seconds = 0;
+
+    while (seconds < BENCH_TIME)
+    {
+      const Series& series = it->second;
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      uint64_t begin_cycles = BENCH_CYCLES();
+
+      encoder.begin(data, BLOCK_SIZE, it->first, SERIES_DELTA);
+      for (size_t i = 0; i < series.timestamps.size(); i++)
+      {
+        if (!encoder.append(series.timestamps[i], series.values[i]))
+        {
+          encoder.finish();
+          encoder.begin(data, BLOCK_SIZE, it->first, SERIES_DELTA);
+          encoder.append(series.timestamps[i], series.values[i]);
+        }
+      }
+      encoder.finish();
+
+      cycles += BENCH_CYCLES() - begin_cycles;
+      seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      done += series.timestamps.size();
+      if (++it == session.end())
+      {
+        it = session.begin();
+      }
+    }
+    printf("encode %.1f ns, %.1f cycles per sample\n", seconds * 1e9 / done, (double)cycles / done);
+  }
+
+  // Decoder, whole blocks as on the host
+  {
+    static uint32_t timestamps[BLOCK_SIZE * 8];
+    static int32_t values[BLOCK_SIZE * 8];
+    Series_Decoder decoder;
+    uint64_t done = 0;
+    uint64_t input = 0;
+    uint32_t sink = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    double seconds = 0;
+
+    while (seconds < BENCH_TIME)
+    {
+      for (size_t b = 0; b < blocks.size(); b++)
+      {
+        decoder.begin(blocks[b].data, blocks[b].length);
+        done += decoder.decode(timestamps, values, BLOCK_SIZE * 8);
+        input += blocks[b].length;
+        sink += values[0];
+      }
+      seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    printf("decode %.0f M samples/s, %.2f GB/s out, %.2f GB/s in (%u)\n",
+           done / seconds / 1e6, done * 8 / seconds / 1e9, input / seconds / 1e9, sink & 1);
+  }
+
+  printf("%s\n", ok ? "ok" : "FAILED");
+
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,324 @@
+/*
+ Two CAN buses polled and merged as on the SAM3X8E build
+ by:
+ date:
+ license:
+
+ Runs the sketch's two CAN_Bus instances and CAN_Merge against traffic
+ on two buses: bus 0 at 500 kbit/s carrying the OBD connector's
+ broadcasts, flooded to full load for a stretch in the middle of the
+ run, and bus 1 at 125 kbit/s with a steady share of transmission and
+ body messages. Loop passes take a few hundred microseconds plus the
+ frames they handle, with a long pass whenever the display is flushed,
+ and bus 1 is polled on its own period as in the sketch.
+
+ With two interface names the frames go out on them through SocketCAN
+ and are read back through CAN_SocketCAN, the same CAN_Driver the buses
+ poll on the board being CAN_Controller. Without them, or when they
+ cannot be opened, each bus is a simulated controller that holds
+ SIM_DEPTH frames and loses the newest when full.
+
+   ip link add dev vcan0 type vcan && ip link set up vcan0
+   ip link add dev vcan1 type vcan && ip link set up vcan1
+   dual_can vcan0 vcan1
+
+ Every frame carries its bus's sequence number and the millisecond it
+ was put on the bus. The merged stream is checked to be in time order,
+ and bus 1 to lose nothing and to be read within its poll period of the
+ slowest pass however hard bus 0 is flooded. The report gives per bus
+ the frames sent, delivered and lost, where they were lost and the
+ worst latency.
+
+ Build from the repository root:
+   g++ -std=c++11 -O2 -Itools/host -I. -o dual_can tools/dual_can.cpp \
+       tools/host/Arduino.cpp tools/host/CAN_SocketCAN.cpp CAN_Ring.cpp CAN_Bus.cpp
+
+ Usage:
+   dual_can [-s seconds] [interface0 interface1]
+ */
+
+#include <unistd.h>
+#include <deque>
+
+#include "Arduino.h"
+#include "CAN_Driver.h"
+#include "CAN_SocketCAN.h"
+#include "CAN_Bus.h"
+
+#define BUSES          2
+#define SIM_DEPTH      32    // frames a simulated controller holds
+#define FRAME_BITS     125   // 8 data bytes with stuffing and the interframe space
+#define PASS_US        300   // rest of a loop pass
+#define FRAME_US       20    // handling one merged frame
+#define FLUSH_PERIOD   200   // milliseconds, LCD_FLUSH_PERIOD
+#define FLUSH_US       25000 // a full display at 100 kHz
+#define BUS1_PERIOD    10    // milliseconds, CAN_BUS1_PERIOD
+#define FLOOD_FROM     3000  // milliseconds
+#define FLOOD_TO       7000
+
+typedef struct
+{
+  uint32_t bitrate;
+  byte load;            // percent of the bus outside the flood
+  byte flood;           // percent during it
+  uint16_t ids[4];      // sent in turn, all subscribed
+} Traffic;
+
+static const Traffic traffic[BUSES] = {
+  {500000, 30, 100, {0x165, 0x171, 0x201, 0x420}},
+  {125000, 40, 40, {0x230, 0x3B3, 0x3C3, 0x430}}
+};
+
+/*
+ A controller holding up to SIM_DEPTH frames, fed by the simulation.
+*/
+class SimController : public CAN_Driver
+{
+  public:
+    SimController()
+    {
+      lost = 0;
+    }
+
+    bool begin(uint32_t bitrate)
+    {
+      (void)bitrate;
+      return true;
+    }
+
+    bool receive(OBD_Frame* frame)
+    {
+      if (held.empty())
+      {
+        return false;
+      }
+      *frame = held.front();
+      held.pop_front();
+      return true;
+    }
+
+    bool send(const OBD_Frame* frame)
+    {
+      if (held.size() >= SIM_DEPTH)
+      {
+        lost++;
+        return true; // on the wire, but this controller missed it
+      }
+      held.push_back(*frame);
+      return true;
+    }
+
+    // The simulation only sends subscribed IDs
+    bool filter(byte slot, uint32_t mask, uint32_t filter)
+    {
+      (void)slot;
+      (void)mask;
+      (void)filter;
+      return true;
+    }
+
+    // Nothing goes out from here to keep quiet
+    bool listen(bool on)
+    {
+      (void)on;
+      return true;
+    }
+
+    uint32_t lost;
+
+  private:
+    std::deque<OBD_Frame> held;
+};
+
+typedef struct
+{
+  uint64_t next_us;    // when the next frame is put on the bus
+  uint32_t sent;
+  uint32_t delivered;
+  uint32_t expected;   // next sequence number
+  uint32_t gaps;       // frames missing from the sequence
+  uint32_t worst;      // milliseconds from the bus to the merged stream
+} Bus_Stats;
+
+/*
+ Microseconds between frames of a bus at a load.
+*/
+static uint64_t spacing(const Traffic* bus, byte load)
+{
+  return (uint64_t)FRAME_BITS * 1000000 * 100 / ((uint64_t)bus->bitrate * load);
+}
+
+/*
+
+*/
+int main(int argc, char* argv[])
+{
+  SimController simulated[BUSES];
+  CAN_SocketCAN* listen[BUSES] = {0, 0};
+  CAN_SocketCAN* talk[BUSES] = {0, 0};
+  CAN_Driver* controllers[BUSES];
+  CAN_Driver* wires[BUSES];
+  CAN_Bus buses[BUSES];
+  CAN_Merge merge;
+  Bus_Stats stats[BUSES];
+  uint32_t seconds = 10;
+  uint32_t out_of_order = 0;
+  uint32_t last_merged = 0;
+  uint32_t next_flush = FLUSH_PERIOD;
+  uint64_t slowest_pass = 0;
+  bool vcan = false;
+  int option;
+
+  while ((option = getopt(argc, argv, "s:")) != -1)
+  {
+    switch (option)
+    {
+      case 's':
+        seconds = atoi(optarg);
+        break;
+      default:
+        fprintf(stderr, "usage: %s [-s seconds] [interface0 interface1]\n", argv[0]);
+        return 2;
+    }
+  }
+
+  if (argc - optind == BUSES)
+  {
+    vcan = true;
+    for (byte b = 0; b < BUSES; b++)
+    {
+      listen[b] = new CAN_SocketCAN(argv[optind + b]);
+      talk[b] = new CAN_SocketCAN(argv[optind + b]);
+      if (!listen[b]->begin(traffic[b].bitrate) || !talk[b]->begin(traffic[b].bitrate))
+      {
+        vcan = false;
+      }
+    }
+    if (vcan == false)
+    {
+      printf("%s and %s cannot be opened, simulated controllers instead\n", argv[optind], argv[optind + 1]);
+    }
+  }
+
+  for (byte b = 0; b < BUSES; b++)
+  {
+    controllers[b] = vcan ? (CAN_Driver*)listen[b] : (CAN_Driver*)&simulated[b];
+    wires[b] = vcan ? (CAN_Driver*)talk[b] : (CAN_Driver*)&simulated[b];
+    buses[b].begin(controllers[b], b, traffic[b].bitrate);
+    for (byte i = 0; i < 4; i++)
+    {
+      buses[b].ring.subscribe(traffic[b].ids[i]);
+    }
+    memset(&stats[b], 0, sizeof(stats[b]));
+  }
+  buses[1].schedule(BUS1_PERIOD, CAN_BUS_BUDGET);
+  merge.begin(buses, BUSES);
+
+  uint64_t end_us = (uint64_t)seconds * 1000000;
+  uint64_t t = 0;
+
+  // Keep passing until the last frames sent are through
+  while (t < end_us + 100000)
+  {
+    uint32_t now = t / 1000;
+    OBD_Frame frame;
+    uint32_t handled = 0;
+
+    // Everything put on the buses since the last pass
+    for (byte b = 0; (b < BUSES) && (t < end_us); b++)
+    {
+      while (stats[b].next_us <= t)
+      {
+        uint32_t at = stats[b].next_us / 1000;
+        bool flood = (at >= FLOOD_FROM) && (at < FLOOD_TO);
+
+        frame.id = traffic[b].ids[stats[b].sent & 3];
+        frame.length = 8;
+        memcpy(frame.data, &stats[b].sent, 4);
+        memcpy(frame.data + 4, &at, 4);
+        if (wires[b]->send(&frame) == false)
+        {
+          // The interface's queue is full, try again next pass
+          break;
+        }
+        stats[b].sent++;
+        stats[b].next_us += spacing(&traffic[b], flood ? traffic[b].flood : traffic[b].load);
+      }
+    }
+
+    // pollBus()
+    for (byte b = 0; b < BUSES; b++)
+    {
+      buses[b].poll(now);
+    }
+    while (merge.pop(&frame))
+    {
+      Bus_Stats* s = &stats[frame.bus];
+      uint32_t sequence;
+      uint32_t at;
+
+      memcpy(&sequence, frame.data, 4);
+      memcpy(&at, frame.data + 4, 4);
+
+      if ((int32_t)(frame.timestamp - last_merged) < 0)
+      {
+        out_of_order++;
+      }
+      last_merged = frame.timestamp;
+
+      if (sequence != s->expected)
+      {
+        s->gaps += sequence - s->expected;
+      }
+      s->expected = sequence + 1;
+      s->delivered++;
+      if (frame.timestamp - at > s->worst)
+      {
+        s->worst = frame.timestamp - at;
+      }
+      handled++;
+    }
+
+    uint64_t pass = PASS_US + FRAME_US * handled + (rand() % PASS_US);
+    if (now >= next_flush)
+    {
+      pass += FLUSH_US;
+      next_flush = now + FLUSH_PERIOD;
+    }
+    if (pass > slowest_pass)
+    {
+      slowest_pass = pass;
+    }
+    if (vcan)
+    {
+      // Let the kernel deliver what was sent
+      usleep(pass / 10);
+    }
+    t += pass;
+  }
+
+  printf("%s, %u s, bus 0 flooded from %u to %u ms, slowest pass %.1f ms\n",
+         vcan ? "SocketCAN" : "simulated controllers", seconds, FLOOD_FROM, FLOOD_TO, slowest_pass / 1000.0);
+  printf("bus | kbit/s | sent   | delivered | lost in controller | lost in ring | deferred | worst ms\n");
+  for (byte b = 0; b < BUSES; b++)
+  {
+    printf("%3u | %6u | %6u | %9u | %18u | %12u | %8u | %8u\n",
+           b, traffic[b].bitrate / 1000, stats[b].sent, stats[b].delivered,
+           vcan ? 0 : simulated[b].lost, buses[b].ring.lost(), buses[b].deferred, stats[b].worst);
+  }
+  printf("merged out of time order %u\n", out_of_order);
+
+  bool ok = (out_of_order == 0) &&
+            (stats[1].delivered == stats[1].sent) && (stats[1].gaps == 0) &&
+            (stats[1].worst <= BUS1_PERIOD + slowest_pass / 1000 + 1) &&
+            (stats[0].delivered + stats[0].gaps == stats[0].sent);
+  printf("%s\n", ok ? "ok" : "FAILED");
+
+  for (byte b = 0; b < BUSES; b++)
+  {
+    delete listen[b];
+    delete talk[b];
+  }
+
+  return ok ? 0 : 1;
+}
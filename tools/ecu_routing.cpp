@@ -0,0 +1,325 @@
+/*
+ Functional against learned physical addressing on a multi-ECU vehicle
+ by:
+ date:
+ license:
+
+ Runs the request path of pollBus() against ECU_Sim set up as a vehicle
+ with three emissions ECUs answering overlapping shares of Service $01:
+ the PCM on 0x7E8 everything but vehicle speed, the TCM on 0x7E9 speed,
+ RPM, coolant temperature and monitor status, a hybrid controller on
+ 0x7EA monitor status, ambient temperature and battery power. The
+ dashboard channels of the sketch are polled twice over the same time:
+
+   functional  every request on ID_REQUEST, as before OBD_Routes
+   physical    OBD_Routes attached to OBD_Engine, so once a PID's owner
+               is learned its requests go to that ECU's ID_REQUEST_n
+
+ In both runs the replies of every ECU are decoded and OBD_Routes::keep()
+ passes on the owner's samples only, so the runs differ in addressing
+ alone. The report gives the frames on the bus and its load at 500
+ kbit/s, the replies per request, the replies thrown away, and per
+ channel the rate achieved and the request to sample latency.
+
+ Build from the repository root:
+   g++ -std=c++11 -O2 -Itools/host -I. -o ecu_routing tools/ecu_routing.cpp \
+       tools/host/Arduino.cpp WWH_OBD.cpp Ford_OBD.cpp OBD_Sample.cpp \
+       OBD_Engine.cpp OBD_Routes.cpp ISO_TP.cpp OBD_Scheduler.cpp OBD_Supported.cpp \
+       ECU_Sim.cpp
+
+ Usage:
+   ecu_routing [-s seconds]
+ */
+
+#include <algorithm>
+#include <vector>
+
+#include <unistd.h>
+
+#include "Arduino.h"
+#include "WWH_OBD.h"
+#include "OBD_Engine.h"
+#include "OBD_Routes.h"
+#include "ISO_TP.h"
+#include "OBD_Scheduler.h"
+#include "OBD_Supported.h"
+#include "ECU_Sim.h"
+
+#define BITRATE    500000
+#define FRAME_BITS 125 // 8 data bytes with stuffing and the interframe space
+
+// As in the sketch
+static const byte dash_pids[] = {PID_APP_R, PID_TP_R, PID_RPM, PID_LOAD_PCT, PID_SPEED, PID_MONITOR};
+static const uint16_t dash_rates[] = {OBD_HZ(20), OBD_HZ(20), OBD_HZ(50), OBD_HZ(10), OBD_HZ(10), OBD_HZ(1)};
+
+#define CHANNELS sizeof(dash_pids)
+
+static const byte tcm_pids[] = {PID_MONITOR, PID_ECT, PID_RPM, PID_SPEED};
+static const byte hcm_pids[] = {PID_MONITOR, PID_AAT, PID_BAT_PWR};
+
+static uint8_t pcm_set[32];
+static uint8_t tcm_set[32];
+static uint8_t hcm_set[32];
+
+typedef struct
+{
+  uint32_t frames;      // both directions
+  uint32_t requests;
+  uint32_t replies;     // positive, from any ECU
+  uint32_t duplicates;
+  uint32_t timeouts;
+  byte learned;
+  uint32_t learned_at;  // milliseconds until every channel was routed
+  std::vector<uint32_t> latencies[CHANNELS];
+  uint16_t achieved[CHANNELS];
+} Result;
+
+/*
+
+*/
+static void setPIDs(uint8_t* set, const byte* pids, byte count)
+{
+  memset(set, 0, 32);
+  for (byte i = 0; i < count; i++)
+  {
+    set[pids[i] >> 3] |= 1 << (pids[i] & 0x07);
+  }
+}
+
+/*
+
+*/
+static uint32_t percentile(std::vector<uint32_t> latencies, uint32_t per_mille)
+{
+  if (latencies.empty())
+  {
+    return 0;
+  }
+
+  size_t index = (latencies.size() - 1) * per_mille / 1000;
+  std::nth_element(latencies.begin(), latencies.begin() + index, latencies.end());
+
+  return latencies[index];
+}
+
+/*
+ Poll the dashboard for seconds, physically addressed once learned if
+ routed.
+*/
+static void run(bool routed, uint32_t seconds, Result* result)
+{
+  ECU_Sim_Config pcm = {5, 5, ECU_SIM_DIAG | ECU_SIM_INFO | ECU_SIM_RDBI, NRC_PR, 0, pcm_set};
+  ECU_Sim_Config tcm = {8, 6, ECU_SIM_DIAG, NRC_PR, 0, tcm_set};
+  ECU_Sim_Config hcm = {12, 8, ECU_SIM_DIAG, NRC_PR, 0, hcm_set};
+  ECU_Sim sim;
+  OBD_Engine engine;
+  OBD_Routes routes;
+  ISO_TP isotp;
+  OBD_Scheduler scheduler;
+  OBD_Supported supported;
+  bool scheduled = false;
+
+  sim.configure(0, &pcm);
+  sim.configure(1, &tcm);
+  sim.configure(2, &hcm);
+  if (routed)
+  {
+    engine.setRoutes(&routes);
+  }
+  supported.begin(0);
+
+  result->frames = 0;
+  result->replies = 0;
+  result->learned_at = 0;
+
+  for (uint32_t now = 0; now < seconds * 1000; now++)
+  {
+    OBD_Frame frame;
+    const byte* payload;
+    uint16_t length;
+
+    while (sim.transmit(now, &frame))
+    {
+      byte ecu = frame.id - ID_REPLY_1;
+
+      result->frames++;
+      if (isotp.receive(&frame, now, &payload, &length) != ISO_TP_RX_COMPLETE)
+      {
+        continue;
+      }
+
+      switch (engine.receive(frame.id, payload, length, now))
+      {
+        case OBD_RX_RESPONSE:
+        case OBD_RX_UNMATCHED:
+          result->replies++;
+          if (routed == false)
+          {
+            // Learned for keep() only, the engine does not route
+            routes.learn(ecu, payload, length);
+          }
+          supported.update(frame.id, payload, length, now);
+          if (payload[0] == SIDPR_DIAG)
+          {
+            OBD_Sample samples[OBD_BATCH_MAX];
+            byte count = WWH_OBD().decodeBatch(payload, length, now, samples, OBD_BATCH_MAX);
+
+            for (byte i = 0; i < count; i++)
+            {
+              if (routes.keep(SIDRQ_DIAG, samples[i].pid, ecu) == false)
+              {
+                continue;
+              }
+              for (byte c = 0; c < scheduler.channels(); c++)
+              {
+                const OBD_Channel* channel = scheduler.channel(c);
+
+                if ((channel->pid == samples[i].pid) && channel->in_flight)
+                {
+                  result->latencies[c].push_back(now - channel->sent);
+                }
+              }
+              scheduler.received(SIDRQ_DIAG, samples[i].pid, now);
+            }
+          }
+          break;
+      }
+    }
+
+    isotp.expire(now);
+    engine.expire(now);
+
+    if (supported.ready() == false)
+    {
+      supported.poll(&engine, now);
+    }
+    else
+    {
+      if (scheduled == false)
+      {
+        for (byte i = 0; i < CHANNELS; i++)
+        {
+          scheduler.add(SIDRQ_DIAG, dash_pids[i], dash_rates[i], i);
+        }
+        scheduled = true;
+      }
+      scheduler.poll(now, &engine, ISO_TP_BUF_SIZE);
+    }
+
+    if (routed && (result->learned_at == 0) && (routes.learned() >= CHANNELS))
+    {
+      result->learned_at = now;
+    }
+
+    while (isotp.transmit(now, &frame) || engine.transmit(now, &frame))
+    {
+      result->frames++;
+      sim.receive(&frame, now);
+    }
+  }
+
+  result->requests = engine.requests_sent;
+  result->duplicates = routes.duplicates;
+  result->timeouts = engine.timeouts;
+  result->learned = routes.learned();
+  for (byte c = 0; c < scheduler.channels(); c++)
+  {
+    result->achieved[c] = scheduler.achieved(c);
+  }
+}
+
+/*
+
+*/
+static void report(const char* mode, const Result* result, uint32_t seconds)
+{
+  printf("%-10s | %8u | %7u | %15.2f | %8u | %7.1f%% | %10u | %8u\n", mode,
+         result->requests, result->replies, (double)result->replies / result->requests,
+         result->frames / seconds, 100.0 * result->frames * FRAME_BITS / ((double)BITRATE * seconds),
+         result->duplicates, result->timeouts);
+}
+
+/*
+
+*/
+int main(int argc, char* argv[])
+{
+  static Result functional;
+  static Result physical;
+  uint32_t seconds = 60;
+  int option;
+
+  while ((option = getopt(argc, argv, "s:")) != -1)
+  {
+    switch (option)
+    {
+      case 's':
+        seconds = atoi(optarg);
+        break;
+      default:
+        fprintf(stderr, "usage: ecu_routing [-s seconds]\n");
+        return 1;
+    }
+  }
+  if (seconds == 0)
+  {
+    seconds = 1;
+  }
+
+  // The PCM answers everything the dictionary has but vehicle speed
+  memset(pcm_set, 0xFF, sizeof(pcm_set));
+  pcm_set[PID_SPEED >> 3] &= ~(1 << (PID_SPEED & 0x07));
+  setPIDs(tcm_set, tcm_pids, sizeof(tcm_pids));
+  setPIDs(hcm_set, hcm_pids, sizeof(hcm_pids));
+
+  run(false, seconds, &functional);
+  run(true, seconds, &physical);
+
+  printf("%u s, 3 ECUs, dashboard channels routed after %u ms (%u routes)\n",
+         seconds, physical.learned_at, physical.learned);
+  printf("mode       | requests | replies | replies/request | frames/s | bus load | duplicates | timeouts\n");
+  report("functional", &functional, seconds);
+  report("physical", &physical, seconds);
+
+  printf("pid  | hz   | functional hz p50 p90 max | physical hz p50 p90 max\n");
+  for (byte c = 0; c < CHANNELS; c++)
+  {
+    const std::vector<uint32_t>& f = functional.latencies[c];
+    const std::vector<uint32_t>& p = physical.latencies[c];
+
+    printf("0x%02X | %4.1f | %13.1f %3u %3u %3u | %11.1f %3u %3u %3u\n", dash_pids[c], dash_rates[c] / 10.0,
+           functional.achieved[c] / 10.0, percentile(f, 500), percentile(f, 900),
+           f.empty() ? 0 : *std::max_element(f.begin(), f.end()),
+           physical.achieved[c] / 10.0, percentile(p, 500), percentile(p, 900),
+           p.empty() ? 0 : *std::max_element(p.begin(), p.end()));
+  }
+
+  std::vector<uint32_t> all_functional;
+  std::vector<uint32_t> all_physical;
+  for (byte c = 0; c < CHANNELS; c++)
+  {
+    all_functional.insert(all_functional.end(), functional.latencies[c].begin(), functional.latencies[c].end());
+    all_physical.insert(all_physical.end(), physical.latencies[c].begin(), physical.latencies[c].end());
+  }
+
+  double load_drop = 100.0 * (1.0 - (double)physical.frames / functional.frames);
+  double extra_drop = 100.0 * (1.0 - ((double)physical.replies / physical.requests - 1.0) /
+                               ((double)functional.replies / functional.requests - 1.0));
+  uint32_t f50 = percentile(all_functional, 500);
+  uint32_t f90 = percentile(all_functional, 900);
+  uint32_t p50 = percentile(all_physical, 500);
+  uint32_t p90 = percentile(all_physical, 900);
+
+  printf("bus frames %.1f%% fewer, extra replies %.1f%% fewer, latency p50 %u -> %u ms, p90 %u -> %u ms\n",
+         load_drop, extra_drop, f50, p50, f90, p90);
+
+  // What routing promises: once learned about one reply per request, the
+  // 5% allowing for the functional requests before, fewer frames and no
+  // more timeouts. It promises nothing for latency, a PID the slower TCM
+  // owns waits for that ECU alone, so that is reported, not checked.
+  bool ok = (physical.learned >= CHANNELS) && (physical.replies <= physical.requests + physical.requests / 20) &&
+            (physical.frames < functional.frames) && (physical.timeouts <= functional.timeouts);
+  printf("%s\n", ok ? "ok" : "FAILED");
+
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,17 @@
+/*
+ Adafruit MCP23017 library stand-in
+ by:
+ date:
+ license:
+
+ The sketch talks to the shield's expander through Wire itself, so only
+ the include has to resolve. A tool simulating the expander attaches a
+ TwoWire_Device at MCP23017_ADDRESS_BASE.
+ */
+#ifndef host_adafruit_mcp23017_h_
+#define host_adafruit_mcp23017_h_
+
+#include "Arduino.h"
+#include "Wire.h"
+
+#endif // _host_adafruit_mcp23017_h_
@@ -0,0 +1,112 @@
+/*
+ Adafruit RGB LCD shield stand-in counting I2C traffic
+ by:
+ date:
+ license:
+ */
+
+#include "Adafruit_RGBLCDShield.h"
+
+/*
+
+*/
+Adafruit_RGBLCDShield::Adafruit_RGBLCDShield()
+{
+  memset(screen, ' ', sizeof(screen));
+  buttons = 0;
+  i2c_bytes = 0;
+  busy_us = 0;
+  characters = 0;
+  commands = 0;
+  col = 0;
+  row = 0;
+}
+
+/*
+ The initialisation sequence is left out of the counts.
+*/
+void Adafruit_RGBLCDShield::begin(uint8_t, uint8_t)
+{
+  memset(screen, ' ', sizeof(screen));
+  col = 0;
+  row = 0;
+}
+
+/*
+
+*/
+void Adafruit_RGBLCDShield::clear()
+{
+  send(LCD_CLEAR_US);
+  commands++;
+  memset(screen, ' ', sizeof(screen));
+  col = 0;
+  row = 0;
+}
+
+/*
+
+*/
+void Adafruit_RGBLCDShield::home()
+{
+  send(LCD_CLEAR_US);
+  commands++;
+  col = 0;
+  row = 0;
+}
+
+/*
+
+*/
+void Adafruit_RGBLCDShield::setCursor(uint8_t col, uint8_t row)
+{
+  send(0);
+  commands++;
+  this->col = col;
+  this->row = (row < 2) ? row : 1;
+}
+
+/*
+ One pin per colour.
+*/
+void Adafruit_RGBLCDShield::setBacklight(uint8_t)
+{
+  i2c_bytes += 3 * LCD_I2C_PIN;
+  busy_us += 3 * LCD_I2C_PIN * LCD_I2C_BYTE_US;
+}
+
+/*
+
+*/
+uint8_t Adafruit_RGBLCDShield::readButtons()
+{
+  i2c_bytes += LCD_I2C_READ;
+  busy_us += LCD_I2C_READ * LCD_I2C_BYTE_US;
+
+  return buttons;
+}
+
+/*
+ Past the end of a line the HD44780 keeps writing into DDRAM nobody sees.
+*/
+size_t Adafruit_RGBLCDShield::write(uint8_t c)
+{
+  send(0);
+  characters++;
+  if (col < sizeof(screen[0]))
+  {
+    screen[row][col] = c;
+  }
+  col++;
+
+  return 1;
+}
+
+/*
+
+*/
+void Adafruit_RGBLCDShield::send(uint32_t extra_us)
+{
+  i2c_bytes += LCD_I2C_SEND;
+  busy_us += LCD_I2C_SEND * LCD_I2C_BYTE_US + 2 * LCD_NIBBLE_US + extra_us;
+}
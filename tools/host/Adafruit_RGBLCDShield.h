@@ -0,0 +1,65 @@
+/*
+ Adafruit RGB LCD shield stand-in counting I2C traffic
+ by:
+ date:
+ license:
+
+ Keeps the characters a real 16x2 display would show and adds up what
+ each call costs on the shield: the I2C bytes Adafruit_RGBLCDShield and
+ Adafruit_MCP23017 put on the wire, address bytes included, and the time
+ they and the HD44780 delays take at the standard 100 kHz clock.
+
+ Every character or command is one send(): the RS and RW pins are set
+ with a read-modify-write of the output latch each (7 bytes), then two
+ nibbles are written, each as a read of both ports and three port writes
+ to set the data and pulse enable (17 bytes).
+ */
+#ifndef host_adafruit_rgblcdshield_h_
+#define host_adafruit_rgblcdshield_h_
+
+#include "Arduino.h"
+
+#define BUTTON_UP     0x08
+#define BUTTON_DOWN   0x04
+#define BUTTON_LEFT   0x10
+#define BUTTON_RIGHT  0x02
+#define BUTTON_SELECT 0x01
+
+#define WHITE 0x7
+
+#define LCD_I2C_PIN    7                                  // MCP23017 digitalWrite
+#define LCD_I2C_NIBBLE 17                                 // readGPIOAB and 3 writeGPIOAB
+#define LCD_I2C_SEND   (2 * LCD_I2C_PIN + 2 * LCD_I2C_NIBBLE)
+#define LCD_I2C_READ   5                                  // readGPIOAB
+#define LCD_I2C_BYTE_US 90                                // 9 clocks at 100 kHz
+#define LCD_NIBBLE_US  102                                // enable pulse and settle
+#define LCD_CLEAR_US   2000                               // clear and home
+
+class Adafruit_RGBLCDShield : public Print
+{
+  public:
+    Adafruit_RGBLCDShield();
+    void begin(uint8_t cols, uint8_t rows);
+    void clear();
+    void home();
+    void setCursor(uint8_t col, uint8_t row);
+    void setBacklight(uint8_t color);
+    uint8_t readButtons();
+    virtual size_t write(uint8_t c);
+    using Print::write;
+
+    char screen[2][40];   // DDRAM of both lines, the first 16 are visible
+    uint8_t buttons;      // what readButtons() returns
+    uint64_t i2c_bytes;
+    uint64_t busy_us;     // time spent in the calls above
+    uint32_t characters;
+    uint32_t commands;
+
+  private:
+    void send(uint32_t extra_us);
+
+    uint8_t col;
+    uint8_t row;
+};
+
+#endif // _host_adafruit_rgblcdshield_h_
@@ -0,0 +1,181 @@
+/*
+ Arduino core stand-in for building the decode sources on a host
+ by:
+ date:
+ license:
+ */
+
+#include <time.h>
+#include "Arduino.h"
+
+static uint8_t pin_levels[HOST_PINS];
+static uint8_t pin_modes[HOST_PINS];
+static void (*handlers[HOST_PINS])(void);
+static int handler_modes[HOST_PINS];
+
+/*
+ Milliseconds since the first call, like millis() since reset.
+*/
+unsigned long millis()
+{
+  return micros() / 1000;
+}
+
+/*
+
+*/
+unsigned long micros()
+{
+  static struct timespec start;
+  struct timespec now;
+
+  if ((start.tv_sec == 0) && (start.tv_nsec == 0))
+  {
+    clock_gettime(CLOCK_MONOTONIC, &start);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  return (now.tv_sec - start.tv_sec) * 1000000UL + (now.tv_nsec - start.tv_nsec) / 1000;
+}
+
+/*
+
+*/
+void delay(unsigned long ms)
+{
+  struct timespec wait = {(time_t)(ms / 1000), (long)(ms % 1000) * 1000000L};
+
+  nanosleep(&wait, 0);
+}
+
+/*
+ avr-libc's float formatting, width and precision as printf takes them.
+*/
+char* dtostrf(double value, signed char width, unsigned char precision, char* text)
+{
+  sprintf(text, "%*.*f", width, precision, value);
+  return text;
+}
+
+/*
+ An input pin pulled up reads HIGH until something drives it.
+*/
+void pinMode(uint8_t pin, uint8_t mode)
+{
+  if (pin >= HOST_PINS)
+  {
+    return;
+  }
+
+  pin_modes[pin] = mode;
+  if (mode == INPUT_PULLUP)
+  {
+    pin_levels[pin] = HIGH;
+  }
+}
+
+/*
+
+*/
+int digitalRead(uint8_t pin)
+{
+  return (pin < HOST_PINS) ? pin_levels[pin] : LOW;
+}
+
+/*
+
+*/
+void digitalWrite(uint8_t pin, uint8_t level)
+{
+  if ((pin < HOST_PINS) && (pin_modes[pin] == OUTPUT))
+  {
+    pin_levels[pin] = level;
+  }
+}
+
+/*
+ The interrupt number is the pin, see digitalPinToInterrupt().
+*/
+void attachInterrupt(uint8_t interrupt, void (*handler)(void), int mode)
+{
+  if (interrupt < HOST_PINS)
+  {
+    handlers[interrupt] = handler;
+    handler_modes[interrupt] = mode;
+  }
+}
+
+/*
+
+*/
+void detachInterrupt(uint8_t interrupt)
+{
+  if (interrupt < HOST_PINS)
+  {
+    handlers[interrupt] = 0;
+  }
+}
+
+/*
+ Set what an input reads and run its handler if the change is an edge it
+ was attached to, on the caller's thread as if it had been interrupted.
+*/
+void pinLevel(uint8_t pin, uint8_t level)
+{
+  uint8_t before;
+
+  if (pin >= HOST_PINS)
+  {
+    return;
+  }
+
+  before = pin_levels[pin];
+  pin_levels[pin] = level;
+
+  if ((handlers[pin] == 0) || (before == level))
+  {
+    return;
+  }
+  if ((handler_modes[pin] == CHANGE) ||
+      ((handler_modes[pin] == FALLING) && (level == LOW)) ||
+      ((handler_modes[pin] == RISING) && (level == HIGH)))
+  {
+    handlers[pin]();
+  }
+}
+
+#if !defined(__GLIBC__) || !__GLIBC_PREREQ(2, 38)
+/*
+ Append src to dst, never letting dst grow past size - 1 characters.
+*/
+size_t strlcat(char* dst, const char* src, size_t size)
+{
+  size_t dst_length = strnlen(dst, size);
+  size_t src_length = strlen(src);
+  size_t copy;
+
+  if (dst_length == size)
+  {
+    return size + src_length;
+  }
+
+  copy = (src_length < size - dst_length - 1) ? src_length : size - dst_length - 1;
+  memcpy(dst + dst_length, src, copy);
+  dst[dst_length + copy] = 0;
+
+  return dst_length + src_length;
+}
+
+/*
+
+*/
+size_t strlcpy(char* dst, const char* src, size_t size)
+{
+  if (size > 0)
+  {
+    dst[0] = 0;
+  }
+
+  return strlcat(dst, src, size);
+}
+#endif
@@ -0,0 +1,82 @@
+/*
+ Arduino core stand-in for building the decode sources on a host
+ by:
+ date:
+ license:
+
+ Only what the sources and the sketch use. Flash is ordinary memory on the
+ host, so the PROGMEM accessors are plain reads. Pins are levels a tool
+ sets with pinLevel(), which also runs a handler attachInterrupt() gave
+ for the edge, so an interrupt arrives where the tool lets it happen.
+ */
+#ifndef host_arduino_h_
+#define host_arduino_h_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define PROGMEM
+#define F(string) (string)
+#define memcpy_P memcpy
+#define strcpy_P strcpy
+#define strlen_P strlen
+#define pgm_read_byte(address) (*(const uint8_t*)(address))
+#define pgm_read_word(address) (*(const uint16_t*)(address))
+#define pgm_read_dword(address) (*(const uint32_t*)(address))
+
+#define noInterrupts()
+#define interrupts()
+
+#define HEX 16
+#define DEC 10
+
+#define LOW  0
+#define HIGH 1
+
+#define INPUT        0
+#define OUTPUT       1
+#define INPUT_PULLUP 2
+
+#define CHANGE  1
+#define FALLING 2
+#define RISING  3
+
+#define HOST_PINS 70 // the Due's digital and analog pins
+#define digitalPinToInterrupt(pin) (pin)
+
+// Casts of PROGMEM strings to this select the flash overloads on the board
+class __FlashStringHelper;
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+char* dtostrf(double value, signed char width, unsigned char precision, char* text);
+void pinMode(uint8_t pin, uint8_t mode);
+int digitalRead(uint8_t pin);
+void digitalWrite(uint8_t pin, uint8_t level);
+void attachInterrupt(uint8_t interrupt, void (*handler)(void), int mode);
+void detachInterrupt(uint8_t interrupt);
+
+// Host only: drive an input pin from outside, as the hardware on it would
+void pinLevel(uint8_t pin, uint8_t level);
+
+// The sketch's
+void setup();
+void loop();
+
+// glibc has its own from 2.38 on
+#if !defined(__GLIBC__) || !__GLIBC_PREREQ(2, 38)
+size_t strlcat(char* dst, const char* src, size_t size);
+size_t strlcpy(char* dst, const char* src, size_t size);
+#endif
+
+#include "Print.h"
+#include "HardwareSerial.h"
+
+#endif // _host_arduino_h_
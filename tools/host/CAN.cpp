@@ -0,0 +1,209 @@
+/*
+ CAN library stand-in with simulated nodes
+ by:
+ date:
+ license:
+ */
+
+#include "CAN.h"
+
+CANClass CAN1;
+
+/*
+ depth frames fit the receive buffers, at most CAN_HOST_DEPTH.
+*/
+CANClass::CANClass(uint8_t depth)
+{
+  this->depth = (depth < CAN_HOST_DEPTH) ? depth : CAN_HOST_DEPTH;
+  device = 0;
+  wire_free = 0;
+  on_wire = false;
+  bitrate = 0;
+  received = 0;
+  sent = 0;
+  lost = 0;
+  filtered = 0;
+  withheld = 0;
+  filters_set = 0;
+  listening = false;
+  head = 0;
+  count = 0;
+}
+
+/*
+
+*/
+void CANClass::begin(uint32_t bitrate)
+{
+  this->bitrate = bitrate;
+}
+
+/*
+
+*/
+void CANClass::end()
+{
+  bitrate = 0;
+}
+
+/*
+
+*/
+bool CANClass::available()
+{
+  collect();
+
+  return count > 0;
+}
+
+/*
+ Take the oldest frame out of the receive buffers.
+*/
+void CANClass::read(unsigned long* id, byte* length, byte* data)
+{
+  if (count == 0)
+  {
+    *id = 0;
+    *length = 0;
+    return;
+  }
+
+  *id = ids[head];
+  *length = lengths[head];
+  memcpy(data, this->data[head], 8);
+  head = (head + 1) % depth;
+  count--;
+}
+
+/*
+ The frame goes straight on the bus, extended IDs as well.
+*/
+void CANClass::write(unsigned long id, byte frame_type, byte length, const byte* data)
+{
+  (void)frame_type;
+
+  if (listening)
+  {
+    withheld++;
+    return;
+  }
+
+  sent++;
+  if ((bitrate != 0) && (device != 0))
+  {
+    device->receive(id, (length <= 8) ? length : 8, data);
+  }
+}
+
+/*
+
+*/
+void CANClass::attach(CANClass_Device* device)
+{
+  this->device = device;
+}
+
+/*
+ Set acceptance filter slot, (id & mask) == (filter & mask) keeps a frame.
+*/
+bool CANClass::filter(uint8_t slot, uint32_t mask, uint32_t id)
+{
+  if (slot >= CAN_HOST_FILTERS)
+  {
+    return false;
+  }
+
+  masks[slot] = mask;
+  filters[slot] = id & mask;
+  filters_set |= 1 << slot;
+
+  return true;
+}
+
+/*
+ Listen-only, writes go nowhere until listen(false).
+*/
+bool CANClass::listen(bool on)
+{
+  listening = on;
+
+  return true;
+}
+
+/*
+ True if no filter is set or one of them keeps id.
+*/
+bool CANClass::accept(uint32_t id)
+{
+  if (filters_set == 0)
+  {
+    return true;
+  }
+
+  for (uint8_t i = 0; i < CAN_HOST_FILTERS; i++)
+  {
+    if ((filters_set & (1 << i)) && ((id & masks[i]) == filters[i]))
+    {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/*
+ Every frame the device has put on the bus that has been received
+ completely by now.
+*/
+void CANClass::collect()
+{
+  uint32_t now = micros();
+
+  if ((bitrate == 0) || (device == 0))
+  {
+    return;
+  }
+
+  while (true)
+  {
+    if (on_wire == false)
+    {
+      if (device->transmit(&wire_id, &wire_length, wire_data) == false)
+      {
+        return;
+      }
+      // Sent as soon as the bus is idle
+      if ((int32_t)(now - wire_free) > 0)
+      {
+        wire_free = now;
+      }
+      wire_free += (uint32_t)CAN_HOST_FRAME_BITS * 1000000 / bitrate;
+      on_wire = true;
+    }
+
+    if ((int32_t)(now - wire_free) < 0)
+    {
+      return;
+    }
+    on_wire = false;
+
+    if (accept(wire_id) == false)
+    {
+      filtered++;
+      continue;
+    }
+    if (count == depth)
+    {
+      lost++;
+      continue;
+    }
+
+    byte slot = (head + count) % depth;
+
+    ids[slot] = wire_id;
+    lengths[slot] = (wire_length <= 8) ? wire_length : 8;
+    memcpy(data[slot], wire_data, 8);
+    count++;
+    received++;
+  }
+}
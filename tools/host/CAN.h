@@ -0,0 +1,96 @@
+/*
+ CAN library stand-in with simulated nodes
+ by:
+ date:
+ license:
+
+ The CANClass interface the sketch and CAN_Controller use, over a bus
+ held in process. Frames written go to the CANClass_Device attached to
+ the channel, a simulated ECU or vehicle, and the frames it puts on the
+ bus wait in the controller's receive buffers until read. Like the
+ hardware a controller holds only a few frames, CAN_MCP2515 two and
+ CAN_SAM3X8E a mailbox ring, and a frame arriving when they are full is
+ lost and counted.
+
+ The device is asked for its frames whenever the channel is checked.
+ They take CAN_HOST_FRAME_BITS each on the wire at the channel's bitrate,
+ so frames that came due together arrive one after the other, and those
+ that arrived while the sketch was busy elsewhere wait in the buffers.
+ Once filter() has set an acceptance filter only the frames one of them
+ keeps take a buffer, as CAN_Controller programs the chips to. While
+ listen() has the channel listen-only the frames written never reach the
+ device.
+ */
+#ifndef host_can_h_
+#define host_can_h_
+
+#include "Arduino.h"
+
+#define CAN_BPS_1000K 1000000
+#define CAN_BPS_500K  500000
+#define CAN_BPS_250K  250000
+#define CAN_BPS_125K  125000
+
+#define CAN_BASE_FRAME     0
+#define CAN_EXTENDED_FRAME 1
+
+#define CAN_HOST_DEPTH      32  // deepest receive buffer of the controllers
+#define CAN_HOST_FRAME_BITS 125 // 8 data bytes with stuffing and the interframe space
+#define CAN_HOST_FILTERS    2   // acceptance filters CAN_Controller sets
+
+class CANClass_Device
+{
+  public:
+    virtual ~CANClass_Device() {}
+    virtual void receive(uint32_t id, uint8_t length, const uint8_t* data) = 0; // a frame written to the bus
+    virtual bool transmit(uint32_t* id, uint8_t* length, uint8_t* data) = 0;    // the next frame due from the device
+};
+
+class CANClass
+{
+  public:
+    CANClass(uint8_t depth = CAN_HOST_DEPTH);
+    virtual ~CANClass() {}
+    void begin(uint32_t bitrate);
+    void end();
+    bool available();
+    void read(unsigned long* id, byte* length, byte* data);
+    void write(unsigned long id, byte frame_type, byte length, const byte* data);
+
+    // Host only
+    void attach(CANClass_Device* device);
+    bool filter(uint8_t slot, uint32_t mask, uint32_t id);
+    bool listen(bool on);
+
+    uint32_t bitrate;
+    uint32_t received;  // frames taken into the receive buffers
+    uint32_t sent;
+    uint32_t lost;      // frames that found the receive buffers full
+    uint32_t filtered;  // frames no acceptance filter kept
+    uint32_t withheld;  // frames written while listening, never sent
+    bool listening;     // listen-only since listen(true)
+
+  private:
+    void collect();
+    bool accept(uint32_t id);
+
+    CANClass_Device* device;
+    uint32_t wire_free;   // micros() when the frame on the wire has been received
+    bool on_wire;         // the frame below is still being sent
+    uint32_t wire_id;
+    uint8_t wire_length;
+    uint8_t wire_data[8];
+    uint32_t ids[CAN_HOST_DEPTH];
+    uint8_t lengths[CAN_HOST_DEPTH];
+    uint8_t data[CAN_HOST_DEPTH][8];
+    uint32_t masks[CAN_HOST_FILTERS];
+    uint32_t filters[CAN_HOST_FILTERS];
+    uint8_t filters_set; // bit n for filter n
+    uint8_t depth;
+    uint8_t head;
+    uint8_t count;
+};
+
+extern CANClass CAN1;
+
+#endif // _host_can_h_
@@ -0,0 +1,27 @@
+/*
+ MCP2515 channel of the CAN library stand-in
+ by:
+ date:
+ license:
+
+ Two receive buffers, RXB0 and RXB1, as on the chip.
+ */
+#ifndef host_can_mcp2515_h_
+#define host_can_mcp2515_h_
+
+#include "CAN.h"
+
+#define MCP2515_RX_BUFFERS 2
+
+class CAN_MCP2515 : public CANClass
+{
+  public:
+    CAN_MCP2515(uint8_t chip_select) : CANClass(MCP2515_RX_BUFFERS)
+    {
+      this->chip_select = chip_select;
+    }
+
+    uint8_t chip_select;
+};
+
+#endif // _host_can_mcp2515_h_
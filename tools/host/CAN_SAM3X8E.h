@@ -0,0 +1,28 @@
+/*
+ SAM3X8E channel of the CAN library stand-in
+ by:
+ date:
+ license:
+
+ The library empties the controller's mailboxes under its own interrupt
+ into a receive ring, which is what the sketch reads from.
+ */
+#ifndef host_can_sam3x8e_h_
+#define host_can_sam3x8e_h_
+
+#include "CAN.h"
+
+#define SAM3X8E_RX_RING 32
+
+class CAN_SAM3X8E : public CANClass
+{
+  public:
+    CAN_SAM3X8E(uint8_t controller) : CANClass(SAM3X8E_RX_RING)
+    {
+      this->controller = controller;
+    }
+
+    uint8_t controller;
+};
+
+#endif // _host_can_sam3x8e_h_
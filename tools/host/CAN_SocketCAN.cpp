@@ -0,0 +1,155 @@
+/*
+ CAN_Driver over a Linux SocketCAN interface
+ by:
+ date:
+ license:
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <net/if.h>
+#include <sys/socket.h>
+#include <linux/can.h>
+#include <linux/can/raw.h>
+
+#include "CAN_SocketCAN.h"
+
+/*
+
+*/
+CAN_SocketCAN::CAN_SocketCAN(const char* interface)
+{
+  this->interface = interface;
+  fd = -1;
+  filters_set = 0;
+  listening = false;
+}
+
+/*
+
+*/
+CAN_SocketCAN::~CAN_SocketCAN()
+{
+  if (fd >= 0)
+  {
+    close(fd);
+  }
+}
+
+/*
+ Open a raw socket bound to the interface. Returns false if there is no
+ such interface or the kernel has no CAN support.
+*/
+bool CAN_SocketCAN::begin(uint32_t bitrate)
+{
+  struct sockaddr_can address;
+  unsigned int index = if_nametoindex(interface);
+
+  (void)bitrate;
+  if (index == 0)
+  {
+    return false;
+  }
+
+  fd = socket(PF_CAN, SOCK_RAW, CAN_RAW);
+  if (fd < 0)
+  {
+    return false;
+  }
+
+  memset(&address, 0, sizeof(address));
+  address.can_family = AF_CAN;
+  address.can_ifindex = index;
+  if ((bind(fd, (struct sockaddr*)&address, sizeof(address)) < 0) ||
+      (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) < 0))
+  {
+    close(fd);
+    fd = -1;
+    return false;
+  }
+
+  return true;
+}
+
+/*
+ Base frames only, as from the boards' controllers.
+*/
+bool CAN_SocketCAN::receive(OBD_Frame* frame)
+{
+  struct can_frame raw;
+
+  while ((fd >= 0) && (read(fd, &raw, sizeof(raw)) == (ssize_t)sizeof(raw)))
+  {
+    if (raw.can_id & (CAN_EFF_FLAG | CAN_RTR_FLAG | CAN_ERR_FLAG))
+    {
+      continue;
+    }
+
+    frame->id = raw.can_id & CAN_SFF_MASK;
+    frame->length = (raw.can_dlc <= 8) ? raw.can_dlc : 8;
+    memcpy(frame->data, raw.data, sizeof(frame->data));
+    return true;
+  }
+
+  return false;
+}
+
+/*
+ Returns false when the interface's transmit queue is full.
+*/
+bool CAN_SocketCAN::send(const OBD_Frame* frame)
+{
+  struct can_frame raw;
+
+  if ((fd < 0) || listening)
+  {
+    return false;
+  }
+
+  memset(&raw, 0, sizeof(raw));
+  raw.can_id = frame->id & CAN_SFF_MASK;
+  raw.can_dlc = frame->length;
+  memcpy(raw.data, frame->data, sizeof(raw.data));
+
+  return write(fd, &raw, sizeof(raw)) == (ssize_t)sizeof(raw);
+}
+
+/*
+ The kernel drops what no filter set so far keeps, base frames only.
+*/
+bool CAN_SocketCAN::filter(byte slot, uint32_t mask, uint32_t filter)
+{
+  struct can_filter set[CAN_DRIVER_FILTERS];
+  byte count = 0;
+
+  if ((fd < 0) || (slot >= CAN_DRIVER_FILTERS))
+  {
+    return false;
+  }
+
+  masks[slot] = mask;
+  filters[slot] = filter;
+  filters_set |= 1 << slot;
+
+  for (byte i = 0; i < CAN_DRIVER_FILTERS; i++)
+  {
+    if (filters_set & (1 << i))
+    {
+      set[count].can_id = filters[i] & CAN_SFF_MASK;
+      set[count].can_mask = (masks[i] & CAN_SFF_MASK) | CAN_EFF_FLAG | CAN_RTR_FLAG;
+      count++;
+    }
+  }
+
+  return setsockopt(fd, SOL_CAN_RAW, CAN_RAW_FILTER, set, count * sizeof(set[0])) == 0;
+}
+
+/*
+ Stop or resume writing to the socket.
+*/
+bool CAN_SocketCAN::listen(bool on)
+{
+  listening = on;
+
+  return true;
+}
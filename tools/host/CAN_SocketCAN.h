@@ -0,0 +1,45 @@
+/*
+ CAN_Driver over a Linux SocketCAN interface
+ by:
+ date:
+ license:
+
+ Lets the host tools run CAN_Bus against vcan interfaces, or a real
+ adapter, instead of a controller on the board. The socket is non-blocking
+ so receive() and send() return at once as the CAN_Driver contract asks;
+ the socket's receive buffer plays the part of the controller's. A vcan
+ interface has no bitrate, begin() ignores it, it is set with ip link on
+ a real one. The acceptance filters become the socket's CAN_RAW_FILTER.
+ Listen-only is a setting of a real interface too, ip link set ... type
+ can listen-only on, so listen() only stops send() writing to the socket.
+
+   ip link add dev vcan0 type vcan && ip link set up vcan0
+ */
+#ifndef host_can_socketcan_h_
+#define host_can_socketcan_h_
+
+#include "Arduino.h"
+#include "OBD_Frame.h"
+#include "CAN_Driver.h"
+
+class CAN_SocketCAN : public CAN_Driver
+{
+  public:
+    CAN_SocketCAN(const char* interface);
+    virtual ~CAN_SocketCAN();
+    bool begin(uint32_t bitrate);
+    bool receive(OBD_Frame* frame);
+    bool send(const OBD_Frame* frame);
+    bool filter(byte slot, uint32_t mask, uint32_t filter);
+    bool listen(bool on);
+
+  private:
+    const char* interface;
+    int fd;
+    uint32_t masks[CAN_DRIVER_FILTERS];
+    uint32_t filters[CAN_DRIVER_FILTERS];
+    uint8_t filters_set; // bit n for filter n
+    bool listening;
+};
+
+#endif // _host_can_socketcan_h_
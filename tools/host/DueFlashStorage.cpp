@@ -0,0 +1,60 @@
+/*
+ DueFlashStorage library stand-in
+ by:
+ date:
+ license:
+ */
+
+#include "DueFlashStorage.h"
+
+/*
+
+*/
+DueFlashStorage::DueFlashStorage()
+{
+  memset(flash, 0xFF, sizeof(flash));
+  pages_written = 0;
+}
+
+/*
+
+*/
+byte DueFlashStorage::read(uint32_t address)
+{
+  return flash[address % IFLASH1_SIZE];
+}
+
+/*
+
+*/
+byte* DueFlashStorage::readAddress(uint32_t address)
+{
+  return &flash[address % IFLASH1_SIZE];
+}
+
+/*
+
+*/
+boolean DueFlashStorage::write(uint32_t address, byte value)
+{
+  return write(address, &value, 1);
+}
+
+/*
+ Each page touched is erased and written whole, as on the chip.
+*/
+boolean DueFlashStorage::write(uint32_t address, byte* data, uint32_t dataLength)
+{
+  if ((address >= IFLASH1_SIZE) || (dataLength > IFLASH1_SIZE - address))
+  {
+    return false;
+  }
+
+  memcpy(&flash[address], data, dataLength);
+  if (dataLength != 0)
+  {
+    pages_written += (address + dataLength - 1) / IFLASH1_PAGE_SIZE - address / IFLASH1_PAGE_SIZE + 1;
+  }
+
+  return true;
+}
@@ -0,0 +1,32 @@
+/*
+ DueFlashStorage library stand-in
+ by:
+ date:
+ license:
+
+ The Due's flash bank 1, erased to 0xFF, kept in RAM for the life of the
+ process. Addresses count from the start of the bank as in the library.
+ Page writes are counted, a page wears out after about 10000.
+ */
+#ifndef host_due_flash_storage_h_
+#define host_due_flash_storage_h_
+
+#include "Arduino.h"
+#include "variant.h"
+
+class DueFlashStorage
+{
+  public:
+    DueFlashStorage();
+    byte read(uint32_t address);
+    byte* readAddress(uint32_t address);
+    boolean write(uint32_t address, byte value);
+    boolean write(uint32_t address, byte* data, uint32_t dataLength);
+
+    uint32_t pages_written;
+
+  private:
+    byte flash[IFLASH1_SIZE];
+};
+
+#endif // _host_due_flash_storage_h_
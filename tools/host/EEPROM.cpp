@@ -0,0 +1,36 @@
+/*
+ AVR EEPROM library stand-in
+ by:
+ date:
+ license:
+ */
+
+#include "EEPROM.h"
+
+EEPROMClass EEPROM;
+
+/*
+
+*/
+EEPROMClass::EEPROMClass()
+{
+  memset(cells, 0xFF, sizeof(cells));
+  writes = 0;
+}
+
+/*
+
+*/
+uint8_t EEPROMClass::read(int address)
+{
+  return cells[address & E2END];
+}
+
+/*
+
+*/
+void EEPROMClass::write(int address, uint8_t value)
+{
+  cells[address & E2END] = value;
+  writes++;
+}
@@ -0,0 +1,32 @@
+/*
+ AVR EEPROM library stand-in
+ by:
+ date:
+ license:
+
+ The Uno's 1 KB, erased to 0xFF, kept in RAM for the life of the process.
+ Writes are counted, the cells wear out after about 100000 each.
+ */
+#ifndef host_eeprom_h_
+#define host_eeprom_h_
+
+#include "Arduino.h"
+
+#define E2END 0x3FF
+
+class EEPROMClass
+{
+  public:
+    EEPROMClass();
+    uint8_t read(int address);
+    void write(int address, uint8_t value);
+
+    uint32_t writes;
+
+  private:
+    uint8_t cells[E2END + 1];
+};
+
+extern EEPROMClass EEPROM;
+
+#endif // _host_eeprom_h_
@@ -0,0 +1,123 @@
+/*
+ Arduino HardwareSerial stand-in
+ by:
+ date:
+ license:
+ */
+
+#include "Arduino.h"
+
+HardwareSerial Serial(stdout);
+HardwareSerial Serial1(0);
+
+/*
+
+*/
+HardwareSerial::HardwareSerial(FILE* echo)
+{
+  this->echo = echo;
+  baud = 0;
+  written = 0;
+  lost = 0;
+  rx_head = 0;
+  rx_tail = 0;
+}
+
+/*
+
+*/
+void HardwareSerial::begin(unsigned long baud)
+{
+  this->baud = baud;
+}
+
+/*
+
+*/
+void HardwareSerial::end()
+{
+  baud = 0;
+}
+
+/*
+
+*/
+void HardwareSerial::flush()
+{
+  if (echo != 0)
+  {
+    fflush(echo);
+  }
+}
+
+/*
+
+*/
+int HardwareSerial::available()
+{
+  return (rx_head + SERIAL_RX_BUFFER_SIZE - rx_tail) % SERIAL_RX_BUFFER_SIZE;
+}
+
+/*
+
+*/
+int HardwareSerial::read()
+{
+  uint8_t c;
+
+  if (rx_head == rx_tail)
+  {
+    return -1;
+  }
+
+  c = rx[rx_tail];
+  rx_tail = (rx_tail + 1) % SERIAL_RX_BUFFER_SIZE;
+
+  return c;
+}
+
+/*
+ The port is always open on the host.
+*/
+HardwareSerial::operator bool()
+{
+  return true;
+}
+
+/*
+
+*/
+size_t HardwareSerial::write(uint8_t c)
+{
+  if (echo != 0)
+  {
+    fputc(c, echo);
+  }
+  written++;
+
+  return 1;
+}
+
+/*
+ Characters received from the far end. Returns how many found room.
+*/
+size_t HardwareSerial::feed(const char* data, size_t length)
+{
+  size_t taken = 0;
+
+  for (size_t i = 0; i < length; i++)
+  {
+    uint16_t next = (rx_head + 1) % SERIAL_RX_BUFFER_SIZE;
+
+    if (next == rx_tail)
+    {
+      lost += length - i;
+      break;
+    }
+    rx[rx_head] = data[i];
+    rx_head = next;
+    taken++;
+  }
+
+  return taken;
+}
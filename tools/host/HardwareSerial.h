@@ -0,0 +1,51 @@
+/*
+ Arduino HardwareSerial stand-in
+ by:
+ date:
+ license:
+
+ Serial and Serial1 as the sketch uses them. What is printed goes to the
+ echo stream, stdout for Serial and nowhere for Serial1 unless a tool
+ sets one. feed() plays the part of the far end: its characters wait in a
+ receive buffer of the board's size and the newest are lost when it is
+ full, as on the UART.
+ */
+#ifndef host_hardwareserial_h_
+#define host_hardwareserial_h_
+
+#include <stdio.h>
+#include "Print.h"
+
+#define SERIAL_RX_BUFFER_SIZE 64
+
+class HardwareSerial : public Print
+{
+  public:
+    HardwareSerial(FILE* echo);
+    void begin(unsigned long baud);
+    void end();
+    void flush();
+    int available();
+    int read();
+    operator bool();
+    virtual size_t write(uint8_t c);
+    using Print::write;
+
+    // Host only
+    size_t feed(const char* data, size_t length);
+
+    FILE* echo;
+    unsigned long baud;
+    uint32_t written;
+    uint32_t lost;       // received characters the buffer had no room for
+
+  private:
+    uint8_t rx[SERIAL_RX_BUFFER_SIZE];
+    uint16_t rx_head;
+    uint16_t rx_tail;
+};
+
+extern HardwareSerial Serial;
+extern HardwareSerial Serial1;
+
+#endif // _host_hardwareserial_h_
@@ -0,0 +1,219 @@
+/*
+ Arduino Print stand-in
+ by:
+ date:
+ license:
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "Print.h"
+
+/*
+
+*/
+size_t Print::write(const uint8_t* data, size_t length)
+{
+  size_t written = 0;
+
+  while (length-- > 0)
+  {
+    written += write(*data++);
+  }
+
+  return written;
+}
+
+/*
+
+*/
+size_t Print::write(const char* text)
+{
+  return write((const uint8_t*)text, strlen(text));
+}
+
+/*
+
+*/
+size_t Print::print(const char* text)
+{
+  return write(text);
+}
+
+/*
+ Flash is ordinary memory on the host.
+*/
+size_t Print::print(const __FlashStringHelper* text)
+{
+  return write((const char*)text);
+}
+
+/*
+
+*/
+size_t Print::print(char c)
+{
+  return write((uint8_t)c);
+}
+
+/*
+
+*/
+size_t Print::print(unsigned char value, int base)
+{
+  return printNumber(value, base);
+}
+
+/*
+
+*/
+size_t Print::print(int value, int base)
+{
+  return print((long)value, base);
+}
+
+/*
+
+*/
+size_t Print::print(unsigned int value, int base)
+{
+  return printNumber(value, base);
+}
+
+/*
+ Only decimal numbers get a sign, as on the board.
+*/
+size_t Print::print(long value, int base)
+{
+  if ((base == 10) && (value < 0))
+  {
+    return print('-') + printNumber(-value, base);
+  }
+
+  return printNumber(value, base);
+}
+
+/*
+
+*/
+size_t Print::print(unsigned long value, int base)
+{
+  return printNumber(value, base);
+}
+
+/*
+ Rounded to digits decimals as the board prints a float.
+*/
+size_t Print::print(double value, int digits)
+{
+  char text[32];
+
+  snprintf(text, sizeof(text), "%.*f", digits, value);
+
+  return write(text);
+}
+
+/*
+
+*/
+size_t Print::println(const char* text)
+{
+  return print(text) + println();
+}
+
+/*
+
+*/
+size_t Print::println(const __FlashStringHelper* text)
+{
+  return print(text) + println();
+}
+
+/*
+
+*/
+size_t Print::println(char c)
+{
+  return print(c) + println();
+}
+
+/*
+
+*/
+size_t Print::println(unsigned char value, int base)
+{
+  return print(value, base) + println();
+}
+
+/*
+
+*/
+size_t Print::println(int value, int base)
+{
+  return print(value, base) + println();
+}
+
+/*
+
+*/
+size_t Print::println(unsigned int value, int base)
+{
+  return print(value, base) + println();
+}
+
+/*
+
+*/
+size_t Print::println(long value, int base)
+{
+  return print(value, base) + println();
+}
+
+/*
+
+*/
+size_t Print::println(unsigned long value, int base)
+{
+  return print(value, base) + println();
+}
+
+/*
+
+*/
+size_t Print::println(double value, int digits)
+{
+  return print(value, digits) + println();
+}
+
+/*
+
+*/
+size_t Print::println()
+{
+  return write("\r\n");
+}
+
+/*
+
+*/
+size_t Print::printNumber(unsigned long value, int base)
+{
+  char text[8 * sizeof(long) + 1];
+  char* digit = &text[sizeof(text) - 1];
+
+  if (base < 2)
+  {
+    base = 10;
+  }
+
+  *digit = 0;
+  do
+  {
+    unsigned long remainder = value % base;
+
+    *--digit = (remainder < 10) ? '0' + remainder : 'A' + remainder - 10;
+    value /= base;
+  } while (value != 0);
+
+  return write(digit);
+}
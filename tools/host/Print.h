@@ -0,0 +1,49 @@
+/*
+ Arduino Print stand-in
+ by:
+ date:
+ license:
+
+ The overloads the sketch's screens use, all ending in write(uint8_t) as
+ on the board.
+ */
+#ifndef host_print_h_
+#define host_print_h_
+
+#include <stdint.h>
+#include <stddef.h>
+
+class __FlashStringHelper;
+
+class Print
+{
+  public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t* data, size_t length);
+    size_t write(const char* text);
+    size_t print(const char* text);
+    size_t print(const __FlashStringHelper* text);
+    size_t print(char c);
+    size_t print(unsigned char value, int base = 10);
+    size_t print(int value, int base = 10);
+    size_t print(unsigned int value, int base = 10);
+    size_t print(long value, int base = 10);
+    size_t print(unsigned long value, int base = 10);
+    size_t print(double value, int digits = 2);
+    size_t println(const char* text);
+    size_t println(const __FlashStringHelper* text);
+    size_t println(char c);
+    size_t println(unsigned char value, int base = 10);
+    size_t println(int value, int base = 10);
+    size_t println(unsigned int value, int base = 10);
+    size_t println(long value, int base = 10);
+    size_t println(unsigned long value, int base = 10);
+    size_t println(double value, int digits = 2);
+    size_t println();
+
+  private:
+    size_t printNumber(unsigned long value, int base);
+};
+
+#endif // _host_print_h_
@@ -0,0 +1,181 @@
+/*
+ SD library stand-in over a host directory
+ by:
+ date:
+ license:
+ */
+
+#include <unistd.h>
+#include "SD.h"
+
+SDClass SD;
+
+/*
+
+*/
+File::File()
+{
+  file = 0;
+}
+
+/*
+
+*/
+File::File(FILE* file)
+{
+  this->file = file;
+}
+
+/*
+
+*/
+size_t File::write(const uint8_t* data, size_t length)
+{
+  size_t written;
+
+  if (file == 0)
+  {
+    return 0;
+  }
+
+  written = fwrite(data, 1, length, file);
+  SD.written += written;
+
+  return written;
+}
+
+/*
+
+*/
+int File::read(uint8_t* data, size_t length)
+{
+  return (file != 0) ? (int)fread(data, 1, length, file) : -1;
+}
+
+/*
+ Fails past the end of the file, the library only grows it by writing.
+*/
+bool File::seek(uint32_t position)
+{
+  long size;
+
+  if ((file == 0) || (fseek(file, 0, SEEK_END) != 0) || ((size = ftell(file)) < 0) || (position > (uint32_t)size))
+  {
+    return false;
+  }
+
+  return fseek(file, position, SEEK_SET) == 0;
+}
+
+/*
+ Down to the host's page cache, what the card's own flush would commit.
+*/
+void File::flush()
+{
+  if (file != 0)
+  {
+    fflush(file);
+    SD.flushes++;
+  }
+}
+
+/*
+ Copies of a File share the open file, closing one closes them all.
+*/
+void File::close()
+{
+  if (file != 0)
+  {
+    fclose(file);
+    file = 0;
+  }
+}
+
+/*
+
+*/
+File::operator bool()
+{
+  return file != 0;
+}
+
+/*
+
+*/
+SDClass::SDClass()
+{
+  directory = 0;
+  written = 0;
+  flushes = 0;
+}
+
+/*
+ Fails without a mounted directory, like an empty slot.
+*/
+bool SDClass::begin(uint8_t chip_select)
+{
+  (void)chip_select;
+
+  return directory != 0;
+}
+
+/*
+
+*/
+bool SDClass::exists(const char* name)
+{
+  char full[256];
+
+  path(name, full, sizeof(full));
+
+  return (directory != 0) && (access(full, F_OK) == 0);
+}
+
+/*
+ FILE_WRITE appends, as the library does, O_WRITE alone writes in place.
+*/
+File SDClass::open(const char* name, int mode)
+{
+  char full[256];
+  FILE* file;
+
+  if (directory == 0)
+  {
+    return File();
+  }
+
+  path(name, full, sizeof(full));
+
+  if (mode & O_APPEND)
+  {
+    return File(fopen(full, "ab"));
+  }
+  if ((mode & O_WRITE) == 0)
+  {
+    return File(fopen(full, "rb"));
+  }
+
+  file = fopen(full, "r+b");
+  if ((file == 0) && (mode & O_CREAT))
+  {
+    file = fopen(full, "w+b");
+  }
+
+  return File(file);
+}
+
+/*
+
+*/
+void SDClass::mount(const char* directory)
+{
+  this->directory = directory;
+}
+
+/*
+
+*/
+void SDClass::path(const char* name, char* full, size_t size)
+{
+  snprintf(full, size, "%s/%s", (directory != 0) ? directory : ".", name);
+}
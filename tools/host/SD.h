@@ -0,0 +1,66 @@
+/*
+ SD library stand-in over a host directory
+ by:
+ date:
+ license:
+
+ The card is a directory the tool hands to mount() before the sketch's
+ SD.begin(), which fails without one as it does with no card in the slot.
+ Files are ordinary host files in it; bytes written and flushes are
+ counted so a tool can see what reached the card. As on the card, seek()
+ stays inside the file and FILE_WRITE appends whatever the position, a
+ file opened O_WRITE without O_APPEND is written where seek() put it.
+ */
+#ifndef host_sd_h_
+#define host_sd_h_
+
+#include <fcntl.h>
+#include <stdio.h>
+#include "Arduino.h"
+
+// The library's open flags, O_CREAT and O_APPEND are the host's
+#define O_READ  0x01
+#define O_WRITE 0x02
+
+#define FILE_READ  O_READ
+#define FILE_WRITE (O_READ | O_WRITE | O_CREAT | O_APPEND)
+
+class File
+{
+  public:
+    File();
+    File(FILE* file);
+    size_t write(const uint8_t* data, size_t length);
+    int read(uint8_t* data, size_t length);
+    bool seek(uint32_t position);
+    void flush();
+    void close();
+    operator bool();
+
+  private:
+    FILE* file;
+};
+
+class SDClass
+{
+  public:
+    SDClass();
+    bool begin(uint8_t chip_select);
+    bool exists(const char* name);
+    File open(const char* name, int mode = FILE_READ);
+
+    // Host only
+    void mount(const char* directory);
+
+    uint64_t written;
+    uint32_t flushes;
+
+  private:
+    void path(const char* name, char* full, size_t size);
+
+    const char* directory;
+};
+
+extern SDClass SD;
+
+#endif // _host_sd_h_
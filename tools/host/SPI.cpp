@@ -0,0 +1,10 @@
+/*
+ SPI library stand-in
+ by:
+ date:
+ license:
+ */
+
+#include "SPI.h"
+
+SPIClass SPI;
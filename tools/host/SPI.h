@@ -0,0 +1,23 @@
+/*
+ SPI library stand-in
+ by:
+ date:
+ license:
+
+ Nothing is on the bus on the host, the calls only have to exist.
+ */
+#ifndef host_spi_h_
+#define host_spi_h_
+
+#include "Arduino.h"
+
+class SPIClass
+{
+  public:
+    void begin() {}
+    void usingInterrupt(uint8_t interrupt) { (void)interrupt; }
+};
+
+extern SPIClass SPI;
+
+#endif // _host_spi_h_
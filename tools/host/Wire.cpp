@@ -0,0 +1,150 @@
+/*
+ Wire library stand-in with simulated I2C devices
+ by:
+ date:
+ license:
+ */
+
+#include "Wire.h"
+
+TwoWire Wire;
+
+/*
+
+*/
+TwoWire::TwoWire()
+{
+  memset(devices, 0, sizeof(devices));
+  bytes = 0;
+  busy_ns = 0;
+  transactions = 0;
+  clock = 100000;
+  address = 0;
+  tx_length = 0;
+  rx_length = 0;
+  rx_index = 0;
+}
+
+/*
+ Back to the standard 100 kHz, as the AVR library does.
+*/
+void TwoWire::begin()
+{
+  clock = 100000;
+}
+
+/*
+
+*/
+void TwoWire::setClock(uint32_t clock)
+{
+  this->clock = clock;
+}
+
+/*
+
+*/
+void TwoWire::attach(uint8_t address, TwoWire_Device* device)
+{
+  devices[address & (WIRE_ADDRESSES - 1)] = device;
+}
+
+/*
+
+*/
+void TwoWire::beginTransmission(uint8_t address)
+{
+  this->address = address & (WIRE_ADDRESSES - 1);
+  tx_length = 0;
+}
+
+/*
+
+*/
+size_t TwoWire::write(uint8_t data)
+{
+  if (tx_length >= BUFFER_LENGTH)
+  {
+    return 0;
+  }
+  tx[tx_length++] = data;
+
+  return 1;
+}
+
+/*
+ 0 if the device took the bytes, 2 for an address NACK, as the AVR library.
+*/
+uint8_t TwoWire::endTransmission(bool)
+{
+  TwoWire_Device* device = devices[address];
+
+  count(device ? tx_length : 0);
+  if (device == 0)
+  {
+    return 2;
+  }
+  device->receive(tx, tx_length);
+
+  return 0;
+}
+
+/*
+
+*/
+uint8_t TwoWire::requestFrom(uint8_t address, uint8_t quantity, bool)
+{
+  TwoWire_Device* device = devices[address & (WIRE_ADDRESSES - 1)];
+
+  rx_length = 0;
+  rx_index = 0;
+  if (quantity > BUFFER_LENGTH)
+  {
+    quantity = BUFFER_LENGTH;
+  }
+
+  count(device ? quantity : 0);
+  if (device == 0)
+  {
+    return 0;
+  }
+
+  while (rx_length < quantity)
+  {
+    rx[rx_length++] = device->transmit();
+  }
+  device->stop();
+
+  return rx_length;
+}
+
+/*
+
+*/
+int TwoWire::available()
+{
+  return rx_length - rx_index;
+}
+
+/*
+
+*/
+int TwoWire::read()
+{
+  if (rx_index >= rx_length)
+  {
+    return -1;
+  }
+
+  return rx[rx_index++];
+}
+
+/*
+ A transaction of length data bytes after the address byte.
+*/
+void TwoWire::count(uint8_t length)
+{
+  transactions++;
+  bytes += 1 + length;
+  busy_ns += (9 * (1 + length) + 2) * 1000000000ULL / clock;
+}
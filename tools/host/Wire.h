@@ -0,0 +1,63 @@
+/*
+ Wire library stand-in with simulated I2C devices
+ by:
+ date:
+ license:
+
+ Transactions go to the TwoWire_Device attached at their address, a NACK
+ if there is none. Each transaction is counted with its address byte and
+ the bus time it takes at the set clock, nine clocks per byte plus the
+ start and stop conditions. Reads are cut to BUFFER_LENGTH as the AVR
+ library does.
+ */
+#ifndef host_wire_h_
+#define host_wire_h_
+
+#include "Arduino.h"
+
+#define BUFFER_LENGTH 32
+#define WIRE_ADDRESSES 128
+
+class TwoWire_Device
+{
+  public:
+    virtual ~TwoWire_Device() {}
+    virtual void receive(const uint8_t* data, uint8_t length) = 0; // one write transaction
+    virtual uint8_t transmit() = 0;                                  // next byte of a read
+    virtual void stop() {}                                           // the read ended
+};
+
+class TwoWire
+{
+  public:
+    TwoWire();
+    void begin();
+    void setClock(uint32_t clock);
+    void attach(uint8_t address, TwoWire_Device* device);
+    void beginTransmission(uint8_t address);
+    size_t write(uint8_t data);
+    uint8_t endTransmission(bool stop = true);
+    uint8_t requestFrom(uint8_t address, uint8_t quantity, bool stop = true);
+    int available();
+    int read();
+
+    uint64_t bytes;         // address bytes included
+    uint64_t busy_ns;
+    uint32_t transactions;
+
+  private:
+    void count(uint8_t length);
+
+    TwoWire_Device* devices[WIRE_ADDRESSES];
+    uint32_t clock;
+    uint8_t address;
+    uint8_t tx[BUFFER_LENGTH];
+    uint8_t tx_length;
+    uint8_t rx[BUFFER_LENGTH];
+    uint8_t rx_length;
+    uint8_t rx_index;
+};
+
+extern TwoWire Wire;
+
+#endif // _host_wire_h_
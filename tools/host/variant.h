@@ -0,0 +1,19 @@
+/*
+ Arduino Due variant stand-in
+ by:
+ date:
+ license:
+
+ The sketch includes it on the SAM build for the chip's definitions, of
+ which the host needs the flash geometry.
+ */
+#ifndef host_variant_h_
+#define host_variant_h_
+
+#include "Arduino.h"
+
+// SAM3X8E flash, the second of the two 256 KB banks
+#define IFLASH1_SIZE      0x40000
+#define IFLASH1_PAGE_SIZE 256
+
+#endif // _host_variant_h_
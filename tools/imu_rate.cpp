@@ -0,0 +1,590 @@
+/*
+ IMU sample rate and I2C load on a simulated bus
+ by:
+ date:
+ license:
+
+ Simulates the ADXL345, L3GD20 and HMC5883L at register level behind the
+ Wire stand-in, FIFOs included, each sampling on its own clock. The loop
+ passes take a few hundred microseconds plus their I2C time, with a
+ longer pass whenever the display is flushed.
+
+ Two ways of reading them are compared at 400 kHz:
+   event  one sample per sensor every 5 ms, the way the Adafruit unified
+          drivers' getEvent() reads them, each accelerometer axis on its
+          own
+   fifo   IMU_FIFO, one read() per loop pass as in the sketch
+
+ Every sample carries its sequence number, so the report gives the rate
+ of distinct samples read, samples lost and read twice, the I2C bytes per
+ second, the share of bus time, the longest I2C time in one pass and how
+ far the given timestamps are from when the samples were taken.
+
+ Build from the repository root:
+   g++ -std=c++11 -O2 -Itools/host -I. -o imu_rate tools/imu_rate.cpp \
+       tools/host/Arduino.cpp tools/host/Print.cpp tools/host/Wire.cpp IMU_FIFO.cpp
+
+ Usage:
+   imu_rate [-s seconds]
+ */
+
+#include <unistd.h>
+#include <math.h>
+#include <deque>
+#include <vector>
+
+#include "Arduino.h"
+#include "Wire.h"
+#include "IMU_FIFO.h"
+
+#define I2C_CLOCK      400000
+#define PASS_US        400   // rest of a loop pass, bus and log
+#define PASS_JITTER_US 800
+#define FLUSH_PERIOD   200   // milliseconds, LCD_FLUSH_PERIOD
+#define FLUSH_US       4500  // LCD_FLUSH_WRITES characters at 400 kHz
+#define EVENT_PERIOD   5     // milliseconds, 200 Hz
+#define IMU_CHUNK      5     // samples per read(), as in the sketch
+
+struct Entry
+{
+  uint8_t data[6];
+  uint32_t sequence;
+};
+
+/*
+ A sensor sampling every period_us while enabled, into its FIFO when that
+ is on. The sample number sits in the X axis so a reader can be checked.
+*/
+class SimSensor : public TwoWire_Device
+{
+  public:
+    SimSensor()
+    {
+      memset(registers, 0, sizeof(registers));
+      pointer = 0;
+      next_us = 0;
+      produced = 0;
+      lost = 0;
+      memset(&latest, 0, sizeof(latest));
+    }
+
+    void advance(uint64_t now_us)
+    {
+      uint32_t period = period_us();
+
+      if (period == 0)
+      {
+        next_us = now_us;
+        return;
+      }
+      while (next_us <= now_us)
+      {
+        Entry entry;
+
+        encode(produced, &entry);
+        entry.sequence = produced;
+        times.push_back(next_us);
+        produced++;
+        latest = entry;
+
+        if (fifo_on())
+        {
+          if (fifo.size() >= 32)
+          {
+            fifo.pop_front();
+            lost++;
+          }
+          fifo.push_back(entry);
+        }
+        next_us += period;
+      }
+    }
+
+    virtual void receive(const uint8_t* data, uint8_t length)
+    {
+      if (length == 0)
+      {
+        return;
+      }
+      pointer = address(data[0]);
+      for (uint8_t i = 1; i < length; i++)
+      {
+        registers[pointer & 0x3F] = data[i];
+        pointer = address(pointer + 1);
+      }
+    }
+
+    virtual uint32_t period_us() = 0;
+    virtual bool fifo_on() = 0;
+    virtual void encode(uint32_t sequence, Entry* entry) = 0;
+    virtual uint8_t address(uint8_t reg) { return reg; }
+
+    uint8_t registers[64];
+    uint8_t pointer;
+    uint64_t next_us;
+    uint32_t produced;
+    uint32_t lost;          // pushed out of a full FIFO
+    std::deque<Entry> fifo;
+    std::vector<uint64_t> times;
+    Entry latest;
+};
+
+class SimADXL345 : public SimSensor
+{
+  public:
+    SimADXL345() { touched = false; }
+
+    uint32_t period_us()
+    {
+      byte rate = registers[ADXL345_BW_RATE] & 0x0F;
+
+      if ((registers[ADXL345_POWER_CTL] & 0x08) == 0)
+      {
+        return 0;
+      }
+      return 1000000 * (1UL << (15 - rate)) / 3200;
+    }
+
+    bool fifo_on() { return (registers[ADXL345_FIFO_CTL] & 0xC0) == 0x80; }
+
+    // X counts 32 per sample, 125 mg
+    void encode(uint32_t sequence, Entry* entry)
+    {
+      int16_t x = (sequence % 1024) * 32;
+
+      memset(entry->data, 0, sizeof(entry->data));
+      entry->data[0] = x;
+      entry->data[1] = x >> 8;
+    }
+
+    uint8_t transmit()
+    {
+      uint8_t reg = pointer;
+
+      pointer++;
+      if ((reg >= ADXL345_DATAX0) && (reg < ADXL345_DATAX0 + 6))
+      {
+        const Entry* entry = (fifo_on() && !fifo.empty()) ? &fifo.front() : &latest;
+
+        touched = true;
+        return entry->data[reg - ADXL345_DATAX0];
+      }
+      if (reg == ADXL345_FIFO_STATUS)
+      {
+        return fifo.size();
+      }
+      return registers[reg & 0x3F];
+    }
+
+    // The FIFO moves on once a read of the data registers ends
+    void stop()
+    {
+      if (touched && fifo_on() && !fifo.empty())
+      {
+        fifo.pop_front();
+      }
+      touched = false;
+    }
+
+  private:
+    bool touched;
+};
+
+class SimL3GD20 : public SimSensor
+{
+  public:
+    SimL3GD20() { increment = false; }
+
+    uint32_t period_us()
+    {
+      static const uint32_t periods[4] = {10526, 5263, 2632, 1316};
+
+      if ((registers[L3GD20_CTRL_REG1] & 0x08) == 0)
+      {
+        return 0;
+      }
+      return periods[registers[L3GD20_CTRL_REG1] >> 6];
+    }
+
+    bool fifo_on()
+    {
+      return (registers[L3GD20_CTRL_REG5] & 0x40) && ((registers[L3GD20_FIFO_CTRL_REG] & 0xE0) == 0x40);
+    }
+
+    // X counts 2 per sample, 35 mdps
+    void encode(uint32_t sequence, Entry* entry)
+    {
+      int16_t x = (sequence % 1024) * 2;
+
+      memset(entry->data, 0, sizeof(entry->data));
+      entry->data[0] = x;
+      entry->data[1] = x >> 8;
+    }
+
+    uint8_t address(uint8_t reg)
+    {
+      increment = (reg & L3GD20_AUTO_INCREMENT) != 0;
+      return reg & 0x7F;
+    }
+
+    uint8_t transmit()
+    {
+      uint8_t reg = pointer;
+      uint8_t value;
+
+      if ((reg >= L3GD20_OUT_X_L) && (reg < L3GD20_OUT_X_L + 6))
+      {
+        const Entry* entry = (fifo_on() && !fifo.empty()) ? &fifo.front() : &latest;
+
+        value = entry->data[reg - L3GD20_OUT_X_L];
+
+        // With the FIFO on the address wraps to OUT_X_L and the next entry
+        if (increment && fifo_on() && (reg == L3GD20_OUT_X_L + 5))
+        {
+          if (!fifo.empty())
+          {
+            fifo.pop_front();
+          }
+          pointer = L3GD20_OUT_X_L;
+          return value;
+        }
+      }
+      else if (reg == L3GD20_FIFO_SRC_REG)
+      {
+        value = (fifo.size() >= 32) ? 0x40 | 31 : fifo.size();
+        value |= fifo.empty() ? 0x20 : 0;
+      }
+      else
+      {
+        value = registers[reg & 0x3F];
+      }
+
+      if (increment)
+      {
+        pointer++;
+      }
+      return value;
+    }
+
+  private:
+    bool increment;
+};
+
+class SimHMC5883 : public SimSensor
+{
+  public:
+    uint32_t period_us()
+    {
+      static const uint32_t periods[7] = {1333333, 666667, 333333, 133333, 66667, 33333, 13333};
+      byte rate = (registers[HMC5883_CRA] >> 2) & 0x07;
+
+      if (((registers[HMC5883_MODE] & 0x03) != 0) || (rate > 6))
+      {
+        return 0;
+      }
+      return periods[rate];
+    }
+
+    bool fifo_on() { return false; }
+
+    // X counts 109 per sample, 100 mG
+    void encode(uint32_t sequence, Entry* entry)
+    {
+      int16_t x = (sequence % 256) * 109;
+
+      memset(entry->data, 0, sizeof(entry->data));
+      entry->data[0] = x >> 8;
+      entry->data[1] = x;
+    }
+
+    uint8_t transmit()
+    {
+      uint8_t reg = pointer;
+
+      pointer = (pointer >= HMC5883_DATA + 5) ? HMC5883_DATA : pointer + 1;
+      if ((reg >= HMC5883_DATA) && (reg < HMC5883_DATA + 6))
+      {
+        return latest.data[reg - HMC5883_DATA];
+      }
+      return registers[reg & 0x3F];
+    }
+};
+
+// What one way of reading did with one sensor
+struct Tally
+{
+  const char* name;
+  SimSensor* sensor;
+  uint32_t modulo;      // sample numbers repeat after this many
+  int32_t step;         // X value per sample number
+  std::vector<bool> seen;
+  uint32_t distinct;
+  uint32_t repeated;
+  double error_sum;     // timestamp minus sample time, milliseconds
+  double error_max;
+  uint32_t stamped;
+  uint32_t last;        // sample number of the last read
+};
+
+static SimADXL345 accel;
+static SimL3GD20 gyro;
+static SimHMC5883 mag;
+
+/*
+ Full sample number from the X value, the one nearest the last read.
+*/
+static uint32_t unwrap(Tally* tally, int32_t x)
+{
+  uint32_t low = (uint32_t)(x / tally->step) % tally->modulo;
+  uint32_t base = tally->last - (tally->last % tally->modulo);
+  uint32_t candidate = base + low;
+
+  if ((candidate + tally->modulo / 2) < tally->last)
+  {
+    candidate += tally->modulo;
+  }
+  else if ((candidate > tally->last + tally->modulo / 2) && (candidate >= tally->modulo))
+  {
+    candidate -= tally->modulo;
+  }
+
+  return candidate;
+}
+
+/*
+
+*/
+static void record(Tally* tally, int32_t x, bool stamped, uint32_t timestamp)
+{
+  uint32_t sequence = unwrap(tally, x);
+
+  tally->last = sequence;
+  if (sequence >= tally->seen.size())
+  {
+    tally->seen.resize(sequence + 1, false);
+  }
+  if (tally->seen[sequence])
+  {
+    tally->repeated++;
+    return;
+  }
+  tally->seen[sequence] = true;
+  tally->distinct++;
+
+  if (stamped && (sequence < tally->sensor->times.size()))
+  {
+    double error = (int32_t)timestamp - tally->sensor->times[sequence] / 1000.0;
+
+    tally->error_sum += fabs(error);
+    tally->error_max = fmax(tally->error_max, fabs(error));
+    tally->stamped++;
+  }
+}
+
+/*
+ One read16() of the Adafruit ADXL345 driver.
+*/
+static int16_t read16(uint8_t address, uint8_t reg)
+{
+  Wire.beginTransmission(address);
+  Wire.write(reg);
+  Wire.endTransmission();
+  Wire.requestFrom(address, (uint8_t)2);
+
+  return Wire.read() | (Wire.read() << 8);
+}
+
+/*
+ getEvent() of the three unified drivers.
+*/
+static void readEvents(Tally* tallies, bool read_mag)
+{
+  uint8_t data[6];
+
+  int16_t x = read16(ADXL345_ADDRESS, ADXL345_DATAX0);
+  read16(ADXL345_ADDRESS, ADXL345_DATAX0 + 2);
+  read16(ADXL345_ADDRESS, ADXL345_DATAX0 + 4);
+  record(&tallies[0], (int32_t)x * 125 / 32, false, 0);
+
+  Wire.beginTransmission(L3GD20_ADDRESS);
+  Wire.write(L3GD20_OUT_X_L | L3GD20_AUTO_INCREMENT);
+  Wire.endTransmission();
+  Wire.requestFrom((uint8_t)L3GD20_ADDRESS, (uint8_t)6);
+  for (byte i = 0; i < 6; i++)
+  {
+    data[i] = Wire.read();
+  }
+  record(&tallies[1], (int32_t)(int16_t)(data[0] | (data[1] << 8)) * 35 / 2, false, 0);
+
+  if (read_mag)
+  {
+    Wire.beginTransmission(HMC5883_ADDRESS);
+    Wire.write(HMC5883_DATA);
+    Wire.endTransmission();
+    Wire.requestFrom((uint8_t)HMC5883_ADDRESS, (uint8_t)6);
+    for (byte i = 0; i < 6; i++)
+    {
+      data[i] = Wire.read();
+    }
+    record(&tallies[2], (int32_t)(int16_t)((data[0] << 8) | data[1]) * 100 / 109, false, 0);
+  }
+}
+
+/*
+ Sensor registers for the event way, as the unified drivers' begin()
+ leaves them but at the same rates as IMU_FIFO.
+*/
+static void beginEvents()
+{
+  const uint8_t accel_setup[][2] = {{ADXL345_BW_RATE, 0x0B}, {ADXL345_DATA_FORMAT, 0x0B}, {ADXL345_POWER_CTL, 0x08}};
+  const uint8_t gyro_setup[][2] = {{L3GD20_CTRL_REG1, 0x5F}, {L3GD20_CTRL_REG4, 0x10}};
+  const uint8_t mag_setup[][2] = {{HMC5883_CRA, 0x14}, {HMC5883_CRB, 0x20}, {HMC5883_MODE, 0x00}};
+
+  for (byte i = 0; i < 3; i++)
+  {
+    accel.receive(accel_setup[i], 2);
+    mag.receive(mag_setup[i], 2);
+  }
+  for (byte i = 0; i < 2; i++)
+  {
+    gyro.receive(gyro_setup[i], 2);
+  }
+}
+
+/*
+
+*/
+static void run(bool fifo, uint32_t seconds)
+{
+  Tally tallies[3] = {
+    {"accel", &accel, 1024, 125, {}, 0, 0, 0, 0, 0, 0},
+    {"gyro", &gyro, 1024, 35, {}, 0, 0, 0, 0, 0, 0},
+    {"mag", &mag, 256, 100, {}, 0, 0, 0, 0, 0, 0},
+  };
+  IMU_FIFO imu;
+  IMU_Sample samples[IMU_CHUNK];
+  uint64_t now_us = 0;
+  uint64_t end_us = (uint64_t)seconds * 1000000;
+  uint64_t worst_pass_ns = 0;
+  uint32_t event_time = 0;
+  uint32_t mag_time = 0;
+  uint32_t flush_time = 0;
+
+  accel = SimADXL345();
+  gyro = SimL3GD20();
+  mag = SimHMC5883();
+  Wire = TwoWire();
+  Wire.attach(ADXL345_ADDRESS, &accel);
+  Wire.attach(L3GD20_ADDRESS, &gyro);
+  Wire.attach(HMC5883_ADDRESS, &mag);
+  Wire.setClock(I2C_CLOCK);
+  srand(1);
+
+  if (fifo)
+  {
+    imu.begin();
+  }
+  else
+  {
+    beginEvents();
+  }
+  uint64_t setup_bytes = Wire.bytes;
+  uint64_t setup_ns = Wire.busy_ns;
+
+  while (now_us < end_us)
+  {
+    uint32_t now = now_us / 1000;
+    uint64_t busy = Wire.busy_ns;
+    uint64_t pass_us = PASS_US + rand() % PASS_JITTER_US;
+
+    accel.advance(now_us);
+    gyro.advance(now_us);
+    mag.advance(now_us);
+
+    if (fifo)
+    {
+      byte count = imu.read(now, samples, IMU_CHUNK);
+
+      for (byte i = 0; i < count; i++)
+      {
+        Tally* tally = (samples[i].channel == IMU_CHANNEL_ACCEL) ? &tallies[0] :
+                       (samples[i].channel == IMU_CHANNEL_GYRO) ? &tallies[1] : &tallies[2];
+
+        record(tally, samples[i].axis[0], tally != &tallies[2], samples[i].timestamp);
+      }
+    }
+    else if ((now - event_time) >= EVENT_PERIOD)
+    {
+      bool read_mag = (now - mag_time) >= IMU_MAG_PERIOD;
+
+      event_time = now;
+      if (read_mag)
+      {
+        mag_time = now;
+      }
+      readEvents(tallies, read_mag);
+    }
+
+    if ((now - flush_time) >= FLUSH_PERIOD)
+    {
+      flush_time = now;
+      pass_us += FLUSH_US;
+    }
+
+    busy = Wire.busy_ns - busy;
+    worst_pass_ns = (busy > worst_pass_ns) ? busy : worst_pass_ns;
+    now_us += pass_us + busy / 1000;
+  }
+
+  uint64_t bytes = Wire.bytes - setup_bytes;
+  uint64_t busy_ns = Wire.busy_ns - setup_ns;
+
+  printf("%s\n", fifo ? "fifo" : "event");
+  for (byte i = 0; i < 3; i++)
+  {
+    Tally* tally = &tallies[i];
+    uint32_t produced = tally->sensor->produced;
+
+    printf("  %-5s %6.1f Hz of %6.1f, lost %5u, read twice %5u", tally->name, tally->distinct / (double)seconds,
+           produced / (double)seconds, produced - tally->distinct, tally->repeated);
+    if (tally->stamped > 0)
+    {
+      printf(", timestamp error mean %.2f max %.2f ms", tally->error_sum / tally->stamped, tally->error_max);
+    }
+    printf("\n");
+  }
+  printf("  I2C %.0f bytes/s, %.1f%% of the bus, worst pass %.2f ms", bytes / (double)seconds,
+         100.0 * busy_ns / (double)end_us / 1000, worst_pass_ns / 1e6);
+  if (fifo)
+  {
+    printf(", FIFO overruns %u", imu.overruns);
+  }
+  printf("\n");
+}
+
+/*
+
+*/
+int main(int argc, char* argv[])
+{
+  uint32_t seconds = 60;
+  int option;
+
+  while ((option = getopt(argc, argv, "s:")) != -1)
+  {
+    switch (option)
+    {
+      case 's':
+        seconds = atoi(optarg);
+        break;
+      default:
+        fprintf(stderr, "usage: %s [-s seconds]\n", argv[0]);
+        return 1;
+    }
+  }
+
+  run(false, seconds);
+  run(true, seconds);
+
+  return 0;
+}
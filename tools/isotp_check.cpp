@@ -0,0 +1,459 @@
+/*
+ ISO_TP against hand made frames and ECU_Sim
+ by:
+ date:
+ license:
+
+ Drives ISO_TP frame by frame on an in-process bus and checks what the
+ transport must do as receiver and as sender:
+
+   single frames handed out in place, first and consecutive frames
+   reassembled into the channel pool, two ECUs at the same time
+   the flow control sent back, ContinueToSend or Overflow for a message
+   larger than the pool's buffers
+   a wrong sequence number dropping the message, N_Cr ending it
+   flow control received: ContinueToSend with its block size and STmin
+   honoured, Wait holding the sender, Overflow and N_Bs giving up
+
+ Then the same end to end against ECU_Sim: a DID group too long for one
+ frame sent physically and answered, and the VIN asked functionally of
+ two ECUs that segment their answers at the same time.
+
+ Build from the repository root:
+   g++ -std=c++11 -O2 -Itools/host -I. -o isotp_check tools/isotp_check.cpp \
+       tools/host/Arduino.cpp WWH_OBD.cpp Ford_OBD.cpp OBD_Sample.cpp \
+       ISO_TP.cpp OBD_Supported.cpp ECU_Sim.cpp
+
+ Usage:
+   isotp_check
+ */
+
+#include "Arduino.h"
+#include "WWH_OBD.h"
+#include "Ford_OBD.h"
+#include "ISO_TP.h"
+#include "ECU_Sim.h"
+
+static uint32_t failures;
+
+/*
+
+*/
+static void check(bool ok, const char* what)
+{
+  if (ok == false)
+  {
+    printf("FAILED %s\n", what);
+    failures++;
+  }
+}
+
+/*
+ A frame of 8 bytes, the first count given and the rest zero.
+*/
+static OBD_Frame frame(uint32_t id, byte count, const byte* data)
+{
+  OBD_Frame f;
+
+  f.id = id;
+  f.timestamp = 0;
+  f.length = 8;
+  f.bus = 0;
+  memset(f.data, 0, sizeof(f.data));
+  memcpy(f.data, data, count);
+
+  return f;
+}
+
+/*
+ A first frame of a length byte message from id, carrying message bytes
+ from 0 on, each byte its offset plus base.
+*/
+static OBD_Frame firstFrame(uint32_t id, uint16_t length, byte base)
+{
+  byte data[8] = {(byte)(ISO_TP_PCI_FF | (length >> 8)), (byte)length};
+
+  for (byte i = 0; i < 6; i++)
+  {
+    data[2 + i] = base + i;
+  }
+
+  return frame(id, 8, data);
+}
+
+/*
+ Consecutive frame sequence of the same message, starting at its offset.
+*/
+static OBD_Frame consecutiveFrame(uint32_t id, byte sequence, uint16_t offset, byte base)
+{
+  byte data[8] = {(byte)(ISO_TP_PCI_CF | (sequence & 0x0F))};
+
+  for (byte i = 0; i < 7; i++)
+  {
+    data[1 + i] = base + offset + i;
+  }
+
+  return frame(id, 8, data);
+}
+
+/*
+ True if payload is the length bytes firstFrame() and consecutiveFrame()
+ numbered from base.
+*/
+static bool numbered(const byte* payload, uint16_t length, byte base)
+{
+  for (uint16_t i = 0; i < length; i++)
+  {
+    if (payload[i] != (byte)(base + i))
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+/*
+ Feed the consecutive frames of a length byte message after its first
+ frame, returning the last result.
+*/
+static byte feedConsecutive(ISO_TP* isotp, uint32_t id, uint16_t length, byte base, uint32_t now,
+                            const byte** payload, uint16_t* received)
+{
+  byte result = ISO_TP_RX_NONE;
+  byte sequence = 1;
+
+  for (uint16_t offset = 6; offset < length; offset += 7)
+  {
+    OBD_Frame cf = consecutiveFrame(id, sequence++, offset, base);
+
+    result = isotp->receive(&cf, now, payload, received);
+  }
+
+  return result;
+}
+
+/*
+ Receiving: single, first and consecutive frames, flow control sent.
+*/
+static void checkReceive()
+{
+  ISO_TP isotp;
+  OBD_Frame out;
+  const byte* payload;
+  uint16_t length;
+
+  // Single frame, in place
+  const byte sf[] = {0x04, SIDPR_DIAG, PID_RPM, 0x1A, 0xF8};
+  OBD_Frame in = frame(ID_REPLY_1, sizeof(sf), sf);
+  check((isotp.receive(&in, 0, &payload, &length) == ISO_TP_RX_COMPLETE) && (length == 4) &&
+        (payload == in.data + 1) && (payload[1] == PID_RPM), "single frame");
+
+  // Not ours
+  in.id = ID_REQUEST_1;
+  check(isotp.receive(&in, 0, &payload, &length) == ISO_TP_RX_NONE, "request ID ignored");
+
+  // First frame, flow control ContinueToSend to the ECU's request ID, then
+  // the consecutive frames into the pool
+  in = firstFrame(ID_REPLY_1 + 2, 20, 0x30);
+  check(isotp.receive(&in, 0, &payload, &length) == ISO_TP_RX_PARTIAL, "first frame");
+  check(isotp.transmit(0, &out) && (out.id == ID_REQUEST_1 + 2) &&
+        (out.data[0] == (ISO_TP_PCI_FC | ISO_TP_FS_CTS)) && (out.data[1] == ISO_TP_BS) &&
+        (out.data[2] == ISO_TP_STMIN) && (out.length == 8), "flow control CTS");
+  check(isotp.transmit(0, &out) == false, "one flow control");
+  check((feedConsecutive(&isotp, ID_REPLY_1 + 2, 20, 0x30, 5, &payload, &length) == ISO_TP_RX_COMPLETE) &&
+        (length == 20) && numbered(payload, 20, 0x30), "consecutive frames");
+  check((payload < in.data) || (payload >= in.data + 8), "multi-frame payload in the pool");
+
+  // The longest message the pool holds
+  in = firstFrame(ID_REPLY_1, ISO_TP_BUF_SIZE, 0);
+  isotp.receive(&in, 0, &payload, &length);
+  isotp.transmit(0, &out);
+  check((feedConsecutive(&isotp, ID_REPLY_1, ISO_TP_BUF_SIZE, 0, 0, &payload, &length) == ISO_TP_RX_COMPLETE) &&
+        (length == ISO_TP_BUF_SIZE) && numbered(payload, ISO_TP_BUF_SIZE, 0), "full buffer");
+
+  // One byte more is refused with an Overflow flow control
+  uint32_t overflows = isotp.overflows;
+  in = firstFrame(ID_REPLY_1, ISO_TP_BUF_SIZE + 1, 0);
+  isotp.receive(&in, 0, &payload, &length);
+  check(isotp.transmit(0, &out) && (out.data[0] == (ISO_TP_PCI_FC | ISO_TP_FS_OVFLW)) &&
+        (isotp.overflows == overflows + 1), "flow control OVFLW");
+  in = consecutiveFrame(ID_REPLY_1, 1, 6, 0);
+  check(isotp.receive(&in, 0, &payload, &length) == ISO_TP_RX_NONE, "overflowed message dropped");
+
+  // A first frame that would fit a single frame is an error
+  in = firstFrame(ID_REPLY_1, OBD_SF_PAYLOAD, 0);
+  check(isotp.receive(&in, 0, &payload, &length) == ISO_TP_RX_ERROR, "short first frame");
+}
+
+/*
+ Wrong sequence number and N_Cr.
+*/
+static void checkReceiveErrors()
+{
+  ISO_TP isotp;
+  OBD_Frame out;
+  OBD_Frame in;
+  const byte* payload;
+  uint16_t length;
+
+  in = firstFrame(ID_REPLY_1, 30, 0);
+  isotp.receive(&in, 0, &payload, &length);
+  isotp.transmit(0, &out);
+  in = consecutiveFrame(ID_REPLY_1, 1, 6, 0);
+  isotp.receive(&in, 0, &payload, &length);
+  in = consecutiveFrame(ID_REPLY_1, 3, 13, 0);
+  check((isotp.receive(&in, 0, &payload, &length) == ISO_TP_RX_ERROR) && (isotp.errors == 1),
+        "sequence number mismatch");
+  in = consecutiveFrame(ID_REPLY_1, 2, 13, 0);
+  check(isotp.receive(&in, 0, &payload, &length) == ISO_TP_RX_NONE, "message dropped after mismatch");
+
+  // N_Cr from the first frame, then from each consecutive frame
+  uint32_t timeouts = isotp.timeouts;
+  in = firstFrame(ID_REPLY_1, 30, 0);
+  isotp.receive(&in, 1000, &payload, &length);
+  isotp.transmit(1000, &out);
+  isotp.expire(1000 + ISO_TP_N_CR - 1);
+  in = consecutiveFrame(ID_REPLY_1, 1, 6, 0);
+  check(isotp.receive(&in, 1000 + ISO_TP_N_CR - 1, &payload, &length) == ISO_TP_RX_PARTIAL, "within N_Cr");
+  isotp.expire(1000 + 2 * ISO_TP_N_CR - 2);
+  check(isotp.timeouts == timeouts, "N_Cr restarted by a consecutive frame");
+  isotp.expire(1000 + 2 * ISO_TP_N_CR - 1);
+  check(isotp.timeouts == timeouts + 1, "N_Cr timeout");
+  in = consecutiveFrame(ID_REPLY_1, 2, 13, 0);
+  check(isotp.receive(&in, 1000 + 2 * ISO_TP_N_CR, &payload, &length) == ISO_TP_RX_NONE,
+        "message dropped after N_Cr");
+}
+
+/*
+ Two ECUs segmenting at once, frames interleaved.
+*/
+static void checkTwoECUs()
+{
+  ISO_TP isotp;
+  OBD_Frame out;
+  OBD_Frame in;
+  const byte* payload;
+  uint16_t length;
+  byte first[ISO_TP_BUF_SIZE];
+  bool first_done = false;
+  bool second_done = false;
+
+  in = firstFrame(ID_REPLY_1, 27, 0x10);
+  isotp.receive(&in, 0, &payload, &length);
+  in = firstFrame(ID_REPLY_1 + 1, 34, 0x80);
+  isotp.receive(&in, 0, &payload, &length);
+  check(isotp.transmit(0, &out) && (out.id == ID_REQUEST_1) &&
+        isotp.transmit(0, &out) && (out.id == ID_REQUEST_1 + 1), "a flow control each");
+
+  for (byte sequence = 1; sequence <= 4; sequence++)
+  {
+    uint16_t offset = 6 + 7 * (sequence - 1);
+
+    if (offset < 27)
+    {
+      in = consecutiveFrame(ID_REPLY_1, sequence, offset, 0x10);
+      if (isotp.receive(&in, 0, &payload, &length) == ISO_TP_RX_COMPLETE)
+      {
+        // Kept until the ECU's next first frame, copied to be sure
+        first_done = (length == 27);
+        memcpy(first, payload, length);
+      }
+    }
+    in = consecutiveFrame(ID_REPLY_1 + 1, sequence, offset, 0x80);
+    if (isotp.receive(&in, 0, &payload, &length) == ISO_TP_RX_COMPLETE)
+    {
+      second_done = (length == 34) && numbered(payload, 34, 0x80);
+    }
+  }
+
+  check(first_done && numbered(first, 27, 0x10), "first ECU reassembled");
+  check(second_done, "second ECU reassembled");
+}
+
+/*
+ Sending: flow control with block size and STmin, Wait, Overflow, N_Bs.
+*/
+static void checkSend()
+{
+  const byte fc_wait[] = {ISO_TP_PCI_FC | ISO_TP_FS_WAIT};
+  const byte fc_overflow[] = {ISO_TP_PCI_FC | ISO_TP_FS_OVFLW};
+  ISO_TP isotp;
+  OBD_Frame out;
+  OBD_Frame in;
+  const byte* payload;
+  uint16_t length;
+  byte message[40];
+  byte sent[40];
+  uint16_t got;
+  bool ok;
+
+  for (byte i = 0; i < sizeof(message); i++)
+  {
+    message[i] = 0x40 + i;
+  }
+
+  // A single frame, functionally; longer messages have to go physically
+  check(isotp.send(ID_REQUEST, message, 5) && isotp.transmit(0, &out) && (out.id == ID_REQUEST) &&
+        (out.data[0] == 5) && (memcmp(out.data + 1, message, 5) == 0) && !isotp.busy(), "send single frame");
+  check(isotp.send(ID_REQUEST, message, sizeof(message)) == false, "functional multi-frame refused");
+
+  // First frame, then nothing until the flow control
+  check(isotp.send(ID_REQUEST_1, message, sizeof(message)), "send");
+  check(isotp.send(ID_REQUEST_1, message, 5) == false, "one message at a time");
+  check(isotp.transmit(100, &out) && (out.data[0] == (ISO_TP_PCI_FF | 0)) && (out.data[1] == sizeof(message)) &&
+        (memcmp(out.data + 2, message, 6) == 0), "first frame sent");
+  memcpy(sent, out.data + 2, 6);
+  got = 6;
+  check(isotp.transmit(100, &out) == false, "waiting for flow control");
+
+  // Wait restarts N_Bs
+  in = frame(ID_REPLY_1, sizeof(fc_wait), fc_wait);
+  check(isotp.receive(&in, 150, &payload, &length) == ISO_TP_RX_FLOW, "flow control WAIT");
+  isotp.expire(150 + ISO_TP_N_BS - 1);
+  check(isotp.busy() && (isotp.transmit(150 + ISO_TP_N_BS - 1, &out) == false), "held by WAIT");
+
+  // ContinueToSend, two frames a block, 5 ms apart
+  const byte fc_block[] = {ISO_TP_PCI_FC | ISO_TP_FS_CTS, 2, 5};
+  uint32_t now = 200;
+  in = frame(ID_REPLY_1, sizeof(fc_block), fc_block);
+  check(isotp.receive(&in, now, &payload, &length) == ISO_TP_RX_FLOW, "flow control CTS");
+  ok = isotp.transmit(now, &out) && (out.data[0] == (ISO_TP_PCI_CF | 1));
+  memcpy(sent + got, out.data + 1, 7);
+  got += 7;
+  ok &= (isotp.transmit(now + 4, &out) == false);
+  ok &= isotp.transmit(now + 5, &out) && (out.data[0] == (ISO_TP_PCI_CF | 2));
+  memcpy(sent + got, out.data + 1, 7);
+  got += 7;
+  check(ok, "STmin honoured");
+  check(isotp.busy() && (isotp.transmit(now + 100, &out) == false), "block size honoured");
+
+  // Next block with STmin in 100 microsecond steps, rounded up to 1 ms
+  const byte fc_micro[] = {ISO_TP_PCI_FC | ISO_TP_FS_CTS, 0, 0xF3};
+  now = 300;
+  in = frame(ID_REPLY_1, sizeof(fc_micro), fc_micro);
+  isotp.receive(&in, now, &payload, &length);
+  ok = true;
+  while (isotp.busy())
+  {
+    if (isotp.transmit(now, &out))
+    {
+      memcpy(sent + got, out.data + 1, (sizeof(message) - got > 7) ? 7 : sizeof(message) - got);
+      got += (sizeof(message) - got > 7) ? 7 : sizeof(message) - got;
+      ok &= (isotp.transmit(now, &out) == false) || !isotp.busy();
+    }
+    now++;
+  }
+  check(ok && (got == sizeof(message)) && (memcmp(sent, message, sizeof(message)) == 0), "message sent whole");
+
+  // Overflow from the receiver gives up
+  uint32_t overflows = isotp.overflows;
+  isotp.send(ID_REQUEST_1, message, sizeof(message));
+  isotp.transmit(0, &out);
+  in = frame(ID_REPLY_1, sizeof(fc_overflow), fc_overflow);
+  isotp.receive(&in, 10, &payload, &length);
+  check(!isotp.busy() && (isotp.overflows == overflows + 1), "flow control OVFLW");
+
+  // A flow control from another ECU is not ours
+  isotp.send(ID_REQUEST_1, message, sizeof(message));
+  isotp.transmit(0, &out);
+  in = frame(ID_REPLY_1 + 1, sizeof(fc_block), fc_block);
+  check(isotp.receive(&in, 10, &payload, &length) == ISO_TP_RX_NONE, "other ECU's flow control");
+
+  // N_Bs without an answer
+  uint32_t timeouts = isotp.timeouts;
+  isotp.expire(ISO_TP_N_BS - 1);
+  check(isotp.busy(), "within N_Bs");
+  isotp.expire(ISO_TP_N_BS);
+  check(!isotp.busy() && (isotp.timeouts == timeouts + 1), "N_Bs timeout");
+}
+
+/*
+ Pass frames between isotp and sim for ms milliseconds, keeping every
+ message completed. Returns how many there were.
+*/
+static byte exchange(ISO_TP* isotp, ECU_Sim* sim, uint32_t start, uint32_t ms,
+                     const byte** payloads, uint16_t* lengths, uint32_t* ids, byte max)
+{
+  byte complete = 0;
+
+  for (uint32_t now = start; now < start + ms; now++)
+  {
+    OBD_Frame frame;
+
+    while (isotp->transmit(now, &frame))
+    {
+      sim->receive(&frame, now);
+    }
+    while (sim->transmit(now, &frame))
+    {
+      const byte* payload;
+      uint16_t length;
+
+      if ((isotp->receive(&frame, now, &payload, &length) == ISO_TP_RX_COMPLETE) && (complete < max))
+      {
+        payloads[complete] = payload;
+        lengths[complete] = length;
+        ids[complete] = frame.id;
+        complete++;
+      }
+    }
+    isotp->expire(now);
+  }
+
+  return complete;
+}
+
+/*
+ End to end with ECU_Sim.
+*/
+static void checkSim()
+{
+  ECU_Sim_Config pcm = {5, 0, ECU_SIM_DIAG | ECU_SIM_INFO | ECU_SIM_RDBI, NRC_PR, 0, 0};
+  ECU_Sim_Config tcm = {7, 0, ECU_SIM_DIAG | ECU_SIM_INFO, NRC_PR, 0, 0};
+  ECU_Sim sim;
+  ISO_TP isotp;
+  const byte* payloads[4];
+  uint16_t lengths[4];
+  uint32_t ids[4];
+  byte complete;
+
+  sim.configure(0, &pcm);
+  sim.configure(1, &tcm);
+
+  // Four DIDs, 9 bytes: first frame, the ECU's flow control, a consecutive frame
+  const byte group[] = {SIDRQ_RDBI, FORD_PID_TR >> 8, FORD_PID_TR & 0xFF, FORD_PID_TRD >> 8, FORD_PID_TRD & 0xFF,
+                        FORD_PID_BPA >> 8, FORD_PID_BPA & 0xFF, FORD_PID_TR >> 8, FORD_PID_TR & 0xFF};
+  check(isotp.send(ID_REQUEST_1, group, sizeof(group)), "ECU_Sim DID group sent");
+  complete = exchange(&isotp, &sim, 0, 100, payloads, lengths, ids, 4);
+  check((complete == 1) && (ids[0] == ID_REPLY_1) && (payloads[0][0] == SIDPR_RDBI) && (lengths[0] > 7) &&
+        !isotp.busy(), "ECU_Sim DID group answered");
+
+  // The VIN from both ECUs, segmented at the same time
+  const byte vin[] = {SIDRQ_INFO, INFOTYPE_VIN};
+  isotp.send(ID_REQUEST, vin, sizeof(vin));
+  complete = exchange(&isotp, &sim, 1000, 100, payloads, lengths, ids, 4);
+  check((complete == 2) && (ids[0] != ids[1]), "ECU_Sim VIN from two ECUs");
+  for (byte i = 0; i < complete; i++)
+  {
+    check((lengths[i] == 3 + OBD_VIN_LENGTH) && (payloads[i][0] == SIDPR_INFO) &&
+          (memcmp(payloads[i] + 3, "1FAHP3F20CL123456", OBD_VIN_LENGTH) == 0), "ECU_Sim VIN reassembled");
+  }
+  check((isotp.errors == 0) && (isotp.timeouts == 0) && (isotp.overflows == 0), "ECU_Sim no errors");
+}
+
+/*
+
+*/
+int main()
+{
+  checkReceive();
+  checkReceiveErrors();
+  checkTwoECUs();
+  checkSend();
+  checkSim();
+
+  printf("%s\n", (failures == 0) ? "ok" : "FAILED");
+
+  return (failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,385 @@
+/*
+ Lap timing replay of recorded or generated GPS tracks
+ by:
+ date:
+ license:
+
+ Feeds NMEA sentences through NMEA_Parser and every RMC fix to Lap_Timer,
+ the way pollGPS() does, and prints the starts, splits and finishes with
+ the live delta.
+
+ Without a track a circular course of 60 m radius is driven for ten laps
+ at 10 Hz, each lap at its own pace, first as a circuit with the start as
+ finish and two splits, then as an autocross with its own finish gate.
+ The time each gate was really crossed is known, so every crossing is
+ checked against it, and the live delta just before each finish against
+ the difference to the best lap. Last, update() is timed on courses of
+ two and eight gates to show the cost per fix does not grow.
+
+ Build from the repository root:
+   g++ -std=c++11 -O2 -Itools/host -I. -o lap_replay tools/lap_replay.cpp \
+       tools/host/Arduino.cpp tools/host/Print.cpp NMEA_Parser.cpp Lap_Timer.cpp
+
+ Usage:
+   lap_replay [-c course.txt] [track.nmea]
+
+ A course file has one gate per line, latitude and longitude of A, then
+ of B, in degrees with A on the driver's left; the start first and the
+ finish last. A line "circuit" makes the start the finish as well.
+ */
+
+#include <unistd.h>
+#include <math.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "Arduino.h"
+#include "NMEA_Parser.h"
+#include "Lap_Timer.h"
+
+#define CENTER_LAT 38.0       // degrees
+#define CENTER_LON -122.0
+#define RADIUS     60.0       // metres
+#define GATE_HALF  8.0        // metres each side of the line driven
+#define LAPS       10
+#define FIX_MS     100
+#define LATENCY_MS 40         // '$' of a fix after its UTC time, on the millis() clock
+#define M_PER_DEG_LAT 111195.0
+
+struct Crossing
+{
+  uint32_t time;  // UTC milliseconds
+  int gate;       // index in the course
+};
+
+static const char* event_names[] = {"", "start", "split", "finish"};
+
+/*
+ Gate across the circle at angle degrees, counterclockwise from east.
+ Driving counterclockwise the centre is on the left, so A is inside.
+*/
+static void gateAt(double degrees, int32_t* gate)
+{
+  double angle = degrees * M_PI / 180;
+  double radii[2] = {RADIUS - GATE_HALF, RADIUS + GATE_HALF};
+
+  for (int i = 0; i < 2; i++)
+  {
+    double x = radii[i] * cos(angle);
+    double y = radii[i] * sin(angle);
+
+    gate[2 * i] = lround((CENTER_LAT + y / M_PER_DEG_LAT) * 1e7);
+    gate[2 * i + 1] = lround((CENTER_LON + x / (M_PER_DEG_LAT * cos(CENTER_LAT * M_PI / 180))) * 1e7);
+  }
+}
+
+/*
+ $GPRMC for the point at angle on the circle.
+*/
+static std::string rmcAt(uint32_t time, double angle, double speed)
+{
+  double latitude = CENTER_LAT + RADIUS * sin(angle) / M_PER_DEG_LAT;
+  double longitude = CENTER_LON + RADIUS * cos(angle) / (M_PER_DEG_LAT * cos(CENTER_LAT * M_PI / 180));
+  double course = fmod(90 - (angle * 180 / M_PI + 90) + 720, 360);
+  char body[192];
+  char sentence[224];
+
+  snprintf(body, sizeof(body), "GPRMC,%02u%02u%02u.%03u,A,%02d%08.5f,%c,%03d%08.5f,%c,%.2f,%.2f,170326,,,A",
+           time / 3600000, time / 60000 % 60, time / 1000 % 60, time % 1000, (int)fabs(latitude),
+           (fabs(latitude) - (int)fabs(latitude)) * 60, (latitude < 0) ? 'S' : 'N', (int)fabs(longitude),
+           (fabs(longitude) - (int)fabs(longitude)) * 60, (longitude < 0) ? 'W' : 'E', speed / 0.514444, course);
+  snprintf(sentence, sizeof(sentence), "$%s*%02X\r\n", body, NMEA_Parser::checksum(body));
+
+  return sentence;
+}
+
+/*
+ Drive LAPS laps counterclockwise from just before angle 0, each at its
+ own pace, in 1 ms steps. Every crossing of a gate angle is noted.
+*/
+static std::string driveCircle(const std::vector<double>& gate_angles, std::vector<Crossing>* crossings)
+{
+  std::string track;
+  double angle = -0.2;   // radians, a few metres before the start
+  uint32_t time = 12 * 3600000;
+
+  while (angle < LAPS * 2 * M_PI + 0.1)
+  {
+    int lap = (int)floor((angle - M_PI / 2) / (2 * M_PI)); // pace changes away from the gates
+    double pace = 14 + 1.5 * ((lap * 7) % 5);                  // metres per second
+    double speed = pace * (1 + 0.25 * sin(2 * angle));
+    double next = angle + speed / RADIUS * 0.001;
+
+    for (size_t g = 0; g < gate_angles.size(); g++)
+    {
+      double gate = gate_angles[g] * M_PI / 180;
+      double turns = floor((next - gate) / (2 * M_PI));
+      double at = gate + turns * 2 * M_PI;
+
+      if ((at > angle) && (at <= next))
+      {
+        Crossing crossing = {time + (uint32_t)lround((at - angle) / (next - angle)), (int)g};
+        crossings->push_back(crossing);
+      }
+    }
+
+    angle = next;
+    time++;
+    if ((time % FIX_MS) == 0)
+    {
+      track += rmcAt(time, angle, speed);
+    }
+  }
+
+  return track;
+}
+
+/*
+ Replay a track, checking crossings if the true ones are known. Returns
+ the worst crossing error in milliseconds.
+*/
+static double replay(const std::string& track, Lap_Timer* timer, const std::vector<Crossing>* crossings)
+{
+  NMEA_Parser gps;
+  uint32_t now = 0;
+  double worst = 0;
+  double worst_delta = 0;
+  int32_t last_delta = 0;
+  uint32_t best = 0;
+  size_t checked = 0;
+
+  for (size_t i = 0; i < track.size(); i++)
+  {
+    // Each sentence reaches the parser LATENCY_MS after its UTC time
+    if (track[i] == '$')
+    {
+      unsigned hours, minutes, seconds, millis;
+
+      if (sscanf(track.c_str() + i, "$%*2cRMC,%2u%2u%2u.%3u", &hours, &minutes, &seconds, &millis) == 4)
+      {
+        now = ((hours * 60 + minutes) * 60 + seconds) * 1000 + millis + LATENCY_MS;
+      }
+    }
+    if ((gps.parse(track[i], now) == false) || (gps.available() == false))
+    {
+      continue;
+    }
+
+    const GPS_Fix* fix = gps.fix();
+    byte event = timer->update(fix);
+
+    if (event == LAP_NONE)
+    {
+      last_delta = timer->delta;
+      continue;
+    }
+
+    // The gate's true time on the millis() clock, if it is known
+    double error = 0;
+    bool known = false;
+    if ((crossings != 0) && (checked < crossings->size()))
+    {
+      const Crossing* truth = &(*crossings)[checked++];
+
+      error = (double)timer->crossing - (truth->time + LATENCY_MS);
+      worst = fmax(worst, fabs(error));
+      known = (truth->gate == timer->gate);
+    }
+
+    printf("%8.3f s  %-6s gate %u", fix->time / 1000.0, event_names[event], timer->gate);
+    if (event == LAP_SPLIT)
+    {
+      printf("  %7.3f s", timer->splits[timer->gate] / 1000.0);
+    }
+    if (event == LAP_FINISH)
+    {
+      printf("  %7.3f s best %7.3f s", timer->last_run / 1000.0, timer->best_run / 1000.0);
+      if (best != 0)
+      {
+        int32_t expected = (int32_t)(timer->last_run - best);
+
+        printf(", delta before %+6d ms for %+6d ms", last_delta, expected);
+        worst_delta = fmax(worst_delta, fabs((double)(last_delta - expected)));
+      }
+    }
+    if (crossings != 0)
+    {
+      printf("%s  error %+.1f ms", known ? "" : " (wrong gate)", error);
+    }
+    printf("\n");
+
+    if (event == LAP_FINISH)
+    {
+      best = timer->best_run;
+    }
+    last_delta = timer->delta;
+  }
+
+  if (crossings != 0)
+  {
+    printf("%zu crossings of %zu, worst error %.1f ms, worst delta error before a finish %.0f ms\n\n", checked,
+           crossings->size(), worst, worst_delta);
+  }
+
+  return worst;
+}
+
+/*
+
+*/
+static bool readCourse(const char* name, std::vector<int32_t>* gates, bool* circuit)
+{
+  FILE* file = fopen(name, "r");
+  char line[256];
+
+  if (file == 0)
+  {
+    return false;
+  }
+  while (fgets(line, sizeof(line), file) != 0)
+  {
+    double values[4];
+
+    if (strncmp(line, "circuit", 7) == 0)
+    {
+      *circuit = true;
+    }
+    else if (sscanf(line, "%lf %lf %lf %lf", &values[0], &values[1], &values[2], &values[3]) == 4)
+    {
+      for (int i = 0; i < 4; i++)
+      {
+        gates->push_back(lround(values[i] * 1e7));
+      }
+    }
+  }
+  fclose(file);
+
+  return true;
+}
+
+/*
+ Nanoseconds per update() over the generated track on a course of count
+ gates, all of them splits around the circle.
+*/
+static double timeUpdates(const std::string& track, int count)
+{
+  std::vector<int32_t> gates(4 * count);
+  std::vector<GPS_Fix> fixes;
+  NMEA_Parser gps;
+  Lap_Timer timer;
+
+  for (int g = 0; g < count; g++)
+  {
+    gateAt(360.0 * g / count, &gates[4 * g]);
+  }
+  for (size_t i = 0; i < track.size(); i++)
+  {
+    if (gps.parse(track[i], 0) && gps.available())
+    {
+      fixes.push_back(*gps.fix());
+    }
+  }
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  static volatile uint32_t events = 0;
+
+  for (int r = 0; r < 200; r++)
+  {
+    timer.begin(&gates[0], count, true);
+    for (size_t i = 0; i < fixes.size(); i++)
+    {
+      events += timer.update(&fixes[i]);
+    }
+  }
+
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  return seconds * 1e9 / (200.0 * fixes.size());
+}
+
+/*
+
+*/
+int main(int argc, char* argv[])
+{
+  const char* course_name = 0;
+  int option;
+
+  while ((option = getopt(argc, argv, "c:")) != -1)
+  {
+    switch (option)
+    {
+      case 'c':
+        course_name = optarg;
+        break;
+      default:
+        fprintf(stderr, "usage: %s [-c course.txt] [track.nmea]\n", argv[0]);
+        return 1;
+    }
+  }
+
+  if (optind < argc)
+  {
+    std::vector<int32_t> gates;
+    bool circuit = false;
+    std::string track;
+    FILE* file = fopen(argv[optind], "rb");
+    char chunk[4096];
+    size_t length;
+    Lap_Timer timer;
+
+    if ((course_name == 0) || (readCourse(course_name, &gates, &circuit) == false) || (file == 0))
+    {
+      fprintf(stderr, "%s: a course and a readable track are needed\n", argv[0]);
+      return 1;
+    }
+    while ((length = fread(chunk, 1, sizeof(chunk), file)) > 0)
+    {
+      track.append(chunk, length);
+    }
+    fclose(file);
+
+    if (timer.begin(&gates[0], gates.size() / 4, circuit) == false)
+    {
+      fprintf(stderr, "%s: course does not fit\n", argv[0]);
+      return 1;
+    }
+    replay(track, &timer, 0);
+    return 0;
+  }
+
+  // Circuit: start and finish at 0 degrees, splits at 120 and 240
+  std::vector<Crossing> crossings;
+  std::vector<double> circuit_angles = {0, 120, 240};
+  std::string track = driveCircle(circuit_angles, &crossings);
+  std::vector<int32_t> gates(4 * 3);
+  Lap_Timer timer;
+  double worst;
+
+  for (size_t g = 0; g < circuit_angles.size(); g++)
+  {
+    gateAt(circuit_angles[g], &gates[4 * g]);
+  }
+  timer.begin(&gates[0], 3, true);
+  printf("circuit\n");
+  worst = replay(track, &timer, &crossings);
+
+  // Autocross: start at 0, splits at 120 and 240, finish at 330
+  std::vector<double> autocross_angles = {0, 120, 240, 330};
+  crossings.clear();
+  track = driveCircle(autocross_angles, &crossings);
+  gates.resize(4 * 4);
+  for (size_t g = 0; g < autocross_angles.size(); g++)
+  {
+    gateAt(autocross_angles[g], &gates[4 * g]);
+  }
+  timer.begin(&gates[0], 4, false);
+  printf("autocross\n");
+  worst = fmax(worst, replay(track, &timer, &crossings));
+
+  printf("update() %.1f ns per fix with 2 gates, %.1f ns with 8\n", timeUpdates(track, 2), timeUpdates(track, 8));
+  printf("%s\n", (worst < 5) ? "ok" : "FAILED");
+
+  return (worst < 5) ? 0 : 1;
+}
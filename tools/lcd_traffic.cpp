@@ -0,0 +1,240 @@
+/*
+ LCD I2C traffic of the dashboard screen
+ by:
+ date:
+ license:
+
+ Draws the dashboard the way dashboard() used to, whole rows straight to
+ the shield every UI_PERIOD, and through LCD_Buffer, on the counting
+ Adafruit_RGBLCDShield stand-in. The four dashboard PIDs change at their
+ poll rates. Time advances by what each loop pass costs, so a slow screen
+ update delays the next pass as it does on the board. Reports the I2C
+ bytes per second and the mean and worst loop pass.
+
+ Build from the repository root:
+   g++ -std=c++11 -O2 -Itools/host -I. -o lcd_traffic tools/lcd_traffic.cpp \
+       tools/host/Arduino.cpp tools/host/Print.cpp \
+       tools/host/Adafruit_RGBLCDShield.cpp LCD_Buffer.cpp \
+       WWH_OBD.cpp OBD_Sample.cpp
+
+ Usage:
+   lcd_traffic [-s seconds] [-c]
+
+ -c holds the values steady, as when cruising, instead of sweeping them.
+ */
+
+#include <unistd.h>
+
+#include "Arduino.h"
+#include "Adafruit_RGBLCDShield.h"
+#include "WWH_OBD.h"
+#include "OBD_Sample.h"
+#include "LCD_Buffer.h"
+
+#define UI_PERIOD 25   // milliseconds, as in the sketch
+#define BUS_US    300  // rest of a loop pass, bus and log
+
+static const byte dash_pids[] = {PID_APP_R, PID_TP_R, PID_RPM, PID_LOAD_PCT};
+static const uint16_t dash_hz[] = {20, 20, 50, 10};
+
+struct Result
+{
+  uint64_t i2c_bytes;
+  uint64_t passes;
+  uint64_t max_us;
+  uint32_t characters;
+  uint32_t commands;
+};
+
+static WWH_OBD OBD;
+static OBD_Sample samples[sizeof(dash_pids)];
+static bool cruise = false;
+
+/*
+ Raw value of PID i at time t, a triangle over its range or a steady value
+ that flickers by one count.
+*/
+static void sampleAt(byte i, uint32_t t)
+{
+  byte data[4] = {0, 0, 0, 0};
+  uint32_t period = 4000 + 1000 * i;
+  uint32_t phase = t % period;
+  uint32_t level = (phase < period / 2) ? phase : period - phase;  // 0 .. period/2
+
+  if (cruise)
+  {
+    level = period / 5 + ((t / 200) & 1);
+  }
+
+  if (dash_pids[i] == PID_RPM)
+  {
+    uint32_t raw = 3200 + level * 20000 / (period / 2);  // 800 - 5800 rpm
+    data[0] = raw >> 8;
+    data[1] = raw;
+  }
+  else
+  {
+    data[0] = level * 255 / (period / 2);
+  }
+
+  OBD.decodeData(dash_pids[i], data, t, &samples[i]);
+}
+
+/*
+ The two rows dashboard() shows.
+*/
+static void formatRows(char rows[2][17])
+{
+  char text[17];
+
+  for (byte r = 0; r < 2; r++)
+  {
+    rows[r][0] = 0;
+    formatSample(&samples[2 * r], text);
+    strlcat(rows[r], text, 17);
+    strlcat(rows[r], " ", 17);
+    formatSample(&samples[2 * r + 1], text);
+    strlcat(rows[r], text, 17);
+  }
+}
+
+/*
+
+*/
+static Result run(uint32_t seconds, bool buffered)
+{
+  Adafruit_RGBLCDShield lcd;
+  LCD_Buffer screen;
+  Result result = {0, 0, 0, 0, 0};
+  uint64_t now_us = 0;
+  uint32_t ui_time = 0;
+  uint32_t next[sizeof(dash_pids)] = {0, 0, 0, 0};
+  char rows[2][17];
+
+  lcd.begin(16, 2);
+  screen.begin(&lcd);
+
+  while (now_us < (uint64_t)seconds * 1000000)
+  {
+    uint32_t now = now_us / 1000;
+    uint64_t busy = lcd.busy_us;
+    uint64_t pass_us;
+
+    for (byte i = 0; i < sizeof(dash_pids); i++)
+    {
+      if ((int32_t)(now - next[i]) >= 0)
+      {
+        sampleAt(i, now);
+        next[i] = now + 1000 / dash_hz[i];
+      }
+    }
+
+    if ((now - ui_time) >= UI_PERIOD)
+    {
+      ui_time = now;
+      lcd.readButtons();
+      formatRows(rows);
+
+      if (buffered)
+      {
+        screen.clear();
+        screen.print(rows[0]);
+        screen.setCursor(0, 1);
+        screen.print(rows[1]);
+      }
+      else
+      {
+        lcd.home();
+        lcd.print(rows[0]);
+        lcd.setCursor(0, 1);
+        lcd.print(rows[1]);
+      }
+    }
+
+    if (buffered)
+    {
+      screen.flush(now);
+    }
+
+    pass_us = BUS_US + (lcd.busy_us - busy);
+    if (pass_us > result.max_us)
+    {
+      result.max_us = pass_us;
+    }
+    now_us += pass_us;
+    result.passes++;
+  }
+
+  // The buffered screen has to end up showing the same text
+  if (buffered)
+  {
+    screen.sync();
+    for (byte r = 0; r < 2; r++)
+    {
+      char expected[17];
+
+      memset(expected, ' ', 16);
+      memcpy(expected, rows[r], strlen(rows[r]));
+      if (memcmp(lcd.screen[r], expected, 16) != 0)
+      {
+        fprintf(stderr, "row %u: '%.16s' expected '%.16s'\n", r, lcd.screen[r], expected);
+      }
+    }
+  }
+
+  result.i2c_bytes = lcd.i2c_bytes;
+  result.characters = lcd.characters;
+  result.commands = lcd.commands;
+
+  return result;
+}
+
+/*
+
+*/
+static void report(const char* name, const Result* result, uint32_t seconds)
+{
+  printf("%s,%.0f,%.0f,%.2f,%.1f,%.1f,%.1f\n", name, (double)result->i2c_bytes / seconds,
+         (double)result->passes / seconds, (double)seconds * 1000 / result->passes,
+         result->max_us / 1000.0, (double)result->characters / seconds,
+         (double)result->commands / seconds);
+}
+
+/*
+
+*/
+int main(int argc, char* argv[])
+{
+  uint32_t seconds = 60;
+  int option;
+
+  while ((option = getopt(argc, argv, "s:c")) != -1)
+  {
+    switch (option)
+    {
+      case 's':
+        seconds = atoi(optarg);
+        break;
+      case 'c':
+        cruise = true;
+        break;
+      default:
+        fprintf(stderr, "usage: lcd_traffic [-s seconds] [-c]\n");
+        return 1;
+    }
+  }
+
+  if (seconds == 0)
+  {
+    seconds = 1;
+  }
+
+  Result direct = run(seconds, false);
+  Result buffered = run(seconds, true);
+
+  printf("path,i2c_bytes_per_s,loop_passes_per_s,mean_pass_ms,max_pass_ms,chars_per_s,commands_per_s\n");
+  report("direct", &direct, seconds);
+  report("LCD_Buffer", &buffered, seconds);
+
+  return 0;
+}
@@ -0,0 +1,227 @@
+/*
+ SD_Log records per second into a file
+ by:
+ date:
+ license:
+
+ Appends numbered records through SD_Log and, once per record as the
+ sketch's writeLog() once per pass, writes the oldest sealed block into
+ a file grown with zeroed sectors ahead of it, the way the sketch's
+ writeBlock() and growLog() do, on the SD stand-in over a temporary
+ directory. The time covers append(), sealing with the CRC and the file
+ calls, so it is what the log costs above the card itself: on the host
+ a write only reaches the page cache, on the board every sector waits for
+ the SPI transfer and the card.
+
+ The file is then read back through the same stand-in and every block
+ checked for its magic, CRC and sequence number and every record for the
+ channel, time and value it was appended with, so nothing was dropped,
+ duplicated or reordered on the way. Only zeroed sectors may follow the
+ last block.
+
+ Build from the repository root:
+   g++ -std=c++11 -O2 -Itools/host -I. -o log_bench tools/log_bench.cpp \
+       tools/host/Arduino.cpp tools/host/SD.cpp SD_Log.cpp
+
+ Usage:
+   log_bench [-n records]
+ */
+
+#include <chrono>
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "Arduino.h"
+#include "SD.h"
+#include "SD_Log.h"
+
+#define CHANNELS 32 // channel numbers the records cycle through
+#define LOG_GROW 16 // as the sketch's
+#define LOG_MODE (O_READ | O_WRITE | O_CREAT)
+
+static SD_Log session_log;
+static uint32_t log_blocks;
+static uint32_t log_size;
+
+/*
+ Record number i, a few records to the millisecond.
+*/
+static void numberRecord(uint32_t i, uint16_t* channel, uint32_t* timestamp, int32_t* raw)
+{
+  *channel = i % CHANNELS;
+  *timestamp = i / 4;
+  *raw = i * 2654435761u;
+}
+
+/*
+ As the sketch's growLog().
+*/
+static void growLog(File* file)
+{
+  byte zeros[32];
+
+  memset(zeros, 0, sizeof(zeros));
+  file->seek(log_size * SD_LOG_BLOCK_SIZE);
+  for (byte i = 0; i < SD_LOG_BLOCK_SIZE / sizeof(zeros); i++)
+  {
+    file->write(zeros, sizeof(zeros));
+  }
+  log_size++;
+
+  if ((log_size % LOG_GROW) == 0)
+  {
+    file->flush();
+  }
+}
+
+/*
+ As the sketch's writeBlock().
+*/
+static void writeBlock(File* file)
+{
+  const byte* block = session_log.block();
+
+  if (block != 0)
+  {
+    file->seek(log_blocks * SD_LOG_BLOCK_SIZE);
+    file->write(block, SD_LOG_BLOCK_SIZE);
+    session_log.written();
+    log_blocks++;
+  }
+
+  if (log_size < log_blocks + 2 * LOG_GROW)
+  {
+    growLog(file);
+  }
+}
+
+/*
+ Read the log back and check every record. Returns the records found.
+*/
+static uint32_t verify(const char* name, uint32_t records, uint32_t* bad)
+{
+  File file = SD.open(name, FILE_READ);
+  SD_Log_Block block;
+  uint32_t next = 0;
+  uint32_t sequence = 0;
+  bool tail = false;
+
+  while (file.read((uint8_t*)&block, sizeof(block)) == (int)sizeof(block))
+  {
+    uint32_t time = block.header.timestamp;
+
+    // Zeroed ahead of the blocks, nothing written after them
+    if (block.header.magic == 0)
+    {
+      tail = true;
+      continue;
+    }
+    if (tail || !SD_Log::valid(&block) || (block.header.sequence != sequence++))
+    {
+      (*bad)++;
+      continue;
+    }
+    for (byte r = 0; r < block.header.count; r++)
+    {
+      uint16_t channel;
+      uint32_t timestamp;
+      int32_t raw;
+
+      numberRecord(next++, &channel, &timestamp, &raw);
+      time += SD_Log::delta(&block, r);
+      if ((block.records[r].channel != channel) || (time != timestamp) || (block.records[r].raw != raw))
+      {
+        (*bad)++;
+      }
+    }
+  }
+  file.close();
+
+  if (next != records)
+  {
+    (*bad)++;
+  }
+
+  return next;
+}
+
+/*
+
+*/
+int main(int argc, char* argv[])
+{
+  char directory[] = "/tmp/log_bench.XXXXXX";
+  char path[64];
+  uint32_t records = 5000000;
+  uint32_t bad = 0;
+  int option;
+
+  while ((option = getopt(argc, argv, "n:")) != -1)
+  {
+    switch (option)
+    {
+      case 'n':
+        records = atoi(optarg);
+        break;
+      default:
+        fprintf(stderr, "usage: log_bench [-n records]\n");
+        return 2;
+    }
+  }
+
+  if (mkdtemp(directory) == 0)
+  {
+    perror(directory);
+    return 1;
+  }
+  SD.mount(directory);
+  if (SD.begin(0) == false)
+  {
+    fprintf(stderr, "%s: cannot mount\n", directory);
+    return 1;
+  }
+
+  File file = SD.open("LOG000.BIN", LOG_MODE);
+
+  session_log.begin();
+  while (log_size < 2 * LOG_GROW)
+  {
+    growLog(&file);
+  }
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < records; i++)
+  {
+    uint16_t channel;
+    uint32_t timestamp;
+    int32_t raw;
+
+    numberRecord(i, &channel, &timestamp, &raw);
+    session_log.append(channel, timestamp, raw);
+    writeBlock(&file);
+  }
+  session_log.seal();
+  while (session_log.block() != 0)
+  {
+    writeBlock(&file);
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  file.close();
+
+  uint32_t found = verify("LOG000.BIN", records, &bad);
+
+  printf("%u records in %u blocks, %llu bytes in %u flushes, %.3f s\n", records, session_log.blocks,
+         (unsigned long long)SD.written, SD.flushes, seconds);
+  printf("%.1f M records/s, %.1f MB/s, %.1f ns per record\n", records / seconds / 1e6,
+         SD.written / seconds / 1e6, seconds * 1e9 / records);
+  printf("read back %u records, %u dropped, %u bad\n", found, session_log.dropped, bad);
+
+  snprintf(path, sizeof(path), "%s/LOG000.BIN", directory);
+  unlink(path);
+  rmdir(directory);
+
+  bool ok = (bad == 0) && (found == records) && (session_log.dropped == 0) && (log_blocks == session_log.blocks);
+  printf("%s\n", ok ? "ok" : "FAILED");
+
+  return ok ? 0 : 1;
+}
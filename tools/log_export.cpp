@@ -0,0 +1,562 @@
+/*
+ Session log exporter
+ by:
+ date:
+ license:
+
+ Turns the LOGnnn.BIN files SD_Log writes into CSV or per-channel column
+ files on a Linux host. The log is memory mapped and cut into chunks of
+ EXPORT_CHUNK_BLOCKS 512 byte blocks, which the threads take from a queue
+ in file order; every block carries its own time base, so each chunk is
+ decoded without looking at the others. The main thread writes each chunk
+ out as soon as it and the ones before it are done and frees it, and the
+ threads stay at most EXPORT_IN_FLIGHT chunks per thread ahead of it, so
+ memory stays bounded however long the log. Values are scaled with the
+ same PID and DID dictionaries the firmware uses. The flight recorder's
+ Series_Codec blocks come out a channel at a time, so the CSV of a
+ compressed window is in time order per channel only.
+
+ Build from the repository root:
+   g++ -std=c++11 -O2 -pthread -Itools/host -I. -o log_export \
+       tools/log_export.cpp tools/host/Arduino.cpp \
+       WWH_OBD.cpp Ford_OBD.cpp OBD_Sample.cpp SD_Log.cpp Series_Codec.cpp
+
+ Usage:
+   log_export [-j threads] [-c directory] [-o file.csv] LOG000.BIN ...
+
+ Without -c the records go to CSV, timestamp_ms,channel,raw,value. With -c
+ every channel gets <directory>/<channel>.ts and <channel>.val, uint32_t
+ timestamps and int32_t values in implied decimals, listed with their
+ unit and decimals in <directory>/channels.csv. Several logs each get a
+ subdirectory named after the log.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Arduino.h"
+#include "WWH_OBD.h"
+#include "Ford_OBD.h"
+#include "OBD_Sample.h"
+#include "SD_Log.h"
+#include "Series_Codec.h"
+
+#define EXPORT_CHUNK_BLOCKS 2048 // 1 MB of log a chunk
+#define EXPORT_IN_FLIGHT    2    // chunks per thread decoded ahead of the writer
+#define EXPORT_SERIES_MAX   (SD_LOG_SERIES_SIZE * 4) // samples in a series block, two bits each at least
+
+// Scaling of one channel, resolved once before decoding
+struct Scaling
+{
+  WWH_OBD_PID field;
+  bool known;
+};
+
+struct Column
+{
+  std::vector<uint32_t> timestamps;
+  std::vector<int32_t> values;
+};
+
+// What a thread makes of one range of blocks
+struct Chunk
+{
+  size_t first;
+  size_t last;
+  std::string csv;
+  std::map<uint16_t, Column> columns;
+  uint64_t records;
+  uint64_t bad_blocks;
+  uint64_t gaps;
+  uint32_t first_sequence;
+  uint32_t last_sequence;
+  bool any;
+  bool done;
+};
+
+// One log on its way out: the chunks, the next one for a thread to take
+// and the ones written so far
+struct Export
+{
+  const SD_Log_Block* blocks;
+  std::vector<Chunk> chunks;
+  size_t next;
+  size_t written;
+  size_t in_flight;
+  bool csv;
+  std::mutex lock;
+  std::condition_variable changed;
+};
+
+static std::vector<Scaling> scaling(0x10000);
+
+/*
+ Channels below 0x100 are Service $01 PIDs, the rest Ford DIDs and the
+ broadcast signals reported under them.
+*/
+static void resolveScaling()
+{
+  for (uint32_t channel = 0; channel < 0x10000; channel++)
+  {
+    Scaling* entry = &scaling[channel];
+    Ford_OBD_DID did;
+
+    entry->known = false;
+
+    if (channel < 0x100)
+    {
+      entry->known = WWH_OBD::lookupPID(channel, &entry->field) &&
+                     !(entry->field.flags & PID_FLAG_NONE);
+    }
+    else if (Ford_OBD::lookupDID(channel, &did))
+    {
+      entry->field = did.field;
+      entry->known = true;
+    }
+  }
+}
+
+/*
+ Scaled value of a record in implied decimals, raw if the channel is
+ unknown or bit mapped.
+*/
+static int32_t scaleRecord(uint16_t channel, int32_t raw, byte* decimals)
+{
+  const Scaling* entry = &scaling[channel];
+
+  *decimals = 0;
+
+  if ((entry->known == false) || (entry->field.flags & PID_FLAG_HEX))
+  {
+    return raw;
+  }
+
+  *decimals = entry->field.flags & PID_FLAG_DECIMALS;
+
+  return WWH_OBD::scalePID(&entry->field, raw);
+}
+
+/*
+ One record into the chunk's CSV or columns.
+*/
+static void addRecord(Chunk* chunk, bool csv, uint32_t timestamp, uint16_t channel, int32_t raw)
+{
+  char line[64];
+  char value_text[16];
+  byte decimals;
+  int32_t value = scaleRecord(channel, raw, &decimals);
+
+  if (csv)
+  {
+    formatFixed(value, decimals, value_text);
+    snprintf(line, sizeof(line), "%u,0x%04X,%d,%s\n", (unsigned)timestamp, channel, (int)raw, value_text);
+    chunk->csv += line;
+  }
+  else
+  {
+    Column* column = &chunk->columns[channel];
+
+    column->timestamps.push_back(timestamp);
+    column->values.push_back(value);
+  }
+}
+
+/*
+ The samples of a Series_Codec block. Returns false if it is not one.
+*/
+static bool decodeSeries(const SD_Log_Block* block, Chunk* chunk, bool csv)
+{
+  Series_Decoder decoder;
+  uint32_t timestamps[EXPORT_SERIES_MAX];
+  int32_t values[EXPORT_SERIES_MAX];
+
+  if (decoder.begin((const byte*)block->records, SD_LOG_SERIES_SIZE) == false)
+  {
+    return false;
+  }
+
+  uint16_t count = decoder.decode(timestamps, values, EXPORT_SERIES_MAX);
+
+  for (uint16_t i = 0; i < count; i++)
+  {
+    addRecord(chunk, csv, timestamps[i], decoder.channel(), values[i]);
+  }
+  chunk->records += count;
+
+  return true;
+}
+
+/*
+
+*/
+static void decodeChunk(const SD_Log_Block* blocks, Chunk* chunk, bool csv)
+{
+  chunk->records = 0;
+  chunk->bad_blocks = 0;
+  chunk->gaps = 0;
+  chunk->any = false;
+
+  if (csv)
+  {
+    chunk->csv.reserve((chunk->last - chunk->first) * SD_LOG_RECORDS * 24);
+  }
+
+  for (size_t i = chunk->first; i < chunk->last; i++)
+  {
+    const SD_Log_Block* block = &blocks[i];
+    uint32_t timestamp = block->header.timestamp;
+
+    // The zeroed sectors the sketch grows the file by, not yet written
+    if (block->header.magic == 0)
+    {
+      continue;
+    }
+    if (SD_Log::valid(block) == false)
+    {
+      chunk->bad_blocks++;
+      continue;
+    }
+
+    if (chunk->any == false)
+    {
+      chunk->first_sequence = block->header.sequence;
+      chunk->any = true;
+    }
+    else if (block->header.sequence != chunk->last_sequence + 1)
+    {
+      chunk->gaps++;
+    }
+    chunk->last_sequence = block->header.sequence;
+
+    if (block->header.kind == SD_LOG_KIND_SERIES)
+    {
+      if (decodeSeries(block, chunk, csv) == false)
+      {
+        chunk->bad_blocks++;
+      }
+      continue;
+    }
+
+    for (byte r = 0; r < block->header.count; r++)
+    {
+      timestamp += SD_Log::delta(block, r);
+      addRecord(chunk, csv, timestamp, block->records[r].channel, block->records[r].raw);
+    }
+
+    chunk->records += block->header.count;
+  }
+}
+
+/*
+ A thread: take the next chunk while the writer is not too far behind,
+ decode it and hand it back.
+*/
+static void exportWorker(Export* job)
+{
+  for (;;)
+  {
+    size_t c;
+
+    {
+      std::unique_lock<std::mutex> guard(job->lock);
+
+      while ((job->next < job->chunks.size()) && (job->next >= job->written + job->in_flight))
+      {
+        job->changed.wait(guard);
+      }
+      if (job->next >= job->chunks.size())
+      {
+        return;
+      }
+      c = job->next++;
+    }
+
+    decodeChunk(job->blocks, &job->chunks[c], job->csv);
+
+    std::lock_guard<std::mutex> guard(job->lock);
+    job->chunks[c].done = true;
+    job->changed.notify_all();
+  }
+}
+
+/*
+
+*/
+static bool writeFile(const std::string& path, const void* data, size_t length, const char* mode)
+{
+  FILE* file = fopen(path.c_str(), mode);
+
+  if (file == 0)
+  {
+    fprintf(stderr, "%s: %s\n", path.c_str(), strerror(errno));
+    return false;
+  }
+
+  fwrite(data, 1, length, file);
+  fclose(file);
+
+  return true;
+}
+
+/*
+ Append a chunk's columns to their files in directory, the first time a
+ channel is seen replacing any file of an earlier export. counts keeps
+ the records of every channel written so far.
+*/
+static bool appendColumns(const std::string& directory, Chunk* chunk, std::map<uint16_t, uint64_t>* counts)
+{
+  for (std::map<uint16_t, Column>::iterator it = chunk->columns.begin(); it != chunk->columns.end(); ++it)
+  {
+    const char* mode = counts->count(it->first) ? "ab" : "wb";
+    char name[32];
+
+    snprintf(name, sizeof(name), "/%04X", it->first);
+    if (!writeFile(directory + name + ".ts", it->second.timestamps.data(),
+                   it->second.timestamps.size() * sizeof(uint32_t), mode) ||
+        !writeFile(directory + name + ".val", it->second.values.data(),
+                   it->second.values.size() * sizeof(int32_t), mode))
+    {
+      return false;
+    }
+    (*counts)[it->first] += it->second.values.size();
+  }
+
+  return true;
+}
+
+/*
+ channels.csv, once every chunk is written.
+*/
+static bool writeIndex(const std::string& directory, const std::map<uint16_t, uint64_t>& counts)
+{
+  std::string index = "channel,unit,decimals,count\n";
+
+  for (std::map<uint16_t, uint64_t>::const_iterator it = counts.begin(); it != counts.end(); ++it)
+  {
+    char line[48];
+    byte decimals = 0;
+
+    scaleRecord(it->first, 0, &decimals);
+    snprintf(line, sizeof(line), "0x%04X,%u,%u,%llu\n", it->first,
+             scaling[it->first].known ? scaling[it->first].field.unit : OBD_UNIT_NONE,
+             decimals, (unsigned long long)it->second);
+    index += line;
+  }
+
+  return writeFile(directory + "/channels.csv", index.data(), index.size(), "w");
+}
+
+/*
+
+*/
+static void usage()
+{
+  fprintf(stderr, "usage: log_export [-j threads] [-c directory] [-o file.csv] LOG000.BIN ...\n");
+}
+
+/*
+
+*/
+int main(int argc, char* argv[])
+{
+  unsigned threads = std::thread::hardware_concurrency();
+  const char* columns = 0;
+  FILE* csv = stdout;
+  int option;
+
+  while ((option = getopt(argc, argv, "j:c:o:")) != -1)
+  {
+    switch (option)
+    {
+      case 'j':
+        threads = atoi(optarg);
+        break;
+      case 'c':
+        columns = optarg;
+        break;
+      case 'o':
+        csv = fopen(optarg, "w");
+        if (csv == 0)
+        {
+          fprintf(stderr, "%s: %s\n", optarg, strerror(errno));
+          return 1;
+        }
+        break;
+      default:
+        usage();
+        return 1;
+    }
+  }
+
+  if (optind >= argc)
+  {
+    usage();
+    return 1;
+  }
+  if (threads == 0)
+  {
+    threads = 1;
+  }
+
+  resolveScaling();
+
+  if (columns == 0)
+  {
+    fputs("timestamp_ms,channel,raw,value\n", csv);
+  }
+
+  for (int arg = optind; arg < argc; arg++)
+  {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    struct stat info;
+    int fd = open(argv[arg], O_RDONLY);
+
+    if ((fd < 0) || (fstat(fd, &info) != 0))
+    {
+      fprintf(stderr, "%s: %s\n", argv[arg], strerror(errno));
+      return 1;
+    }
+
+    // A torn last block is simply left out
+    size_t count = info.st_size / SD_LOG_BLOCK_SIZE;
+    if (count == 0)
+    {
+      close(fd);
+      continue;
+    }
+
+    void* map = mmap(0, count * SD_LOG_BLOCK_SIZE, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+      fprintf(stderr, "%s: %s\n", argv[arg], strerror(errno));
+      return 1;
+    }
+    madvise(map, count * SD_LOG_BLOCK_SIZE, MADV_SEQUENTIAL);
+
+    std::string directory;
+    std::map<uint16_t, uint64_t> counts;
+
+    if (columns != 0)
+    {
+      directory = columns;
+      if (argc - optind > 1)
+      {
+        std::string name = argv[arg];
+
+        mkdir(columns, 0755);
+        name = name.substr(name.find_last_of('/') + 1);
+        directory += "/" + name.substr(0, name.find_last_of('.'));
+      }
+      mkdir(directory.c_str(), 0755);
+    }
+
+    Export job;
+    size_t chunks = (count + EXPORT_CHUNK_BLOCKS - 1) / EXPORT_CHUNK_BLOCKS;
+    unsigned used = (chunks < threads) ? chunks : threads;
+    std::vector<std::thread> workers;
+
+    job.blocks = (const SD_Log_Block*)map;
+    job.chunks.resize(chunks);
+    job.next = 0;
+    job.written = 0;
+    job.in_flight = used * EXPORT_IN_FLIGHT;
+    job.csv = (columns == 0);
+    for (size_t c = 0; c < chunks; c++)
+    {
+      job.chunks[c].first = c * EXPORT_CHUNK_BLOCKS;
+      job.chunks[c].last = (c + 1 < chunks) ? (c + 1) * EXPORT_CHUNK_BLOCKS : count;
+      job.chunks[c].done = false;
+    }
+    for (unsigned t = 0; t < used; t++)
+    {
+      workers.push_back(std::thread(exportWorker, &job));
+    }
+
+    uint64_t records = 0;
+    uint64_t bad_blocks = 0;
+    uint64_t gaps = 0;
+    bool any = false;
+    uint32_t sequence = 0;
+    bool failed = false;
+
+    for (size_t c = 0; c < chunks; c++)
+    {
+      Chunk* chunk = &job.chunks[c];
+
+      {
+        std::unique_lock<std::mutex> guard(job.lock);
+
+        while (chunk->done == false)
+        {
+          job.changed.wait(guard);
+        }
+      }
+
+      records += chunk->records;
+      bad_blocks += chunk->bad_blocks;
+      gaps += chunk->gaps;
+      if (chunk->any)
+      {
+        if (any && (chunk->first_sequence != sequence + 1))
+        {
+          gaps++;
+        }
+        sequence = chunk->last_sequence;
+        any = true;
+      }
+
+      // Written as soon as the chunk is done, in file order, and freed
+      if (columns == 0)
+      {
+        fwrite(chunk->csv.data(), 1, chunk->csv.size(), csv);
+        std::string().swap(chunk->csv);
+      }
+      else if ((failed == false) && (appendColumns(directory, chunk, &counts) == false))
+      {
+        failed = true;
+      }
+      std::map<uint16_t, Column>().swap(chunk->columns);
+
+      std::lock_guard<std::mutex> guard(job.lock);
+      job.written = c + 1;
+      job.changed.notify_all();
+    }
+
+    for (unsigned t = 0; t < used; t++)
+    {
+      workers[t].join();
+    }
+
+    if ((columns != 0) && (failed || (writeIndex(directory, counts) == false)))
+    {
+      return 1;
+    }
+
+    munmap(map, count * SD_LOG_BLOCK_SIZE);
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    fprintf(stderr, "%s: %zu blocks, %llu records, %llu bad blocks, %llu gaps, %u threads, %.1f MB/s\n",
+            argv[arg], count, (unsigned long long)records, (unsigned long long)bad_blocks,
+            (unsigned long long)gaps, used, (count * SD_LOG_BLOCK_SIZE) / seconds / 1e6);
+  }
+
+  if (csv != stdout)
+  {
+    fclose(csv);
+  }
+
+  return 0;
+}
@@ -0,0 +1,361 @@
+/*
+ The sketch's loop() on the host, one display mode at a time
+ by:
+ date:
+ license:
+
+ Builds arducross.ino itself against the tools/host stand-ins and runs
+ setup() and loop() as the board would, with millis() on the host clock.
+ The vehicle behind CANbus0 is ECU_Sim answering the requests, plus the
+ broadcast messages of the CAN_Signal table every BROADCAST_PERIOD. The
+ LCD shield's MCP23017 is simulated on Wire so the modes are entered with
+ button presses, INTA and all, the way pollButtons() sees them, and the
+ log goes to a temporary directory standing in for the card.
+
+ Once the supported PIDs are discovered every mode runs for the set time
+ and prints one CSV line: passes, ns per loop() pass and TSC cycles on
+ x86 as tools/bench does, then the slowest pass and the replies per
+ second the engine matched. The timing covers everything one pass does,
+ the LCD stand-in's bookkeeping included, but not the I2C time a real
+ shield would spend, which tools/lcd_traffic reports.
+
+ The SAM3X8E build is the default. ARDUINO_ARCH_AVR builds the Uno's
+ instead, where the MCP2515's INT pin runs canReceive() as soon as a frame
+ is waiting.
+
+ Build from the repository root with CMake, the loop_bench and
+ loop_bench_avr targets, as it needs every module and host stand-in.
+
+ Usage:
+   loop_bench [-s seconds] [-v]   -v echoes the sketch's serial output to stderr
+ */
+
+#include "arducross.ino"
+
+#include <chrono>
+#include <stdlib.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_CYCLES() __rdtsc()
+#else
+#define BENCH_CYCLES() 0
+#endif
+
+#define BROADCAST_PERIOD 10   // milliseconds between broadcasts of each message
+#define PRESS_MS         100  // a button is held this long, and released as long
+#define DISCOVERY_MS     5000 // longest the supported PID discovery may take
+
+/*
+ ECU_Sim and the broadcasting modules on one bus.
+*/
+class Vehicle : public CANClass_Device
+{
+  public:
+    Vehicle()
+    {
+      next_broadcast = 0;
+      pending = 0;
+    }
+
+    void receive(uint32_t id, uint8_t length, const uint8_t* data)
+    {
+      OBD_Frame frame;
+
+      frame.id = id;
+      frame.timestamp = millis();
+      frame.length = length;
+      frame.bus = 0;
+      memcpy(frame.data, data, length);
+      sim.receive(&frame, frame.timestamp);
+    }
+
+    bool transmit(uint32_t* id, uint8_t* length, uint8_t* data)
+    {
+      uint32_t now = millis();
+      OBD_Frame frame;
+
+      if (sim.transmit(now, &frame))
+      {
+        *id = frame.id;
+        *length = frame.length;
+        memcpy(data, frame.data, 8);
+        return true;
+      }
+
+      // Every message of the signal table once per period
+      if ((pending == 0) && ((int32_t)(now - next_broadcast) >= 0))
+      {
+        pending = signals.messages();
+        next_broadcast = now + BROADCAST_PERIOD;
+      }
+      if (pending == 0)
+      {
+        return false;
+      }
+
+      pending--;
+      *id = signals.message(pending);
+      *length = 8;
+      for (byte i = 0; i < 8; i++)
+      {
+        data[i] = (now >> (i & 3)) + i;
+      }
+      return true;
+    }
+
+    ECU_Sim sim;
+
+  private:
+    uint32_t next_broadcast;
+    byte pending;
+};
+
+/*
+ The shield's MCP23017 as far as the buttons go: GPIOA reads back the
+ buttons held, pulled low, and reading it releases INTA.
+*/
+class Expander : public TwoWire_Device
+{
+  public:
+    Expander()
+    {
+      memset(registers, 0, sizeof(registers));
+      pointer = 0;
+      held = 0;
+    }
+
+    void receive(const uint8_t* data, uint8_t length)
+    {
+      if (length == 0)
+      {
+        return;
+      }
+      pointer = data[0];
+      for (uint8_t i = 1; i < length; i++)
+      {
+        registers[(pointer + i - 1) & 0x1F] = data[i];
+      }
+    }
+
+    uint8_t transmit()
+    {
+      uint8_t value = registers[pointer & 0x1F];
+
+      if (pointer == MCP23017_GPIOA)
+      {
+        value = ~held;
+        pinLevel(BUTTON_INT_PIN, HIGH);
+      }
+      pointer++;
+
+      return value;
+    }
+
+    // A change on an enabled pin pulls INTA low
+    void set(uint8_t buttons)
+    {
+      held = buttons;
+      if (registers[MCP23017_GPINTENA] & UI_BUTTONS_MASK)
+      {
+        pinLevel(BUTTON_INT_PIN, LOW);
+      }
+    }
+
+  private:
+    uint8_t registers[0x20];
+    uint8_t pointer;
+    uint8_t held;
+};
+
+static Vehicle vehicle;
+static Expander expander;
+static uint64_t worst_ns;
+
+/*
+ One loop() pass, with the MCP2515's INT on the Uno.
+*/
+static uint64_t pass()
+{
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+#if defined(ARDUINO_ARCH_AVR)
+  if (CANbus0.available())
+  {
+    pinLevel(CAN_INT_PIN, LOW);
+    pinLevel(CAN_INT_PIN, HIGH);
+  }
+#endif
+  loop();
+
+  uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+  if (ns > worst_ns)
+  {
+    worst_ns = ns;
+  }
+
+  return ns;
+}
+
+/*
+ Keep the loop running for ms.
+*/
+static void run(uint32_t ms)
+{
+  uint32_t start = millis();
+
+  while (millis() - start < ms)
+  {
+    pass();
+  }
+}
+
+/*
+
+*/
+static void press(byte button)
+{
+  expander.set(button);
+  run(PRESS_MS);
+  expander.set(0);
+  run(PRESS_MS);
+}
+
+/*
+ Run mode for seconds from the menu, then go back to it.
+*/
+static bool measure(const char* name, byte enter, byte leave, byte mode, uint32_t seconds)
+{
+  uint32_t iterations = 0;
+  uint32_t responses;
+  uint32_t sent;
+  uint64_t ns = 0;
+  uint64_t cycles;
+  uint32_t start;
+
+  if (enter != 0)
+  {
+    press(enter);
+  }
+  if (ui.state() != mode)
+  {
+    fprintf(stderr, "%s: mode %s not entered\n", name, UI_Mode::name(mode));
+    return false;
+  }
+
+  worst_ns = 0;
+  responses = engine.responses;
+  sent = CANbus0.sent;
+  cycles = BENCH_CYCLES();
+  start = millis();
+  while (millis() - start < seconds * 1000)
+  {
+    ns += pass();
+    iterations++;
+  }
+  cycles = BENCH_CYCLES() - cycles;
+
+  printf("loop %s,%u,%.1f,%.1f,%.1f,%.1f\n", name, iterations, (double)ns / iterations,
+         (double)cycles / iterations, worst_ns / 1000.0, (double)(engine.responses - responses) / seconds);
+
+  // The modes that poll have to be answered
+  bool answered = (engine.responses != responses) || (mode == UI_MENU) || (mode == UI_LISTEN);
+
+  // and listening sends nothing, the controller is listen-only
+  bool quiet = (mode != UI_LISTEN) || ((CANbus0.sent == sent) && (CANbus0.listening == true));
+
+  if (leave != 0)
+  {
+    press(leave);
+  }
+
+  return answered && quiet && (ui.state() == UI_MENU) && (CANbus0.listening == false);
+}
+
+/*
+
+*/
+int main(int argc, char* argv[])
+{
+  char directory[] = "/tmp/loop_bench.XXXXXX";
+  uint32_t seconds = 1;
+  bool ok = true;
+  int option;
+
+  Serial.echo = 0;
+  while ((option = getopt(argc, argv, "s:v")) != -1)
+  {
+    switch (option)
+    {
+      case 's':
+        seconds = atoi(optarg);
+        break;
+      case 'v':
+        Serial.echo = stderr;
+        break;
+      default:
+        fprintf(stderr, "usage: loop_bench [-s seconds] [-v]\n");
+        return 2;
+    }
+  }
+  if (seconds == 0)
+  {
+    seconds = 1;
+  }
+
+  if (mkdtemp(directory) != 0)
+  {
+    SD.mount(directory);
+  }
+  CANbus0.attach(&vehicle);
+  Wire.attach(MCP23017_ADDRESS_BASE, &expander);
+
+  setup();
+
+  uint32_t start = millis();
+  while ((supported_pids.ready() == false) && (millis() - start < DISCOVERY_MS))
+  {
+    pass();
+  }
+  printf("# %s build, supported PIDs %s after %lu ms, logging %s\n",
+#if defined(ARDUINO_ARCH_AVR)
+         "AVR",
+#else
+         "SAM3X8E",
+#endif
+         supported_pids.ready() ? "ready" : "NOT ready", millis() - start, logging ? "on" : "off");
+
+  printf("benchmark,iterations,ns_per_op,cycles_per_op,worst_us,replies_per_s\n");
+  ok &= supported_pids.ready();
+  ok &= measure("menu", 0, 0, UI_MENU, seconds);
+  ok &= measure("dashboard", BUTTON_DOWN, BUTTON_UP, UI_DASH, seconds);
+  ok &= measure("vehicle info", BUTTON_UP, BUTTON_DOWN, UI_INFO, seconds);
+  ok &= measure("ford", BUTTON_LEFT, BUTTON_RIGHT, UI_FORD, seconds);
+  ok &= measure("listen", BUTTON_RIGHT, BUTTON_UP, UI_LISTEN, seconds);
+
+  if (logging)
+  {
+    log_file.close();
+    printf("# %u blocks, %u records dropped, %llu bytes logged in %u flushes\n", session_log.blocks,
+           session_log.dropped, (unsigned long long)SD.written, SD.flushes);
+  }
+  if (SD.begin(chipSelect))
+  {
+    char path[64];
+
+    for (uint16_t i = 0; i < 1000; i++)
+    {
+      snprintf(path, sizeof(path), "%s/LOG%03u.BIN", directory, i);
+      if (unlink(path) != 0)
+      {
+        break;
+      }
+    }
+    rmdir(directory);
+  }
+
+  printf("%s\n", ok ? "ok" : "FAILED");
+
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,270 @@
+/*
+ NMEA parser throughput and accuracy on recorded sentences
+ by:
+ date:
+ license:
+
+ Feeds a recorded NMEA log through NMEA_Parser one character at a time,
+ as pollGPS() does, and reports characters per second, the time per
+ character and the checksum errors. Every accepted RMC is checked against
+ the same sentence parsed with strtod(), so any fixed-point rounding shows
+ as the worst position error. The run fails if that is over
+ POSITION_TOLERANCE or the speed is off by more than SPEED_TOLERANCE.
+
+ Without a file a 10 Hz drive is generated: RMC and GGA each epoch, a GSV
+ now and then that the parser has to skip, and every 97th sentence with a
+ damaged character that the checksum has to catch.
+
+ Build from the repository root:
+   g++ -std=c++11 -O2 -Itools/host -I. -o nmea_bench tools/nmea_bench.cpp \
+       tools/host/Arduino.cpp tools/host/Print.cpp NMEA_Parser.cpp
+
+ Usage:
+   nmea_bench [-r repeat] [file.nmea]
+ */
+
+#include <unistd.h>
+#include <math.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "Arduino.h"
+#include "NMEA_Parser.h"
+
+#define GPS_BAUD 38400 // as in the sketch
+
+#define POSITION_TOLERANCE 1e-6 // degrees, 11 cm of latitude
+#define SPEED_TOLERANCE    0.01 // m/s
+
+struct Reference
+{
+  double latitude;
+  double longitude;
+  double knots;
+  bool present;
+};
+
+/*
+ Append $body*checksum\r\n, damaging one character after the checksum
+ was taken if asked to.
+*/
+static void appendSentence(std::string* log, const char* body, bool damage)
+{
+  char sentence[176];
+
+  snprintf(sentence, sizeof(sentence), "$%s*%02X\r\n", body, NMEA_Parser::checksum(body));
+  if (damage)
+  {
+    sentence[10] ^= 0x01;
+  }
+  *log += sentence;
+}
+
+/*
+ Ten minutes of a drive at 10 Hz around a circuit near 52.5 N, 13.4 W.
+*/
+static std::string generateLog()
+{
+  std::string log;
+  char body[160];
+  unsigned sentence = 0;
+
+  for (unsigned epoch = 0; epoch < 6000; epoch++)
+  {
+    double t = epoch / 10.0;
+    double angle = t / 90.0 * 2 * M_PI;
+    double latitude = 52.5 + 0.004 * sin(angle);
+    double longitude = -13.4 - 0.006 * cos(angle);
+    double knots = 60 + 25 * sin(angle * 3);
+    double course = fmod(angle * 180 / M_PI + 90, 360);
+    unsigned seconds = 12 * 3600 + 30 * 60 + epoch / 10;
+    char lat_text[40];
+    char lon_text[40];
+    char time_text[16];
+
+    snprintf(time_text, sizeof(time_text), "%02u%02u%02u.%03u", seconds / 3600, seconds / 60 % 60, seconds % 60,
+             (epoch % 10) * 100);
+    snprintf(lat_text, sizeof(lat_text), "%02d%08.5f,%c", (int)fabs(latitude),
+             (fabs(latitude) - (int)fabs(latitude)) * 60, (latitude < 0) ? 'S' : 'N');
+    snprintf(lon_text, sizeof(lon_text), "%03d%08.5f,%c", (int)fabs(longitude),
+             (fabs(longitude) - (int)fabs(longitude)) * 60, (longitude < 0) ? 'W' : 'E');
+
+    snprintf(body, sizeof(body), "GPGGA,%s,%s,%s,1,09,0.92,%.1f,M,47.0,M,,", time_text, lat_text, lon_text,
+             34.0 + 3 * sin(angle));
+    appendSentence(&log, body, (++sentence % 97) == 0);
+
+    snprintf(body, sizeof(body), "GPRMC,%s,A,%s,%s,%.2f,%.2f,170326,,,A", time_text, lat_text, lon_text, knots,
+             course);
+    appendSentence(&log, body, (++sentence % 97) == 0);
+
+    if ((epoch % 10) == 0)
+    {
+      appendSentence(&log, "GPGSV,3,1,11,10,63,137,17,07,61,098,15,05,59,290,20,08,54,157,30", false);
+    }
+  }
+
+  return log;
+}
+
+/*
+ Position and speed of an RMC sentence with a good checksum, parsed in
+ floating point.
+*/
+static Reference referenceRMC(const char* sentence, size_t length)
+{
+  Reference reference = {0, 0, 0, false};
+  std::string text(sentence, length);
+  std::vector<std::string> fields;
+  size_t star = text.find('*');
+  size_t begin = 1;
+
+  if ((text.size() < 7) || (text.compare(3, 3, "RMC") != 0) || (star == std::string::npos))
+  {
+    return reference;
+  }
+  if (strtoul(text.substr(star + 1, 2).c_str(), 0, 16) != NMEA_Parser::checksum(text.substr(1, star - 1).c_str()))
+  {
+    return reference;
+  }
+
+  for (size_t i = 1; i <= star; i++)
+  {
+    if ((text[i] == ',') || (text[i] == '*'))
+    {
+      fields.push_back(text.substr(begin, i - begin));
+      begin = i + 1;
+    }
+  }
+  if ((fields.size() < 8) || fields[3].empty() || fields[5].empty())
+  {
+    return reference;
+  }
+
+  double latitude = strtod(fields[3].c_str(), 0);
+  double longitude = strtod(fields[5].c_str(), 0);
+
+  reference.latitude = floor(latitude / 100) + fmod(latitude, 100) / 60;
+  reference.longitude = floor(longitude / 100) + fmod(longitude, 100) / 60;
+  reference.latitude *= (fields[4] == "S") ? -1 : 1;
+  reference.longitude *= (fields[6] == "W") ? -1 : 1;
+  reference.knots = strtod(fields[7].c_str(), 0);
+  reference.present = true;
+
+  return reference;
+}
+
+/*
+
+*/
+static bool readFile(const char* name, std::string* log)
+{
+  FILE* file = fopen(name, "rb");
+  char chunk[4096];
+  size_t length;
+
+  if (file == 0)
+  {
+    return false;
+  }
+  while ((length = fread(chunk, 1, sizeof(chunk), file)) > 0)
+  {
+    log->append(chunk, length);
+  }
+  fclose(file);
+
+  return true;
+}
+
+/*
+
+*/
+int main(int argc, char* argv[])
+{
+  unsigned repeat = 20;
+  std::string log;
+  int option;
+
+  while ((option = getopt(argc, argv, "r:")) != -1)
+  {
+    switch (option)
+    {
+      case 'r':
+        repeat = atoi(optarg);
+        break;
+      default:
+        fprintf(stderr, "usage: %s [-r repeat] [file.nmea]\n", argv[0]);
+        return 1;
+    }
+  }
+
+  if (optind < argc)
+  {
+    if (readFile(argv[optind], &log) == false)
+    {
+      fprintf(stderr, "%s: cannot read %s\n", argv[0], argv[optind]);
+      return 1;
+    }
+  }
+  else
+  {
+    log = generateLog();
+  }
+
+  // Accuracy, one pass with a reference parse of each RMC
+  NMEA_Parser checked;
+  double worst_position = 0;
+  double worst_speed = 0;
+  uint32_t fixes = 0;
+  size_t sentence_start = 0;
+
+  for (size_t i = 0; i < log.size(); i++)
+  {
+    if (log[i] == '$')
+    {
+      sentence_start = i;
+    }
+    if (checked.parse(log[i], i) && checked.available())
+    {
+      const GPS_Fix* fix = checked.fix();
+      Reference reference = referenceRMC(log.data() + sentence_start, i + 1 - sentence_start);
+
+      if (reference.present)
+      {
+        worst_position = fmax(worst_position, fabs(fix->latitude / 1e7 - reference.latitude));
+        worst_position = fmax(worst_position, fabs(fix->longitude / 1e7 - reference.longitude));
+        worst_speed = fmax(worst_speed, fabs(fix->speed / 1000.0 - reference.knots * 1852 / 3600));
+        fixes++;
+      }
+    }
+  }
+
+  // Throughput
+  NMEA_Parser timed;
+  uint32_t accepted = 0;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  for (unsigned r = 0; r < repeat; r++)
+  {
+    for (size_t i = 0; i < log.size(); i++)
+    {
+      accepted += timed.parse(log[i], i);
+    }
+  }
+
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  double characters = (double)log.size() * repeat;
+
+  printf("%zu characters, %u sentences accepted, %u checksum errors\n", log.size(), checked.sentences,
+         checked.checksum_errors);
+  printf("%u RMC fixes checked, worst position error %.2e deg (%.1f mm), worst speed error %.4f m/s\n",
+         fixes, worst_position, worst_position * 111.32e6, worst_speed);
+  printf("%.1f M characters/s, %.2f ns/character, %.0fx the %u baud line rate (%u sentences)\n",
+         characters / seconds / 1e6, seconds / characters * 1e9, characters / seconds / (GPS_BAUD / 10),
+         (unsigned)GPS_BAUD, accepted);
+
+  bool ok = (fixes > 0) && (worst_position <= POSITION_TOLERANCE) && (worst_speed <= SPEED_TOLERANCE);
+  printf("%s\n", ok ? "ok" : "FAILED");
+
+  return ok ? 0 : 1;
+}
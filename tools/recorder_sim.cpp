@@ -0,0 +1,355 @@
+/*
+ Flight recorder capture on a simulated run
+ by:
+ date:
+ license:
+
+ Feeds Flight_Recorder the records of the SAM build's channel set at
+ their full rates for a minute: the IMU in 50 ms batches stamped with
+ when each sample was taken, the GPS a fix behind, the dashboard PIDs and
+ the derived channels as they come. A simulated card takes one block at
+ a time and is busy a few milliseconds per block, with a long stall
+ every few seconds, so the drain has to keep up around it.
+
+ Combined g crosses the threshold trigger twice and the button is
+ pressed twice, once while a window is still draining. Every record
+ carries a value that identifies it, so the log written is checked for
+ every record within RECORDER_PRE before to RECORDER_POST after each
+ trigger, for duplicates and for the CRC and sequence of every block.
+ The report gives the seconds the ring holds, the share of records that
+ reached the card and the cost of append().
+
+ With -s the window goes to the card through compress() as the sketch
+ does, in Series_Codec blocks that are decoded back for the same checks.
+
+ Build from the repository root:
+   g++ -std=c++11 -O2 -Itools/host -I. -o recorder_sim tools/recorder_sim.cpp \
+       tools/host/Arduino.cpp SD_Log.cpp Flight_Recorder.cpp Series_Codec.cpp
+
+ Usage:
+   recorder_sim [-s]
+ */
+
+#include <chrono>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include <unistd.h>
+
+#include "Arduino.h"
+#include "SD_Log.h"
+#include "Flight_Recorder.h"
+#include "Series_Codec.h"
+
+#define RECORDER_RECORDS 8192
+#define RECORDER_PRE     3000
+#define RECORDER_POST    2000
+#define SIM_SECONDS      60
+#define G_CHANNEL        0xFF32
+#define G_LEVEL          1000
+#define SERIES_SAMPLES   (SD_LOG_SERIES_SIZE * 4) // a sample takes two bits at least
+
+typedef struct
+{
+  uint16_t channel; // first of count channels
+  byte count;
+  uint32_t period;  // microseconds between samples
+  uint16_t read;    // milliseconds between reads, 0 as soon as taken
+  uint16_t late;    // milliseconds a sample is read after it was taken
+} Stream;
+
+// The SAM build with every sensor, GPS and the dashboard screen polling
+static const Stream streams[] = {
+  {0xFF10, 3, 5000, 50, 0},   // accelerometer
+  {0xFF13, 3, 5263, 50, 0},   // gyro
+  {0xFF16, 3, 34000, 0, 0},   // magnetometer
+  {0xFF32, 2, 5000, 50, 0},   // combined and peak g, with the accelerometer
+  {0xFF00, 4, 100000, 0, 60}, // GPS fix
+  {0xFF23, 1, 100000, 0, 60}, // lap delta
+  {0x5A, 1, 50000, 0, 0},     // dashboard PIDs
+  {0x45, 1, 50000, 0, 0},
+  {0x0C, 1, 20000, 0, 0},
+  {0x04, 1, 100000, 0, 0},
+  {0x0D, 1, 100000, 0, 0},
+  {0x01, 1, 1000000, 0, 0},
+  {0xFF30, 1, 16667, 0, 0},   // gear, with RPM and speed
+  {0xFF34, 1, 100000, 0, 0},  // RPM rate
+  {0xFF35, 1, 100000, 0, 0}   // response
+};
+
+#define STREAMS (sizeof(streams) / sizeof(streams[0]))
+
+static const Recorder_Trigger triggers[] PROGMEM = {
+  {G_CHANNEL, RECORDER_ABOVE, G_LEVEL}
+};
+
+// Milliseconds combined g is above the level, and button presses
+static const uint32_t g_events[][2] = {{8000, 9500}, {25000, 25400}};
+static const uint32_t presses[] = {9000, 40000};
+
+static SD_Log_Record ring[RECORDER_RECORDS];
+static Flight_Recorder recorder;
+static SD_Log session_log;
+
+typedef std::pair<uint32_t, uint32_t> Key; // channel, timestamp
+
+/*
+ Combined g at a time, the value that sets off the trigger.
+*/
+static int32_t gAt(uint32_t time)
+{
+  for (size_t i = 0; i < sizeof(g_events) / sizeof(g_events[0]); i++)
+  {
+    if ((time >= g_events[i][0]) && (time < g_events[i][1]))
+    {
+      return G_LEVEL + 300;
+    }
+  }
+
+  return 400;
+}
+
+/*
+
+*/
+static double appendCost()
+{
+  Flight_Recorder bench;
+  uint32_t iterations = 10000000;
+
+  bench.begin(ring, RECORDER_RECORDS, RECORDER_PRE, RECORDER_POST);
+  bench.watch(triggers, 1);
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < iterations; i++)
+  {
+    bench.append(0xFF10 + (i & 7), i >> 3, i);
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  return seconds * 1e9 / iterations;
+}
+
+/*
+ The records of a Series_Codec block into logged, counting the markers.
+*/
+static bool readSeries(const SD_Log_Block* block, std::multiset<Key>* logged, uint32_t* markers)
+{
+  Series_Decoder decoder;
+  uint32_t timestamps[SERIES_SAMPLES];
+  int32_t values[SERIES_SAMPLES];
+
+  if (decoder.begin((const byte*)block->records, SD_LOG_SERIES_SIZE) == false)
+  {
+    return false;
+  }
+
+  uint16_t count = decoder.decode(timestamps, values, SERIES_SAMPLES);
+
+  if ((count != decoder.count()) || (timestamps[0] != block->header.timestamp))
+  {
+    return false;
+  }
+  for (uint16_t i = 0; i < count; i++)
+  {
+    if (decoder.channel() == RECORDER_CHANNEL_TRIGGER)
+    {
+      (*markers)++;
+      continue;
+    }
+    logged->insert(Key(decoder.channel(), timestamps[i]));
+  }
+
+  return true;
+}
+
+/*
+
+*/
+int main(int argc, char* argv[])
+{
+  std::vector<uint64_t> next(STREAMS, 0);  // microseconds of each stream's next sample
+  std::vector<std::pair<uint64_t, uint32_t> > waiting[STREAMS]; // taken, not yet read
+  std::vector<uint32_t> trigger_times;
+  std::set<Key> truth_g;
+  std::vector<std::pair<Key, int32_t> > appended;
+  std::vector<SD_Log_Block> written;
+  uint32_t card_busy = 0;
+  uint32_t total = 0;
+  uint32_t span_at_trigger = 0;
+  bool g_above = false;
+  bool series = false;
+  bool ok = true;
+  int option;
+
+  while ((option = getopt(argc, argv, "s")) != -1)
+  {
+    switch (option)
+    {
+      case 's':
+        series = true;
+        break;
+      default:
+        fprintf(stderr, "usage: recorder_sim [-s]\n");
+        return 2;
+    }
+  }
+
+  recorder.begin(ring, RECORDER_RECORDS, RECORDER_PRE, RECORDER_POST);
+  recorder.watch(triggers, 1);
+  session_log.begin();
+  srand(7);
+
+  for (uint32_t now = 0; now < SIM_SECONDS * 1000; now++)
+  {
+    // Samples taken up to now, appended when their stream is read
+    for (size_t s = 0; s < STREAMS; s++)
+    {
+      while (next[s] <= (uint64_t)now * 1000)
+      {
+        waiting[s].push_back(std::make_pair(next[s], 0));
+        next[s] += streams[s].period;
+      }
+
+      bool read = (streams[s].read == 0) || ((now % streams[s].read) == 0);
+      while (read && !waiting[s].empty() && (waiting[s].front().first / 1000 + streams[s].late <= now))
+      {
+        uint32_t taken = waiting[s].front().first / 1000;
+
+        waiting[s].erase(waiting[s].begin());
+        for (byte c = 0; c < streams[s].count; c++)
+        {
+          uint16_t channel = streams[s].channel + c;
+          int32_t raw = (channel == G_CHANNEL) ? gAt(taken) : (int32_t)total;
+
+          if ((channel == G_CHANNEL) && (raw > G_LEVEL) && !g_above)
+          {
+            trigger_times.push_back(taken);
+          }
+          if (channel == G_CHANNEL)
+          {
+            g_above = raw > G_LEVEL;
+          }
+          if (recorder.append(channel, taken, raw))
+          {
+            appended.push_back(std::make_pair(Key(channel, taken), raw));
+          }
+          total++;
+        }
+      }
+    }
+
+    for (size_t i = 0; i < sizeof(presses) / sizeof(presses[0]); i++)
+    {
+      if (presses[i] == now)
+      {
+        if (span_at_trigger == 0)
+        {
+          span_at_trigger = recorder.span();
+        }
+        recorder.trigger(now, RECORDER_MANUAL);
+        trigger_times.push_back(now);
+      }
+    }
+
+    // writeLog(): drain, seal and give the card a block when it is free
+    if (series)
+    {
+      recorder.compress(&session_log, now);
+    }
+    else
+    {
+      recorder.drain(&session_log, now, SD_LOG_RECORDS);
+    }
+    session_log.poll(now);
+    if ((now >= card_busy) && (session_log.block() != 0))
+    {
+      written.push_back(*(const SD_Log_Block*)session_log.block());
+      session_log.written();
+      card_busy = now + 2 + rand() % 3 + (((rand() % 1000) == 0) ? 150 : 0);
+    }
+  }
+
+  // Read the log back as log_export does
+  std::multiset<Key> logged;
+  uint32_t markers = 0;
+
+  for (size_t b = 0; b < written.size(); b++)
+  {
+    const SD_Log_Block* block = &written[b];
+    uint32_t time = block->header.timestamp;
+
+    if (!SD_Log::valid(block) || (block->header.sequence != b))
+    {
+      printf("block %u bad or out of sequence\n", (unsigned)b);
+      ok = false;
+      continue;
+    }
+    if (block->header.kind == SD_LOG_KIND_SERIES)
+    {
+      if (readSeries(block, &logged, &markers) == false)
+      {
+        printf("block %u not a series block\n", (unsigned)b);
+        ok = false;
+      }
+      continue;
+    }
+    for (byte r = 0; r < block->header.count; r++)
+    {
+      time += SD_Log::delta(block, r);
+      if (block->records[r].channel == RECORDER_CHANNEL_TRIGGER)
+      {
+        markers++;
+        continue;
+      }
+      logged.insert(Key(block->records[r].channel, time));
+    }
+  }
+
+  // Everything around every trigger has to be there, once
+  uint32_t missing = 0;
+  uint32_t duplicates = 0;
+
+  for (size_t i = 0; i < appended.size(); i++)
+  {
+    const Key& key = appended[i].first;
+    size_t found = logged.count(key);
+    bool wanted = false;
+
+    for (size_t t = 0; t < trigger_times.size(); t++)
+    {
+      if ((key.second + RECORDER_PRE >= trigger_times[t]) && (key.second <= trigger_times[t] + RECORDER_POST))
+      {
+        wanted = true;
+      }
+    }
+    if (wanted && (found == 0))
+    {
+      missing++;
+    }
+    if (found > 1)
+    {
+      duplicates++;
+    }
+  }
+
+  printf("%u records at %u/s over %u s, ring of %u holds %.1f s (%u ms held at the first press)\n",
+         total, total / SIM_SECONDS, SIM_SECONDS, RECORDER_RECORDS,
+         (double)RECORDER_RECORDS * SIM_SECONDS / total, span_at_trigger);
+  printf("%u triggers, %u captures, %u markers, %u blocks, %u records on the card (%.1f%%)\n",
+         (unsigned)trigger_times.size(), recorder.captures, markers, (unsigned)written.size(),
+         (unsigned)logged.size(), 100.0 * logged.size() / total);
+  printf("missing %u, duplicated %u, recorder overruns %u, log dropped %u\n",
+         missing, duplicates, recorder.overruns, session_log.dropped);
+  printf("append() %.1f ns\n", appendCost());
+
+  if ((missing != 0) || (duplicates != 0) || (recorder.overruns != 0) || (session_log.dropped != 0) ||
+      (markers != trigger_times.size()))
+  {
+    ok = false;
+  }
+  printf("%s\n", ok ? "ok" : "FAILED");
+
+  return ok ? 0 : 1;
+}
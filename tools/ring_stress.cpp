@@ -0,0 +1,176 @@
+/*
+ CAN_Ring with a producer thread standing in for the receive interrupt
+ by:
+ date:
+ license:
+
+ One thread pushes numbered frames into a CAN_Ring in bursts with short
+ pauses between them, as the receive interrupt does, while the main
+ thread pops them and now and then stalls the way a loop pass flushing
+ the display does. Every frame carries its sequence number in the ID,
+ the timestamp and all eight data bytes, so a frame copied while the
+ producer was writing it shows up.
+
+ The consumer checks that the frames come out in order and whole, and
+ that the frames missing between two it received add up to the overflows
+ counted, the newest frame being the one a full ring drops. At the end
+ every frame pushed has to be either popped or counted in lost(), and the
+ high-water mark has to have reached the ring's size since it overflowed.
+
+ Build from the repository root with CMake, the ring_stress target.
+
+ Usage:
+   ring_stress [-n frames]
+ */
+
+#include <atomic>
+#include <thread>
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "Arduino.h"
+#include "CAN_Ring.h"
+
+#define BURST_MAX   (2 * CAN_RING_SIZE) // frames the producer pushes back to back
+#define PAUSE_US    400                 // longest pause between bursts
+#define STALL_EVERY 512                 // frames popped between consumer stalls
+#define STALL_US    1000
+
+static CAN_Ring ring;
+static std::atomic<bool> done(false);
+
+/*
+ Frame number seq as the producer fills it in.
+*/
+static void numberFrame(OBD_Frame* frame, uint32_t seq)
+{
+  frame->id = ID_REPLY_1 + (seq & 0x07);
+  frame->timestamp = seq;
+  frame->length = 8;
+  frame->bus = 0;
+  for (byte i = 0; i < 8; i++)
+  {
+    frame->data[i] = (seq >> ((i & 3) * 8)) ^ (i * 0x11);
+  }
+}
+
+/*
+ True if every field of frame carries the same sequence number.
+*/
+static bool whole(const OBD_Frame* frame)
+{
+  OBD_Frame expected;
+
+  numberFrame(&expected, frame->timestamp);
+
+  return (frame->id == expected.id) && (frame->length == 8) && (memcmp(frame->data, expected.data, 8) == 0);
+}
+
+/*
+ The interrupt, bursts of frames with a pause in between.
+*/
+static void produce(uint32_t frames)
+{
+  uint32_t seed = 1;
+  uint32_t seq = 0;
+
+  while (seq < frames)
+  {
+    seed = seed * 1103515245 + 12345;
+    uint32_t burst = 1 + (seed >> 16) % BURST_MAX;
+
+    for (uint32_t i = 0; (i < burst) && (seq < frames); i++)
+    {
+      OBD_Frame frame;
+
+      numberFrame(&frame, seq++);
+      ring.push(&frame);
+    }
+
+    seed = seed * 1103515245 + 12345;
+    usleep((seed >> 16) % PAUSE_US);
+  }
+
+  done = true;
+}
+
+/*
+
+*/
+int main(int argc, char* argv[])
+{
+  uint32_t frames = 200000;
+  uint32_t received = 0;
+  uint32_t missing = 0;
+  uint32_t torn = 0;
+  uint32_t disorder = 0;
+  uint32_t expected = 0;
+  int option;
+
+  while ((option = getopt(argc, argv, "n:")) != -1)
+  {
+    switch (option)
+    {
+      case 'n':
+        frames = atoi(optarg);
+        break;
+      default:
+        fprintf(stderr, "usage: ring_stress [-n frames]\n");
+        return 2;
+    }
+  }
+
+  std::thread producer(produce, frames);
+
+  for (;;)
+  {
+    OBD_Frame frame;
+    bool finished = done;
+
+    if (ring.pop(&frame) == false)
+    {
+      if (finished)
+      {
+        break;
+      }
+      continue;
+    }
+
+    if (whole(&frame) == false)
+    {
+      torn++;
+    }
+    if (frame.timestamp < expected)
+    {
+      disorder++;
+    }
+    else
+    {
+      missing += frame.timestamp - expected;
+      expected = frame.timestamp + 1;
+    }
+
+    if ((++received % STALL_EVERY) == 0)
+    {
+      usleep(STALL_US);
+    }
+  }
+  producer.join();
+
+  // Frames dropped after the last one received
+  missing += frames - expected;
+
+  uint16_t lost = ring.lost();
+
+  printf("%u frames pushed, %u popped, %u missing, %u overflows, high water %u of %u\n",
+         frames, received, missing, lost, ring.high_water, CAN_RING_SIZE);
+  printf("%u out of order, %u torn\n", disorder, torn);
+
+  // overflows is 16 bits and wraps
+  bool ok = (disorder == 0) && (torn == 0) && (received + missing == frames) &&
+            ((uint16_t)missing == lost) && (missing != 0) && (ring.high_water == CAN_RING_SIZE);
+  printf("%s\n", ok ? "ok" : "FAILED");
+
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,230 @@
+/*
+ CAN_Signal unpacking against a bit at a time reference
+ by:
+ date:
+ license:
+
+ CAN_Signal::extract() takes whole bytes where the layout allows. Here
+ every start bit and length up to 32 bits that fits in an 8 byte frame is
+ unpacked, in both byte orders, signed and unsigned, from random frames
+ and checked against a reference that walks the signal one bit at a time
+ the way the DBC numbering describes it: little endian signals up from
+ the start bit, big endian signals down from it to bit 0 of the byte and
+ on from bit 7 of the next.
+
+ The signal table itself is checked through decode(): a few frames with
+ known values, the short frames that must leave out the signals reaching
+ past their end, an ID not in the table, and messages() / message()
+ listing the IDs in ascending order.
+
+ Build from the repository root:
+   g++ -std=c++11 -O2 -Itools/host -I. -o signal_check tools/signal_check.cpp \
+       tools/host/Arduino.cpp OBD_Sample.cpp WWH_OBD.cpp Ford_OBD.cpp CAN_Signal.cpp
+
+ Usage:
+   signal_check
+ */
+
+#include <stdlib.h>
+
+#include "Arduino.h"
+#include "CAN_Signal.h"
+
+#define FRAMES 64 // random frames per layout
+
+static uint32_t failures;
+
+/*
+
+*/
+static void check(bool ok, const char* what)
+{
+  if (ok == false)
+  {
+    printf("FAILED %s\n", what);
+    failures++;
+  }
+}
+
+/*
+ Byte holding the last bit of the signal, or 8 or more if it does not fit
+ in a frame.
+*/
+static byte lastByte(const CAN_Signal_Def* desc)
+{
+  byte position = desc->start;
+
+  for (byte i = 1; i < desc->length; i++)
+  {
+    if ((desc->flags & SIGNAL_FLAG_MOTOROLA) == 0)
+    {
+      position++;
+    }
+    else if ((position & 0x07) == 0)
+    {
+      position += 15;
+    }
+    else
+    {
+      position--;
+    }
+    if (position >= 64)
+    {
+      return 8;
+    }
+  }
+
+  return position >> 3;
+}
+
+/*
+ The signal one bit at a time, most significant first.
+*/
+static int32_t reference(const CAN_Signal_Def* desc, const byte* data)
+{
+  uint32_t raw = 0;
+  byte position = desc->start;
+
+  for (byte i = 0; i < desc->length; i++)
+  {
+    uint32_t bit = (data[position >> 3] >> (position & 0x07)) & 1;
+
+    if (desc->flags & SIGNAL_FLAG_MOTOROLA)
+    {
+      raw = (raw << 1) | bit;
+      position = ((position & 0x07) == 0) ? position + 15 : position - 1;
+    }
+    else
+    {
+      raw |= bit << i;
+      position++;
+    }
+  }
+
+  if ((desc->flags & PID_FLAG_SIGNED) && (raw & ((uint32_t)1 << (desc->length - 1))))
+  {
+    raw |= ~(uint32_t)0 << (desc->length - 1);
+  }
+
+  return raw;
+}
+
+/*
+ Every layout that fits a frame, both byte orders, signed and unsigned.
+*/
+static void checkExtract()
+{
+  static const byte flags[] = {0, PID_FLAG_SIGNED, SIGNAL_FLAG_MOTOROLA, SIGNAL_FLAG_MOTOROLA | PID_FLAG_SIGNED};
+  CAN_Signal_Def desc;
+  uint32_t layouts = 0;
+  uint32_t wrong = 0;
+  byte data[8];
+
+  memset(&desc, 0, sizeof(desc));
+  srand(1);
+
+  for (byte f = 0; f < sizeof(flags); f++)
+  {
+    for (byte start = 0; start < 64; start++)
+    {
+      for (byte length = 1; length <= 32; length++)
+      {
+        desc.start = start;
+        desc.length = length;
+        desc.flags = flags[f];
+        if (lastByte(&desc) >= 8)
+        {
+          continue;
+        }
+
+        layouts++;
+        for (uint16_t n = 0; n < FRAMES; n++)
+        {
+          for (byte i = 0; i < 8; i++)
+          {
+            // All ones and all zeros first, for the sign and the masks
+            data[i] = (n == 0) ? 0xFF : (n == 1) ? 0x00 : rand();
+          }
+          if (CAN_Signal::extract(&desc, data) != reference(&desc, data))
+          {
+            if (wrong++ == 0)
+            {
+              printf("start %u length %u flags 0x%02X: 0x%08X, expected 0x%08X\n", start, length, flags[f],
+                     CAN_Signal::extract(&desc, data), reference(&desc, data));
+            }
+          }
+        }
+      }
+    }
+  }
+
+  printf("extract: %u layouts, %u frames each, %u wrong\n", layouts, FRAMES, wrong);
+  check(wrong == 0, "extract");
+}
+
+/*
+ Samples decode() gives for a frame of length bytes.
+*/
+static byte decode(uint32_t id, const byte* data, byte length, OBD_Sample* samples)
+{
+  CAN_Signal signals;
+
+  return signals.decode(id, data, length, 1234, samples, 4);
+}
+
+/*
+ The table's entries through decode().
+*/
+static void checkTable()
+{
+  CAN_Signal signals;
+  OBD_Sample samples[4];
+
+  // Brake switch in bit 3 of byte 0
+  const byte brake[8] = {0x08, 0, 0, 0, 0, 0, 0, 0};
+  check((decode(FORD_CAN_ID_BRAKE, brake, 8, samples) == 1) && (samples[0].pid == FORD_PID_BPA) &&
+        (samples[0].value == 1) && (samples[0].unit == OBD_UNIT_BITS) && (samples[0].timestamp == 1234),
+        "brake switch");
+
+  // Selector in the high nibble of byte 0, gear in the low nibble of byte 1
+  const byte trans[8] = {0x5A, 0xC3, 0, 0, 0, 0, 0, 0};
+  check((decode(FORD_CAN_ID_TRANS, trans, 8, samples) == 2) &&
+        (samples[0].pid == FORD_PID_TR) && (samples[0].value == 5) && (samples[0].digits == 1) &&
+        (samples[1].pid == FORD_PID_TRD) && (samples[1].value == 3) && (samples[1].unit == OBD_UNIT_COUNT),
+        "transmission");
+
+  // A short frame keeps only the signals inside it
+  check(decode(FORD_CAN_ID_TRANS, trans, 0, samples) == 0, "empty frame");
+  check((decode(FORD_CAN_ID_TRANS, trans, 1, samples) == 1) && (samples[0].pid == FORD_PID_TR), "one byte frame");
+  check(decode(FORD_CAN_ID_TRANS, trans, 2, samples) == 2, "two byte frame");
+  check(decode(FORD_CAN_ID_BRAKE, brake, 0, samples) == 0, "empty brake frame");
+
+  // Room for fewer samples than the message has
+  check(signals.decode(FORD_CAN_ID_TRANS, trans, 8, 0, samples, 1) == 1, "max samples");
+
+  // IDs around and between the table's
+  check(decode(0, trans, 8, samples) == 0, "ID 0");
+  check(decode(FORD_CAN_ID_BRAKE + 1, trans, 8, samples) == 0, "ID between messages");
+  check(decode(0x7FF, trans, 8, samples) == 0, "ID 0x7FF");
+  check(decode(ID_REPLY_1, trans, 8, samples) == 0, "diagnostic reply");
+
+  // Message IDs once each, ascending
+  check(signals.messages() == 2, "messages()");
+  check((signals.message(0) == FORD_CAN_ID_BRAKE) && (signals.message(1) == FORD_CAN_ID_TRANS) &&
+        (signals.message(2) == 0), "message()");
+
+  printf("table: %u messages\n", signals.messages());
+}
+
+/*
+
+*/
+int main()
+{
+  checkExtract();
+  checkTable();
+
+  printf("%s\n", (failures == 0) ? "ok" : "FAILED");
+
+  return (failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,399 @@
+/*
+ Polling path against simulated ECUs
+ by:
+ date:
+ license:
+
+ Runs the same request path as pollBus() - OBD_Supported discovery, then
+ the dashboard channels through OBD_Scheduler, OBD_Engine and ISO_TP -
+ against ECU_Sim in simulated milliseconds, and reports the rate each
+ channel achieved and the request to response latency percentiles, then
+ the PID updates per second all channels got together. -f asks for every
+ channel at FLAT_OUT instead of the dashboard rates, so the updates per
+ second are what the ECU and the request window allow. -1 sends one PID
+ per request instead of batching the due ones, for comparison.
+
+ Before the run the start of the sketch is timed twice against the same
+ ECUs, to the supported PIDs being known: cold with nothing stored, then
+ warm with the sets the cold start saved, as loadSupported() restores
+ them from EEPROM or flash.
+
+ Build from the repository root:
+   g++ -std=c++11 -O2 -Itools/host -I. -o sim_latency tools/sim_latency.cpp \
+       tools/host/Arduino.cpp WWH_OBD.cpp Ford_OBD.cpp OBD_Sample.cpp \
+       OBD_Engine.cpp OBD_Routes.cpp ISO_TP.cpp OBD_Scheduler.cpp OBD_Supported.cpp \
+       ECU_Sim.cpp SD_Log.cpp
+
+ Usage:
+   sim_latency [-s seconds] [-e ecus] [-l latency] [-j jitter]
+               [-n brr|rcrrp] [-r nrc_per_256] [-p LOG000.BIN] [-f] [-1]
+
+ -p replays the raw values of a recorded session through the simulated
+ ECUs, in the session's own time.
+ */
+
+#include <algorithm>
+#include <vector>
+
+#include <unistd.h>
+
+#include "Arduino.h"
+#include "WWH_OBD.h"
+#include "OBD_Engine.h"
+#include "ISO_TP.h"
+#include "OBD_Scheduler.h"
+#include "OBD_Supported.h"
+#include "ECU_Sim.h"
+#include "SD_Log.h"
+
+static const byte dash_pids[] = {PID_APP_R, PID_TP_R, PID_RPM, PID_LOAD_PCT};
+static const uint16_t dash_rates[] = {OBD_HZ(20), OBD_HZ(20), OBD_HZ(50), OBD_HZ(10)};
+
+#define FLAT_OUT OBD_HZ(1000) // -f, faster than any ECU answers
+
+// Recorded session being replayed, one record at a time
+struct Replay
+{
+  std::vector<SD_Log_Block> blocks;
+  size_t block;
+  byte record;
+  uint32_t timestamp; // of the next record
+  uint32_t start;     // of the session
+};
+
+/*
+ Read the valid blocks of a log. Returns false if there are none.
+*/
+static bool loadReplay(const char* path, Replay* replay)
+{
+  SD_Log_Block block;
+  FILE* file = fopen(path, "rb");
+
+  if (file == 0)
+  {
+    perror(path);
+    return false;
+  }
+
+  while (fread(&block, sizeof(block), 1, file) == 1)
+  {
+    if (SD_Log::valid(&block) && (block.header.count > 0))
+    {
+      replay->blocks.push_back(block);
+    }
+  }
+  fclose(file);
+
+  replay->block = 0;
+  replay->record = 0;
+  if (replay->blocks.empty())
+  {
+    return false;
+  }
+  replay->start = replay->blocks[0].header.timestamp;
+  replay->timestamp = replay->start + SD_Log::delta(&replay->blocks[0], 0);
+
+  return true;
+}
+
+/*
+ Hand the simulated ECUs every recorded value up to now, session time
+ starting at 0.
+*/
+static void replayUntil(Replay* replay, ECU_Sim* sim, uint32_t now)
+{
+  while ((replay->block < replay->blocks.size()) && ((replay->timestamp - replay->start) <= now))
+  {
+    const SD_Log_Block* block = &replay->blocks[replay->block];
+    const SD_Log_Record* record = &block->records[replay->record];
+
+    sim->setValue(record->channel, record->raw);
+
+    if (++replay->record >= block->header.count)
+    {
+      replay->record = 0;
+      if (++replay->block >= replay->blocks.size())
+      {
+        return;
+      }
+      block = &replay->blocks[replay->block];
+      replay->timestamp = block->header.timestamp;
+    }
+    replay->timestamp += SD_Log::delta(block, replay->record);
+  }
+}
+
+/*
+
+*/
+static uint32_t percentile(std::vector<uint32_t>& latencies, uint32_t per_mille)
+{
+  if (latencies.empty())
+  {
+    return 0;
+  }
+
+  size_t index = (latencies.size() - 1) * per_mille / 1000;
+  std::nth_element(latencies.begin(), latencies.begin() + index, latencies.end());
+
+  return latencies[index];
+}
+
+/*
+ Milliseconds from begin() to ready() against fresh ECUs, starting from
+ the stored sets if there are any. The sets known at the end go to saved.
+*/
+static uint32_t startup(const ECU_Sim_Config* config, byte ecus, const OBD_Supported_Image* stored,
+                        OBD_Supported_Image* saved)
+{
+  ECU_Sim sim;
+  OBD_Engine engine;
+  ISO_TP isotp;
+  OBD_Supported supported;
+
+  for (byte ecu = 0; ecu < ecus; ecu++)
+  {
+    sim.configure(ecu, config);
+  }
+  if (stored != 0)
+  {
+    supported.load(stored);
+  }
+  supported.begin(0);
+
+  for (uint32_t now = 0; (now < OBD_TIMEOUT_LONG) && (supported.ready() == false); now++)
+  {
+    OBD_Frame frame;
+    const byte* payload;
+    uint16_t length;
+
+    while (sim.transmit(now, &frame))
+    {
+      if (isotp.receive(&frame, now, &payload, &length) != ISO_TP_RX_COMPLETE)
+      {
+        continue;
+      }
+
+      switch (engine.receive(frame.id, payload, length, now))
+      {
+        case OBD_RX_RESPONSE:
+        case OBD_RX_UNMATCHED:
+          supported.update(frame.id, payload, length, now);
+          break;
+      }
+    }
+
+    isotp.expire(now);
+    engine.expire(now);
+    supported.poll(&engine, now);
+
+    while (isotp.transmit(now, &frame) || engine.transmit(now, &frame))
+    {
+      sim.receive(&frame, now);
+    }
+  }
+
+  *saved = *supported.image();
+
+  return supported.ready() ? supported.discovery_time : OBD_TIMEOUT_LONG;
+}
+
+/*
+
+*/
+int main(int argc, char* argv[])
+{
+  ECU_Sim_Config config = {5, 5, ECU_SIM_DIAG | ECU_SIM_INFO | ECU_SIM_RDBI, NRC_PR, 0, 0};
+  uint32_t seconds = 60;
+  byte ecus = 1;
+  const char* replay_path = 0;
+  bool flat_out = false;
+  byte max_payload = ISO_TP_BUF_SIZE;
+  Replay replay;
+  int option;
+
+  while ((option = getopt(argc, argv, "s:e:l:j:n:r:p:f1")) != -1)
+  {
+    switch (option)
+    {
+      case 's':
+        seconds = atoi(optarg);
+        break;
+      case 'e':
+        ecus = atoi(optarg);
+        break;
+      case 'l':
+        config.latency = atoi(optarg);
+        break;
+      case 'j':
+        config.jitter = atoi(optarg);
+        break;
+      case 'n':
+        config.nrc = (strcmp(optarg, "rcrrp") == 0) ? NRC_RCRRP : NRC_BRR;
+        break;
+      case 'r':
+        config.nrc_rate = atoi(optarg);
+        break;
+      case 'p':
+        replay_path = optarg;
+        break;
+      case 'f':
+        flat_out = true;
+        break;
+      case '1':
+        // No response with a PID in it fits, so every batch is one PID
+        max_payload = 1;
+        break;
+      default:
+        fprintf(stderr, "usage: sim_latency [-s seconds] [-e ecus] [-l latency] [-j jitter] "
+                "[-n brr|rcrrp] [-r nrc_per_256] [-p LOG000.BIN] [-f] [-1]\n");
+        return 1;
+    }
+  }
+
+  if ((config.nrc != NRC_PR) && (config.nrc_rate == 0))
+  {
+    config.nrc_rate = 16;
+  }
+  if ((ecus == 0) || (ecus > ECU_SIM_ECUS))
+  {
+    ecus = 1;
+  }
+  if ((replay_path != 0) && (loadReplay(replay_path, &replay) == false))
+  {
+    fprintf(stderr, "%s: no valid blocks\n", replay_path);
+    return 1;
+  }
+
+  OBD_Supported_Image cold_image;
+  OBD_Supported_Image warm_image;
+  uint32_t cold = startup(&config, ecus, 0, &cold_image);
+  uint32_t warm = startup(&config, ecus, &cold_image, &warm_image);
+
+  printf("startup cold %u ms, warm %u ms\n", cold, warm);
+
+  ECU_Sim sim;
+  OBD_Engine engine;
+  ISO_TP isotp;
+  OBD_Scheduler scheduler;
+  OBD_Supported supported;
+  std::vector<uint32_t> latencies[sizeof(dash_pids)];
+  bool scheduled = false;
+  uint32_t scheduled_at = 0;
+  uint32_t updates = 0;
+
+  for (byte ecu = 0; ecu < ecus; ecu++)
+  {
+    sim.configure(ecu, &config);
+  }
+
+  supported.begin(0);
+
+  for (uint32_t now = 0; now < seconds * 1000; now++)
+  {
+    OBD_Frame frame;
+    const byte* payload;
+    uint16_t length;
+
+    if (replay_path != 0)
+    {
+      replayUntil(&replay, &sim, now);
+    }
+
+    while (sim.transmit(now, &frame))
+    {
+      if (isotp.receive(&frame, now, &payload, &length) != ISO_TP_RX_COMPLETE)
+      {
+        continue;
+      }
+
+      switch (engine.receive(frame.id, payload, length, now))
+      {
+        case OBD_RX_RESPONSE:
+        case OBD_RX_UNMATCHED:
+          supported.update(frame.id, payload, length, now);
+          if ((frame.id == ID_REPLY_1) && (payload[0] == SIDPR_DIAG))
+          {
+            OBD_Sample samples[OBD_BATCH_MAX];
+            byte count = WWH_OBD().decodeBatch(payload, length, now, samples, OBD_BATCH_MAX);
+
+            for (byte i = 0; i < count; i++)
+            {
+              for (byte c = 0; c < scheduler.channels(); c++)
+              {
+                const OBD_Channel* channel = scheduler.channel(c);
+
+                if (channel->pid != samples[i].pid)
+                {
+                  continue;
+                }
+                updates++;
+                if (channel->in_flight)
+                {
+                  latencies[c].push_back(now - channel->sent);
+                }
+              }
+              scheduler.received(SIDRQ_DIAG, samples[i].pid, now);
+            }
+          }
+          break;
+      }
+    }
+
+    isotp.expire(now);
+    engine.expire(now);
+
+    if (supported.ready() == false)
+    {
+      supported.poll(&engine, now);
+    }
+    else
+    {
+      if (scheduled == false)
+      {
+        byte found = 0;
+
+        for (byte ecu = 0; ecu < OBD_SUPPORTED_ECUS; ecu++)
+        {
+          found += supported.supported(ecu, PID_SUPPORTED);
+        }
+        printf("discovery %u ms, %u of %u ECUs\n", (unsigned)supported.discovery_time, found, ecus);
+        for (byte i = 0; i < sizeof(dash_pids); i++)
+        {
+          if (supported.supported(dash_pids[i]))
+          {
+            scheduler.add(SIDRQ_DIAG, dash_pids[i], flat_out ? FLAT_OUT : dash_rates[i], i);
+          }
+        }
+        scheduled = true;
+        scheduled_at = now;
+      }
+      scheduler.poll(now, &engine, max_payload);
+    }
+
+    while (isotp.transmit(now, &frame) || engine.transmit(now, &frame))
+    {
+      sim.receive(&frame, now);
+    }
+  }
+
+  printf("pid,requested_hz,achieved_hz,samples,p50_ms,p90_ms,p99_ms,max_ms\n");
+  for (byte c = 0; c < scheduler.channels(); c++)
+  {
+    std::vector<uint32_t>* channel = &latencies[c];
+    uint32_t max = channel->empty() ? 0 : *std::max_element(channel->begin(), channel->end());
+
+    printf("0x%02X,%.1f,%.1f,%zu,%u,%u,%u,%u\n", scheduler.channel(c)->pid,
+           scheduler.requested(c) / 10.0, scheduler.achieved(c) / 10.0, channel->size(),
+           percentile(*channel, 500), percentile(*channel, 900), percentile(*channel, 990), max);
+  }
+  printf("requests %u responses %u negatives %u timeouts %u load %u\n",
+         (unsigned)engine.requests_sent, (unsigned)engine.responses, (unsigned)engine.negatives,
+         (unsigned)engine.timeouts, scheduler.load());
+  if (seconds * 1000 > scheduled_at)
+  {
+    printf("updates %.1f/s\n", updates * 1000.0 / (seconds * 1000 - scheduled_at));
+  }
+
+  return 0;
+}
@@ -0,0 +1,225 @@
+/*
+ Button events and display modes with a simulated button source
+ by:
+ date:
+ license:
+
+ Plays a script of button presses through UI_Buttons and UI_Mode the way
+ pollButtons() does, one loop pass per simulated millisecond. Each press
+ and release bounces for a few milliseconds, and the port is only read
+ when the simulated INTA would have fired. Prints every mode change and
+ action, checks the mode each step is expected to reach, and shows that
+ the loop kept running in every mode.
+
+ Build from the repository root:
+   g++ -std=c++11 -O2 -Itools/host -I. -o ui_sim tools/ui_sim.cpp \
+       tools/host/Arduino.cpp tools/host/Print.cpp UI_Buttons.cpp UI_Mode.cpp
+
+ Usage:
+   ui_sim [step ...]
+
+ A step is time_ms:BUTTON[:MODE], BUTTON one of UP DOWN LEFT RIGHT SELECT
+ and MODE the mode expected after it. Without steps a walk through every
+ mode is played.
+ */
+
+#include "Arduino.h"
+#include "Adafruit_RGBLCDShield.h"
+#include "UI_Buttons.h"
+#include "UI_Mode.h"
+
+#define HOLD_MS   120 // how long a button is held
+#define BOUNCE_MS 4   // contacts chatter this long on press and release
+
+struct Step
+{
+  uint32_t time;
+  byte button;
+  int expected; // UI_* mode, -1 if not checked
+};
+
+static const char* default_script[] = {
+  "200:DOWN:DASH", "600:SELECT:DASH", "1000:UP:MENU", "1400:UP:INFO", "1800:RIGHT:INFO",
+  "2200:LEFT:INFO", "2600:DOWN:MENU", "3000:LEFT:FORD", "3400:UP:FORD", "3800:RIGHT:MENU",
+  "4200:RIGHT:LISTEN", "4600:DOWN:LISTEN", "5000:UP:MENU"
+};
+
+static const char* button_names[] = {"SELECT", "RIGHT", "DOWN", "UP", "LEFT"};
+
+/*
+
+*/
+static byte parseButton(const char* name, size_t length)
+{
+  for (byte i = 0; i < 5; i++)
+  {
+    if ((strlen(button_names[i]) == length) && (strncmp(button_names[i], name, length) == 0))
+    {
+      return 1 << i;
+    }
+  }
+
+  return 0;
+}
+
+/*
+
+*/
+static int parseMode(const char* name)
+{
+  for (byte mode = UI_MENU; mode <= UI_LISTEN; mode++)
+  {
+    if (strcmp(UI_Mode::name(mode), name) == 0)
+    {
+      return mode;
+    }
+  }
+
+  return -1;
+}
+
+/*
+
+*/
+static bool parseStep(const char* text, Step* step)
+{
+  const char* button = strchr(text, ':');
+  const char* mode;
+
+  if (button == 0)
+  {
+    return false;
+  }
+  button++;
+  mode = strchr(button, ':');
+
+  step->time = atoi(text);
+  step->button = parseButton(button, (mode != 0) ? (size_t)(mode - button) : strlen(button));
+  step->expected = (mode != 0) ? parseMode(mode + 1) : -1;
+
+  return step->button != 0;
+}
+
+/*
+ Buttons held at time t: each step holds its button for HOLD_MS, and the
+ contacts toggle every millisecond for BOUNCE_MS after either edge.
+*/
+static byte buttonsAt(const Step* steps, size_t count, uint32_t t)
+{
+  byte held = 0;
+
+  for (size_t i = 0; i < count; i++)
+  {
+    uint32_t start = steps[i].time;
+    uint32_t end = start + HOLD_MS;
+    bool down = (t >= start) && (t < end);
+
+    if (((t >= start) && (t < start + BOUNCE_MS)) || ((t >= end) && (t < end + BOUNCE_MS)))
+    {
+      down = (t & 1) != 0;
+    }
+    if (down)
+    {
+      held |= steps[i].button;
+    }
+  }
+
+  return held;
+}
+
+/*
+
+*/
+int main(int argc, char* argv[])
+{
+  Step steps[64];
+  size_t count = 0;
+  const char** script = (argc > 1) ? (const char**)(argv + 1) : default_script;
+  size_t lines = (argc > 1) ? argc - 1 : sizeof(default_script) / sizeof(default_script[0]);
+
+  for (size_t i = 0; (i < lines) && (count < 64); i++)
+  {
+    if (parseStep(script[i], &steps[count]) == false)
+    {
+      fprintf(stderr, "bad step '%s'\n", script[i]);
+      return 1;
+    }
+    count++;
+  }
+
+  UI_Buttons buttons;
+  UI_Mode ui;
+  uint32_t passes[UI_LISTEN + 1] = {0, 0, 0, 0, 0};
+  uint32_t reads = 0;
+  uint32_t end = (count > 0) ? steps[count - 1].time + 500 : 500;
+  byte port = 0;
+  size_t step = 0;
+  int failures = 0;
+
+  for (uint32_t now = 0; now < end; now++)
+  {
+    byte held = buttonsAt(steps, count, now);
+    byte button;
+
+    // INTA falls on any change of the port
+    if (held != port)
+    {
+      port = held;
+      buttons.interrupt();
+    }
+
+    if (buttons.pending())
+    {
+      buttons.update(port, now);
+      reads++;
+    }
+
+    while ((button = buttons.next()) != 0)
+    {
+      byte action = ui.handle(button);
+
+      printf("%5u %-6s -> %-6s", (unsigned)now, button_names[__builtin_ctz(button)], UI_Mode::name(ui.state()));
+      switch (action)
+      {
+        case UI_ACT_ENTER:
+          printf(" enter");
+          break;
+        case UI_ACT_PID_PREV:
+          printf(" previous PID");
+          break;
+        case UI_ACT_PID_NEXT:
+          printf(" next PID");
+          break;
+        case UI_ACT_REPORT:
+          printf(" report rates");
+          break;
+      }
+
+      if ((step < count) && (steps[step].expected >= 0) && (steps[step].expected != ui.state()))
+      {
+        printf("  expected %s", UI_Mode::name(steps[step].expected));
+        failures++;
+      }
+      printf("\n");
+      step++;
+    }
+
+    // Stands for pollBus() and writeLog(), which run whatever the mode
+    passes[ui.state()]++;
+  }
+
+  if (step != count)
+  {
+    printf("%u presses seen, %u played\n", (unsigned)step, (unsigned)count);
+    failures++;
+  }
+
+  printf("port reads %u, dropped %u\n", (unsigned)reads, buttons.dropped);
+  for (byte mode = UI_MENU; mode <= UI_LISTEN; mode++)
+  {
+    printf("%-6s %u loop passes\n", UI_Mode::name(mode), (unsigned)passes[mode]);
+  }
+  printf("%s\n", (failures == 0) ? "ok" : "FAILED");
+
+  return (failures == 0) ? 0 : 1;
+}